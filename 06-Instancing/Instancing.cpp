@@ -8,6 +8,8 @@
 #include <Rush/Window.h>
 
 #include <Common/ExampleApp.h>
+#include <Common/JobSystem.h>
+#include <Common/MeshOptimizer.h>
 #include <Common/Utils.h>
 
 #include <memory>
@@ -181,42 +183,66 @@ public:
 			return false;
 		}
 
-		std::vector<Vertex> vertices;
-		std::vector<u32>  indices;
-
-		for (const auto& shape : shapes)
+		// Shapes are converted and welded in parallel, then merged and welded again to join the
+		// vertices they share
+		std::vector<std::vector<Vertex>> shapeVertices(shapes.size());
+		std::vector<std::vector<u32>>    shapeIndices(shapes.size());
+		JobSystem::getDefault().parallelFor(u32(shapes.size()), 1, [&](u32 begin, u32 end)
 		{
-			u32         firstVertex = (u32)vertices.size();
-			const auto& mesh = shape.mesh;
+			for (u32 shapeIt = begin; shapeIt < end; ++shapeIt)
+			{
+				const auto&          mesh     = shapes[shapeIt].mesh;
+				std::vector<Vertex>& vertices = shapeVertices[shapeIt];
+				std::vector<u32>&    indices  = shapeIndices[shapeIt];
 
-			const u32 vertexCount = (u32)mesh.positions.size() / 3;
+				const u32 vertexCount = (u32)mesh.positions.size() / 3;
+				for (u32 i = 0; i < vertexCount; ++i)
+				{
+					Vertex v = {};
 
-			const bool haveTexcoords = !mesh.texcoords.empty();
-			const bool haveNormals = mesh.positions.size() == mesh.normals.size();
+					v.position.x = mesh.positions[i * 3 + 0];
+					v.position.y = mesh.positions[i * 3 + 1];
+					v.position.z = mesh.positions[i * 3 + 2];
 
-			for (u32 i = 0; i < vertexCount; ++i)
-			{
-				Vertex v = {};
+					vertices.push_back(v);
+				}
 
-				v.position.x = mesh.positions[i * 3 + 0];
-				v.position.y = mesh.positions[i * 3 + 1];
-				v.position.z = mesh.positions[i * 3 + 2];
+				const u32 triangleCount = (u32)mesh.indices.size() / 3;
+				for (u32 triangleIt = 0; triangleIt < triangleCount; ++triangleIt)
+				{
+					indices.push_back(mesh.indices[triangleIt * 3 + 0]);
+					indices.push_back(mesh.indices[triangleIt * 3 + 2]);
+					indices.push_back(mesh.indices[triangleIt * 3 + 1]);
+				}
 
-				vertices.push_back(v);
+				vertices.resize(
+				    weldVertices(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size()));
 			}
+		});
 
-			const u32 triangleCount = (u32)mesh.indices.size() / 3;
-			for (u32 triangleIt = 0; triangleIt < triangleCount; ++triangleIt)
+		std::vector<Vertex> vertices;
+		std::vector<u32>    indices;
+		size_t              sourceVertexCount = 0;
+
+		for (size_t shapeIt = 0; shapeIt < shapes.size(); ++shapeIt)
+		{
+			const u32 firstVertex = (u32)vertices.size();
+			for (u32 index : shapeIndices[shapeIt])
 			{
-				indices.push_back(mesh.indices[triangleIt * 3 + 0] + firstVertex);
-				indices.push_back(mesh.indices[triangleIt * 3 + 2] + firstVertex);
-				indices.push_back(mesh.indices[triangleIt * 3 + 1] + firstVertex);
+				indices.push_back(index + firstVertex);
 			}
-
-			m_meshVertexCount = (u32)vertices.size();
-			m_meshIndexCount = (u32)indices.size();
+			vertices.insert(vertices.end(), shapeVertices[shapeIt].begin(), shapeVertices[shapeIt].end());
+			sourceVertexCount += shapes[shapeIt].mesh.positions.size() / 3;
 		}
 
+		vertices.resize(weldVertices(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size()));
+
+		RUSH_LOG("Welded %u vertices to %u (%.1f MB -> %.1f MB)", u32(sourceVertexCount), u32(vertices.size()),
+		    sourceVertexCount * sizeof(Vertex) / double(1 << 20), vertices.size() * sizeof(Vertex) / double(1 << 20));
+
+		m_meshVertexCount = (u32)vertices.size();
+		m_meshIndexCount  = (u32)indices.size();
+
 		Vec4 boundingSphere = computeApproximateBoundingSphere(&vertices[0], m_meshVertexCount);
 		for (Vertex& v : vertices)
 		{
@@ -12,17 +12,20 @@
 #include <Rush/UtilHash.h>
 #include <Rush/UtilLog.h>
 
+#include <Common/BlockCompression.h>
+#include <Common/MeshCompression.h>
 #include <Common/Reflect.h>
 #include <Common/Utils.h>
 
 #include "Model.h"
 
-#include <stb_image.h>
-#include <stb_image_resize.h>
 #include <tiny_obj_loader.h>
 
-#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 static AppConfig g_appCfg;
 
@@ -62,12 +65,29 @@ ExampleModelViewer::ExampleModelViewer() : ExampleApp(), m_boundingBox(Vec3(0.0f
 
 	m_windowEvents.setOwner(m_window);
 
+	// Desktop GPUs all sample BCn; mobile GPUs generally do not, so they keep RGBA8
+	m_useTextureCompression = isDesktop();
+
+	u32 quantizedVertices = 0;
+	getArgU32(g_appCfg.argc, g_appCfg.argv, "quantized-vertices", nullptr, quantizedVertices);
+	m_quantizedVertices = quantizedVertices != 0;
+
+	u32 clusterCulling = 1;
+	getArgU32(g_appCfg.argc, g_appCfg.argv, "cluster-culling", nullptr, clusterCulling);
+	m_clusterCulling = clusterCulling != 0;
+
+	u32 lodSelection = 1;
+	getArgU32(g_appCfg.argc, g_appCfg.argv, "lod", nullptr, lodSelection);
+	m_lodSelection = lodSelection != 0;
+	getArgFloat(g_appCfg.argc, g_appCfg.argv, "lod-error", nullptr, m_lodErrorPixels);
+
 	const u32      whiteTexturePixels[4] = {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
 	GfxTextureDesc textureDesc           = GfxTextureDesc::make2D(2, 2);
 	m_defaultWhiteTexture                = Gfx_CreateTexture(textureDesc, whiteTexturePixels);
 
 	{
-		m_vs = Gfx_CreateVertexShader(loadShaderFromFile(RUSH_SHADER_NAME("ModelVS.hlsl")));
+		m_vs = Gfx_CreateVertexShader(loadShaderFromFile(
+			m_quantizedVertices ? RUSH_SHADER_NAME("ModelQuantizedVS.hlsl") : RUSH_SHADER_NAME("ModelVS.hlsl")));
 		m_ps = Gfx_CreatePixelShader(loadShaderFromFile(RUSH_SHADER_NAME("ModelPS.hlsl")));
 	}
 
@@ -89,10 +109,21 @@ ExampleModelViewer::ExampleModelViewer() : ExampleApp(), m_boundingBox(Vec3(0.0f
 		GfxRenderPipelineDesc pipelineDesc;
 		pipelineDesc.vs = m_vs.get();
 		pipelineDesc.ps = m_ps.get();
-		pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Float3, GfxVertexFormatDesc::Semantic::Position, 0);
-		pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Float3, GfxVertexFormatDesc::Semantic::Normal, 0);
-		pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Float2, GfxVertexFormatDesc::Semantic::Texcoord, 0);
-		pipelineDesc.bindings.descriptorSets[0].constantBuffers = 1; // scene constants
+		if (m_quantizedVertices)
+		{
+			pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Short2N, GfxVertexFormatDesc::Semantic::Position, 0);
+			pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Short2N, GfxVertexFormatDesc::Semantic::Position, 1);
+			pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Short2N, GfxVertexFormatDesc::Semantic::Normal, 0);
+			pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Half2, GfxVertexFormatDesc::Semantic::Texcoord, 0);
+			pipelineDesc.bindings.descriptorSets[0].constantBuffers = 2; // scene and segment constants
+		}
+		else
+		{
+			pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Float3, GfxVertexFormatDesc::Semantic::Position, 0);
+			pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Float3, GfxVertexFormatDesc::Semantic::Normal, 0);
+			pipelineDesc.vertexFormat.add(0, GfxVertexFormatDesc::DataType::Float2, GfxVertexFormatDesc::Semantic::Texcoord, 0);
+			pipelineDesc.bindings.descriptorSets[0].constantBuffers = 1; // scene constants
+		}
 		// Metal argument buffers expect sampler+texture to share a set for reliable pairing.
 		pipelineDesc.bindings.descriptorSets[1] = m_materialDescriptorSetDesc;
 		pipelineDesc.depthStencil = GfxDepthStencilDesc::makeWriteTest(GfxCompareFunc::GreaterEqual);
@@ -107,6 +138,21 @@ ExampleModelViewer::ExampleModelViewer() : ExampleApp(), m_boundingBox(Vec3(0.0f
 	GfxBufferDesc cbDesc(GfxBufferFlags::TransientConstant, GfxFormat_Unknown, 1, sizeof(Constants));
 	m_constantBuffer = Gfx_CreateBuffer(cbDesc);
 
+	getArgString(g_appCfg.argc, g_appCfg.argv, "save-model", nullptr, m_saveModelFilename);
+
+	std::string saveModelEncoding;
+	if (getArgString(g_appCfg.argc, g_appCfg.argv, "save-model-encoding", nullptr, saveModelEncoding))
+	{
+		if (saveModelEncoding == "compressed")
+		{
+			m_saveModelCompressed = true;
+		}
+		else if (saveModelEncoding != "raw")
+		{
+			RUSH_LOG_ERROR("Unknown model encoding '%s', expected 'raw' or 'compressed'", saveModelEncoding.c_str());
+		}
+	}
+
 	const char* modelFilename = nullptr;
 	if (getPositionalArg(g_appCfg.argc, g_appCfg.argv, 0, modelFilename))
 	{
@@ -141,26 +187,15 @@ ExampleModelViewer::ExampleModelViewer() : ExampleApp(), m_boundingBox(Vec3(0.0f
 	loadConfig();
 
 	m_cameraMan = new CameraManipulator();
-
-	u32 threadCount = std::thread::hardware_concurrency();
-	for (u32 i = 0; i < threadCount; ++i)
-	{
-		m_loadingThreads.push_back(std::thread([this]() { this->loadingThreadFunction(); }));
-	}
 }
 
 ExampleModelViewer::~ExampleModelViewer()
 {
-	m_loadingThreadShouldExit = true;
-	for (auto& it : m_loadingThreads)
-	{
-		it.join();
-	}
+	JobSystem::getDefault().wait(m_textureLoadCounter);
 
-	for (const auto& it : m_textures)
+	for (const auto& textureData : m_textures)
 	{
-		it.second->albedoTexture.reset();
-		delete it.second;
+		textureData->albedoTexture.reset();
 	}
 
 	m_windowEvents.setOwner(nullptr);
@@ -195,6 +230,16 @@ void ExampleModelViewer::onUpdate()
 			{
 				resetCamera();
 			}
+			else if (e.code == Key_F5)
+			{
+				m_clusterCulling = !m_clusterCulling;
+				RUSH_LOG("Cluster culling: %s", m_clusterCulling ? "on" : "off");
+			}
+			else if (e.code == Key_F6)
+			{
+				m_lodSelection = !m_lodSelection;
+				RUSH_LOG("Level of detail selection: %s", m_lodSelection ? "on" : "off");
+			}
 			break;
 		case WindowEventType_Scroll:
 			if (e.scroll.y > 0)
@@ -255,40 +300,49 @@ void ExampleModelViewer::onUpdate()
 
 	m_windowEvents.clear();
 
+	// Every texture that finished decoding since the last frame is created now,
+	// while the remaining ones keep decoding on the job system
+	m_loadedTextures.consumeAll([&](TextureData* textureData)
 	{
-		TextureData* textureData = nullptr;
-		m_loadingMutex.lock();
-		if (!m_loadedTextures.empty())
+		textureData->desc = textureData->staged.desc;
+
+		// Levels come straight from staging memory or the mapped cache file
+		GfxTextureData mipData[StagedTexture::MaxMips] = {};
+		for (u32 i = 0; i < textureData->desc.mips; ++i)
 		{
-			textureData = m_loadedTextures.back();
-			m_loadedTextures.pop_back();
+			mipData[i].pixels = textureData->staged.mips[i];
+			mipData[i].mip = i;
 		}
-		m_loadingMutex.unlock();
 
-		if (textureData)
+		textureData->albedoTexture = Gfx_CreateTexture(textureData->desc, mipData, textureData->desc.mips);
+
+		if (textureData->duplicateCount)
 		{
-			GfxTextureData mipData[16] = {};
+			size_t textureBytes = 0;
 			for (u32 i = 0; i < textureData->desc.mips; ++i)
 			{
-				mipData[i].pixels = textureData->mips[i].data();
-				mipData[i].mip = i;
+				textureBytes += textureData->staged.mipSizes[i];
 			}
+			RUSH_LOG("Texture '%s' is shared by %u identical files, saving %.1f MB", textureData->filename.c_str(),
+			    textureData->duplicateCount, double(textureBytes * textureData->duplicateCount) / (1024.0 * 1024.0));
+		}
 
-			textureData->albedoTexture = Gfx_CreateTexture(textureData->desc, mipData, textureData->desc.mips);
-			for (u32 i : textureData->patchList)
-			{
-				m_materials[i].albedoTexture = textureData->albedoTexture.get();
-				GfxSampler sampler = m_samplerStates.anisotropicWrap.get();
-				Gfx_UpdateDescriptorSet(m_materials[i].descriptorSet,
-					&m_materials[i].constantBuffer,
-					&sampler,
-					&m_materials[i].albedoTexture,
-					nullptr, // storage images
-					nullptr  // storage buffers
-				);
-			}
+		// Staging memory goes back to the pool as soon as the GPU copy exists
+		textureData->staged.reset();
+
+		for (u32 i : textureData->patchList)
+		{
+			m_materials[i].albedoTexture = textureData->albedoTexture.get();
+			GfxSampler sampler = m_samplerStates.anisotropicWrap.get();
+			Gfx_UpdateDescriptorSet(m_materials[i].descriptorSet,
+				&m_materials[i].constantBuffer,
+				&sampler,
+				&m_materials[i].albedoTexture,
+				nullptr, // storage images
+				nullptr  // storage buffers
+			);
 		}
-	}
+	});
 
 	render();
 
@@ -323,6 +377,46 @@ void ExampleModelViewer::createRenderTargets()
 	m_resolveTarget = Gfx_CreateTexture(desc);
 }
 
+// Side and near planes of a row-vector projection matrix, as (normal, distance) with normals
+// pointing inside. The far plane is left out, as it may be at infinity.
+static void getFrustumPlanes(const Mat4& m, bool reverseZ, Vec4 planes[5])
+{
+	const u32   sideAxes[4]  = {0, 0, 1, 1}; // left, right, bottom, top
+	const float sideSigns[4] = {1.0f, -1.0f, 1.0f, -1.0f};
+	for (u32 i = 0; i < 5; ++i)
+	{
+		Vec4 plane;
+		for (u32 r = 0; r < 4; ++r)
+		{
+			if (i < 4)
+			{
+				plane[r] = m.rows[r][3] + sideSigns[i] * m.rows[r][sideAxes[i]];
+			}
+			else
+			{
+				// Depth is in [0, 1], with the near plane at 1 when reversed
+				plane[r] = reverseZ ? m.rows[r][3] - m.rows[r][2] : m.rows[r][2];
+			}
+		}
+
+		const float length = Vec3(plane.x, plane.y, plane.z).length();
+		planes[i]          = length > 0.0f ? Vec4(plane.x / length, plane.y / length, plane.z / length, plane.w / length)
+		                                   : plane;
+	}
+}
+
+static bool isSphereVisible(const Vec3& center, float radius, const Vec4* planes, u32 planeCount)
+{
+	for (u32 i = 0; i < planeCount; ++i)
+	{
+		if (dot(Vec3(planes[i].x, planes[i].y, planes[i].z), center) + planes[i].w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 void ExampleModelViewer::render()
 {
 	const GfxCapability& caps = Gfx_GetCapability();
@@ -367,13 +461,97 @@ void ExampleModelViewer::render()
 			Gfx_SetVertexStream(ctx, 0, m_vertexBuffer);
 			Gfx_SetIndexStream(ctx, m_indexBuffer);
 			Gfx_SetConstantBuffer(ctx, 0, m_constantBuffer); // scene constants
-			for (const MeshSegment& segment : m_segments)
+
+			// Clusters are culled in model space, against the frustum and the camera position
+			const Mat4 matModelViewProj = m_worldTransform * matView * matProj;
+			const Vec3 cameraPosition   = m_worldTransform.inverse() * m_interpolatedCamera.getPosition();
+			Vec4       frustumPlanes[5];
+			getFrustumPlanes(matModelViewProj, m_reverseZ, frustumPlanes);
+
+			// Model space errors become pixels at unit distance, the same way the projection scales y
+			const float pixelsPerUnit = matProj.rows[1][1] * 0.5f * float(m_window->getFramebufferSize().y);
+
+			m_visibleClusters    = 0;
+			m_submittedTriangles = 0;
+			m_fullTriangles      = 0;
+			for (size_t segmentIt = 0; segmentIt < m_segments.size(); ++segmentIt)
 			{
-				const Material& material =
+				const MeshSegment& segment = m_segments[segmentIt];
+				const Material&    material =
 					(segment.material == 0xFFFFFFFF) ? m_defaultMaterial : m_materials[segment.material];
 
+				m_fullTriangles += segment.indexCount / 3;
+
+				// Pick the coarsest level whose error stays under m_lodErrorPixels at the point of the
+				// bounding sphere nearest to the camera. Cameras inside the sphere get full detail.
+				u32 lod = 0;
+				if (m_lodSelection)
+				{
+					const float distance = (segment.center - cameraPosition).length() - segment.radius;
+					while (lod < segment.lodCount && distance > 0.0f &&
+					       m_lods[segment.lodOffset + lod].error * pixelsPerUnit <= m_lodErrorPixels * distance)
+					{
+						++lod;
+					}
+				}
+
+				if (lod != 0 && !isSphereVisible(segment.center, segment.radius, frustumPlanes, 5))
+				{
+					continue;
+				}
+
+				if (m_quantizedVertices)
+				{
+					Gfx_SetConstantBuffer(ctx, 1, m_segmentConstantBuffer, segmentIt * sizeof(SegmentConstants));
+				}
 				Gfx_SetDescriptors(ctx, 1, material.descriptorSet);
-				Gfx_DrawIndexed(ctx, segment.indexCount, segment.indexOffset, 0, m_vertexCount);
+
+				// Simplified levels are small enough to be drawn whole
+				if (lod != 0)
+				{
+					const MeshLod& level = m_lods[segment.lodOffset + lod - 1];
+					Gfx_DrawIndexed(ctx, level.indexCount, level.indexOffset, 0, m_vertexCount);
+					m_submittedTriangles += level.indexCount / 3;
+					continue;
+				}
+
+				if (!m_clusterCulling || segment.clusterCount == 0)
+				{
+					Gfx_DrawIndexed(ctx, segment.indexCount, segment.indexOffset, 0, m_vertexCount);
+					m_visibleClusters += segment.clusterCount;
+					m_submittedTriangles += segment.indexCount / 3;
+					continue;
+				}
+
+				// Visible clusters next to each other in the index buffer are merged into one draw
+				u32 drawOffset = 0;
+				u32 drawCount  = 0;
+				for (u32 i = segment.clusterOffset; i < segment.clusterOffset + segment.clusterCount; ++i)
+				{
+					const MeshCluster& cluster = m_clusters[i];
+					if (!isMeshClusterVisible(cluster, frustumPlanes, 5, cameraPosition))
+					{
+						continue;
+					}
+
+					++m_visibleClusters;
+					m_submittedTriangles += cluster.indexCount / 3;
+					if (drawCount && drawOffset + drawCount == cluster.indexOffset)
+					{
+						drawCount += cluster.indexCount;
+						continue;
+					}
+					if (drawCount)
+					{
+						Gfx_DrawIndexed(ctx, drawCount, drawOffset, 0, m_vertexCount);
+					}
+					drawOffset = cluster.indexOffset;
+					drawCount  = cluster.indexCount;
+				}
+				if (drawCount)
+				{
+					Gfx_DrawIndexed(ctx, drawCount, drawOffset, 0, m_vertexCount);
+				}
 			}
 		}
 
@@ -427,6 +605,8 @@ void ExampleModelViewer::render()
 		snprintf(timingString, sizeof(timingString),
 		    "Draw calls: %d\n"
 		    "Vertices: %d\n"
+		    "Clusters: %u / %u%s\n"
+		    "Triangles: %u / %u%s\n"
 		    "GPU time: %.2f ms\n"
 		    "CPU time: %.2f ms\n"
 		    "> Update CB: %.2f ms\n"
@@ -434,6 +614,12 @@ void ExampleModelViewer::render()
 		    "> UI: %.2f ms",
 		    stats.drawCalls,
 		    stats.vertices,
+		    m_visibleClusters,
+		    u32(m_clusters.size()),
+		    m_clusterCulling ? "" : " (culling off)",
+		    m_submittedTriangles,
+		    m_fullTriangles,
+		    m_lodSelection ? "" : " (LOD off)",
 		    m_stats.gpuTotal.get() * 1000.0f,
 		    m_stats.cpuTotal.get() * 1000.0f,
 		    m_stats.cpuUpdateConstantBuffer.get() * 1000.0f,
@@ -452,99 +638,78 @@ void ExampleModelViewer::render()
 	}
 }
 
-void ExampleModelViewer::loadingThreadFunction()
+void ExampleModelViewer::loadTexture(TextureData* textureData)
 {
-	while (!m_loadingThreadShouldExit)
+	const GfxFormat   format    = m_useTextureCompression ? GfxFormat_BC7_Unorm : GfxFormat_RGBA8_Unorm;
+	const std::string cachePath = getTextureCachePath("ModelViewer", textureData->filename, format);
+	if (!loadCachedTexture(cachePath, textureData->staged))
 	{
-		TextureData* pendingLoad = nullptr;
+		RUSH_LOG("Loading texture '%s'", textureData->filename.c_str());
 
-		m_loadingMutex.lock();
-		if (!m_pendingTextures.empty())
+		// Albedo maps are authored in sRGB, so filter them in linear light
+		const bool sRGB = true;
+		if (!stageTextureFromFile(textureData->filename.c_str(), format, sRGB, textureData->staged))
 		{
-			pendingLoad = m_pendingTextures.back();
-			m_pendingTextures.pop_back();
+			RUSH_LOG("Failed to load texture '%s'", textureData->filename.c_str());
+			return;
 		}
-		m_loadingMutex.unlock();
-
-		if (pendingLoad)
-		{
-			RUSH_LOG("Loading texture '%s'", pendingLoad->filename.c_str());
-
-			int w, h, comp;
-			u8* pixels = stbi_load(pendingLoad->filename.c_str(), &w, &h, &comp, 4);
-
-			if (pixels)
-			{
-				u32 mipIndex = 0;
-
-				{
-					u32 levelSize = w * h * 4;
-					pendingLoad->mips[mipIndex].resize(levelSize);
-					memcpy(pendingLoad->mips[mipIndex].data(), pixels, levelSize);
-					mipIndex++;
-				}
-
-				u32 mipWidth  = w;
-				u32 mipHeight = h;
-
-				while (mipWidth != 1 && mipHeight != 1)
-				{
-					u32 nextMipWidth  = max<u32>(1, mipWidth / 2);
-					u32 nextMipHeight = max<u32>(1, mipHeight / 2);
 
-					u32 levelSize = nextMipWidth * nextMipHeight * 4;
-					pendingLoad->mips[mipIndex].resize(levelSize);
+		saveCachedTexture(cachePath, textureData->staged);
+	}
 
-					const u32 mipPitch     = mipWidth * 4;
-					const u32 nextMipPitch = nextMipWidth * 4;
+	m_loadedTextures.push(textureData);
+}
 
-					int resizeResult = stbir_resize_uint8(pendingLoad->mips[mipIndex - 1].data(), mipWidth, mipHeight,
-					    mipPitch, pendingLoad->mips[mipIndex].data(), nextMipWidth, nextMipHeight, nextMipPitch, 4);
-					RUSH_ASSERT(resizeResult);
+void ExampleModelViewer::enqueueLoadTexture(const std::string& filename, u32 materialId)
+{
+	auto it = m_texturesByName.find(filename);
+	if (it != m_texturesByName.end())
+	{
+		it->second->patchList.push_back(materialId);
+		return;
+	}
 
-					mipIndex++;
-					mipWidth  = nextMipWidth;
-					mipHeight = nextMipHeight;
-				}
+	// Byte-identical images under different names share one texture. Only files whose size matches
+	// an earlier texture can be duplicates, so the raw file is hashed just when the sizes collide.
+	std::error_code ec;
+	const u64       fileSize = std::filesystem::file_size(filename, ec);
 
-				pendingLoad->desc      = GfxTextureDesc::make2D(w, h);
-				pendingLoad->desc.mips = mipIndex;
+	std::vector<TextureData*>* candidates  = ec ? nullptr : &m_texturesBySize[fileSize];
+	u64                        contentHash = 0;
+	const bool hashed = candidates && !candidates->empty() && computeFileContentHash(filename.c_str(), contentHash);
 
-				m_loadingMutex.lock();
-				m_loadedTextures.push_back(pendingLoad);
-				m_loadingMutex.unlock();
-			}
-			else
-			{
-				RUSH_LOG("Failed to load texture '%s'", pendingLoad->filename.c_str());
-			}
+	for (u32 i = 0; hashed && i < candidates->size(); ++i)
+	{
+		TextureData* textureData = (*candidates)[i];
+		if (!textureData->contentHashed)
+		{
+			textureData->contentHashed = computeFileContentHash(textureData->filename.c_str(), textureData->contentHash);
 		}
-		else
+
+		if (textureData->contentHashed && textureData->contentHash == contentHash)
 		{
-			using namespace std::chrono_literals;
-			std::this_thread::sleep_for(100ms);
+			textureData->duplicateCount++;
+			textureData->patchList.push_back(materialId);
+			m_texturesByName[filename] = textureData;
+			return;
 		}
 	}
-}
 
-void ExampleModelViewer::enqueueLoadTexture(const std::string& filename, u32 materialId)
-{
-	auto it = m_textures.find(filename);
+	m_textures.push_back(std::make_unique<TextureData>());
+	TextureData* textureData = m_textures.back().get();
+	textureData->filename    = filename;
+	textureData->patchList.push_back(materialId);
 
-	if (it == m_textures.end())
-	{
-		TextureData* textureData = new TextureData;
-		textureData->filename    = filename;
-		textureData->patchList.push_back(materialId);
+	textureData->contentHash   = contentHash;
+	textureData->contentHashed = hashed;
 
-		m_textures[filename] = textureData;
-
-		m_pendingTextures.push_back(textureData);
-	}
-	else
+	m_texturesByName[filename] = textureData;
+	if (candidates)
 	{
-		it->second->patchList.push_back(materialId);
+		candidates->push_back(textureData);
 	}
+
+	JobSystem::getDefault().submit([this, textureData]() { loadTexture(textureData); }, &m_textureLoadCounter);
 }
 
 bool ExampleModelViewer::loadModelObj(const char* filename)
@@ -631,129 +796,236 @@ bool ExampleModelViewer::loadModelObj(const char* filename)
 
 	RUSH_LOG("Converting mesh");
 
-	std::vector<Vertex> vertices;
-	std::vector<u32>    indices;
+	// Shapes are converted in parallel, with indices and segments relative to the shape
+	struct ObjShape
+	{
+		std::vector<Vertex>      vertices;
+		std::vector<u32>         indices;
+		std::vector<MeshSegment> segments;
+		Box3                     bounds;
+		u32                      sourceVertexCount = 0;
+	};
 
-	m_boundingBox.expandInit();
+	std::vector<ObjShape> objShapes(shapes.size());
 
-	for (const auto& shape : shapes)
+	JobSystem::getDefault().parallelFor(u32(shapes.size()), 1, [&](u32 begin, u32 end)
 	{
-		u32         firstVertex = (u32)vertices.size();
-		const auto& mesh        = shape.mesh;
+		for (u32 shapeIt = begin; shapeIt < end; ++shapeIt)
+		{
+			const auto&          mesh     = shapes[shapeIt].mesh;
+			ObjShape&            shape    = objShapes[shapeIt];
+			std::vector<Vertex>& vertices = shape.vertices;
+			std::vector<u32>&    indices  = shape.indices;
 
-		const u32 vertexCount = (u32)mesh.positions.size() / 3;
+			shape.bounds.expandInit();
 
-		const bool haveTexcoords = !mesh.texcoords.empty();
-		const bool haveNormals   = mesh.positions.size() == mesh.normals.size();
+			const u32 vertexCount   = (u32)mesh.positions.size() / 3;
+			shape.sourceVertexCount = vertexCount;
 
-		for (u32 i = 0; i < vertexCount; ++i)
-		{
-			Vertex v;
+			const bool haveTexcoords = !mesh.texcoords.empty();
+			const bool haveNormals   = mesh.positions.size() == mesh.normals.size();
 
-			v.position.x = mesh.positions[i * 3 + 0];
-			v.position.y = mesh.positions[i * 3 + 1];
-			v.position.z = mesh.positions[i * 3 + 2];
+			for (u32 i = 0; i < vertexCount; ++i)
+			{
+				Vertex v;
 
-			m_boundingBox.expand(v.position);
+				v.position.x = mesh.positions[i * 3 + 0];
+				v.position.y = mesh.positions[i * 3 + 1];
+				v.position.z = mesh.positions[i * 3 + 2];
 
-			if (haveTexcoords)
-			{
-				v.texcoord.x = mesh.texcoords[i * 2 + 0];
-				v.texcoord.y = mesh.texcoords[i * 2 + 1];
+				shape.bounds.expand(v.position);
 
-				v.texcoord.y = 1.0f - v.texcoord.y;
-			}
-			else
-			{
-				v.texcoord = Vec2(0.0f);
+				if (haveTexcoords)
+				{
+					v.texcoord.x = mesh.texcoords[i * 2 + 0];
+					v.texcoord.y = mesh.texcoords[i * 2 + 1];
+
+					v.texcoord.y = 1.0f - v.texcoord.y;
+				}
+				else
+				{
+					v.texcoord = Vec2(0.0f);
+				}
+
+				if (haveNormals)
+				{
+					v.normal.x = mesh.normals[i * 3 + 0];
+					v.normal.y = mesh.normals[i * 3 + 1];
+					v.normal.z = mesh.normals[i * 3 + 2];
+				}
+				else
+				{
+					v.normal = Vec3(0.0);
+				}
+
+				v.position.x = -v.position.x;
+				v.normal.x   = -v.normal.x;
+
+				vertices.push_back(v);
 			}
 
-			if (haveNormals)
+			if (!haveNormals)
 			{
-				v.normal.x = mesh.normals[i * 3 + 0];
-				v.normal.y = mesh.normals[i * 3 + 1];
-				v.normal.z = mesh.normals[i * 3 + 2];
+				const u32 triangleCount = (u32)mesh.indices.size() / 3;
+				for (u32 i = 0; i < triangleCount; ++i)
+				{
+					u32 idxA = mesh.indices[i * 3 + 0];
+					u32 idxB = mesh.indices[i * 3 + 2];
+					u32 idxC = mesh.indices[i * 3 + 1];
+
+					Vec3 a = vertices[idxA].position;
+					Vec3 b = vertices[idxB].position;
+					Vec3 c = vertices[idxC].position;
+
+					Vec3 normal = cross(b - a, c - b);
+
+					normal = normalize(normal);
+
+					vertices[idxA].normal += normal;
+					vertices[idxB].normal += normal;
+					vertices[idxC].normal += normal;
+				}
+
+				for (Vertex& v : vertices)
+				{
+					v.normal = normalize(v.normal);
+				}
 			}
-			else
+
+			u32 currentMaterialId = 0xFFFFFFFF;
+
+			const u32 triangleCount = (u32)mesh.indices.size() / 3;
+			for (u32 triangleIt = 0; triangleIt < triangleCount; ++triangleIt)
 			{
-				v.normal = Vec3(0.0);
+				if (mesh.material_ids[triangleIt] != currentMaterialId || shape.segments.empty())
+				{
+					currentMaterialId = mesh.material_ids[triangleIt];
+					shape.segments.push_back(MeshSegment());
+					shape.segments.back().material    = currentMaterialId;
+					shape.segments.back().indexOffset = (u32)indices.size();
+					shape.segments.back().indexCount  = 0;
+				}
+
+				indices.push_back(mesh.indices[triangleIt * 3 + 0]);
+				indices.push_back(mesh.indices[triangleIt * 3 + 2]);
+				indices.push_back(mesh.indices[triangleIt * 3 + 1]);
+
+				shape.segments.back().indexCount += 3;
 			}
 
-			v.position.x = -v.position.x;
-			v.normal.x   = -v.normal.x;
+			// Duplicates within a shape are welded here, in parallel
+			vertices.resize(
+			    weldVertices(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size()));
+		}
+	});
+
+	// Merging shapes and welding again joins the vertices that OBJ files repeat for every shape
+	// or group that shares them
+	std::vector<Vertex> vertices;
+	std::vector<u32>    indices;
+	size_t              sourceVertexCount = 0;
+
+	m_boundingBox.expandInit();
 
-			vertices.push_back(v);
+	for (const ObjShape& shape : objShapes)
+	{
+		const u32 firstVertex = u32(vertices.size());
+		for (MeshSegment segment : shape.segments)
+		{
+			segment.indexOffset += u32(indices.size());
+			m_segments.push_back(segment);
+		}
+		for (u32 index : shape.indices)
+		{
+			indices.push_back(index + firstVertex);
 		}
+		vertices.insert(vertices.end(), shape.vertices.begin(), shape.vertices.end());
 
-		if (!haveNormals)
+		if (!shape.vertices.empty())
 		{
-			const u32 triangleCount = (u32)mesh.indices.size() / 3;
-			for (u32 i = 0; i < triangleCount; ++i)
-			{
-				u32 idxA = firstVertex + mesh.indices[i * 3 + 0];
-				u32 idxB = firstVertex + mesh.indices[i * 3 + 2];
-				u32 idxC = firstVertex + mesh.indices[i * 3 + 1];
+			m_boundingBox.expand(shape.bounds.m_min);
+			m_boundingBox.expand(shape.bounds.m_max);
+		}
+		sourceVertexCount += shape.sourceVertexCount;
+	}
+	objShapes.clear();
 
-				Vec3 a = vertices[idxA].position;
-				Vec3 b = vertices[idxB].position;
-				Vec3 c = vertices[idxC].position;
+	vertices.resize(weldVertices(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size()));
 
-				Vec3 normal = cross(b - a, c - b);
+	RUSH_LOG("Welded %u vertices to %u (%.1f MB -> %.1f MB)", u32(sourceVertexCount), u32(vertices.size()),
+	    sourceVertexCount * sizeof(Vertex) / double(1 << 20), vertices.size() * sizeof(Vertex) / double(1 << 20));
 
-				normal = normalize(normal);
+	m_vertexCount = (u32)vertices.size();
+	m_indexCount  = (u32)indices.size();
 
-				vertices[idxA].normal += normal;
-				vertices[idxB].normal += normal;
-				vertices[idxC].normal += normal;
+	if (!m_saveModelFilename.empty())
+	{
+		// Texture paths stay relative to the OBJ, so the model should be saved next to it
+		Model model;
+		for (const auto& objMaterial : materials)
+		{
+			Model::OfflineMaterial material;
+			if (objMaterial.diffuse_texname.length() <= Model::OfflineMaterial::MaxStringLength)
+			{
+				strcpy(material.albedoTexture, objMaterial.diffuse_texname.c_str());
 			}
-
-			for (u32 i = firstVertex; i < (u32)vertices.size(); ++i)
+			else
 			{
-				vertices[i].normal = normalize(vertices[i].normal);
+				RUSH_LOG_ERROR("Texture path '%s' is too long to be saved", objMaterial.diffuse_texname.c_str());
 			}
+			material.baseColor = Vec4(objMaterial.diffuse[0], objMaterial.diffuse[1], objMaterial.diffuse[2], 1.0f);
+			model.materials.push_back(material);
 		}
 
-		u32 currentMaterialId = 0xFFFFFFFF;
+		for (const MeshSegment& segment : m_segments)
+		{
+			model.segments.push_back({segment.material, segment.indexOffset, segment.indexCount});
+		}
 
-		const u32 triangleCount = (u32)mesh.indices.size() / 3;
-		for (u32 triangleIt = 0; triangleIt < triangleCount; ++triangleIt)
+		model.vertices.reserve(vertices.size());
+		for (const Vertex& v : vertices)
 		{
-			if (mesh.material_ids[triangleIt] != currentMaterialId || m_segments.empty())
-			{
-				currentMaterialId = mesh.material_ids[triangleIt];
-				m_segments.push_back(MeshSegment());
-				m_segments.back().material    = currentMaterialId;
-				m_segments.back().indexOffset = (u32)indices.size();
-				m_segments.back().indexCount  = 0;
-			}
+			model.vertices.push_back({v.position, v.normal, Vec3(0.0f), Vec3(0.0f), v.texcoord});
+		}
+		model.indices = std::move(indices);
 
-			indices.push_back(mesh.indices[triangleIt * 3 + 0] + firstVertex);
-			indices.push_back(mesh.indices[triangleIt * 3 + 2] + firstVertex);
-			indices.push_back(mesh.indices[triangleIt * 3 + 1] + firstVertex);
+		// Segment ranges are preserved, so the reordered mesh is also what gets drawn below
+		model.optimize();
+		RUSH_LOG("Saving model to '%s'", m_saveModelFilename.c_str());
+		model.write(m_saveModelFilename.c_str(), m_saveModelCompressed ? ModelEncoding::Compressed : ModelEncoding::Raw);
 
-			m_segments.back().indexCount += 3;
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const ModelVertex& v = model.vertices[i];
+			vertices[i]          = {v.position, v.normal, v.texcoord};
 		}
-
-		m_vertexCount = (u32)vertices.size();
-		m_indexCount  = (u32)indices.size();
+		indices       = std::move(model.indices);
+		m_indexCount  = u32(indices.size());
+		m_clusters    = std::move(model.clusters);
+		setLods(model.lods.data(), model.lods.size());
+	}
+	else
+	{
+		buildClusters(vertices.data(), indices.data());
 	}
 
 	RUSH_LOG("Uploading mesh to GPU");
 
-	GfxBufferDesc vbDesc(GfxBufferFlags::Vertex, GfxFormat_Unknown, m_vertexCount, sizeof(Vertex));
-	m_vertexBuffer = Gfx_CreateBuffer(vbDesc, vertices.data());
-
-	GfxBufferDesc ibDesc(GfxBufferFlags::Index, GfxFormat_R32_Uint, m_indexCount, 4);
-	m_indexBuffer = Gfx_CreateBuffer(ibDesc, indices.data());
+	createMeshBuffers(vertices.data(), indices.data());
 
 	return true;
 }
 
 bool ExampleModelViewer::loadModelNative(const char* filename)
 {
-	Model model;
+	static_assert(sizeof(Vertex) == sizeof(ModelRenderVertex), "Model vertices are uploaded as-is");
+	static_assert(offsetof(Vertex, normal) == offsetof(ModelRenderVertex, normal), "Model vertices are uploaded as-is");
+	static_assert(offsetof(Vertex, texcoord) == offsetof(ModelRenderVertex, texcoord), "Model vertices are uploaded as-is");
 
-	if (!model.read(filename))
+	Timer timer;
+
+	ModelData model;
+	if (!model.open(filename))
 	{
 		return false;
 	}
@@ -825,37 +1097,28 @@ bool ExampleModelViewer::loadModelNative(const char* filename)
 		m_segments.push_back(segment);
 	}
 
-	RUSH_LOG("Converting mesh");
-
 	m_vertexCount = u32(model.vertices.size());
 	m_indexCount  = u32(model.indices.size());
+	m_boundingBox = model.bounds;
 
-	m_boundingBox.expandInit();
+	setLods(model.lods.data(), model.lods.size());
 
-	std::vector<Vertex> vertices;
-	vertices.reserve(m_vertexCount);
-
-	for (u32 i = 0; i < m_vertexCount; ++i)
+	const Vertex* vertices = reinterpret_cast<const Vertex*>(model.vertices.data());
+	if (model.clusters.empty())
 	{
-		const auto& vSrc = model.vertices[i];
-		Vertex      vDst;
-
-		vDst.position = vSrc.position;
-		vDst.normal   = vSrc.normal;
-		vDst.texcoord = vSrc.texcoord;
-
-		m_boundingBox.expand(vSrc.position);
-
-		vertices.push_back(vDst);
+		// Clustering reorders triangles, so models saved without clusters need a copy of their indices
+		std::vector<u32> indices(model.indices.begin(), model.indices.end());
+		buildClusters(vertices, indices.data());
+		createMeshBuffers(vertices, indices.data());
+	}
+	else
+	{
+		// Version 2 models are mapped, so the buffers are created straight from the file contents
+		m_clusters.assign(model.clusters.begin(), model.clusters.end());
+		createMeshBuffers(vertices, model.indices.data());
 	}
 
-	RUSH_LOG("Uploading mesh to GPU");
-
-	GfxBufferDesc vbDesc(GfxBufferFlags::Vertex, GfxFormat_Unknown, m_vertexCount, sizeof(Vertex));
-	m_vertexBuffer = Gfx_CreateBuffer(vbDesc, vertices.data());
-
-	GfxBufferDesc ibDesc(GfxBufferFlags::Index, GfxFormat_R32_Uint, m_indexCount, 4);
-	m_indexBuffer = Gfx_CreateBuffer(ibDesc, model.indices.data());
+	RUSH_LOG("Loaded model '%s' in %.1f ms", filename, timer.time() * 1000.0);
 
 	return true;
 }
@@ -871,6 +1134,8 @@ bool ExampleModelViewer::buildProceduralModel()
 
 	m_materials.clear();
 	m_segments.clear();
+	m_clusters.clear();
+	m_lods.clear();
 	m_materialConstantBuffers.clear();
 
 	const GfxBufferDesc materialCbDesc(GfxBufferFlags::Constant, GfxFormat_Unknown, 1, sizeof(MaterialConstants));
@@ -953,15 +1218,186 @@ bool ExampleModelViewer::buildProceduralModel()
 		vertices.push_back(v);
 	}
 
+	buildClusters(vertices.data(), data.indices.data());
+
 	RUSH_LOG("Uploading procedural mesh to GPU");
 
-	GfxBufferDesc vbDesc(GfxBufferFlags::Vertex, GfxFormat_Unknown, m_vertexCount, sizeof(Vertex));
-	m_vertexBuffer = Gfx_CreateBuffer(vbDesc, vertices.data());
+	createMeshBuffers(vertices.data(), data.indices.data());
+
+	return m_vertexBuffer.valid() && m_indexBuffer.valid();
+}
+
+void ExampleModelViewer::buildClusters(const Vertex* vertices, u32* indices)
+{
+	Timer timer;
+
+	m_clusters.clear();
+	for (const MeshSegment& segment : m_segments)
+	{
+		if (u64(segment.indexOffset) + segment.indexCount > m_indexCount)
+		{
+			RUSH_LOG_ERROR("Model segment references indices past the end of the index buffer");
+			m_clusters.clear();
+			return;
+		}
+		buildMeshClusters(indices + segment.indexOffset, segment.indexCount, &vertices[0].position.x, sizeof(Vertex),
+		    segment.indexOffset, m_clusters);
+	}
+
+	std::sort(m_clusters.begin(), m_clusters.end(),
+	    [](const MeshCluster& a, const MeshCluster& b) { return a.indexOffset < b.indexOffset; });
+
+	RUSH_LOG("Built %u clusters in %.1f ms", u32(m_clusters.size()), timer.time() * 1000.0);
+}
+
+void ExampleModelViewer::setLods(const ModelLod* lods, size_t count)
+{
+	m_lods.clear();
+	for (size_t i = 0; i < count; ++i)
+	{
+		MeshSegment& segment = m_segments[lods[i].segment];
+		if (segment.lodCount == 0)
+		{
+			segment.lodOffset = u32(m_lods.size());
+		}
+		segment.lodCount++;
+
+		MeshLod lod;
+		lod.indexOffset = lods[i].indexOffset;
+		lod.indexCount  = lods[i].indexCount;
+		lod.error       = lods[i].error;
+		m_lods.push_back(lod);
+	}
+}
+
+void ExampleModelViewer::createMeshBuffers(const Vertex* vertices, const u32* indices)
+{
+	static_assert(sizeof(QuantizedVertex) * 2 == sizeof(Vertex), "Quantized vertices are half the size");
+	static_assert(sizeof(SegmentConstants) == 256, "Segment constants are bound at 256 byte offsets");
+
+	for (MeshSegment& segment : m_segments)
+	{
+		const auto first = std::lower_bound(m_clusters.begin(), m_clusters.end(), segment.indexOffset,
+		    [](const MeshCluster& cluster, u32 offset) { return cluster.indexOffset < offset; });
+		auto last = first;
+		while (last != m_clusters.end() && last->indexOffset < segment.indexOffset + segment.indexCount)
+		{
+			++last;
+		}
+		segment.clusterOffset = u32(first - m_clusters.begin());
+		segment.clusterCount  = u32(last - first);
+
+		Box3 bounds;
+		bounds.expandInit();
+		for (u32 i = segment.indexOffset; i < segment.indexOffset + segment.indexCount; ++i)
+		{
+			bounds.expand(vertices[indices[i]].position);
+		}
+		segment.center = segment.indexCount ? bounds.center() : Vec3(0.0f);
+		segment.radius = 0.0f;
+		for (u32 i = segment.indexOffset; i < segment.indexOffset + segment.indexCount; ++i)
+		{
+			segment.radius = max(segment.radius, (vertices[indices[i]].position - segment.center).length());
+		}
+	}
+
+	if (!m_quantizedVertices)
+	{
+		GfxBufferDesc vbDesc(GfxBufferFlags::Vertex, GfxFormat_Unknown, m_vertexCount, sizeof(Vertex));
+		m_vertexBuffer = Gfx_CreateBuffer(vbDesc, vertices);
+
+		GfxBufferDesc ibDesc(GfxBufferFlags::Index, GfxFormat_R32_Uint, m_indexCount, 4);
+		m_indexBuffer = Gfx_CreateBuffer(ibDesc, indices);
+		return;
+	}
+
+	// Every segment gets its own copy of the vertices it references, so that positions can be
+	// quantized relative to the segment bounds. Shared vertices only occur along material
+	// boundaries, so the duplication is small.
+	std::vector<QuantizedVertex>  quantizedVertices;
+	std::vector<u32>              quantizedIndices(m_indexCount);
+	std::vector<SegmentConstants> segmentConstants(max<size_t>(m_segments.size(), 1));
+	std::vector<u32>              remap(m_vertexCount, 0xFFFFFFFF);
+
+	quantizedVertices.reserve(m_vertexCount);
+
+	for (size_t segmentIt = 0; segmentIt < m_segments.size(); ++segmentIt)
+	{
+		const MeshSegment& segment  = m_segments[segmentIt];
+		const u32          indexEnd = segment.indexOffset + segment.indexCount;
+		if (segment.indexCount == 0)
+		{
+			continue;
+		}
+
+		Box3 bounds;
+		bounds.expandInit();
+		for (u32 i = segment.indexOffset; i < indexEnd; ++i)
+		{
+			bounds.expand(vertices[indices[i]].position);
+		}
+
+		const Vec3 center = bounds.center();
+		const Vec3 extent = bounds.dimensions() * 0.5f;
+		const Vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+		    extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+		segmentConstants[segmentIt].positionCenter = Vec4(center.x, center.y, center.z, 0.0f);
+		segmentConstants[segmentIt].positionExtent = Vec4(extent.x, extent.y, extent.z, 0.0f);
+
+		// Keep culling conservative for positions that moved by up to half a quantization step
+		for (u32 i = segment.clusterOffset; i < segment.clusterOffset + segment.clusterCount; ++i)
+		{
+			m_clusters[i].radius += extent.length() / 32767.0f;
+		}
+
+		const u32 firstVertex   = u32(quantizedVertices.size());
+		auto      quantizeRange = [&](u32 rangeBegin, u32 rangeEnd)
+		{
+			for (u32 i = rangeBegin; i < rangeEnd; ++i)
+			{
+				const u32 index = indices[i];
+				if (remap[index] == 0xFFFFFFFF || remap[index] < firstVertex)
+				{
+					const Vertex&   v = vertices[index];
+					QuantizedVertex q = {};
+					q.position[0]     = quantizeSnorm16((v.position.x - center.x) * invExtent.x);
+					q.position[1]     = quantizeSnorm16((v.position.y - center.y) * invExtent.y);
+					q.position[2]     = quantizeSnorm16((v.position.z - center.z) * invExtent.z);
+					encodeOctahedral16(v.normal, q.normal);
+					q.texcoord[0] = floatToHalf(v.texcoord.x);
+					q.texcoord[1] = floatToHalf(v.texcoord.y);
+
+					remap[index] = u32(quantizedVertices.size());
+					quantizedVertices.push_back(q);
+				}
+				quantizedIndices[i] = remap[index];
+			}
+		};
+
+		// Levels of detail reuse the vertices of their segment
+		quantizeRange(segment.indexOffset, indexEnd);
+		for (u32 i = segment.lodOffset; i < segment.lodOffset + segment.lodCount; ++i)
+		{
+			quantizeRange(m_lods[i].indexOffset, m_lods[i].indexOffset + m_lods[i].indexCount);
+		}
+	}
+
+	RUSH_LOG("Quantized %u vertices to %u (%.1f MB, %.1f MB as floats)", m_vertexCount, u32(quantizedVertices.size()),
+	    quantizedVertices.size() * sizeof(QuantizedVertex) / double(1 << 20),
+	    m_vertexCount * sizeof(Vertex) / double(1 << 20));
+
+	m_vertexCount = u32(quantizedVertices.size());
+
+	GfxBufferDesc vbDesc(GfxBufferFlags::Vertex, GfxFormat_Unknown, m_vertexCount, sizeof(QuantizedVertex));
+	m_vertexBuffer = Gfx_CreateBuffer(vbDesc, quantizedVertices.data());
 
 	GfxBufferDesc ibDesc(GfxBufferFlags::Index, GfxFormat_R32_Uint, m_indexCount, 4);
-	m_indexBuffer = Gfx_CreateBuffer(ibDesc, data.indices.data());
+	m_indexBuffer = Gfx_CreateBuffer(ibDesc, quantizedIndices.data());
 
-	return m_vertexBuffer.valid() && m_indexBuffer.valid();
+	GfxBufferDesc cbDesc(
+	    GfxBufferFlags::Constant, GfxFormat_Unknown, u32(segmentConstants.size()), sizeof(SegmentConstants));
+	m_segmentConstantBuffer = Gfx_CreateBuffer(cbDesc, segmentConstants.data());
 }
 
 // Adding/removing/reordering Settings fields needs no bump (tagged format).
@@ -8,7 +8,12 @@
 #include <Rush/UtilTimer.h>
 #include <Rush/Window.h>
 
+#include <Common/CompletionQueue.h>
+#include <Common/ContentHash.h>
 #include <Common/ExampleApp.h>
+#include <Common/JobSystem.h>
+#include <Common/MeshOptimizer.h>
+#include <Common/TextureCache.h>
 #include <Common/Utils.h>
 #include <Common/VirtualGamepad.h>
 
@@ -19,6 +24,8 @@
 #include <thread>
 #include <unordered_map>
 
+struct ModelLod;
+
 class ExampleModelViewer : public ExampleApp
 {
 public:
@@ -87,8 +94,42 @@ private:
 		Vec2 texcoord;
 	};
 
+	// Compact layout enabled with --quantized-vertices=1, half the size of Vertex. Positions are
+	// 16-bit snorm relative to the bounds of their segment, normals 16-bit snorm octahedral
+	// coordinates and texcoords half floats.
+	struct QuantizedVertex
+	{
+		u16 position[4]; // w is unused
+		u16 normal[2];
+		u16 texcoord[2];
+	};
+
+	// Maps quantized positions of one segment back to model space. Padded so that each segment
+	// can be bound at its own constant buffer offset.
+	struct SegmentConstants
+	{
+		Vec4 positionCenter;
+		Vec4 positionExtent;
+		Vec4 padding[14];
+	};
+
+	bool m_quantizedVertices = false;
+	GfxOwn<GfxBuffer> m_segmentConstantBuffer;
+
+	// Builds culling clusters for models that do not come with them, reordering triangles within segments.
+	void buildClusters(const Vertex* vertices, u32* indices);
+
+	// Creates the vertex and index buffers for m_segments, quantizing vertices when enabled, and
+	// points each segment at its clusters and computes its bounding sphere.
+	void createMeshBuffers(const Vertex* vertices, const u32* indices);
+
+	// Copies levels of detail from an offline model, which stores them sorted by segment.
+	void setLods(const ModelLod* lods, size_t count);
+
 	std::string m_statusString;
 	std::string m_modelFilename;
+	std::string m_saveModelFilename; // OBJ models are optimized and written here when set
+	bool m_saveModelCompressed = false;
 	bool m_valid = false;
 	bool m_useProceduralScene = false;
 
@@ -117,9 +158,30 @@ private:
 		u32 material = 0;
 		u32 indexOffset = 0;
 		u32 indexCount = 0;
+		u32 clusterOffset = 0; // segments without clusters are drawn whole
+		u32 clusterCount = 0;
+		u32 lodOffset = 0; // simplified levels in m_lods, from finest to coarsest
+		u32 lodCount = 0;
+		Vec3 center = Vec3(0.0f); // bounding sphere in model space
+		float radius = 0.0f;
+	};
+
+	struct MeshLod
+	{
+		u32 indexOffset = 0;
+		u32 indexCount = 0;
+		float error = 0.0f; // approximate distance from the full detail surface, in model units
 	};
 
 	std::vector<MeshSegment> m_segments;
+	std::vector<MeshCluster> m_clusters; // sorted by index offset
+	std::vector<MeshLod> m_lods;
+	bool m_clusterCulling = true; // toggled with F5
+	bool m_lodSelection = true; // toggled with F6
+	float m_lodErrorPixels = 1.0f; // coarsest level error allowed on screen, set with --lod-error
+	u32 m_visibleClusters = 0;
+	u32 m_submittedTriangles = 0;
+	u32 m_fullTriangles = 0; // visible or not, at full detail
 
 	WindowEventListener m_windowEvents;
 
@@ -155,27 +217,28 @@ private:
 	struct TextureData
 	{
 		GfxTextureDesc     desc;
-		std::vector<u8>    mips[16];
+		StagedTexture      staged;
 		std::vector<u32>   patchList;
 		std::string        filename;
 		GfxOwn<GfxTexture> albedoTexture;
+		u32                duplicateCount = 0; // other files with identical contents sharing this texture
+		u64                contentHash    = 0; // raw file hash, only computed when another file has the same size
+		bool               contentHashed  = false;
 	};
 
-	std::unordered_map<std::string, TextureData*> m_textures;
-	std::vector<TextureData*>                     m_pendingTextures;
-	std::vector<TextureData*>                     m_loadedTextures;
-
-	std::vector<std::thread> m_loadingThreads;
-	bool        m_loadingThreadShouldExit = false;
-
-	std::mutex m_loadingMutex;
+	std::vector<std::unique_ptr<TextureData>>          m_textures;
+	std::unordered_map<std::string, TextureData*>      m_texturesByName;
+	std::unordered_map<u64, std::vector<TextureData*>> m_texturesBySize;
+	CompletionQueue<TextureData*>                      m_loadedTextures; // pushed by loader jobs
+	JobCounter                                         m_textureLoadCounter;
+	bool                                               m_useTextureCompression = true;
 
 	GfxOwn<GfxTexture> m_colorTarget;
 	GfxOwn<GfxTexture> m_depthTarget;
 	GfxOwn<GfxTexture> m_resolveTarget;
 	void               createRenderTargets();
 
-	void loadingThreadFunction();
+	void loadTexture(TextureData* textureData);
 
 	VirtualGamepad m_virtualGamepad;
 	int m_btnVertical = -1;
@@ -1,14 +1,197 @@
 #include "Model.h"
 
+#include <Common/JobSystem.h>
+#include <Common/MeshCompression.h>
+#include <Common/MeshOptimizer.h>
 #include <Common/Utils.h>
 #include <Rush/UtilFile.h>
 #include <Rush/UtilLog.h>
+#include <Rush/UtilTimer.h>
+
+#include <algorithm>
+#include <float.h>
+#include <string.h>
 
 #ifdef __linux__
 #define strcpy_s strcpy
 #endif
 
-const u32 Model::magic = 0xfe892a37;
+const u32 Model::magic   = 0xfe892a37;
+const u32 Model::magicV2 = 0xfe892a38;
+
+namespace
+{
+
+enum ModelSection
+{
+	ModelSection_Materials,
+	ModelSection_Segments,
+	ModelSection_Vertices,
+	ModelSection_TangentFrames,
+	ModelSection_Indices,
+	ModelSection_CompressedVertices,
+	ModelSection_CompressedIndices,
+	ModelSection_Clusters,
+	ModelSection_Lods,
+
+	ModelSection_Count
+};
+
+enum ModelFileFlags : u32
+{
+	ModelFileFlags_Compressed = 1 << 0,
+};
+
+constexpr u64 ModelSectionAlignment = 16;
+
+// Levels of detail stop when a segment is this small, or when simplification stops making progress
+constexpr u32 ModelMaxLods         = 4;
+constexpr u32 ModelLodMinTriangles = 64;
+
+// Position xyz, then octahedral normal, tangent and bitangent, then texcoord uv
+constexpr u32 ModelQuantizedComponentCount = 11;
+
+struct ModelFileSection
+{
+	u64 offset;
+	u64 count;
+	u32 stride;
+	u32 reserved;
+};
+
+struct ModelFileHeaderV2
+{
+	u32              magic;
+	u32              sectionCount;
+	u32              flags;
+	u32              vertexCount;
+	u32              indexCount;
+	u32              reserved;
+	Vec3             boundsMin;
+	Vec3             boundsMax;
+	Vec2             texcoordMin; // quantization range of compressed texcoords
+	Vec2             texcoordMax;
+	ModelFileSection sections[ModelSection_Count];
+};
+
+const u32 modelSectionStrides[ModelSection_Count] = {
+    sizeof(Model::OfflineMaterial),
+    sizeof(ModelSegment),
+    sizeof(ModelRenderVertex),
+    sizeof(ModelTangentFrame),
+    sizeof(u32),
+    1,
+    1,
+    sizeof(MeshCluster),
+    sizeof(ModelLod),
+};
+
+bool writeAll(FileOut& stream, const void* data, u64 size)
+{
+	// FileOut takes 32-bit sizes
+	const u8* bytes = static_cast<const u8*>(data);
+	while (size)
+	{
+		const u32 chunk = u32(min<u64>(size, 1u << 30));
+		if (stream.write(bytes, chunk) != chunk)
+		{
+			return false;
+		}
+		bytes += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+bool validateSections(const ModelFileHeaderV2& header, size_t fileSize, const char* filename)
+{
+	if (header.sectionCount != ModelSection_Count)
+	{
+		Log::error("Model '%s' has %u sections, expected %u", filename, header.sectionCount, ModelSection_Count);
+		return false;
+	}
+
+	for (u32 i = 0; i < ModelSection_Count; ++i)
+	{
+		const ModelFileSection& section = header.sections[i];
+		if (section.stride != modelSectionStrides[i] || section.offset % ModelSectionAlignment != 0 ||
+		    section.offset < sizeof(header) || section.offset > fileSize ||
+		    section.count > (fileSize - section.offset) / section.stride)
+		{
+			Log::error("Model '%s' is truncated or has an invalid section %u", filename, i);
+			return false;
+		}
+	}
+
+	// Raw files store vertices and indices in their own sections, compressed files only in the
+	// compressed ones
+	const bool compressed  = (header.flags & ModelFileFlags_Compressed) != 0;
+	const u64  vertexCount = compressed ? 0 : header.vertexCount;
+	const u64  indexCount  = compressed ? 0 : header.indexCount;
+	if (header.sections[ModelSection_Vertices].count != vertexCount ||
+	    header.sections[ModelSection_TangentFrames].count != vertexCount ||
+	    header.sections[ModelSection_Indices].count != indexCount ||
+	    (!compressed && (header.sections[ModelSection_CompressedVertices].count != 0 ||
+	                        header.sections[ModelSection_CompressedIndices].count != 0)))
+	{
+		Log::error("Model '%s' has inconsistent vertex or index counts", filename);
+		return false;
+	}
+
+	return true;
+}
+
+template <typename T> std::span<const T> getSection(const u8* base, const ModelFileSection& section)
+{
+	return std::span<const T>(reinterpret_cast<const T*>(base + section.offset), size_t(section.count));
+}
+
+void quantizeVertices(const std::vector<ModelVertex>& vertices, const ModelFileHeaderV2& header, std::vector<u16>& out)
+{
+	out.resize(vertices.size() * ModelQuantizedComponentCount);
+	JobSystem::getDefault().parallelFor(u32(vertices.size()), 16384, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const ModelVertex& v = vertices[i];
+			u16*               q = &out[size_t(i) * ModelQuantizedComponentCount];
+			for (int c = 0; c < 3; ++c)
+			{
+				q[c] = quantizeUnorm16(v.position[c], header.boundsMin[c], header.boundsMax[c]);
+			}
+			encodeOctahedral16(v.normal, q + 3);
+			encodeOctahedral16(v.tangent, q + 5);
+			encodeOctahedral16(v.bitangent, q + 7);
+			q[9]  = quantizeUnorm16(v.texcoord.x, header.texcoordMin.x, header.texcoordMax.x);
+			q[10] = quantizeUnorm16(v.texcoord.y, header.texcoordMin.y, header.texcoordMax.y);
+		}
+	});
+}
+
+void dequantizeVertices(const std::vector<u16>& components, const ModelFileHeaderV2& header,
+    ModelRenderVertex* outVertices, ModelTangentFrame* outTangentFrames)
+{
+	JobSystem::getDefault().parallelFor(header.vertexCount, 16384, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const u16*         q = &components[size_t(i) * ModelQuantizedComponentCount];
+			ModelRenderVertex& v = outVertices[i];
+			for (int c = 0; c < 3; ++c)
+			{
+				v.position[c] = dequantizeUnorm16(q[c], header.boundsMin[c], header.boundsMax[c]);
+			}
+			v.normal     = decodeOctahedral16(q + 3);
+			v.texcoord.x = dequantizeUnorm16(q[9], header.texcoordMin.x, header.texcoordMax.x);
+			v.texcoord.y = dequantizeUnorm16(q[10], header.texcoordMin.y, header.texcoordMax.y);
+
+			outTangentFrames[i].tangent   = decodeOctahedral16(q + 5);
+			outTangentFrames[i].bitangent = decodeOctahedral16(q + 7);
+		}
+	});
+}
+
+}
 
 bool Model::read(const char* filename)
 {
@@ -21,9 +204,37 @@ bool Model::read(const char* filename)
 
 	u32 actualMagic = 0;
 	stream.readT(actualMagic);
+	if (actualMagic == magicV2)
+	{
+		ModelData data;
+		if (!data.open(filename))
+		{
+			return false;
+		}
+
+		bounds = data.bounds;
+		materials.assign(data.materials.begin(), data.materials.end());
+		segments.assign(data.segments.begin(), data.segments.end());
+		clusters.assign(data.clusters.begin(), data.clusters.end());
+		lods.assign(data.lods.begin(), data.lods.end());
+		indices.assign(data.indices.begin(), data.indices.end());
+
+		vertices.resize(data.vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			vertices[i].position  = data.vertices[i].position;
+			vertices[i].normal    = data.vertices[i].normal;
+			vertices[i].texcoord  = data.vertices[i].texcoord;
+			vertices[i].tangent   = data.tangentFrames[i].tangent;
+			vertices[i].bitangent = data.tangentFrames[i].bitangent;
+		}
+
+		return true;
+	}
+
 	if (actualMagic != magic)
 	{
-		Log::error("Model format identifier mismatch. Expected 0x%08x, got 0x%08x.", magic, actualMagic);
+		Log::error("Model format identifier mismatch. Expected 0x%08x or 0x%08x, got 0x%08x.", magic, magicV2, actualMagic);
 		return false;
 	}
 
@@ -36,18 +247,358 @@ bool Model::read(const char* filename)
 	return true;
 }
 
-void Model::write(const char* filename)
+void Model::optimize()
+{
+	if (indices.empty() || vertices.empty())
+	{
+		return;
+	}
+
+	for (const ModelSegment& segment : segments)
+	{
+		if (u64(segment.indexOffset) + segment.indexCount > indices.size())
+		{
+			Log::error("Model segment references indices past the end of the index buffer");
+			return;
+		}
+	}
+
+	// Levels of detail from an earlier pass are regenerated from the full detail indices
+	if (!lods.empty())
+	{
+		u32 segmentIndexCount = 0;
+		for (const ModelSegment& segment : segments)
+		{
+			segmentIndexCount = max(segmentIndexCount, segment.indexOffset + segment.indexCount);
+		}
+		indices.resize(segmentIndexCount);
+		lods.clear();
+	}
+
+	const VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size());
+
+	Timer timer;
+
+	std::vector<std::vector<MeshCluster>> segmentClusters(segments.size());
+	std::vector<std::vector<ModelLod>>    segmentLods(segments.size());
+	std::vector<std::vector<u32>>         segmentLodIndices(segments.size());
+	JobSystem::getDefault().parallelFor(u32(segments.size()), 1, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			u32*      segmentIndices = indices.data() + segments[i].indexOffset;
+			const u32 indexCount     = segments[i].indexCount;
+
+			optimizeVertexCache(segmentIndices, indexCount);
+			optimizeOverdraw(segmentIndices, indexCount, &vertices[0].position.x, sizeof(ModelVertex));
+			buildMeshClusters(segmentIndices, indexCount, &vertices[0].position.x, sizeof(ModelVertex),
+			    segments[i].indexOffset, segmentClusters[i]);
+
+			// Each level targets half the triangles of the previous one and simplifies that level
+			// further, so errors add up. Offsets are relative to this segment's level indices for now.
+			std::vector<u32> source(segmentIndices, segmentIndices + indexCount);
+			std::vector<u32> level;
+			float            error = 0.0f;
+			while (segmentLods[i].size() < ModelMaxLods && source.size() / 3 > ModelLodMinTriangles)
+			{
+				float levelError = 0.0f;
+				level.resize(source.size());
+				level.resize(simplifyMesh(level.data(), source.data(), source.size(), &vertices[0].position.x,
+				    sizeof(ModelVertex), source.size() / 6 * 3, FLT_MAX, &levelError));
+				if (level.size() > source.size() * 3 / 4)
+				{
+					break;
+				}
+
+				optimizeVertexCache(level.data(), level.size());
+				error += levelError;
+
+				std::vector<u32>& lodIndices = segmentLodIndices[i];
+				segmentLods[i].push_back({i, u32(lodIndices.size()), u32(level.size()), error});
+				lodIndices.insert(lodIndices.end(), level.begin(), level.end());
+				std::swap(source, level);
+			}
+		}
+	});
+
+	// Statistics only cover the full detail indices
+	const size_t fullIndexCount = indices.size();
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		for (ModelLod lod : segmentLods[i])
+		{
+			lod.indexOffset += u32(indices.size());
+			lods.push_back(lod);
+		}
+		indices.insert(indices.end(), segmentLodIndices[i].begin(), segmentLodIndices[i].end());
+	}
+
+	clusters.clear();
+	for (const std::vector<MeshCluster>& list : segmentClusters)
+	{
+		clusters.insert(clusters.end(), list.begin(), list.end());
+	}
+	std::sort(clusters.begin(), clusters.end(),
+	    [](const MeshCluster& a, const MeshCluster& b) { return a.indexOffset < b.indexOffset; });
+
+	optimizeVertexFetch(vertices.data(), vertices.size(), sizeof(ModelVertex), indices.data(), indices.size());
+
+	const VertexCacheStats after = analyzeVertexCache(indices.data(), fullIndexCount);
+
+	RUSH_LOG("Optimized %u triangles in %u segments, %u clusters and %u levels of detail in %.1f ms: ACMR %.3f -> %.3f, "
+	         "ATVR %.3f -> %.3f",
+	    u32(fullIndexCount / 3), u32(segments.size()), u32(clusters.size()), u32(lods.size()), timer.time() * 1000.0,
+	    before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+void Model::write(const char* filename, ModelEncoding encoding)
 {
+	ModelFileHeaderV2 header = {};
+	header.magic             = magicV2;
+	header.sectionCount      = ModelSection_Count;
+	header.flags             = encoding == ModelEncoding::Compressed ? ModelFileFlags_Compressed : 0;
+	header.vertexCount       = u32(vertices.size());
+	header.indexCount        = u32(indices.size());
+
+	if (!vertices.empty())
+	{
+		bounds.expandInit();
+		header.texcoordMin = vertices[0].texcoord;
+		header.texcoordMax = vertices[0].texcoord;
+		for (const ModelVertex& v : vertices)
+		{
+			bounds.expand(v.position);
+			header.texcoordMin = Vec2(min(header.texcoordMin.x, v.texcoord.x), min(header.texcoordMin.y, v.texcoord.y));
+			header.texcoordMax = Vec2(max(header.texcoordMax.x, v.texcoord.x), max(header.texcoordMax.y, v.texcoord.y));
+		}
+	}
+
+	header.boundsMin = bounds.m_min;
+	header.boundsMax = bounds.m_max;
+
+	std::vector<ModelRenderVertex> renderVertices;
+	std::vector<ModelTangentFrame> tangentFrames;
+	std::vector<u8>                compressedVertices;
+	std::vector<u8>                compressedIndices;
+	std::vector<MeshCluster>       fileClusters = clusters;
+
+	if (encoding == ModelEncoding::Compressed)
+	{
+		// Quantized positions move by up to half a step per axis, so cluster bounds grow to match
+		const float positionError = (bounds.m_max - bounds.m_min).length() / 65535.0f;
+		for (MeshCluster& cluster : fileClusters)
+		{
+			cluster.radius += positionError;
+		}
+
+		std::vector<u16> components;
+		quantizeVertices(vertices, header, components);
+		compressVertexComponents(components.data(), vertices.size(), ModelQuantizedComponentCount, compressedVertices);
+		compressIndices(indices.data(), indices.size(), compressedIndices);
+	}
+	else
+	{
+		renderVertices.resize(vertices.size());
+		tangentFrames.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			renderVertices[i] = {vertices[i].position, vertices[i].normal, vertices[i].texcoord};
+			tangentFrames[i]  = {vertices[i].tangent, vertices[i].bitangent};
+		}
+	}
+
+	const bool rawIndices = encoding == ModelEncoding::Raw;
+
+	const void* sectionData[ModelSection_Count] = {materials.data(), segments.data(), renderVertices.data(),
+	    tangentFrames.data(), indices.data(), compressedVertices.data(), compressedIndices.data(), fileClusters.data(),
+	    lods.data()};
+	const size_t sectionCounts[ModelSection_Count] = {materials.size(), segments.size(), renderVertices.size(),
+	    tangentFrames.size(), rawIndices ? indices.size() : 0, compressedVertices.size(), compressedIndices.size(),
+	    fileClusters.size(), lods.size()};
+
+	u64 offset = sizeof(header);
+	for (u32 i = 0; i < ModelSection_Count; ++i)
+	{
+		offset                    = alignCeiling(offset, ModelSectionAlignment);
+		header.sections[i].offset = offset;
+		header.sections[i].count  = sectionCounts[i];
+		header.sections[i].stride = modelSectionStrides[i];
+		offset += sectionCounts[i] * modelSectionStrides[i];
+	}
+
 	FileOut stream(filename);
 	if (!stream.valid())
 	{
 		Log::error("Failed to open file '%s' for writing", filename);
+		return;
+	}
+
+	static const u8 padding[ModelSectionAlignment] = {};
+
+	bool ok      = writeAll(stream, &header, sizeof(header));
+	u64  written = sizeof(header);
+	for (u32 i = 0; i < ModelSection_Count; ++i)
+	{
+		const u64 size = header.sections[i].count * header.sections[i].stride;
+		ok = ok && writeAll(stream, padding, header.sections[i].offset - written) && writeAll(stream, sectionData[i], size);
+		written = header.sections[i].offset + size;
+	}
+
+	if (!ok)
+	{
+		Log::error("Failed to write model '%s'", filename);
+	}
+}
+
+bool ModelData::open(const char* filename)
+{
+	*this = ModelData();
+
+	if (!m_file.open(filename))
+	{
+		Log::error("Failed to open file '%s' for reading", filename);
+		return false;
+	}
+
+	u32 actualMagic = 0;
+	if (m_file.size() >= sizeof(actualMagic))
+	{
+		memcpy(&actualMagic, m_file.data(), sizeof(actualMagic));
+	}
+
+	if (actualMagic != Model::magicV2)
+	{
+		// Version 1 interleaves all attributes, so it has to be read and split up front
+		m_file.close();
+
+		if (!m_legacyModel.read(filename))
+		{
+			return false;
+		}
+
+		const std::vector<ModelVertex>& src = m_legacyModel.vertices;
+		m_vertexStorage.resize(src.size());
+		m_tangentFrameStorage.resize(src.size());
+
+		bounds.expandInit();
+		for (size_t i = 0; i < src.size(); ++i)
+		{
+			m_vertexStorage[i]      = {src[i].position, src[i].normal, src[i].texcoord};
+			m_tangentFrameStorage[i] = {src[i].tangent, src[i].bitangent};
+			bounds.expand(src[i].position);
+		}
+		if (src.empty())
+		{
+			bounds = m_legacyModel.bounds;
+		}
+
+		materials     = m_legacyModel.materials;
+		segments      = m_legacyModel.segments;
+		vertices      = m_vertexStorage;
+		tangentFrames = m_tangentFrameStorage;
+		indices       = m_legacyModel.indices;
+
+		return true;
+	}
+
+	ModelFileHeaderV2 header;
+	if (m_file.size() < sizeof(header))
+	{
+		Log::error("Model '%s' is truncated", filename);
+		m_file.close();
+		return false;
+	}
+
+	memcpy(&header, m_file.data(), sizeof(header));
+	if (!validateSections(header, m_file.size(), filename))
+	{
+		m_file.close();
+		return false;
+	}
+
+	const u8* base = m_file.data();
+
+	bounds    = Box3(header.boundsMin, header.boundsMax);
+	materials = getSection<Model::OfflineMaterial>(base, header.sections[ModelSection_Materials]);
+	segments  = getSection<ModelSegment>(base, header.sections[ModelSection_Segments]);
+	clusters  = getSection<MeshCluster>(base, header.sections[ModelSection_Clusters]);
+	lods      = getSection<ModelLod>(base, header.sections[ModelSection_Lods]);
+
+	for (const ModelSegment& segment : segments)
+	{
+		if (u64(segment.indexOffset) + segment.indexCount > header.indexCount ||
+		    (segment.material != 0xFFFFFFFF && segment.material >= materials.size()))
+		{
+			Log::error("Model '%s' has a segment past the end of the index buffer or material table", filename);
+			*this = ModelData();
+			return false;
+		}
+	}
+
+	for (const MeshCluster& cluster : clusters)
+	{
+		if (u64(cluster.indexOffset) + cluster.indexCount > header.indexCount)
+		{
+			Log::error("Model '%s' has a cluster past the end of the index buffer", filename);
+			*this = ModelData();
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < lods.size(); ++i)
+	{
+		const ModelLod& lod = lods[i];
+		if (lod.segment >= segments.size() || (i && lod.segment < lods[i - 1].segment) ||
+		    u64(lod.indexOffset) + lod.indexCount > header.indexCount)
+		{
+			Log::error("Model '%s' has an invalid level of detail", filename);
+			*this = ModelData();
+			return false;
+		}
+	}
+
+	if (header.flags & ModelFileFlags_Compressed)
+	{
+		const ModelFileSection& vertexSection = header.sections[ModelSection_CompressedVertices];
+		const ModelFileSection& indexSection  = header.sections[ModelSection_CompressedIndices];
+
+		std::vector<u16> components(size_t(header.vertexCount) * ModelQuantizedComponentCount);
+		m_indexStorage.resize(header.indexCount);
+		if (!decompressVertexComponents(base + vertexSection.offset, size_t(vertexSection.count), components.data(),
+		        header.vertexCount, ModelQuantizedComponentCount) ||
+		    !decompressIndices(base + indexSection.offset, size_t(indexSection.count), m_indexStorage.data(),
+		        header.indexCount))
+		{
+			Log::error("Model '%s' has corrupt compressed data", filename);
+			*this = ModelData();
+			return false;
+		}
+
+		m_vertexStorage.resize(header.vertexCount);
+		m_tangentFrameStorage.resize(header.vertexCount);
+		dequantizeVertices(components, header, m_vertexStorage.data(), m_tangentFrameStorage.data());
+
+		vertices      = m_vertexStorage;
+		tangentFrames = m_tangentFrameStorage;
+		indices       = m_indexStorage;
+	}
+	else
+	{
+		vertices      = getSection<ModelRenderVertex>(base, header.sections[ModelSection_Vertices]);
+		tangentFrames = getSection<ModelTangentFrame>(base, header.sections[ModelSection_TangentFrames]);
+		indices       = getSection<u32>(base, header.sections[ModelSection_Indices]);
 	}
 
-	stream.writeT(magic);
-	stream.writeT(bounds);
-	writeContainer(stream, materials);
-	writeContainer(stream, segments);
-	writeContainer(stream, vertices);
-	writeContainer(stream, indices);
+	// Compressed indices can only be checked once decoded
+	for (u32 index : indices)
+	{
+		if (index >= header.vertexCount)
+		{
+			Log::error("Model '%s' has an index past the end of the vertex buffer", filename);
+			*this = ModelData();
+			return false;
+		}
+	}
+
+	return true;
 }
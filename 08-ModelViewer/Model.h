@@ -1,6 +1,11 @@
 #pragma once
 
 #include <Rush/MathTypes.h>
+
+#include <Common/MappedFile.h>
+#include <Common/MeshOptimizer.h>
+
+#include <span>
 #include <vector>
 
 struct ModelVertex
@@ -12,6 +17,21 @@ struct ModelVertex
 	Vec2 texcoord;
 };
 
+// Version 2 files split vertices into the attributes needed for rasterization, laid out the way
+// the viewer's vertex buffer expects them, and a separate stream of tangent frames.
+struct ModelRenderVertex
+{
+	Vec3 position;
+	Vec3 normal;
+	Vec2 texcoord;
+};
+
+struct ModelTangentFrame
+{
+	Vec3 tangent;
+	Vec3 bitangent;
+};
+
 struct ModelSegment
 {
 	u32 material    = 0;
@@ -19,6 +39,22 @@ struct ModelSegment
 	u32 indexCount  = 0;
 };
 
+// Simplified copy of a segment's triangles. Levels of a segment are stored coarser and coarser, and
+// their indices follow those of all segments in the index buffer.
+struct ModelLod
+{
+	u32   segment     = 0;
+	u32   indexOffset = 0;
+	u32   indexCount  = 0;
+	float error       = 0.0f; // approximate distance from the full detail surface, in model units
+};
+
+enum class ModelEncoding
+{
+	Raw,        // float attributes and 32-bit indices that can be mapped and uploaded directly
+	Compressed, // quantized attributes and delta-coded indices, entropy coded in chunks
+};
+
 struct Model
 {
 	struct OfflineMaterial
@@ -34,14 +70,52 @@ struct Model
 		Vec4 baseColor                    = Vec4(1.0f);
 	};
 
-	static const u32 magic;
+	static const u32 magic;   // version 1: header followed by length-prefixed arrays
+	static const u32 magicV2; // version 2: offset table followed by 16-byte aligned sections
 
-	Box3                         bounds = Box3(Vec3(0.0f), Vec3(0.0f));
-	std::vector<OfflineMaterial> materials;
-	std::vector<ModelSegment>    segments;
-	std::vector<ModelVertex>     vertices;
-	std::vector<u32>             indices;
+	Box3                           bounds = Box3(Vec3(0.0f), Vec3(0.0f));
+	std::vector<OfflineMaterial>   materials;
+	std::vector<ModelSegment>      segments;
+	std::vector<Rush::MeshCluster> clusters; // sorted by index offset, built by optimize()
+	std::vector<ModelLod>          lods;     // sorted by segment, built by optimize()
+	std::vector<ModelVertex>       vertices;
+	std::vector<u32>               indices;
 
+	// Reads either version into the arrays above.
 	bool read(const char* filename);
-	void write(const char* filename);
+
+	// Reorders each segment's triangles for post-transform vertex cache locality and overdraw,
+	// groups them into culling clusters and simplifies them into up to four levels of detail,
+	// then reorders vertices in order of first use. Logs ACMR and ATVR before and after.
+	void optimize();
+
+	// Writes version 2. Bounds are recomputed from the vertices.
+	// Compressed files store positions and texcoords as 16 bits relative to their bounds and
+	// directions as 16-bit octahedral coordinates, and are decoded on all cores when loaded.
+	void write(const char* filename, ModelEncoding encoding = ModelEncoding::Raw);
+};
+
+// Read-only model for rendering. Raw version 2 files are memory-mapped and the spans point
+// straight into the mapping, so vertices and indices can be handed to the GPU without a copy.
+// Compressed files are decoded once, and version 1 files are read with Model::read and converted.
+class ModelData
+{
+public:
+	bool open(const char* filename);
+
+	Box3                                    bounds = Box3(Vec3(0.0f), Vec3(0.0f));
+	std::span<const Model::OfflineMaterial> materials;
+	std::span<const ModelSegment>           segments;
+	std::span<const Rush::MeshCluster>      clusters;
+	std::span<const ModelLod>               lods;
+	std::span<const ModelRenderVertex>      vertices;
+	std::span<const ModelTangentFrame>      tangentFrames;
+	std::span<const u32>                    indices;
+
+private:
+	Rush::MappedFile               m_file;
+	Model                          m_legacyModel;
+	std::vector<ModelRenderVertex> m_vertexStorage;
+	std::vector<ModelTangentFrame> m_tangentFrameStorage;
+	std::vector<u32>               m_indexStorage;
 };
@@ -0,0 +1,2 @@
+#define QUANTIZED_VERTICES
+#include "ModelVS.hlsl"
@@ -1,5 +1,37 @@
 #include "Common.hlsl"
 
+// ModelQuantizedVS.hlsl defines QUANTIZED_VERTICES to read ExampleModelViewer::QuantizedVertex
+#ifdef QUANTIZED_VERTICES
+
+cbuffer SegmentConstants : register(b1, space0)
+{
+	float4 g_positionCenter;
+	float4 g_positionExtent;
+};
+
+struct VSInput
+{
+	float2 posXY : POSITION0; // snorm relative to the segment bounds
+	float2 posZ : POSITION1;
+	float2 nor : NORMAL0; // octahedral
+	float2 tex : TEXCOORD0;
+};
+
+float3 decodeOctahedral(float2 e)
+{
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	if (n.z < 0.0f)
+	{
+		n.xy = (1.0f - abs(n.yx)) * (step(0.0f, n.xy) * 2.0f - 1.0f);
+	}
+	return normalize(n);
+}
+
+float3 getPosition(VSInput input) { return g_positionCenter.xyz + float3(input.posXY, input.posZ.x) * g_positionExtent.xyz; }
+float3 getNormal(VSInput input) { return decodeOctahedral(input.nor); }
+
+#else
+
 struct VSInput
 {
 	float3 pos : POSITION;
@@ -7,6 +39,11 @@ struct VSInput
 	float2 tex : TEXCOORD0;
 };
 
+float3 getPosition(VSInput input) { return input.pos; }
+float3 getNormal(VSInput input) { return input.nor; }
+
+#endif
+
 struct VSOutput
 {
 	float4 pos : SV_Position;
@@ -17,9 +54,9 @@ struct VSOutput
 VSOutput main(VSInput input)
 {
 	VSOutput output;
-	float3 worldPos = mul(float4(input.pos, 1.0f), g_matWorld).xyz;
+	float3 worldPos = mul(float4(getPosition(input), 1.0f), g_matWorld).xyz;
 	output.pos = mul(float4(worldPos, 1.0f), g_matViewProj);
 	output.tex = input.tex;
-	output.nor = input.nor;
+	output.nor = getNormal(input);
 	return output;
 }
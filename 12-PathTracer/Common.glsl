@@ -12,14 +12,18 @@
 //  0 SceneConstants
 //  1 defaultSampler
 //  2 envmapTexture
-//  3 outputImage
-//  4 indexBuffer
-//  5 vertexBuffer
-//  6 envmapDistributionBuffer
-//  7 focusFeedbackBuffer
-//  8 TLAS (Vulkan)
+//  3 envmapPdfTexture
+//  4 outputImage
+//  5 indexBuffer
+//  6 vertexBuffer
+//  7 envmapDistributionBuffer
+//  8 focusFeedbackBuffer
+//  9 tileSampleBuffer
+// 10 tileErrorBuffer
+// 11 TLAS (Vulkan)
 // Metal argument buffers follow the same ordering; when Metal-only material buffers
-// are bound, they occupy slots 7/8, focusFeedback is 9, and TLAS shifts to 10.
+// are bound, they occupy slots 8/9, focusFeedback is 10, instance index offsets 11,
+// tile samples 12, tile errors 13, and TLAS shifts to 14.
 // Binding layout (set=1): texture array at binding 0.
 
 layout(set=0, binding=0)
@@ -54,10 +58,14 @@ uniform sampler defaultSampler;
 layout(set=0, binding=2)
 uniform texture2D envmapTexture;
 
-layout(set=0, binding=3, rgba32f)
+// solid-angle PDF of importance sampling each envmap texel
+layout(set=0, binding=3)
+uniform texture2D envmapPdfTexture;
+
+layout(set=0, binding=4, rgba32f)
 uniform image2D outputImage;
 
-layout(set=0, binding=4, std430)
+layout(set=0, binding=5, std430)
 buffer IndexBuffer
 {
 	uint indexBuffer[];
@@ -71,7 +79,7 @@ struct Vertex
 	float tangent[4];
 };
 
-layout(set=0, binding=5, std430)
+layout(set=0, binding=6, std430)
 buffer VertexBuffer
 {
 	Vertex vertexBuffer[];
@@ -83,14 +91,14 @@ struct EnvmapCell
 	uint i;
 };
 
-layout(set = 0, binding = 6, std430)
+layout(set = 0, binding = 7, std430)
 buffer EnvmapDistributionBuffer
 {
 	EnvmapCell envmapDistributionBuffer[];
 };
 
 // click-to-focus: cursor pixel writes its primary-hit depth here
-layout(set = 0, binding = 7, std430)
+layout(set = 0, binding = 8, std430)
 buffer FocusFeedbackBuffer
 {
 	float focusFeedback[];
@@ -101,7 +109,21 @@ vec3 getNormal(Vertex v) { return vec3(v.normal[0], v.normal[1], v.normal[2]); }
 vec2 getTexcoord(Vertex v) { return vec2(v.texcoord[0], v.texcoord[1]); }
 vec4 getTangent(Vertex v) { return vec4(v.tangent[0], v.tangent[1], v.tangent[2], v.tangent[3]); }
 
-layout(set=0, binding=8)
+// adaptive sampling: samples accumulated by each tile so far, or PT_ADAPTIVE_TILE_CONVERGED
+layout(set = 0, binding = 9, std430)
+buffer TileSampleBuffer
+{
+	uint tileSampleCount[];
+};
+
+// adaptive sampling: largest error estimate of each tile's pixels, as float bits for atomicMax
+layout(set = 0, binding = 10, std430)
+buffer TileErrorBuffer
+{
+	uint tileError[];
+};
+
+layout(set=0, binding=11)
 uniform accelerationStructureEXT TLAS;
 
 layout(set=1, binding = 0)
@@ -0,0 +1,15 @@
+// Copies the CPU path tracer output, uploaded as a row-major buffer, into the output image
+[[vk::image_format("rgba32f")]] RWTexture2D<float4> outputImage : register(u0, space0);
+RWStructuredBuffer<float4> inputPixels : register(u1, space0);
+
+[numthreads(8, 8, 1)]
+void main(uint3 dispatchThreadId : SV_DispatchThreadID)
+{
+	uint2 outputSize;
+	outputImage.GetDimensions(outputSize.x, outputSize.y);
+
+	if (dispatchThreadId.x < outputSize.x && dispatchThreadId.y < outputSize.y)
+	{
+		outputImage[dispatchThreadId.xy] = inputPixels[dispatchThreadId.y * outputSize.x + dispatchThreadId.x];
+	}
+}
@@ -0,0 +1,606 @@
+#include "CpuPathTracer.h"
+
+#include "CpuShaderMath.h"
+#include "PathTracerConstants.glsl"
+
+#include <Rush/UtilTimer.h>
+
+#include <Common/JobSystem.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// Shader-side declarations of the resources, matching Common.glsl
+namespace CpuShader
+{
+
+struct Vertex
+{
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	float tangent[4];
+};
+
+struct EnvmapCell
+{
+	float p;
+	uint  i;
+};
+
+struct MaterialConstants
+{
+	vec4  albedoFactor;
+	vec4  specularFactor;
+	uint  albedoTextureId;
+	uint  specularTextureId;
+	uint  normalTextureId;
+	uint  firstIndex;
+	uint  alphaMode;
+	float metallicFactor;
+	float roughnessFactor;
+	float reflectance;
+	uint  materialMode;
+};
+
+struct SceneConstants
+{
+	mat4 matView;
+	mat4 matProj;
+	mat4 matViewProj;
+	mat4 matViewProjInv;
+	mat4 matEnvmapTransform;
+	vec4 cameraPosition;
+
+	ivec2 outputSize;
+	uint  frameIndex;
+	uint  flags;
+
+	ivec2 envmapSize;
+	vec2  cameraSensorSize;
+
+	float focalLength;
+	float focusDistance;
+	float apertureSize;
+	uint  debugVisMode;
+
+	ivec2 focusPickPixel; // cursor pixel; x < 0 = no pick
+	float focalPlaneFalloffPx;
+};
+
+static_assert(sizeof(Vertex) == CpuPathTracer::VertexSize, "Vertex must match Common.glsl");
+static_assert(sizeof(MaterialConstants) == CpuPathTracer::MaterialSize, "MaterialConstants must match Common.glsl");
+static_assert(sizeof(SceneConstants) == CpuPathTracer::SceneConstantsSize, "SceneConstants must match Common.glsl");
+static_assert(sizeof(EnvmapCell) == sizeof(AliasTableCell), "Envmap distribution cells must be 8 bytes");
+static_assert(sizeof(vec4) == sizeof(Vec4), "Output texels are shared with the host");
+
+inline vec3 getPosition(const Vertex& v) { return vec3(v.position[0], v.position[1], v.position[2]); }
+inline vec3 getNormal(const Vertex& v) { return vec3(v.normal[0], v.normal[1], v.normal[2]); }
+inline vec2 getTexcoord(const Vertex& v) { return vec2(v.texcoord[0], v.texcoord[1]); }
+inline vec4 getTangent(const Vertex& v) { return vec4(v.tangent[0], v.tangent[1], v.tangent[2], v.tangent[3]); }
+
+#include "ShaderShared.glsl"
+#include "PathTracerContext.glsl"
+
+} // namespace CpuShader
+
+using namespace CpuShader;
+
+namespace
+{
+	constexpr u32 TileSize = PT_ADAPTIVE_TILE_SIZE;
+	constexpr u32 InstanceStackSize = BvhMaxDepth + 1;
+
+	struct SrgbTable
+	{
+		float values[256];
+
+		SrgbTable()
+		{
+			for (u32 i = 0; i < 256; ++i)
+			{
+				const float c = float(i) / 255.0f;
+				values[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+
+	const SrgbTable g_srgbTable;
+
+	Vec3 toVec3(vec3 v) { return Vec3(v.x, v.y, v.z); }
+
+	Vec3 transformPoint(const Mat4& m, const Vec3& p)
+	{
+		return Vec3(p.x * m.rows[0][0] + p.y * m.rows[1][0] + p.z * m.rows[2][0] + m.rows[3][0],
+		    p.x * m.rows[0][1] + p.y * m.rows[1][1] + p.z * m.rows[2][1] + m.rows[3][1],
+		    p.x * m.rows[0][2] + p.y * m.rows[1][2] + p.z * m.rows[2][2] + m.rows[3][2]);
+	}
+
+	Vec3 transformVector(const Mat4& m, const Vec3& v)
+	{
+		return Vec3(v.x * m.rows[0][0] + v.y * m.rows[1][0] + v.z * m.rows[2][0],
+		    v.x * m.rows[0][1] + v.y * m.rows[1][1] + v.z * m.rows[2][1],
+		    v.x * m.rows[0][2] + v.y * m.rows[1][2] + v.z * m.rows[2][2]);
+	}
+
+	struct TraceRay
+	{
+		Vec3  origin;
+		Vec3  direction;
+		Vec3  invDirection;
+		float minT;
+	};
+
+	TraceRay makeTraceRay(const Vec3& origin, const Vec3& direction, float minT)
+	{
+		TraceRay r;
+		r.origin       = origin;
+		r.direction    = direction;
+		r.invDirection = Vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		r.minT         = minT;
+		return r;
+	}
+
+	// Returns the entry distance, or a value above maxT when the box is missed
+	float intersectBox(const Vec3& boundsMin, const Vec3& boundsMax, const TraceRay& r, float maxT)
+	{
+		float tNear = r.minT;
+		float tFar  = maxT;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float t0 = (boundsMin[axis] - r.origin[axis]) * r.invDirection[axis];
+			float t1 = (boundsMax[axis] - r.origin[axis]) * r.invDirection[axis];
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+			}
+			tNear = t0 > tNear ? t0 : tNear; // NaN from 0 * inf leaves the range unchanged
+			tFar  = t1 < tFar ? t1 : tFar;
+		}
+		return tNear <= tFar ? tNear : FLT_MAX;
+	}
+
+	// Wraps a texel coordinate into [0, size). The float is reduced before converting, so huge
+	// coordinates can't overflow the integer; NaN and infinity (from degenerate uvs) map to 0.
+	u32 wrapCoord(float c, u32 size)
+	{
+		if (!std::isfinite(c))
+		{
+			return 0;
+		}
+
+		float wrapped = std::fmod(c, float(size));
+		if (wrapped < 0.0f)
+		{
+			wrapped += float(size);
+		}
+		return std::min(u32(wrapped), size - 1);
+	}
+
+	// Bilinear filtering with wrapping; fetch(x, y) returns a texel
+	template <typename T, typename Fetch> T sampleBilinear(u32 width, u32 height, vec2 uv, Fetch fetch)
+	{
+		const float x  = uv.x * float(width) - 0.5f;
+		const float y  = uv.y * float(height) - 0.5f;
+		const float fx = std::floor(x);
+		const float fy = std::floor(y);
+		const float wx = x - fx;
+		const float wy = y - fy;
+
+		const u32 x0 = wrapCoord(fx, width);
+		const u32 x1 = wrapCoord(fx + 1.0f, width);
+		const u32 y0 = wrapCoord(fy, height);
+		const u32 y1 = wrapCoord(fy + 1.0f, height);
+
+		return mix(mix(fetch(x0, y0), fetch(x1, y0), wx), mix(fetch(x0, y1), fetch(x1, y1), wx), wy);
+	}
+
+	vec4 sampleBilinear(const std::vector<Vec4>& texels, u32 width, u32 height, vec2 uv)
+	{
+		return sampleBilinear<vec4>(width, height, uv, [&](u32 x, u32 y)
+		{
+			const Vec4& t = texels[size_t(y) * width + x];
+			return vec4(t.x, t.y, t.z, t.w);
+		});
+	}
+}
+
+struct CpuPathTracer::Context
+{
+	CpuPathTracer*        tracer;
+	const SceneConstants* constants;
+
+	uint index(uint i) const { return tracer->m_scene.indices[i]; }
+
+	const Vertex& vertex(uint i) const { return static_cast<const Vertex*>(tracer->m_scene.vertices)[i]; }
+
+	// Same fallback as the Metal backend when the scene has no materials
+	MaterialConstants material(uint triangle) const
+	{
+		MaterialConstants material;
+		material.albedoFactor      = vec4(1.0f);
+		material.specularFactor    = vec4(1.0f);
+		material.albedoTextureId   = 0u;
+		material.specularTextureId = 0u;
+		material.normalTextureId   = 0u;
+		material.firstIndex        = 0u;
+		material.alphaMode         = 0u;
+		material.metallicFactor    = 1.0f;
+		material.roughnessFactor   = 1.0f;
+		material.reflectance       = 0.04f;
+		material.materialMode      = PT_MATERIAL_MODE_PBR_METALLIC_ROUGHNESS;
+
+		const uint materialIndex = triangle < tracer->m_materialIndices.size() ? tracer->m_materialIndices[triangle] : 0u;
+		if (materialIndex < tracer->m_scene.materialCount)
+		{
+			material = static_cast<const MaterialConstants*>(tracer->m_scene.materials)[materialIndex];
+		}
+		return material;
+	}
+
+	// Textures that haven't arrived yet read as white, like the default descriptor on the GPU.
+	// Sampling is bilinear from the top level, so minified textures alias where the GPU filters.
+	vec4 sampleTexture(uint id, vec2 uv) const
+	{
+		if (id >= tracer->m_textures.size() || tracer->m_textures[id].texels.empty())
+		{
+			return vec4(1.0f);
+		}
+
+		const Texture& texture = tracer->m_textures[id];
+		return sampleBilinear(texture.texels, texture.width, texture.height, uv);
+	}
+
+	vec4 sampleEnvmap(vec2 uv) const
+	{
+		if (tracer->m_envmapColor.empty())
+		{
+			return vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		return sampleBilinear(tracer->m_envmapColor, tracer->m_envmapWidth, tracer->m_envmapHeight, uv);
+	}
+
+	float sampleEnvmapPdf(vec2 uv) const
+	{
+		if (tracer->m_envmapPdf.empty())
+		{
+			return 0.0f;
+		}
+
+		const std::vector<float>& pdf = tracer->m_envmapPdf;
+		const u32                 w   = tracer->m_envmapWidth;
+		return sampleBilinear<float>(w, tracer->m_envmapHeight, uv, [&](u32 x, u32 y) { return pdf[size_t(y) * w + x]; });
+	}
+
+	EnvmapCell envmapCell(uint i) const
+	{
+		const AliasTableCell& cell = tracer->m_envmapCells[i];
+		EnvmapCell            result;
+		memcpy(&result, &cell, sizeof(result));
+		return result;
+	}
+
+	bool hasEnvmapDistribution() const { return !tracer->m_envmapCells.empty(); }
+
+	vec3 readOutput(ivec2 px) const
+	{
+		const Vec4& texel = tracer->m_output[size_t(px.y) * constants->outputSize.x + px.x];
+		return vec3(texel.x, texel.y, texel.z);
+	}
+
+	void writeOutput(ivec2 px, vec3 v) const
+	{
+		tracer->m_output[size_t(px.y) * constants->outputSize.x + px.x] = Vec4(v.x, v.y, v.z, 1.0f);
+	}
+
+	vec4 readOutput4(ivec2 px) const
+	{
+		const Vec4& texel = tracer->m_output[size_t(px.y) * constants->outputSize.x + px.x];
+		return vec4(texel.x, texel.y, texel.z, texel.w);
+	}
+
+	void writeOutput4(ivec2 px, vec4 v) const
+	{
+		tracer->m_output[size_t(px.y) * constants->outputSize.x + px.x] = Vec4(v.x, v.y, v.z, v.w);
+	}
+
+	void writeFocus(float depth) const { tracer->m_focusDepth = depth; }
+
+	uint tileSamples(uint tile) const { return tracer->m_tileSamples[tile]; }
+
+	// Work tiles are the adaptive sampling tiles, so only one thread writes each tile's error
+	void maxTileError(uint tile, float error) const
+	{
+		float& tileError = tracer->m_tileErrors[tile];
+		tileError        = std::max(tileError, error);
+	}
+
+	// Walks the instance BVH and the mesh BVHs of the instances it reaches. With anyHit, stops at
+	// the first intersection and leaves the hit unfilled.
+	bool trace(const PtRay& ray, bool anyHit, PtHit* hit, uint* triangle) const
+	{
+		const Bvh& top = tracer->m_instanceBvh;
+		if (top.nodes.empty())
+		{
+			return false;
+		}
+
+		const TraceRay worldRay = makeTraceRay(toVec3(ray.origin), toVec3(ray.direction), ray.minT);
+
+		float     closestT        = ray.maxT;
+		BvhRayHit closestHit;
+		u32       closestInstance = 0;
+		bool      found           = false;
+
+		u32 stack[InstanceStackSize];
+		u32 stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize != 0)
+		{
+			const BvhNode& node = top.nodes[stack[--stackSize]];
+			if (intersectBox(node.boundsMin, node.boundsMax, worldRay, closestT) > closestT)
+			{
+				continue;
+			}
+
+			if (node.count == 0)
+			{
+				stack[stackSize++] = node.first;
+				stack[stackSize++] = node.first + 1;
+				continue;
+			}
+
+			for (u32 i = node.first; i < node.first + node.count; ++i)
+			{
+				const u32           instanceIndex = top.primitives[i];
+				const InstanceData& instance      = tracer->m_instances[instanceIndex];
+
+				// The direction is not normalized, so distances stay in world units
+				const Vec3 meshOrigin    = transformPoint(instance.worldToMesh, worldRay.origin);
+				const Vec3 meshDirection = transformVector(instance.worldToMesh, worldRay.direction);
+
+				if (anyHit)
+				{
+					const bool occluded =
+					    tracer->m_meshBvhWidth == 8
+					        ? isWideBvhOccluded(tracer->m_meshBvhs8[instance.mesh], meshOrigin, meshDirection, worldRay.minT, closestT)
+					        : isWideBvhOccluded(tracer->m_meshBvhs4[instance.mesh], meshOrigin, meshDirection, worldRay.minT, closestT);
+					if (occluded)
+					{
+						return true;
+					}
+					continue;
+				}
+
+				BvhRayHit  meshHit;
+				const bool meshFound =
+				    tracer->m_meshBvhWidth == 8
+				        ? intersectWideBvh(tracer->m_meshBvhs8[instance.mesh], meshOrigin, meshDirection, worldRay.minT, closestT, meshHit)
+				        : intersectWideBvh(tracer->m_meshBvhs4[instance.mesh], meshOrigin, meshDirection, worldRay.minT, closestT, meshHit);
+				if (meshFound)
+				{
+					found           = true;
+					closestT        = meshHit.t;
+					closestHit      = meshHit;
+					closestInstance = instanceIndex;
+				}
+			}
+		}
+
+		if (!found)
+		{
+			return false;
+		}
+
+		// objectToWorld maps mesh-space directions like meshToWorld, normalToWorld is its inverse
+		// transpose; both as GLSL column-major matrices
+		const InstanceData& instance = tracer->m_instances[closestInstance];
+		const Mat4&         m        = instance.meshToWorld;
+		const Mat4&         w        = instance.worldToMesh;
+
+		hit->valid         = true;
+		hit->t             = closestT;
+		hit->primId        = closestHit.primitive;
+		hit->bary          = vec2(closestHit.u, closestHit.v);
+		hit->frontFacing   = closestHit.frontFacing;
+		hit->objectToWorld = mat3(vec3(m.rows[0][0], m.rows[0][1], m.rows[0][2]), vec3(m.rows[1][0], m.rows[1][1], m.rows[1][2]),
+		    vec3(m.rows[2][0], m.rows[2][1], m.rows[2][2]));
+		hit->normalToWorld = mat3(vec3(w.rows[0][0], w.rows[1][0], w.rows[2][0]), vec3(w.rows[0][1], w.rows[1][1], w.rows[2][1]),
+		    vec3(w.rows[0][2], w.rows[1][2], w.rows[2][2]));
+
+		*triangle = tracer->m_meshes[instance.mesh].indexOffset / 3 + closestHit.primitive;
+		return true;
+	}
+
+	bool traceClosest(const PtRay& ray, PtHit& hit, uint& triangle) const { return trace(ray, false, &hit, &triangle); }
+
+	bool traceAny(const PtRay& ray) const { return trace(ray, true, nullptr, nullptr); }
+};
+
+namespace CpuShader
+{
+
+using PathTracerContext = CpuPathTracer::Context;
+
+#include "PathTracerCore.glsl"
+
+} // namespace CpuShader
+
+void CpuPathTracer::setScene(const SceneDesc& desc)
+{
+	Timer timer;
+
+	m_scene = desc;
+	m_meshes.assign(desc.meshes, desc.meshes + desc.meshCount);
+	m_materialIndices.assign(desc.materialIndices, desc.materialIndices + (desc.materialIndices ? desc.indexCount / 3 : 0));
+
+	// Mesh BVHs are collapsed to the SIMD width of this CPU, from binary BVHs whose leaves fill one
+	// triangle pack. Vertex positions are at the start of the vertex structure.
+	m_meshBvhWidth = getPreferredWideBvhWidth();
+
+	BvhBuildSettings meshSettings;
+	meshSettings.maxLeafSize = m_meshBvhWidth;
+
+	m_meshBvhs4.clear();
+	m_meshBvhs8.clear();
+	m_meshBvhs4.resize(m_meshBvhWidth == 4 ? desc.meshCount : 0);
+	m_meshBvhs8.resize(m_meshBvhWidth == 8 ? desc.meshCount : 0);
+
+	std::vector<Box3> meshBounds(desc.meshCount);
+	JobSystem::getDefault().parallelFor(desc.meshCount, 1, [&](u32 begin, u32 end)
+	{
+		for (u32 meshIt = begin; meshIt < end; ++meshIt)
+		{
+			const Mesh&  mesh      = desc.meshes[meshIt];
+			const u32*   indices   = desc.indices + mesh.indexOffset;
+			const float* positions = static_cast<const float*>(desc.vertices);
+
+			Bvh bvh;
+			buildTriangleBvh(indices, mesh.indexCount, positions, VertexSize, bvh, meshSettings);
+
+			meshBounds[meshIt].expandInit();
+			if (!bvh.nodes.empty())
+			{
+				meshBounds[meshIt] = Box3(bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax);
+			}
+
+			if (m_meshBvhWidth == 8)
+			{
+				collapseBvh(bvh, indices, positions, VertexSize, m_meshBvhs8[meshIt]);
+			}
+			else
+			{
+				collapseBvh(bvh, indices, positions, VertexSize, m_meshBvhs4[meshIt]);
+			}
+		}
+	});
+
+	m_instances.resize(desc.instanceCount);
+	std::vector<Box3> instanceBounds(desc.instanceCount);
+	for (u32 i = 0; i < desc.instanceCount; ++i)
+	{
+		const Instance& instance = desc.instances[i];
+		m_instances[i].meshToWorld = instance.transform;
+		m_instances[i].worldToMesh = instance.transform.inverse();
+		m_instances[i].mesh        = instance.mesh;
+
+		// Meshes without triangles keep inverted bounds, and so do their instances
+		const Box3& bounds = meshBounds[instance.mesh];
+		instanceBounds[i].expandInit();
+		if (bounds.m_min.x > bounds.m_max.x)
+		{
+			continue;
+		}
+
+		for (u32 corner = 0; corner < 8; ++corner)
+		{
+			const Vec3 p((corner & 1) ? bounds.m_max.x : bounds.m_min.x, (corner & 2) ? bounds.m_max.y : bounds.m_min.y,
+			    (corner & 4) ? bounds.m_max.z : bounds.m_min.z);
+			instanceBounds[i].expand(transformPoint(instance.transform, p));
+		}
+	}
+
+	buildBvh(instanceBounds.data(), desc.instanceCount, m_instanceBvh);
+
+	size_t bvhSize = m_instanceBvh.nodes.size() * sizeof(BvhNode);
+	for (const Bvh4& bvh : m_meshBvhs4)
+	{
+		bvhSize += bvh.nodes.size() * sizeof(bvh.nodes[0]) + bvh.triangles.size() * sizeof(bvh.triangles[0]);
+	}
+	for (const Bvh8& bvh : m_meshBvhs8)
+	{
+		bvhSize += bvh.nodes.size() * sizeof(bvh.nodes[0]) + bvh.triangles.size() * sizeof(bvh.triangles[0]);
+	}
+
+	RUSH_LOG("CPU path tracer: built BVH%u for %u meshes and %u instances (%.1f MB) in %.1f ms", m_meshBvhWidth,
+	    desc.meshCount, desc.instanceCount, double(bvhSize) / (1024.0 * 1024.0), timer.time() * 1000.0);
+}
+
+void CpuPathTracer::setTexture(u32 id, u32 width, u32 height, const u8* rgba8, bool sRGB)
+{
+	if (id >= m_textures.size())
+	{
+		m_textures.resize(id + 1);
+	}
+
+	Texture& texture = m_textures[id];
+	texture.width    = width;
+	texture.height   = height;
+	texture.texels.resize(size_t(width) * height);
+
+	// Color textures are decoded like an sRGB view would on the GPU; alpha is always linear
+	for (size_t i = 0; i < texture.texels.size(); ++i)
+	{
+		const u8* p = rgba8 + i * 4;
+		if (sRGB)
+		{
+			texture.texels[i] = Vec4(g_srgbTable.values[p[0]], g_srgbTable.values[p[1]], g_srgbTable.values[p[2]], p[3] / 255.0f);
+		}
+		else
+		{
+			texture.texels[i] = Vec4(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f, p[3] / 255.0f);
+		}
+	}
+}
+
+void CpuPathTracer::setEnvmap(u32 width, u32 height, const float* rgba, const float* pdf, const AliasTableCell* cells)
+{
+	const size_t texelCount = size_t(width) * height;
+
+	m_envmapWidth  = width;
+	m_envmapHeight = height;
+	m_envmapColor.resize(texelCount);
+	memcpy(static_cast<void*>(m_envmapColor.data()), rgba, texelCount * sizeof(Vec4));
+	m_envmapPdf.assign(pdf, pdf + texelCount);
+	m_envmapCells.assign(cells, cells + texelCount);
+}
+
+double CpuPathTracer::render(const void* sceneConstants, const u32* tileSamples)
+{
+	Timer timer;
+
+	SceneConstants constants;
+	memcpy(&constants, sceneConstants, sizeof(constants));
+
+	const u32 width  = u32(std::max(constants.outputSize.x, 0));
+	const u32 height = u32(std::max(constants.outputSize.y, 0));
+	if (m_output.size() != size_t(width) * height)
+	{
+		m_output.assign(size_t(width) * height, Vec4(0.0f));
+	}
+	m_focusDepth = -1.0f;
+
+	const u32 tilesX = (width + TileSize - 1) / TileSize;
+	const u32 tilesY = (height + TileSize - 1) / TileSize;
+
+	RUSH_ASSERT(tileSamples || !(constants.flags & PT_FLAG_ADAPTIVE_SAMPLING));
+	m_tileSamples = tileSamples;
+	m_tileErrors.assign(size_t(tilesX) * tilesY, 0.0f);
+
+	Context ctx;
+	ctx.tracer    = this;
+	ctx.constants = &constants;
+
+	JobSystem::getDefault().parallelFor(tilesX * tilesY, 1, [&](u32 begin, u32 end)
+	{
+		for (u32 tile = begin; tile < end; ++tile)
+		{
+			const u32 x0 = (tile % tilesX) * TileSize;
+			const u32 y0 = (tile / tilesX) * TileSize;
+			const u32 x1 = std::min(x0 + TileSize, width);
+			const u32 y1 = std::min(y0 + TileSize, height);
+			for (u32 y = y0; y < y1; ++y)
+			{
+				for (u32 x = x0; x < x1; ++x)
+				{
+					ptRenderPixel(ctx, ivec2(int(x), int(y)));
+				}
+			}
+		}
+	});
+
+	return timer.time();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+
+#include <Common/WideBvh.h>
+#include <Common/EnvmapSampling.h>
+
+#include <vector>
+
+// CPU backend of the path tracer, for machines without ray tracing support and as a reference for
+// the GPU backends. It reads the same vertex, index, material and scene constant data the shaders
+// get, in the layouts declared in Common.glsl, and runs PathTracerCore.glsl compiled as C++, so the
+// accumulated images converge to the same result. Tiles are traced on all cores; every pixel has
+// its own random sequence, so the output doesn't depend on the number of threads.
+class CpuPathTracer
+{
+public:
+
+	// Sizes of the Common.glsl structures that the host arrays must match
+	static constexpr size_t VertexSize         = 48;
+	static constexpr size_t MaterialSize       = 68;
+	static constexpr size_t SceneConstantsSize = 396;
+
+	struct Mesh
+	{
+		u32 indexOffset = 0;
+		u32 indexCount  = 0;
+	};
+
+	struct Instance
+	{
+		Mat4 transform = Mat4::identity(); // mesh space to world space
+		u32  mesh      = 0;
+	};
+
+	// Vertex, index and material arrays are referenced and must stay alive while the tracer is used,
+	// the rest is copied by setScene()
+	struct SceneDesc
+	{
+		const void*     vertices        = nullptr;
+		u32             vertexCount     = 0;
+		const u32*      indices         = nullptr;
+		u32             indexCount      = 0;
+		const void*     materials       = nullptr;
+		u32             materialCount   = 0;
+		const u32*      materialIndices = nullptr; // one per triangle
+		const Mesh*     meshes          = nullptr;
+		u32             meshCount       = 0;
+		const Instance* instances       = nullptr;
+		u32             instanceCount   = 0;
+	};
+
+	void setScene(const SceneDesc& desc);
+
+	// Textures are referenced by material texture ids, like the GPU descriptor array
+	void setTexture(u32 id, u32 width, u32 height, const u8* rgba8, bool sRGB);
+
+	// Color is RGBA32_Float; pdf and cells are the envmap sampling data built by loadEnvmapData()
+	void setEnvmap(u32 width, u32 height, const float* rgba, const float* pdf, const AliasTableCell* cells);
+
+	// Traces one sample per pixel of SceneConstants.outputSize and accumulates it into the output
+	// like the GPU shader does, using SceneConstants.frameIndex. With PT_FLAG_ADAPTIVE_SAMPLING,
+	// tileSamples holds the sample count of every PT_ADAPTIVE_TILE_SIZE tile instead, as the tile
+	// sample buffer does on the GPU. Returns the time spent in seconds.
+	double render(const void* sceneConstants, const u32* tileSamples = nullptr);
+
+	const Vec4*  getOutput() const { return m_output.data(); }
+	float        getFocusDepth() const { return m_focusDepth; } // written for SceneConstants.focusPickPixel
+	const float* getTileErrors() const { return m_tileErrors.data(); } // 0 for tiles that weren't traced
+
+	struct Context; // shader-side view of the tracer, defined in CpuPathTracer.cpp
+
+private:
+
+	struct InstanceData
+	{
+		Mat4 worldToMesh;
+		Mat4 meshToWorld;
+		u32  mesh;
+	};
+
+	struct Texture
+	{
+		u32               width  = 0;
+		u32               height = 0;
+		std::vector<Vec4> texels; // linear, top level only
+	};
+
+	SceneDesc m_scene;
+
+	std::vector<Mesh>         m_meshes;
+	u32                       m_meshBvhWidth = 4; // selects m_meshBvhs4 or m_meshBvhs8
+	std::vector<Bvh4>         m_meshBvhs4; // primitives are triangle indices relative to the mesh
+	std::vector<Bvh8>         m_meshBvhs8;
+	Bvh                       m_instanceBvh;
+	std::vector<InstanceData> m_instances;
+	std::vector<u32>          m_materialIndices;
+
+	std::vector<Texture> m_textures;
+
+	u32                         m_envmapWidth  = 0;
+	u32                         m_envmapHeight = 0;
+	std::vector<Vec4>           m_envmapColor;
+	std::vector<float>          m_envmapPdf;
+	std::vector<AliasTableCell> m_envmapCells;
+
+	std::vector<Vec4>  m_output;
+	float              m_focusDepth = -1.0f;
+	const u32*         m_tileSamples = nullptr;
+	std::vector<float> m_tileErrors;
+};
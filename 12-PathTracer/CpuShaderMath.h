@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cmath>
+#include <type_traits>
+
+// GLSL vector and matrix types and the intrinsics the path tracer uses, so that ShaderShared.glsl,
+// PathTracerContext.glsl and PathTracerCore.glsl compile as C++ for the CPU backend. Only what the
+// shaders need is here: no swizzles besides vec4.xyz, and matrices are column-major like GLSL.
+namespace CpuShader
+{
+
+using uint = unsigned int;
+
+struct ivec2
+{
+	int x, y;
+
+	ivec2() = default;
+	ivec2(int x_, int y_) : x(x_), y(y_) {}
+};
+
+struct vec2
+{
+	float x, y;
+
+	vec2() = default;
+	explicit vec2(float v) : x(v), y(v) {}
+	explicit vec2(ivec2 v) : x(float(v.x)), y(float(v.y)) {}
+	vec2(float x_, float y_) : x(x_), y(y_) {}
+
+	float& operator[](int i) { return (&x)[i]; }
+	float  operator[](int i) const { return (&x)[i]; }
+};
+
+struct vec3
+{
+	float x, y, z;
+
+	vec3() = default;
+	explicit vec3(float v) : x(v), y(v), z(v) {}
+	vec3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+	vec3(vec2 v, float z_) : x(v.x), y(v.y), z(z_) {}
+
+	float& operator[](int i) { return (&x)[i]; }
+	float  operator[](int i) const { return (&x)[i]; }
+};
+
+struct vec4
+{
+	union
+	{
+		struct
+		{
+			float x, y, z, w;
+		};
+		vec3 xyz;
+	};
+
+	vec4() = default;
+	explicit vec4(float v) : x(v), y(v), z(v), w(v) {}
+	vec4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+	vec4(vec3 v, float w_) : x(v.x), y(v.y), z(v.z), w(w_) {}
+
+	float& operator[](int i) { return (&x)[i]; }
+	float  operator[](int i) const { return (&x)[i]; }
+};
+
+template <typename T>
+concept FloatVector = std::is_same_v<T, vec2> || std::is_same_v<T, vec3> || std::is_same_v<T, vec4>;
+
+template <FloatVector T> constexpr int componentCount = int(sizeof(T) / sizeof(float));
+
+// Component-wise arithmetic, with scalars on either side
+
+template <FloatVector T, typename Op> inline T map(T a, T b, Op op)
+{
+	for (int i = 0; i < componentCount<T>; ++i)
+	{
+		a[i] = op(a[i], b[i]);
+	}
+	return a;
+}
+
+template <FloatVector T> inline T operator+(T a, T b) { return map(a, b, [](float x, float y) { return x + y; }); }
+template <FloatVector T> inline T operator-(T a, T b) { return map(a, b, [](float x, float y) { return x - y; }); }
+template <FloatVector T> inline T operator*(T a, T b) { return map(a, b, [](float x, float y) { return x * y; }); }
+template <FloatVector T> inline T operator/(T a, T b) { return map(a, b, [](float x, float y) { return x / y; }); }
+template <FloatVector T> inline T operator+(T a, float s) { return a + T(s); }
+template <FloatVector T> inline T operator-(T a, float s) { return a - T(s); }
+template <FloatVector T> inline T operator*(T a, float s) { return a * T(s); }
+template <FloatVector T> inline T operator/(T a, float s) { return a / T(s); }
+template <FloatVector T> inline T operator+(float s, T a) { return T(s) + a; }
+template <FloatVector T> inline T operator-(float s, T a) { return T(s) - a; }
+template <FloatVector T> inline T operator*(float s, T a) { return T(s) * a; }
+template <FloatVector T> inline T operator/(float s, T a) { return T(s) / a; }
+template <FloatVector T> inline T operator-(T a) { return a * -1.0f; }
+
+template <FloatVector T, typename U> inline T& operator+=(T& a, U b) { return a = a + b; }
+template <FloatVector T, typename U> inline T& operator-=(T& a, U b) { return a = a - b; }
+template <FloatVector T, typename U> inline T& operator*=(T& a, U b) { return a = a * b; }
+template <FloatVector T, typename U> inline T& operator/=(T& a, U b) { return a = a / b; }
+
+template <FloatVector T> inline float dot(T a, T b)
+{
+	float r = 0.0f;
+	for (int i = 0; i < componentCount<T>; ++i)
+	{
+		r += a[i] * b[i];
+	}
+	return r;
+}
+
+template <FloatVector T> inline T abs(T a) { return map(a, a, [](float x, float) { return std::fabs(x); }); }
+template <FloatVector T> inline T floor(T a) { return map(a, a, [](float x, float) { return std::floor(x); }); }
+template <FloatVector T> inline float length(T a) { return std::sqrt(dot(a, a)); }
+template <FloatVector T> inline T normalize(T a) { return a / length(a); }
+template <FloatVector T> inline T mix(T a, T b, float t) { return a + (b - a) * t; }
+
+inline float abs(float x) { return std::fabs(x); }
+inline float floor(float x) { return std::floor(x); }
+inline float fract(float x) { return x - std::floor(x); }
+inline float sqrt(float x) { return std::sqrt(x); }
+inline float inversesqrt(float x) { return 1.0f / std::sqrt(x); }
+inline float sin(float x) { return std::sin(x); }
+inline float cos(float x) { return std::cos(x); }
+inline float acos(float x) { return std::acos(x); }
+inline float atan2(float y, float x) { return std::atan2(y, x); }
+inline float min(float a, float b) { return a < b ? a : b; }
+inline float max(float a, float b) { return a > b ? a : b; }
+inline float clamp(float x, float lo, float hi) { return min(max(x, lo), hi); }
+inline float saturate(float x) { return clamp(x, 0.0f, 1.0f); }
+inline float mix(float a, float b, float t) { return a + (b - a) * t; }
+
+inline float smoothstep(float edge0, float edge1, float x)
+{
+	float t = clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+	return t * t * (3.0f - 2.0f * t);
+}
+
+inline vec3 cross(vec3 a, vec3 b)
+{
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline vec3 reflect(vec3 i, vec3 n)
+{
+	return i - n * (2.0f * dot(n, i));
+}
+
+// Column-major; m * v treats v as a column and v * m as a row, like GLSL
+struct mat3
+{
+	vec3 columns[3];
+
+	mat3() = default;
+	mat3(vec3 c0, vec3 c1, vec3 c2) : columns{c0, c1, c2} {}
+
+	vec3&       operator[](int i) { return columns[i]; }
+	const vec3& operator[](int i) const { return columns[i]; }
+};
+
+struct mat4
+{
+	vec4 columns[4];
+
+	vec4&       operator[](int i) { return columns[i]; }
+	const vec4& operator[](int i) const { return columns[i]; }
+};
+
+inline vec3 operator*(const mat3& m, vec3 v)
+{
+	return m[0] * v.x + m[1] * v.y + m[2] * v.z;
+}
+
+inline vec3 operator*(vec3 v, const mat3& m)
+{
+	return vec3(dot(v, m[0]), dot(v, m[1]), dot(v, m[2]));
+}
+
+inline mat3 transpose(const mat3& m)
+{
+	return mat3(vec3(m[0].x, m[1].x, m[2].x), vec3(m[0].y, m[1].y, m[2].y), vec3(m[0].z, m[1].z, m[2].z));
+}
+
+} // namespace CpuShader
@@ -1,4 +1,5 @@
 #include "ExamplePathTracer.h"
+#include "CpuPathTracer.h"
 
 #include <Rush/GfxBitmapFont.h>
 #include <Rush/GfxPrimitiveBatch.h>
@@ -13,18 +14,22 @@
 #include <Rush/UtilHash.h>
 #include <Rush/UtilLog.h>
 
-#include <stb_image.h>
-#include <stb_image_resize.h>
 #include <tiny_obj_loader.h>
 #include <cgltf.h>
 #include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <stdio.h>
 #include <utility>
 
 #include <Common/ImGuiImpl.h>
+#include <Common/BlockCompression.h>
+#include <Common/EnvmapCache.h>
 #include <Common/ImGuiExt.h>
+#include <Common/MeshOptimizer.h>
 #include <Common/Reflect.h>
 #include <Common/Utils.h>
 #include <imgui.h>
@@ -78,17 +83,72 @@ ExamplePathTracer::ExamplePathTracer() : ExampleApp(), m_boundingBox(Vec3(0.0f),
 	const GfxCapability& caps = Gfx_GetCapability();
 	const bool rtAvailable = caps.rayTracingPipeline;
 
+	// Desktop GPUs all sample BCn; mobile GPUs generally do not, so they keep RGBA8
+	m_useTextureCompression = isDesktop();
+
+	u32 cpuTracer = rtAvailable ? 0 : 1;
+	getArgU32(g_appCfg.argc, g_appCfg.argv, "cpu-tracer", nullptr, cpuTracer);
+	const bool useCpuTracer = cpuTracer != 0;
+	if (useCpuTracer)
+	{
+		// The CPU backend samples RGBA8 textures and an RGBA32F envmap
+		m_cpuPathTracer = std::make_unique<CpuPathTracer>();
+		m_useTextureCompression = false;
+		RUSH_LOG("Using the CPU path tracer on %u threads", JobSystem::getDefault().getWorkerCount() + 1);
+	}
+
+	u32 textureStreaming = 1;
+	getArgU32(g_appCfg.argc, g_appCfg.argv, "texture-streaming", nullptr, textureStreaming);
+	m_textureStreaming = textureStreaming != 0;
+
+	u32 textureBudgetMB = 0;
+	if (getArgU32(g_appCfg.argc, g_appCfg.argv, "texture-budget", nullptr, textureBudgetMB))
+	{
+		m_textureBudgetBytes = u64(textureBudgetMB) << 20;
+	}
+
+	u32 sceneCache = 1;
+	getArgU32(g_appCfg.argc, g_appCfg.argv, "scene-cache", nullptr, sceneCache);
+	m_useSceneCache = sceneCache != 0;
+
+	std::string envmapFormat;
+	if (getArgString(g_appCfg.argc, g_appCfg.argv, "envmap-format", nullptr, envmapFormat))
+	{
+		if (envmapFormat == "rgba32f")
+		{
+			m_envmapFormat = GfxFormat_RGBA32_Float;
+		}
+		else if (envmapFormat != "rgba16f")
+		{
+			RUSH_LOG_ERROR("Unknown envmap format '%s', expected 'rgba16f' or 'rgba32f'", envmapFormat.c_str());
+		}
+	}
+	if (useCpuTracer)
+	{
+		m_envmapFormat = GfxFormat_RGBA32_Float;
+	}
+
+	// Turns adaptive sampling on and quits once every tile's error is below the target
+	if (getArgFloat(g_appCfg.argc, g_appCfg.argv, "target-error", nullptr, m_exitTargetError))
+	{
+		m_exitTargetError = max(m_exitTargetError, 0.0f);
+	}
+
 	const u32      whiteTexturePixels[4] = {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF};
 	GfxTextureDesc textureDesc           = GfxTextureDesc::make2D(2, 2);
 
 	m_defaultWhiteTextureId = u32(m_textureDescriptors.size());
 	m_textureDescriptors.push_back(Gfx_CreateTexture(textureDesc, whiteTexturePixels));
+	if (m_cpuPathTracer)
+	{
+		m_cpuPathTracer->setTexture(m_defaultWhiteTextureId, 2, 2, reinterpret_cast<const u8*>(whiteTexturePixels), false);
+	}
 
 	GfxDescriptorSetDesc materialDescriptorSetDesc;
 	materialDescriptorSetDesc.flags = GfxDescriptorSetFlags::TextureArray;
 	materialDescriptorSetDesc.stageFlags = GfxStageFlags::RayTracing;
 	materialDescriptorSetDesc.textures = MaxTextures;
-	if (rtAvailable)
+	if (rtAvailable && !useCpuTracer)
 	{
 		m_materialDescriptorSet = Gfx_CreateDescriptorSet(materialDescriptorSetDesc);
 		if (!m_materialDescriptorSet.valid())
@@ -96,7 +156,7 @@ ExamplePathTracer::ExamplePathTracer() : ExampleApp(), m_boundingBox(Vec3(0.0f),
 			setError("Failed to create material descriptors.");
 		}
 	}
-	else
+	else if (!useCpuTracer)
 	{
 		setError("Ray tracing is not supported.");
 	}
@@ -111,18 +171,10 @@ ExamplePathTracer::ExamplePathTracer() : ExampleApp(), m_boundingBox(Vec3(0.0f),
 		m_tonemapConstantBuffer = Gfx_CreateBuffer(cbDesc);
 	}
 
-	{
-		// click-to-focus feedback (shader writes the depth, CPU reads it back)
-		GfxBufferDesc bd;
-		bd.flags       = GfxBufferFlags::Storage;
-		bd.hostVisible = true;
-		bd.stride      = sizeof(float);
-		bd.count       = 1;
-		bd.debugName   = "FocusFeedback";
-		m_focusFeedbackBuffer = Gfx_CreateBuffer(bd);
-	}
+	// click-to-focus feedback (shader writes the depth, CPU reads it back a few frames later)
+	m_focusReadback.create(sizeof(float), 1, "FocusFeedback");
 	
-	if (rtAvailable && m_startupError.empty())
+	if (rtAvailable && !useCpuTracer && m_startupError.empty())
 	{
 		GfxRayTracingPipelineDesc pipelineDesc;
 #if RUSH_RENDER_API == RUSH_RENDER_API_MTL
@@ -145,14 +197,15 @@ ExamplePathTracer::ExamplePathTracer() : ExampleApp(), m_boundingBox(Vec3(0.0f),
 
 		pipelineDesc.bindings.descriptorSets[0].constantBuffers = 1; // scene constants
 		pipelineDesc.bindings.descriptorSets[0].samplers = 1; // default sampler
-		pipelineDesc.bindings.descriptorSets[0].textures = 1; // envmap
+		pipelineDesc.bindings.descriptorSets[0].textures = 2; // envmap + envmap PDF
 		pipelineDesc.bindings.descriptorSets[0].rwImages = 1; // output image
 #if RUSH_RENDER_API == RUSH_RENDER_API_MTL
 	// Metal argument buffer layout is sequential; extra material buffers shift later bindings.
-	// set=0 bindings: 0 cb,1 sampler,2 envmap,3 output,4 ib,5 vb,6 envmap dist,7 material,8 material index,9 focus feedback,10 TLAS.
-	pipelineDesc.bindings.descriptorSets[0].rwBuffers = 6; // IB + VB + envmap distribution + materials + material indices + focus feedback
+	// set=0 bindings: 0 cb,1 sampler,2 envmap,3 envmap pdf,4 output,5 ib,6 vb,7 envmap dist,8 material,9 material index,10 focus feedback,
+	// 11 instance index offsets,12 tile samples,13 tile errors,14 TLAS.
+	pipelineDesc.bindings.descriptorSets[0].rwBuffers = 9; // IB + VB + envmap distribution + materials + material indices + focus feedback + instance index offsets + tile samples + tile errors
 #else
-	pipelineDesc.bindings.descriptorSets[0].rwBuffers = 4; // IB + VB + envmap distribution + focus feedback
+	pipelineDesc.bindings.descriptorSets[0].rwBuffers = 6; // IB + VB + envmap distribution + focus feedback + tile samples + tile errors
 #endif
 		pipelineDesc.bindings.descriptorSets[0].accelerationStructures = 1; // TLAS
 		pipelineDesc.bindings.descriptorSets[1] = materialDescriptorSetDesc;
@@ -200,6 +253,23 @@ ExamplePathTracer::ExamplePathTracer() : ExampleApp(), m_boundingBox(Vec3(0.0f),
 		}
 	}
 
+	if (m_cpuPathTracer && m_startupError.empty())
+	{
+		m_copyOutputShader = Gfx_CreateComputeShader(loadShaderFromFile(RUSH_SHADER_NAME("CopyOutput.hlsl")));
+
+		GfxComputePipelineDesc pipelineDesc;
+		pipelineDesc.cs = m_copyOutputShader.get();
+		pipelineDesc.bindings.descriptorSets[0].rwImages  = 1; // output image
+		pipelineDesc.bindings.descriptorSets[0].rwBuffers = 1; // CPU output pixels
+		pipelineDesc.workGroupSize = {8, 8, 1};
+		m_copyOutputPipeline = Gfx_CreateComputePipeline(pipelineDesc);
+
+		if (!m_copyOutputPipeline.valid())
+		{
+			setError("Failed to create output copy pipeline.");
+		}
+	}
+
 	const char* modelFilename = nullptr;
 	if (getPositionalArg(g_appCfg.argc, g_appCfg.argv, 0, modelFilename))
 	{
@@ -299,10 +369,7 @@ ExamplePathTracer::~ExamplePathTracer()
 {
 	ImGuiImpl_Shutdown();
 
-	for (const auto& it : m_textures)
-	{
-		delete it.second;
-	}
+	JobSystem::getDefault().wait(m_textureLoadCounter);
 
 	m_windowEvents.setOwner(nullptr);
 
@@ -370,7 +437,12 @@ void ExamplePathTracer::onUpdate()
 	TimingScope timingScope(m_stats.cpuTotal);
 
 	m_stats.gpuTotal.add(Gfx_Stats().lastFrameGpuTime);
-	m_totalGpuRenderTime += Gfx_Stats().lastFrameGpuTime;
+
+	// The CPU backend adds its own trace time; its GPU time is only the output copy
+	if (!m_cpuPathTracer)
+	{
+		m_totalGpuRenderTime += Gfx_Stats().lastFrameGpuTime;
+	}
 
 	Gfx_ResetStats();
 
@@ -434,6 +506,12 @@ void ExamplePathTracer::onUpdate()
 			renderSettingsChanged |= ImGuiExt::SliderFloat("Focus assist falloff (px)", &m_settings.m_focusAssistFalloffPx, 0.5f, 64.0f, ImGuiExt::LabelMode::Above, "%.1f", ImGuiSliderFlags_Logarithmic);
 		}
 		renderSettingsChanged |= ImGuiExt::SliderFloat("Envmap rotation (deg)", &m_settings.m_envmapRotationDegrees, 0.0f, 360.0f);
+		renderSettingsChanged |= ImGui::Checkbox("Adaptive sampling", &m_settings.m_adaptiveSampling);
+		if (m_settings.m_adaptiveSampling)
+		{
+			// Converged tiles are re-checked against the target every frame, so no reset is needed
+			ImGuiExt::SliderFloat("Target error", &m_settings.m_adaptiveTargetError, 0.001f, 0.5f, ImGuiExt::LabelMode::Above, "%.3f", ImGuiSliderFlags_Logarithmic);
+		}
 		ImGuiExt::SliderFloat("Exposure EV100", &m_settings.m_exposureEV100, -10.0f, 10.0f);
 		ImGuiExt::SliderFloat("Gamma", &m_settings.m_gamma, 0.25f, 3.0f);
 		Vec3 camPos = m_camera.getPosition();
@@ -598,6 +676,27 @@ void ExamplePathTracer::onUpdate()
 		m_frameIndex = 0;
 	}
 
+	// Upgraded textures are used straight away, but accumulation restarts at most once per
+	// TextureStreamingResetInterval and once more when streaming settles, so the image keeps
+	// converging while textures arrive
+	if (updateTextureStreaming())
+	{
+		updateTextureDescriptors();
+		m_textureResetPending = true;
+	}
+	if (m_textureResetPending)
+	{
+		const bool   settled = m_streamingTextures.empty() && m_loadedTextures.empty() && m_textureLoadCounter.done();
+		const double now     = m_textureResetTimer.time();
+		if (settled || now - m_lastTextureResetTime >= TextureStreamingResetInterval)
+		{
+			m_textureResetPending = false;
+			m_lastTextureResetTime = now;
+			m_frameIndex = 0;
+			m_totalGpuRenderTime = 0;
+		}
+	}
+
 	m_windowEvents.clear();
 
 	render();
@@ -610,7 +709,7 @@ void ExamplePathTracer::createRayTracingScene(GfxContext* ctx)
 {
 	GfxAccelerationStructureDesc tlasDesc;
 	tlasDesc.type = GfxAccelerationStructureType::TopLevel;
-	tlasDesc.instanceCount = 1;
+	tlasDesc.instanceCount = u32(m_instances.size());
 	m_tlas = Gfx_CreateAccelerationStructure(tlasDesc);
 
 	if (!m_rtInstanceBuffer.valid())
@@ -619,23 +718,154 @@ void ExamplePathTracer::createRayTracingScene(GfxContext* ctx)
 		    tlasDesc.instanceCount, (u32)sizeof(GfxRayTracingInstanceDesc));
 	}
 	{
-		Mat4 transform = m_worldTransform.transposed();
 		auto instanceData = Gfx_BeginUpdateBuffer<GfxRayTracingInstanceDesc>(ctx, m_rtInstanceBuffer.get(), tlasDesc.instanceCount);
-		instanceData[0].init();
-		memcpy(instanceData[0].transform, &transform, sizeof(float) * 12);
-		instanceData[0].accelerationStructureHandle = Gfx_GetAccelerationStructureHandle(m_blas);
+		for (u32 i = 0; i < tlasDesc.instanceCount; ++i)
+		{
+			const MeshInstance& instance = m_instances[i];
+			const SceneMesh&    mesh     = m_meshes[instance.mesh];
+
+			Mat4 transform = (instance.transform * m_worldTransform).transposed();
+			instanceData[i].init();
+			memcpy(instanceData[i].transform, &transform, sizeof(float) * 12);
+			instanceData[i].instanceID = i;
+			instanceData[i].instanceContributionToHitGroupIndex = mesh.segmentOffset;
+			instanceData[i].accelerationStructureHandle = Gfx_GetAccelerationStructureHandle(m_blases[instance.mesh]);
+		}
 		Gfx_EndUpdateBuffer(ctx, m_rtInstanceBuffer);
 	}
 
-	Gfx_BuildAccelerationStructure(ctx, m_blas);
+	for (const auto& blas : m_blases)
+	{
+		Gfx_BuildAccelerationStructure(ctx, blas);
+	}
 	Gfx_AddFullPipelineBarrier(ctx);
 
 	Gfx_BuildAccelerationStructure(ctx, m_tlas, m_rtInstanceBuffer);
 	Gfx_AddFullPipelineBarrier(ctx);
 }
 
+bool ExamplePathTracer::updateAdaptiveSampling(Tuple2i outputSize)
+{
+	const Tuple2i gridSize = {int(divUp(u32(outputSize.x), PT_ADAPTIVE_TILE_SIZE)), int(divUp(u32(outputSize.y), PT_ADAPTIVE_TILE_SIZE))};
+	const u32     tileCount = max(1u, u32(gridSize.x * gridSize.y));
+
+	if (gridSize != m_adaptiveGridSize || m_adaptiveTiles.size() != tileCount)
+	{
+		m_adaptiveGridSize = gridSize;
+		m_adaptiveTiles.assign(tileCount, AdaptiveTile());
+		m_adaptiveTileSamples.assign(tileCount, 0);
+		for (int y = 0; y < gridSize.y; ++y)
+		{
+			for (int x = 0; x < gridSize.x; ++x)
+			{
+				const u32 w = min(PT_ADAPTIVE_TILE_SIZE, u32(outputSize.x) - x * PT_ADAPTIVE_TILE_SIZE);
+				const u32 h = min(PT_ADAPTIVE_TILE_SIZE, u32(outputSize.y) - y * PT_ADAPTIVE_TILE_SIZE);
+				m_adaptiveTiles[y * gridSize.x + x].pixelCount = w * h;
+			}
+		}
+
+		if (!m_cpuPathTracer)
+		{
+			m_tileSampleBuffer = Gfx_CreateBuffer(GfxBufferFlags::Transient | GfxBufferFlags::Storage, tileCount, u32(sizeof(u32)));
+			m_tileErrorReadback.create(sizeof(u32), tileCount, "TileError");
+		}
+
+		m_frameIndex = 0;
+	}
+
+	const bool debugShading = m_settings.m_debugSimpleShading || m_settings.m_debugDisableAccumulation
+	                       || m_settings.m_debugHitMask || m_settings.m_debugVisMode != 0;
+	m_adaptiveActive = (m_settings.m_adaptiveSampling || m_exitTargetError > 0.0f) && !debugShading;
+
+	if (m_frameIndex == 0 || !m_adaptiveActive)
+	{
+		for (AdaptiveTile& tile : m_adaptiveTiles)
+		{
+			tile.sampleCount = 0;
+			tile.error       = -1.0f;
+		}
+		m_adaptiveEpoch++;
+		m_adaptivePixelSamples = 0;
+		m_adaptiveConverged    = false;
+	}
+
+	if (!m_adaptiveActive)
+	{
+		return false;
+	}
+
+	// Converged tiles are tested again every frame, so a lower target brings them back. On the GPU
+	// the errors are a few frames old, which only costs a few extra samples per tile.
+	const float targetError = m_exitTargetError > 0.0f ? m_exitTargetError : m_settings.m_adaptiveTargetError;
+	u32         activeCount = 0;
+	for (size_t i = 0; i < m_adaptiveTiles.size(); ++i)
+	{
+		AdaptiveTile& tile   = m_adaptiveTiles[i];
+		const bool    active = tile.sampleCount < PT_ADAPTIVE_MIN_SAMPLES || tile.error < 0.0f || tile.error > targetError;
+		if (active)
+		{
+			m_adaptiveTileSamples[i] = tile.sampleCount++;
+			m_adaptivePixelSamples += tile.pixelCount;
+			activeCount++;
+		}
+		else
+		{
+			m_adaptiveTileSamples[i] = PT_ADAPTIVE_TILE_CONVERGED;
+		}
+	}
+	m_adaptiveConverged = activeCount == 0;
+
+	return true;
+}
+
+void ExamplePathTracer::applyTileErrors(const float* errors)
+{
+	for (size_t i = 0; i < m_adaptiveTiles.size(); ++i)
+	{
+		if (errors[i] > 0.0f) // 0 = skipped this frame, keeps the last measurement
+		{
+			m_adaptiveTiles[i].error = errors[i];
+		}
+	}
+}
+
+double ExamplePathTracer::getSamplesPerPixel() const
+{
+	if (!m_adaptiveActive)
+	{
+		return double(m_frameIndex);
+	}
+
+	u64 pixelCount = 0;
+	for (const AdaptiveTile& tile : m_adaptiveTiles)
+	{
+		pixelCount += tile.pixelCount;
+	}
+	return pixelCount ? double(m_adaptivePixelSamples) / double(pixelCount) : 0.0;
+}
+
 void ExamplePathTracer::render()
 {
+	// Picks requested SlotCount frames ago, by now finished on the GPU
+	m_focusReadback.beginFrame([&](const void* data, size_t size, u64)
+	{
+		const float depth = size >= sizeof(float) ? *static_cast<const float*>(data) : 0.0f;
+		if (depth > 0.0f) // <= 0 = background
+		{
+			m_settings.m_focusDistance = depth;
+			m_frameIndex = 0;
+		}
+	});
+
+	m_tileErrorReadback.beginFrame([&](void* data, size_t size, u64 epoch)
+	{
+		if (epoch == m_adaptiveEpoch && size >= m_adaptiveTiles.size() * sizeof(float))
+		{
+			applyTileErrors(static_cast<const float*>(data));
+		}
+		memset(data, 0, size); // shaders atomicMax into the slot when it comes round again
+	});
+
 	Mat4 matView = m_camera.buildViewMatrix();
 	Mat4 matProj = m_camera.buildProjMatrix();
 
@@ -670,6 +900,12 @@ void ExamplePathTracer::render()
 
 		m_outputImage = Gfx_CreateTexture(outputImageDesc);
 		m_frameIndex = 0;
+
+		if (m_cpuPathTracer)
+		{
+			m_cpuOutputBuffer = Gfx_CreateBuffer(GfxBufferFlags::Transient | GfxBufferFlags::Storage,
+			    u32(framebufferSize.x * framebufferSize.y), u32(sizeof(Vec4)));
+		}
 	}
 
 	constants.outputSize = outputImageDesc.getSize2D();
@@ -684,10 +920,50 @@ void ExamplePathTracer::render()
 
 	GfxMarkerScope markerFrame(ctx, "Frame");
 
+	const bool rtReady = m_rtPipeline.valid() && m_materialDescriptorSet.valid();
+	const bool tracing = m_valid && (m_cpuPathTracer || rtReady);
+	const bool adaptive = tracing && updateAdaptiveSampling(constants.outputSize);
+	constants.flags |= adaptive ? PT_FLAG_ADAPTIVE_SAMPLING : 0;
+
 	Gfx_UpdateBuffer(ctx, m_sceneConstantBuffer, &constants, sizeof(constants));
 
-	const bool rtReady = m_rtPipeline.valid() && m_materialDescriptorSet.valid();
-	if (m_valid && rtReady)
+	if (m_valid && m_cpuPathTracer)
+	{
+		const double traceTime = m_cpuPathTracer->render(&constants, m_adaptiveTileSamples.data());
+		m_stats.cpuTrace.add(traceTime);
+		m_totalGpuRenderTime += traceTime;
+
+		if (adaptive)
+		{
+			applyTileErrors(m_cpuPathTracer->getTileErrors());
+		}
+
+		// The output image is only recreated on resize; each frame's pixels go through a
+		// transient buffer and a copy dispatch
+		{
+			const u32 pixelCount = outputImageDesc.width * outputImageDesc.height;
+			auto      pixels     = Gfx_BeginUpdateBuffer<Vec4>(ctx, m_cpuOutputBuffer.get(), pixelCount);
+			memcpy(pixels, m_cpuPathTracer->getOutput(), pixelCount * sizeof(Vec4));
+			Gfx_EndUpdateBuffer(ctx, m_cpuOutputBuffer);
+
+			Gfx_SetComputePipeline(ctx, m_copyOutputPipeline);
+			Gfx_SetStorageImage(ctx, 0, m_outputImage);
+			Gfx_SetStorageBuffer(ctx, 0, m_cpuOutputBuffer);
+			Gfx_Dispatch(ctx, divUp(outputImageDesc.width, 8), divUp(outputImageDesc.height, 8), 1);
+		}
+
+		if (m_focusPickRequested)
+		{
+			m_focusPickRequested = false;
+			const float depth = m_cpuPathTracer->getFocusDepth();
+			if (depth > 0.0f) // <= 0 = background
+			{
+				m_settings.m_focusDistance = depth;
+				m_frameIndex = 0;
+			}
+		}
+	}
+	else if (m_valid && rtReady)
 	{
 		GfxMarkerScope markerFrame(ctx, "Model");
 
@@ -697,9 +973,17 @@ void ExamplePathTracer::render()
 		}
 
 		GfxMarkerScope markerRT(ctx, "RT");
+
+		{
+			auto tileSamples = Gfx_BeginUpdateBuffer<u32>(ctx, m_tileSampleBuffer.get(), u32(m_adaptiveTileSamples.size()));
+			memcpy(tileSamples, m_adaptiveTileSamples.data(), m_adaptiveTileSamples.size() * sizeof(u32));
+			Gfx_EndUpdateBuffer(ctx, m_tileSampleBuffer);
+		}
+
 		Gfx_SetConstantBuffer(ctx, 0, m_sceneConstantBuffer);
 		Gfx_SetSampler(ctx, 0, m_samplerStates.anisotropicWrap);
 		Gfx_SetTexture(ctx, 0, m_envmap);
+		Gfx_SetTexture(ctx, 1, m_envmapPdf);
 		Gfx_SetStorageImage(ctx, 0, m_outputImage);
 		Gfx_SetStorageBuffer(ctx, 0, m_indexBuffer);
 		Gfx_SetStorageBuffer(ctx, 1, m_vertexBuffer);
@@ -713,9 +997,14 @@ void ExamplePathTracer::render()
 		{
 			Gfx_SetStorageBuffer(ctx, 4, m_materialIndexBuffer);
 		}
-		Gfx_SetStorageBuffer(ctx, 5, m_focusFeedbackBuffer);
+		Gfx_SetStorageBuffer(ctx, 5, m_focusReadback.getBuffer());
+		Gfx_SetStorageBuffer(ctx, 6, m_instanceIndexOffsetBuffer);
+		Gfx_SetStorageBuffer(ctx, 7, m_tileSampleBuffer);
+		Gfx_SetStorageBuffer(ctx, 8, m_tileErrorReadback.getBuffer());
 #else
-		Gfx_SetStorageBuffer(ctx, 3, m_focusFeedbackBuffer);
+		Gfx_SetStorageBuffer(ctx, 3, m_focusReadback.getBuffer());
+		Gfx_SetStorageBuffer(ctx, 4, m_tileSampleBuffer);
+		Gfx_SetStorageBuffer(ctx, 5, m_tileErrorReadback.getBuffer());
 #endif
 		Gfx_SetDescriptors(ctx, 1, m_materialDescriptorSet);
 		Gfx_SetAccelerationStructure(ctx, 0, m_tlas);
@@ -725,21 +1014,23 @@ void ExamplePathTracer::render()
 		if (m_focusPickRequested)
 		{
 			m_focusPickRequested = false;
-			Gfx_Finish(); // ensure the shader's feedback write completed
-			GfxMappedBuffer mapped = Gfx_MapBuffer(m_focusFeedbackBuffer);
-			if (mapped.data)
-			{
-				const float depth = *reinterpret_cast<const float*>(mapped.data);
-				if (depth > 0.0f) // <= 0 = background
-				{
-					m_settings.m_focusDistance = depth;
-					m_frameIndex = 0;
-				}
-			}
-			Gfx_UnmapBuffer(mapped);
+			m_focusReadback.request();
+		}
+		if (adaptive)
+		{
+			m_tileErrorReadback.request(m_adaptiveEpoch);
 		}
 	}
 
+	if (adaptive && m_adaptiveConverged && m_exitTargetError > 0.0f && m_textureLoadCounter.done()
+	    && m_loadedTextures.empty() && m_streamingTextures.empty())
+	{
+		RUSH_LOG("Converged to target error %g after %u frames: %.1f samples per pixel, %.2f sec", m_exitTargetError,
+		    m_frameIndex, getSamplesPerPixel(), m_totalGpuRenderTime);
+		m_exitTargetError = 0.0f;
+		m_window->close();
+	}
+
 	Gfx_AddImageBarrier(ctx, m_outputImage, GfxResourceState_ShaderRead);
 
 	GfxPassDesc passDesc;
@@ -782,14 +1073,19 @@ void ExamplePathTracer::render()
 		char            timingString[1024];
 		const GfxStats& stats = Gfx_Stats();
 		snprintf(timingString, sizeof(timingString),
-		    "GPU time: %.2f ms\n"
+		    "%s time: %.2f ms\n"
 		    "CPU time: %.2f ms\n"
 		    "Total render time: %.2f sec\n"
-		    "Samples per pixel: %d\n",
-		    m_stats.gpuTotal.get() * 1000.0f,
+		    "Samples per pixel: %.1f%s\n"
+		    "Texture memory: %.1f MB (%d streaming)\n",
+		    m_cpuPathTracer ? "CPU trace" : "GPU",
+		    (m_cpuPathTracer ? m_stats.cpuTrace.get() : m_stats.gpuTotal.get()) * 1000.0f,
 		    m_stats.cpuTotal.get() * 1000.0f,
 		    m_totalGpuRenderTime,
-		    m_frameIndex);
+		    getSamplesPerPixel(),
+		    m_adaptiveActive ? (m_adaptiveConverged ? " (converged)" : " (adaptive)") : "",
+		    double(m_textureResidentBytes) / (1024.0 * 1024.0),
+		    int(m_streamingTextures.size()));
 
 		m_font->draw(m_prim, safeOrigin + Vec2(10.0f, 30.0f), timingString);
 
@@ -806,205 +1102,427 @@ void ExamplePathTracer::render()
 	Gfx_EndPass(ctx);
 }
 
-void ExamplePathTracer::loadingThreadFunction()
+void ExamplePathTracer::loadTexture(TextureData* textureData)
 {
-	bool hasWork = true;
-	while(hasWork)
+	const std::string cachePath = getTextureCachePath("PathTracer", textureData->filename, textureData->loadFormat);
+	if (!loadCachedTexture(cachePath, textureData->staged))
 	{
-		TextureData* pendingLoad = nullptr;
-		
 		m_loadingMutex.lock();
-		if (!m_pendingTextures.empty())
-		{
-			pendingLoad = m_pendingTextures.back();
-			m_pendingTextures.pop_back();
-		}
-		hasWork = !m_pendingTextures.empty() || !m_loadingThreadShouldExit;
+		RUSH_LOG("Loading texture '%s'", textureData->filename.c_str());
 		m_loadingMutex.unlock();
 
-		if (pendingLoad)
+		const GfxFormat format = textureData->loadFormat;
+		const bool      sRGB   = getBlockCompressionSourceFormat(format) == GfxFormat_RGBA8_sRGB;
+		if (!stageTextureFromFile(textureData->filename.c_str(), format, sRGB, textureData->staged))
 		{
-			m_loadingMutex.lock();
-			RUSH_LOG("Loading texture '%s'", pendingLoad->filename.c_str());
-			m_loadingMutex.unlock();
-
-			int w, h, comp;
-			u8* pixels = stbi_load(pendingLoad->filename.c_str(), &w, &h, &comp, 4);
-
-			if (pixels)
-			{
-				u32 mipIndex = 0;
-
-				{
-					u32 levelSize = w * h * 4;
-					pendingLoad->mips[mipIndex].resize(levelSize);
-					memcpy(pendingLoad->mips[mipIndex].data(), pixels, levelSize);
-					mipIndex++;
-				}
-
-				u32 mipWidth  = w;
-				u32 mipHeight = h;
-
-				while (mipWidth != 1 && mipHeight != 1)
-				{
-					u32 nextMipWidth  = max<u32>(1, mipWidth / 2);
-					u32 nextMipHeight = max<u32>(1, mipHeight / 2);
-
-					u32 levelSize = nextMipWidth * nextMipHeight * 4;
-					pendingLoad->mips[mipIndex].resize(levelSize);
-
-					const u32 mipPitch     = mipWidth * 4;
-					const u32 nextMipPitch = nextMipWidth * 4;
+			RUSH_LOG("Failed to load texture '%s'", textureData->filename.c_str());
+			return;
+		}
 
-					int resizeResult = stbir_resize_uint8(pendingLoad->mips[mipIndex - 1].data(), mipWidth, mipHeight,
-					    mipPitch, pendingLoad->mips[mipIndex].data(), nextMipWidth, nextMipHeight, nextMipPitch, 4);
-					RUSH_ASSERT(resizeResult);
+		saveCachedTexture(cachePath, textureData->staged);
+	}
 
-					mipIndex++;
-					mipWidth  = nextMipWidth;
-					mipHeight = nextMipHeight;
-				}
+	m_loadedTextures.push(textureData);
+}
 
-				pendingLoad->desc      = GfxTextureDesc::make2D(w, h, pendingLoad->desc.format);
-				pendingLoad->desc.mips = mipIndex;
+u32 ExamplePathTracer::enqueueLoadTexture(const std::string& filename, GfxFormat format)
+{
+	auto it = m_texturesByName.find(filename);
+	if (it != m_texturesByName.end())
+	{
+		return it->second->descriptorIndex;
+	}
 
-				m_loadingMutex.lock();
-				m_loadedTextures.push_back(pendingLoad);
-				m_loadingMutex.unlock();
+	// Exported scenes often reference byte-identical images under different names. Only files
+	// whose size matches an earlier texture can be duplicates, so the main thread just stats the
+	// file and reads it for a content hash only when the sizes collide.
+	std::error_code ec;
+	const u64       fileSize = std::filesystem::file_size(filename, ec);
+
+	// The same image loaded as color and as data becomes two different textures
+	std::vector<TextureData*>* candidates  = nullptr;
+	u64                        contentHash = 0;
+	bool                       hashed      = false;
+	if (!ec)
+	{
+		candidates = &m_texturesBySize[computeContentHash(&format, sizeof(format), fileSize)];
+		hashed     = !candidates->empty() && computeFileContentHash(filename.c_str(), contentHash);
+	}
 
-				free(pixels);
-			}
-			else
-			{
-				RUSH_LOG("Failed to load texture '%s'", pendingLoad->filename.c_str());
-				m_loadedTextures.push_back(nullptr);
-			}
+	for (u32 i = 0; hashed && i < candidates->size(); ++i)
+	{
+		TextureData* textureData = (*candidates)[i];
+		if (!textureData->contentHashed)
+		{
+			textureData->contentHashed = computeFileContentHash(textureData->filename.c_str(), textureData->contentHash);
 		}
-		else
+
+		if (textureData->contentHashed && textureData->contentHash == contentHash)
 		{
-			using namespace std::chrono_literals;
-			std::this_thread::sleep_for(100ms);
+			textureData->duplicateCount++;
+			m_texturesByName[filename] = textureData;
+			RUSH_LOG("Texture '%s' is identical to '%s'", filename.c_str(), textureData->filename.c_str());
+			return textureData->descriptorIndex;
 		}
 	}
-}
-
-u32 ExamplePathTracer::enqueueLoadTexture(const std::string& filename, GfxFormat format)
-{
-	auto it = m_textures.find(filename);
-
-	if (it == m_textures.end())
-	{
-		TextureData* textureData = new TextureData;
 
-		textureData->desc.format = format;
-		textureData->filename    = filename;
-		textureData->descriptorIndex = u32(m_textureDescriptors.size());
-		m_textureDescriptors.push_back(InvalidResourceHandle());
+	m_textures.push_back(std::make_unique<TextureData>());
+	TextureData* textureData = m_textures.back().get();
 
-		RUSH_ASSERT(m_textureDescriptors.size() < MaxTextures);
+	textureData->requestedFormat = format;
+	textureData->loadFormat      = m_useTextureCompression ? format : getBlockCompressionSourceFormat(format);
+	textureData->filename        = filename;
+	textureData->descriptorIndex = u32(m_textureDescriptors.size());
+	m_textureDescriptors.push_back(InvalidResourceHandle());
 
-		m_textures[filename] = textureData;
+	RUSH_ASSERT(m_textureDescriptors.size() < MaxTextures);
 
-		m_loadingMutex.lock();
-		m_pendingTextures.push_back(textureData);
-		m_loadingMutex.unlock();
+	textureData->contentHash   = contentHash;
+	textureData->contentHashed = hashed;
 
-		return textureData->descriptorIndex;
+	m_texturesByName[filename] = textureData;
+	if (candidates)
+	{
+		candidates->push_back(textureData);
 	}
-	else
+
+	if (m_textureUploadStats.enqueueCount++ == 0)
 	{
-		return it->second->descriptorIndex;
+		m_textureUploadStats.loadTimer.reset();
 	}
 
-}
+	JobSystem::getDefault().submit([this, textureData]() { loadTexture(textureData); }, &m_textureLoadCounter);
 
-template <typename T>
-const T* getDataPtr(const cgltf_accessor* attr)
-{
-	const char* buffer = (const char*)(attr->buffer_view->buffer->data);
-	return reinterpret_cast<const T*>(&buffer[attr->offset + attr->buffer_view->offset]);
+	return textureData->descriptorIndex;
 }
 
-inline Vec3 mulPosition(Vec3 v, float transform[16])
+static size_t getTextureLevelSize(const GfxTextureDesc& desc, u32 mip)
 {
-	Vec3 r;
-	r.x = v.x * transform[0] + v.y * transform[4] + v.z * transform[8] + transform[12];
-	r.y = v.x * transform[1] + v.y * transform[5] + v.z * transform[9] + transform[13];
-	r.z = v.x * transform[2] + v.y * transform[6] + v.z * transform[10] + transform[14];
-	return r;
+	const u32 width  = max<u32>(1, desc.width >> mip);
+	const u32 height = max<u32>(1, desc.height >> mip);
+	return isBlockCompressedFormat(desc.format) ? getCompressedLevelSize(desc.format, width, height)
+	                                            : size_t(width) * height * 4;
 }
 
-inline Vec3 mulNormal(Vec3 v, float transform[16])
+// Block-compressed textures need whole blocks in their top level
+static bool isValidTopMip(const GfxTextureDesc& desc, u32 mip)
 {
-	Vec3 r;
-	r.x = v.x * transform[0] + v.y * transform[4] + v.z * transform[8];
-	r.y = v.x * transform[1] + v.y * transform[5] + v.z * transform[9];
-	r.z = v.x * transform[2] + v.y * transform[6] + v.z * transform[10];
-	return r;
+	return mip == 0 || !isBlockCompressedFormat(desc.format) ||
+	       (((desc.width >> mip) % 4) == 0 && ((desc.height >> mip) % 4) == 0);
 }
 
-static const char* toString(cgltf_result v)
+// Finest mip whose longest side is at most maxSize and that can be the top level of a texture
+static u32 findStreamingMip(const GfxTextureDesc& desc, u32 maxSize)
 {
-	switch (v)
+	u32 mip = 0;
+	while (mip + 1 < desc.mips && max(desc.width >> mip, desc.height >> mip) > maxSize)
 	{
-		case cgltf_result_success: return "success";
-		case cgltf_result_data_too_short: return "data_too_short";
-		case cgltf_result_unknown_format: return "unknown_format";
-		case cgltf_result_invalid_json: return "invalid_json";
-		case cgltf_result_invalid_gltf: return "invalid_gltf";
-		case cgltf_result_invalid_options: return "invalid_options";
-		case cgltf_result_file_not_found: return "file_not_found";
-		case cgltf_result_io_error: return "io_error";
-		case cgltf_result_out_of_memory: return "out_of_memory";
-		default: return "[unknown]";
+		++mip;
 	}
+
+	while (!isValidTopMip(desc, mip))
+	{
+		--mip;
+	}
+
+	return mip;
 }
 
-bool ExamplePathTracer::loadModelGLTF(const char* filename)
+bool ExamplePathTracer::uploadTextureMips(TextureData* textureData, u32 firstMip)
 {
-	std::string directory = directoryFromFilename(filename);
+	const GfxTextureDesc& fullDesc = textureData->desc;
 
-	cgltf_options options = {};
-	cgltf_data* data = nullptr;
-	cgltf_result result = cgltf_parse_file(&options, filename, &data);
-	if (result != cgltf_result_success)
+	GfxTextureDesc desc = GfxTextureDesc::make2D(
+	    max<u32>(1, fullDesc.width >> firstMip), max<u32>(1, fullDesc.height >> firstMip), fullDesc.format);
+	desc.mips = fullDesc.mips - firstMip;
+
+	// Levels come straight from staging memory or the mapped cache file
+	GfxTextureData mipData[StagedTexture::MaxMips] = {};
+	u64            bytes       = 0;
+	for (u32 i = firstMip; i < fullDesc.mips; ++i)
 	{
-		RUSH_LOG_ERROR("GLTF loader error: %s (%d)", toString(result), (int)result);
-		cgltf_free(data);
-		return false;
+		mipData[i - firstMip].pixels = textureData->staged.mips[i];
+		mipData[i - firstMip].mip    = i - firstMip;
+		bytes += getTextureLevelSize(fullDesc, i);
 	}
 
-	result = cgltf_load_buffers(&options, data, filename);
-	if (result != cgltf_result_success)
+	// Uploads that run while other textures are still decoding are hidden behind the decode
+	const bool   overlapped = !m_textureLoadCounter.done();
+	const double startTime  = m_timer.time();
+
+	auto texture = Gfx_CreateTexture(desc, mipData, desc.mips);
+
+	const double uploadTime = m_timer.time() - startTime;
+	m_textureUploadStats.uploadTime += uploadTime;
+	if (overlapped)
 	{
-		RUSH_LOG_ERROR("GLTF loader error: %s (%d)", toString(result), (int)result);
-		cgltf_free(data);
+		m_textureUploadStats.overlappedUploadTime += uploadTime;
+	}
+
+	if (!texture.valid())
+	{
+		RUSH_LOG_ERROR("Failed to create texture '%s' (format %u)", textureData->filename.c_str(), u32(desc.format));
 		return false;
 	}
 
-	RUSH_LOG("Converting mesh from GLTF");
+	m_textureDescriptors[textureData->descriptorIndex] = std::move(texture);
 
-	std::unordered_map<const void*, u32> materialMap;
+	m_textureResidentBytes     = m_textureResidentBytes - textureData->residentBytes + bytes;
+	textureData->residentBytes = bytes;
+	textureData->residentMip   = firstMip;
 
-	{
-		MaterialConstants constants;
-		constants.albedoTextureId = m_defaultWhiteTextureId;
-		constants.albedoFactor = Vec4(1.0f);
-		constants.specularFactor = Vec4(1.0f);
-		m_materials.push_back(constants);
-	}
+	return true;
+}
 
-	for (u32 i=0; i<data->materials_count; ++i)
+void ExamplePathTracer::releaseTextureSource(TextureData* textureData)
+{
+	textureData->staged.reset();
+}
+
+bool ExamplePathTracer::uploadLoadedTextures()
+{
+	bool changed = false;
+
+	// Newly decoded textures get their tail mips right away, so every material shows
+	// roughly the right color within a frame of its texture arriving
+	m_loadedTextures.consumeAll([&](TextureData* textureData)
 	{
-		const cgltf_material& inMaterial = data->materials[i];
+		// Loader jobs only fill in the staged data; the description is published here
+		textureData->desc = textureData->staged.desc;
 
-		MaterialConstants constants;
-		constants.albedoTextureId = m_defaultWhiteTextureId;
+		if (!m_textureLoadCounter.done())
+		{
+			m_textureUploadStats.overlappedCount++;
+		}
+		m_textureUploadStats.uploadCount++;
 
-		switch (inMaterial.alpha_mode)
+		if (m_cpuPathTracer)
 		{
-		default:
-		case cgltf_alpha_mode_opaque:
+			// Texture compression is off in this mode, so the top level is RGBA8
+			const GfxTextureDesc& desc = textureData->desc;
+			m_cpuPathTracer->setTexture(textureData->descriptorIndex, desc.width, desc.height,
+			    textureData->staged.mips[0], desc.format == GfxFormat_RGBA8_sRGB);
+			releaseTextureSource(textureData);
+			changed = true;
+			return;
+		}
+
+		const u32 firstMip = m_textureStreaming ? findStreamingMip(textureData->desc, TextureStreamingTailSize) : 0;
+		if (!uploadTextureMips(textureData, firstMip))
+		{
+			releaseTextureSource(textureData);
+			return;
+		}
+
+		changed = true;
+
+		if (firstMip > 0)
+		{
+			m_streamingTextures.push_back(textureData);
+		}
+		else
+		{
+			releaseTextureSource(textureData);
+		}
+	});
+
+	TextureUploadStats& stats = m_textureUploadStats;
+	if (!stats.reported && stats.enqueueCount != 0 && m_textureLoadCounter.done() && m_loadedTextures.empty())
+	{
+		stats.reported = true;
+		RUSH_LOG("Loaded %u textures in %.1f ms: %u uploaded while others were decoding, "
+		         "%.1f of %.1f ms upload time overlapped, peak staging memory %.1f MB",
+		    stats.uploadCount, stats.loadTimer.time() * 1000.0, stats.overlappedCount,
+		    stats.overlappedUploadTime * 1000.0, stats.uploadTime * 1000.0,
+		    double(StagingAllocator::getDefault().getPeakBytesInUse()) / (1024.0 * 1024.0));
+
+		u32 duplicateCount = 0;
+		u64 savedBytes     = 0;
+		for (const auto& textureData : m_textures)
+		{
+			if (textureData->duplicateCount == 0 || textureData->desc.width == 0)
+			{
+				continue;
+			}
+
+			u64 textureBytes = 0;
+			for (u32 i = 0; i < textureData->desc.mips; ++i)
+			{
+				textureBytes += getTextureLevelSize(textureData->desc, i);
+			}
+
+			duplicateCount += textureData->duplicateCount;
+			savedBytes += textureBytes * textureData->duplicateCount;
+		}
+
+		if (duplicateCount)
+		{
+			RUSH_LOG("Shared %u duplicate texture files, saving %.1f MB", duplicateCount,
+			    double(savedBytes) / (1024.0 * 1024.0));
+		}
+	}
+
+	return changed;
+}
+
+bool ExamplePathTracer::updateTextureStreaming()
+{
+	bool changed = uploadLoadedTextures();
+
+	// Then raise residency a step at a time, lowest resolution first, so the whole scene sharpens evenly
+	u64 uploadedBytes = 0;
+	while (!m_streamingTextures.empty() && uploadedBytes < TextureStreamingBytesPerFrame)
+	{
+		auto residentSize = [](const TextureData* t)
+		{ return max(t->desc.width >> t->residentMip, t->desc.height >> t->residentMip); };
+
+		auto it = std::min_element(m_streamingTextures.begin(), m_streamingTextures.end(),
+		    [&](const TextureData* a, const TextureData* b) { return residentSize(a) < residentSize(b); });
+
+		TextureData* textureData = *it;
+
+		// Each step adds one level, quadrupling the resident texel count
+		u32 nextMip = textureData->residentMip - 1;
+		while (!isValidTopMip(textureData->desc, nextMip))
+		{
+			--nextMip;
+		}
+
+		u64 nextBytes = 0;
+		for (u32 i = nextMip; i < textureData->desc.mips; ++i)
+		{
+			nextBytes += getTextureLevelSize(textureData->desc, i);
+		}
+
+		const u64 residentAfterUpgrade = m_textureResidentBytes - textureData->residentBytes + nextBytes;
+		const bool fitsBudget = m_textureBudgetBytes == 0 || residentAfterUpgrade <= m_textureBudgetBytes;
+
+		if (fitsBudget && uploadTextureMips(textureData, nextMip))
+		{
+			uploadedBytes += nextBytes;
+			changed = true;
+		}
+
+		// Textures that are complete, over budget or failed to upload stay at their current residency
+		if (!fitsBudget || textureData->residentMip != nextMip || nextMip == 0)
+		{
+			releaseTextureSource(textureData);
+			m_streamingTextures.erase(it);
+		}
+	}
+
+	return changed;
+}
+
+void ExamplePathTracer::updateTextureDescriptors()
+{
+	std::vector<GfxTexture> textureDescriptors;
+	textureDescriptors.resize(MaxTextures, m_textureDescriptors[m_defaultWhiteTextureId].get());
+
+	for (size_t i = 0; i < m_textureDescriptors.size(); ++i)
+	{
+		if (m_textureDescriptors[i].get().valid())
+		{
+			textureDescriptors[i] = m_textureDescriptors[i].get();
+		}
+	}
+
+	if (m_materialDescriptorSet.valid())
+	{
+		Gfx_UpdateDescriptorSet(m_materialDescriptorSet,
+			nullptr, // constant buffers
+			nullptr, // samplers
+			textureDescriptors.data(),
+			nullptr, // storage images
+			nullptr  // storage buffers
+		);
+	}
+}
+
+template <typename T>
+const T* getDataPtr(const cgltf_accessor* attr)
+{
+	const char* buffer = (const char*)(attr->buffer_view->buffer->data);
+	return reinterpret_cast<const T*>(&buffer[attr->offset + attr->buffer_view->offset]);
+}
+
+template <typename T>
+const T* getElementPtr(const cgltf_accessor* attr, size_t index)
+{
+	return reinterpret_cast<const T*>(reinterpret_cast<const char*>(getDataPtr<T>(attr)) + index * attr->stride);
+}
+
+static const char* toString(cgltf_result v)
+{
+	switch (v)
+	{
+		case cgltf_result_success: return "success";
+		case cgltf_result_data_too_short: return "data_too_short";
+		case cgltf_result_unknown_format: return "unknown_format";
+		case cgltf_result_invalid_json: return "invalid_json";
+		case cgltf_result_invalid_gltf: return "invalid_gltf";
+		case cgltf_result_invalid_options: return "invalid_options";
+		case cgltf_result_file_not_found: return "file_not_found";
+		case cgltf_result_io_error: return "io_error";
+		case cgltf_result_out_of_memory: return "out_of_memory";
+		default: return "[unknown]";
+	}
+}
+
+bool ExamplePathTracer::loadModelGLTF(const char* filename)
+{
+	std::string directory = directoryFromFilename(filename);
+
+	cgltf_options options = {};
+	cgltf_data* data = nullptr;
+	cgltf_result result = cgltf_parse_file(&options, filename, &data);
+	if (result != cgltf_result_success)
+	{
+		RUSH_LOG_ERROR("GLTF loader error: %s (%d)", toString(result), (int)result);
+		cgltf_free(data);
+		return false;
+	}
+
+	result = cgltf_load_buffers(&options, data, filename);
+	if (result != cgltf_result_success)
+	{
+		RUSH_LOG_ERROR("GLTF loader error: %s (%d)", toString(result), (int)result);
+		cgltf_free(data);
+		return false;
+	}
+
+	for (u32 i = 0; i < data->buffers_count; ++i)
+	{
+		const char* uri = data->buffers[i].uri;
+		if (uri && strncmp(uri, "data:", 5) != 0)
+		{
+			m_modelDependencies.push_back(directory + uri);
+		}
+	}
+
+	RUSH_LOG("Converting mesh from GLTF");
+
+	std::unordered_map<const void*, u32> materialMap;
+
+	{
+		MaterialConstants constants;
+		constants.albedoTextureId = m_defaultWhiteTextureId;
+		constants.albedoFactor = Vec4(1.0f);
+		constants.specularFactor = Vec4(1.0f);
+		m_materials.push_back(constants);
+	}
+
+	for (u32 i=0; i<data->materials_count; ++i)
+	{
+		const cgltf_material& inMaterial = data->materials[i];
+
+		MaterialConstants constants;
+		constants.albedoTextureId = m_defaultWhiteTextureId;
+
+		switch (inMaterial.alpha_mode)
+		{
+		default:
+		case cgltf_alpha_mode_opaque:
 			constants.alphaMode = AlphaMode::Opaque;
 			break;
 		case cgltf_alpha_mode_blend:
@@ -1039,7 +1557,7 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 				{
 					std::string filename = directory + std::string(texture->image->uri);
 					fixDirectorySeparatorsInplace(filename);
-					constants.albedoTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_RGBA8_sRGB);
+					constants.albedoTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_BC7_Unorm_sRGB);
 				}
 			}
 
@@ -1049,7 +1567,7 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 				{
 					std::string filename = directory + std::string(texture->image->uri);
 					fixDirectorySeparatorsInplace(filename);
-					constants.specularTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_RGBA8_Unorm);
+					constants.specularTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_BC1_Unorm);
 				}
 			}
 		}
@@ -1073,7 +1591,7 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 				{
 					std::string filename = directory + std::string(texture->image->uri);
 					fixDirectorySeparatorsInplace(filename);
-					constants.albedoTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_RGBA8_sRGB);
+					constants.albedoTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_BC7_Unorm_sRGB);
 				}
 			}
 
@@ -1083,7 +1601,7 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 				{
 					std::string filename = directory + std::string(texture->image->uri);
 					fixDirectorySeparatorsInplace(filename);
-					constants.specularTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_RGBA8_sRGB);
+					constants.specularTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_BC3_Unorm_sRGB);
 				}
 			}
 		}
@@ -1095,7 +1613,7 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 				m_haveNormalMaps = true;
 				std::string filename = directory + std::string(texture->image->uri);
 				fixDirectorySeparatorsInplace(filename);
-				constants.normalTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_RGBA8_Unorm);
+				constants.normalTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_BC5_Unorm);
 			}
 		}
 
@@ -1104,7 +1622,40 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 		m_materials.push_back(constants);
 	}
 
-	m_boundingBox.expandInit();
+	// Conversion runs in two passes. The first gives every primitive of every unique mesh its range of
+	// the vertex and index arrays, which are then sized exactly, and records an instance per node. The
+	// second fills the ranges in parallel, in chunks, so that scenes made of a few large meshes also
+	// spread over all cores. Meshes stay in their own space, node transforms go to the TLAS instances.
+	struct GltfPrimitive
+	{
+		const cgltf_accessor* indices   = nullptr;
+		const cgltf_accessor* positions = nullptr;
+		const cgltf_accessor* normals   = nullptr; // optional attributes are null unless per vertex
+		const cgltf_accessor* texcoords = nullptr;
+		const cgltf_accessor* tangents  = nullptr;
+		u32                   mesh        = 0;
+		u32                   firstVertex = 0;
+		u32                   firstIndex  = 0;
+	};
+
+	struct GltfChunk
+	{
+		u32  primitive;
+		u32  vertexBegin; // relative to the primitive
+		u32  vertexEnd;
+		u32  indexBegin;
+		u32  indexEnd;
+		Box3 bounds;
+	};
+
+	Timer timer;
+
+	std::vector<GltfPrimitive> primitives;
+	size_t                     vertexCount = m_vertices.size();
+	size_t                     indexCount  = m_indices.size();
+
+	constexpr u32                              InvalidMesh = ~0u;
+	std::unordered_map<const cgltf_mesh*, u32> meshMap;
 
 	for (u32 ni = 0; ni < data->nodes_count; ++ni)
 	{
@@ -1114,148 +1665,245 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 			continue;
 		}
 
-		float transform[16];
-		cgltf_node_transform_world(&node, transform);
-
-		const cgltf_mesh& mesh = *node.mesh;
-
-		for (u32 pi = 0; pi < mesh.primitives_count; ++pi)
+		auto meshIt = meshMap.find(node.mesh);
+		if (meshIt == meshMap.end())
 		{
-			const cgltf_primitive& prim = mesh.primitives[pi];
-			const cgltf_accessor* aidx = prim.indices;
-			const cgltf_accessor* apos = nullptr;
-			const cgltf_accessor* anor = nullptr;
-			const cgltf_accessor* atex = nullptr;
-			const cgltf_accessor* atan = nullptr;
+			const cgltf_mesh& mesh = *node.mesh;
 
-			for (u32 ai = 0; ai < prim.attributes_count; ++ai)
+			SceneMesh sceneMesh;
+			sceneMesh.segmentOffset = u32(m_segments.size());
+			sceneMesh.indexOffset   = u32(indexCount);
+
+			for (u32 pi = 0; pi < mesh.primitives_count; ++pi)
 			{
-				const cgltf_attribute& attr = prim.attributes[ai];
-				if (attr.type == cgltf_attribute_type_position && attr.index == 0)
+				const cgltf_primitive& prim = mesh.primitives[pi];
+				const cgltf_accessor* aidx = prim.indices;
+				const cgltf_accessor* apos = nullptr;
+				const cgltf_accessor* anor = nullptr;
+				const cgltf_accessor* atex = nullptr;
+				const cgltf_accessor* atan = nullptr;
+
+				for (u32 ai = 0; ai < prim.attributes_count; ++ai)
+				{
+					const cgltf_attribute& attr = prim.attributes[ai];
+					if (attr.type == cgltf_attribute_type_position && attr.index == 0)
+					{
+						apos = attr.data;
+					}
+					else if (attr.type == cgltf_attribute_type_normal && attr.index == 0)
+					{
+						anor = attr.data;
+					}
+					else if (attr.type == cgltf_attribute_type_texcoord && attr.index == 0)
+					{
+						atex = attr.data;
+					}
+					else if (attr.type == cgltf_attribute_type_tangent && attr.index == 0)
+					{
+						atan = attr.data;
+					}
+				}
+
+				if (!aidx || !apos)
 				{
-					apos = attr.data;
+					continue;
 				}
-				else if (attr.type == cgltf_attribute_type_normal && attr.index == 0)
+
+				MeshSegment seg;
+				seg.material = materialMap[prim.material];
+				seg.indexOffset = u32(indexCount);
+				seg.indexCount = u32(aidx->count);
+
+				if (m_materials[seg.material].alphaMode == AlphaMode::Blend)
 				{
-					anor = attr.data;
+					continue; // transparent materials not implemented
 				}
-				else if (attr.type == cgltf_attribute_type_texcoord && attr.index == 0)
+
+				m_segments.push_back(seg);
+
+				GltfPrimitive primitive;
+				primitive.indices     = aidx;
+				primitive.positions   = apos;
+				primitive.mesh        = u32(m_meshes.size());
+				primitive.firstVertex = u32(vertexCount);
+				primitive.firstIndex  = u32(indexCount);
+
+				if (anor && anor->count == apos->count)
 				{
-					atex = attr.data;
+					m_haveNormals     = true;
+					primitive.normals = anor;
 				}
-				else if (attr.type == cgltf_attribute_type_tangent && attr.index == 0)
+
+				if (atan && atan->count == apos->count)
 				{
-					atan = attr.data;
+					m_haveTangents     = true;
+					primitive.tangents = atan;
 				}
-			}
 
-			const u32 firstIndex = u32(m_indices.size());
-			const u32 firstVertex = u32(m_vertices.size());
+				if (atex && atex->count == apos->count)
+				{
+					m_haveTexcoords     = true;
+					primitive.texcoords = atex;
+				}
 
-			MeshSegment seg;
-			seg.material = materialMap[prim.material];
-			seg.indexOffset = firstIndex;
-			seg.indexCount = u32(aidx->count);
+				primitives.push_back(primitive);
 
-			if (m_materials[seg.material].alphaMode == AlphaMode::Blend)
-			{
-				continue; // transparent materials not implemented
+				vertexCount += apos->count;
+				indexCount += aidx->count;
 			}
 
-			m_segments.push_back(seg);
+			sceneMesh.segmentCount = u32(m_segments.size()) - sceneMesh.segmentOffset;
+			sceneMesh.indexCount   = u32(indexCount) - sceneMesh.indexOffset;
 
-			if (!aidx || !apos)
+			u32 meshIndex = InvalidMesh;
+			if (sceneMesh.segmentCount != 0)
 			{
-				continue;
+				meshIndex = u32(m_meshes.size());
+				m_meshes.push_back(sceneMesh);
 			}
+			meshIt = meshMap.emplace(node.mesh, meshIndex).first;
+		}
+
+		if (meshIt->second == InvalidMesh)
+		{
+			continue;
+		}
 
-			if (aidx->component_type == cgltf_component_type_r_32u)
+		// Vertices are mirrored in X due to coordinate system difference, so the node transform is
+		// applied between two mirrors, which keeps the determinant and the triangle facing
+		float transform[16];
+		cgltf_node_transform_world(&node, transform);
+
+		MeshInstance instance;
+		instance.mesh = meshIt->second;
+		memcpy(&instance.transform, transform, sizeof(transform));
+		for (u32 i = 0; i < 4; ++i)
+		{
+			instance.transform.rows[0][i] = -instance.transform.rows[0][i];
+			instance.transform.rows[i][0] = -instance.transform.rows[i][0];
+		}
+		m_instances.push_back(instance);
+	}
+
+	m_vertices.resize(vertexCount);
+	m_indices.resize(indexCount);
+
+	// Chunks cover the same number of vertices and triangles, and index ranges start on triangles
+	constexpr u32          chunkSize = 65536;
+	std::vector<GltfChunk> chunks;
+	for (u32 i = 0; i < u32(primitives.size()); ++i)
+	{
+		const u32 primitiveVertexCount = u32(primitives[i].positions->count);
+		const u32 primitiveIndexCount  = u32(primitives[i].indices->count);
+		for (u32 k = 0; k * chunkSize < primitiveVertexCount || k * chunkSize * 3 < primitiveIndexCount; ++k)
+		{
+			GltfChunk chunk;
+			chunk.primitive   = i;
+			chunk.vertexBegin = min(k * chunkSize, primitiveVertexCount);
+			chunk.vertexEnd   = min((k + 1) * chunkSize, primitiveVertexCount);
+			chunk.indexBegin  = min(k * chunkSize * 3, primitiveIndexCount);
+			chunk.indexEnd    = min((k + 1) * chunkSize * 3, primitiveIndexCount);
+			chunks.push_back(chunk);
+		}
+	}
+
+	JobSystem::getDefault().parallelFor(u32(chunks.size()), 1, [&](u32 begin, u32 end)
+	{
+		for (u32 chunkIt = begin; chunkIt < end; ++chunkIt)
+		{
+			GltfChunk&            chunk     = chunks[chunkIt];
+			const GltfPrimitive&  primitive = primitives[chunk.primitive];
+			const cgltf_accessor* aidx      = primitive.indices;
+
+			// convert winding due to coordinate system difference
+			const u32 triangleIndexCount = u32(aidx->count / 3 * 3);
+			for (u32 i = chunk.indexBegin; i < chunk.indexEnd; ++i)
 			{
-				auto ptr = getDataPtr<u32>(aidx);
-				for (u32 i = 0; i < aidx->count; ++i)
+				u32 index = 0;
+				if (aidx->component_type == cgltf_component_type_r_32u)
 				{
-					m_indices.push_back(firstVertex + ptr[i]);
+					index = getDataPtr<u32>(aidx)[i];
 				}
-			}
-			else
-			{
-				auto ptr = getDataPtr<u16>(aidx);
-				for (u32 i = 0; i < aidx->count; ++i)
+				else if (aidx->component_type == cgltf_component_type_r_8u)
 				{
-					m_indices.push_back(firstVertex + ptr[i]);
+					index = getDataPtr<u8>(aidx)[i];
 				}
-			}
-
-			// convert winding due to coordinate system difference
-			const u64 triCount = (m_indices.size() - firstIndex) / 3;
-			for (u64 i = 0; i < triCount; ++i)
-			{
-				std::swap(m_indices[firstIndex + i * 3 + 1], m_indices[firstIndex + i * 3 + 2]);
-			}
-
-			// positions
-
-			if (apos)
-			{
-				auto ptr = getDataPtr<float>(apos);
-				for (u32 i = 0; i < apos->count; ++i)
+				else
 				{
-					Vertex v = {};
-					v.position = mulPosition(Vec3(ptr), transform);
-					v.position.x = -v.position.x;
-					m_vertices.push_back(v);
-					ptr += apos->stride / 4;
-					m_boundingBox.expand(v.position);
+					index = getDataPtr<u16>(aidx)[i];
 				}
-			}
-
-			// normals
 
-			if (anor && anor->count == apos->count)
-			{
-				m_haveNormals = true;
-				auto ptr = getDataPtr<float>(anor);
-				for (u32 i = 0; i < anor->count; ++i)
+				u32 target = i;
+				if (i < triangleIndexCount && i % 3 != 0)
 				{
-					m_vertices[firstVertex + i].normal = mulNormal(Vec3(ptr), transform);
-					m_vertices[firstVertex + i].normal.x = -m_vertices[firstVertex + i].normal.x;
-					ptr += anor->stride / 4;
+					target = i % 3 == 1 ? i + 1 : i - 1;
 				}
+				m_indices[primitive.firstIndex + target] = primitive.firstVertex + index;
 			}
 
-			// tangents
-
-			if (atan && apos && atan->count == apos->count)
+			chunk.bounds.expandInit();
+			for (u32 i = chunk.vertexBegin; i < chunk.vertexEnd; ++i)
 			{
-				m_haveTangents = true;
-				auto ptr     = getDataPtr<float>(atan);
-				for (u32 i = 0; i < atan->count; ++i)
+				Vertex v = {};
+				v.position = Vec3(getElementPtr<float>(primitive.positions, i));
+				v.position.x = -v.position.x;
+				chunk.bounds.expand(v.position);
+
+				if (primitive.normals)
 				{
-					m_vertices[firstVertex + i].tangent = Vec4(ptr);
-					ptr += atan->stride / 4;
+					v.normal = Vec3(getElementPtr<float>(primitive.normals, i));
+					v.normal.x = -v.normal.x;
 				}
-			}
 
-			// texcoords
+				if (primitive.tangents)
+				{
+					v.tangent = Vec4(getElementPtr<float>(primitive.tangents, i));
+				}
 
-			if (atex && atex->count == apos->count)
-			{
-				m_haveTexcoords = true;
-				auto ptr = getDataPtr<float>(atex);
-				for (u32 i = 0; i < atex->count; ++i)
+				if (primitive.texcoords)
 				{
-					m_vertices[firstVertex + i].texcoord = Vec2(ptr);
-					ptr += atex->stride / 4;
+					v.texcoord = Vec2(getElementPtr<float>(primitive.texcoords, i));
 				}
-			}
 
-			if (!m_haveNormals)
-			{
-				// TODO: compute face normals
+				m_vertices[primitive.firstVertex + i] = v;
 			}
 		}
+	});
+
+	std::vector<Box3> meshBounds(m_meshes.size());
+	for (Box3& bounds : meshBounds)
+	{
+		bounds.expandInit();
+	}
+	for (const GltfChunk& chunk : chunks)
+	{
+		if (chunk.vertexBegin != chunk.vertexEnd)
+		{
+			Box3& bounds = meshBounds[primitives[chunk.primitive].mesh];
+			bounds.expand(chunk.bounds.m_min);
+			bounds.expand(chunk.bounds.m_max);
+		}
+	}
+
+	m_boundingBox.expandInit();
+	size_t instancedTriangleCount = 0;
+	for (const MeshInstance& instance : m_instances)
+	{
+		const Box3& bounds = meshBounds[instance.mesh];
+		for (u32 corner = 0; corner < 8; ++corner)
+		{
+			const Vec3 p((corner & 1) ? bounds.m_max.x : bounds.m_min.x, (corner & 2) ? bounds.m_max.y : bounds.m_min.y,
+			    (corner & 4) ? bounds.m_max.z : bounds.m_min.z);
+			m_boundingBox.expand(instance.transform * p);
+		}
+		instancedTriangleCount += m_meshes[instance.mesh].indexCount / 3;
 	}
 
+	RUSH_LOG("Converted %u primitives with %u vertices and %u indices in %u chunks in %.1f ms",
+	    u32(primitives.size()), u32(vertexCount), u32(indexCount), u32(chunks.size()), timer.time() * 1000.0);
+	RUSH_LOG("Scene has %u unique meshes and %u instances, %.1f M instanced triangles", u32(m_meshes.size()),
+	    u32(m_instances.size()), double(instancedTriangleCount) / 1e6);
+
 	cgltf_free(data);
 
 	m_vertexCount = (u32)m_vertices.size();
@@ -1266,6 +1914,31 @@ bool ExamplePathTracer::loadModelGLTF(const char* filename)
 	return true;
 }
 
+// Loads material libraries like the default reader, and records them as scene cache dependencies
+class ObjMaterialReader final : public tinyobj::MaterialFileReader
+{
+public:
+	ObjMaterialReader(const std::string& directory, std::vector<std::string>& files)
+	: MaterialFileReader(directory), m_directory(directory), m_files(files)
+	{
+	}
+
+	bool operator()(const std::string& matId, std::vector<tinyobj::material_t>& materials,
+	    std::map<std::string, int>& matMap, std::string& err) override
+	{
+		const std::string filename = m_directory + matId;
+		if (std::filesystem::exists(filename))
+		{
+			m_files.push_back(filename);
+		}
+		return MaterialFileReader::operator()(matId, materials, matMap, err);
+	}
+
+private:
+	std::string               m_directory;
+	std::vector<std::string>& m_files;
+};
+
 bool ExamplePathTracer::loadModelObj(const char* filename)
 {
 	std::vector<tinyobj::shape_t>    shapes;
@@ -1274,7 +1947,16 @@ bool ExamplePathTracer::loadModelObj(const char* filename)
 
 	std::string directory = directoryFromFilename(filename);
 
-	bool loaded = tinyobj::LoadObj(shapes, materials, errors, filename, directory.c_str());
+	std::ifstream stream(filename);
+	if (!stream)
+	{
+		RUSH_LOG_ERROR("OBJ loader error: can't open '%s'", filename);
+		return false;
+	}
+
+	ObjMaterialReader materialReader(directory, m_modelDependencies);
+
+	bool loaded = tinyobj::LoadObj(shapes, materials, errors, stream, materialReader);
 	if (!loaded)
 	{
 		RUSH_LOG_ERROR("OBJ loader error: %s", errors.c_str());
@@ -1297,7 +1979,7 @@ bool ExamplePathTracer::loadModelObj(const char* filename)
 		{
 			std::string filename = directory + objMaterial.diffuse_texname;
 			fixDirectorySeparatorsInplace(filename);
-			constants.albedoTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_RGBA8_sRGB);
+			constants.albedoTextureId = enqueueLoadTexture(filename, GfxFormat::GfxFormat_BC7_Unorm_sRGB);
 		}
 
 		m_materials.push_back(constants);
@@ -1310,111 +1992,165 @@ bool ExamplePathTracer::loadModelObj(const char* filename)
 		m_materials.push_back(constants);
 	}
 
-	m_boundingBox.expandInit();
+	// Shapes are converted in parallel, with indices and segments relative to the shape
+	struct ObjShape
+	{
+		std::vector<Vertex>      vertices;
+		std::vector<u32>         indices;
+		std::vector<MeshSegment> segments;
+		Box3                     bounds;
+		u32                      sourceVertexCount = 0;
+	};
 
-	for (const auto& shape : shapes)
+	std::vector<ObjShape> objShapes(shapes.size());
+
+	JobSystem::getDefault().parallelFor(u32(shapes.size()), 1, [&](u32 begin, u32 end)
 	{
-		u32         firstVertex = (u32)m_vertices.size();
-		const auto& mesh        = shape.mesh;
+		for (u32 shapeIt = begin; shapeIt < end; ++shapeIt)
+		{
+			const auto&          mesh     = shapes[shapeIt].mesh;
+			ObjShape&            shape    = objShapes[shapeIt];
+			std::vector<Vertex>& vertices = shape.vertices;
+			std::vector<u32>&    indices  = shape.indices;
 
-		const u32 vertexCount = (u32)mesh.positions.size() / 3;
+			shape.bounds.expandInit();
 
-		const bool haveTexcoords = !mesh.texcoords.empty();
-		const bool haveNormals   = mesh.positions.size() == mesh.normals.size();
+			const u32 vertexCount   = (u32)mesh.positions.size() / 3;
+			shape.sourceVertexCount = vertexCount;
 
-		for (u64 i = 0; i < vertexCount; ++i)
-		{
-			Vertex v;
+			const bool haveTexcoords = !mesh.texcoords.empty();
+			const bool haveNormals   = mesh.positions.size() == mesh.normals.size();
+
+			for (u64 i = 0; i < vertexCount; ++i)
+			{
+				Vertex v = {};
+
+				v.position.x = mesh.positions[i * 3 + 0];
+				v.position.y = mesh.positions[i * 3 + 1];
+				v.position.z = mesh.positions[i * 3 + 2];
+
+				shape.bounds.expand(v.position);
+
+				if (haveTexcoords)
+				{
+					v.texcoord.x = mesh.texcoords[i * 2 + 0];
+					v.texcoord.y = mesh.texcoords[i * 2 + 1];
+
+					v.texcoord.y = 1.0f - v.texcoord.y;
+				}
+
+				if (haveNormals)
+				{
+					v.normal.x = mesh.normals[i * 3 + 0];
+					v.normal.y = mesh.normals[i * 3 + 1];
+					v.normal.z = mesh.normals[i * 3 + 2];
+				}
 
-			v.position.x = mesh.positions[i * 3 + 0];
-			v.position.y = mesh.positions[i * 3 + 1];
-			v.position.z = mesh.positions[i * 3 + 2];
+				v.position.x = -v.position.x;
+				v.normal.x   = -v.normal.x;
 
-			m_boundingBox.expand(v.position);
+				vertices.push_back(v);
+			}
 
-			if (haveTexcoords)
+			if (!haveNormals)
 			{
-				v.texcoord.x = mesh.texcoords[i * 2 + 0];
-				v.texcoord.y = mesh.texcoords[i * 2 + 1];
+				const u32 triangleCount = (u32)mesh.indices.size() / 3;
+				for (u64 i = 0; i < triangleCount; ++i)
+				{
+					u32 idxA = mesh.indices[i * 3 + 0];
+					u32 idxB = mesh.indices[i * 3 + 2];
+					u32 idxC = mesh.indices[i * 3 + 1];
 
-				v.texcoord.y = 1.0f - v.texcoord.y;
-			}
-			else
-			{
-				v.texcoord = Vec2(0.0f);
-			}
+					Vec3 a = vertices[idxA].position;
+					Vec3 b = vertices[idxB].position;
+					Vec3 c = vertices[idxC].position;
 
-			if (haveNormals)
-			{
-				v.normal.x = mesh.normals[i * 3 + 0];
-				v.normal.y = mesh.normals[i * 3 + 1];
-				v.normal.z = mesh.normals[i * 3 + 2];
-			}
-			else
-			{
-				v.normal = Vec3(0.0);
-			}
+					Vec3 normal = cross(b - a, c - b);
 
-			v.position.x = -v.position.x;
-			v.normal.x   = -v.normal.x;
+					normal = normalize(normal);
 
-			//v.normal = Vec3(1, 0, 0);
+					vertices[idxA].normal += normal;
+					vertices[idxB].normal += normal;
+					vertices[idxC].normal += normal;
+				}
 
-			m_vertices.push_back(v);
-		}
+				for (Vertex& v : vertices)
+				{
+					v.normal = normalize(v.normal);
+				}
+			}
+
+			int currentMaterialId = -1;
 
-		if (!haveNormals)
-		{
 			const u32 triangleCount = (u32)mesh.indices.size() / 3;
-			for (u64 i = 0; i < triangleCount; ++i)
+			for (u64 triangleIt = 0; triangleIt < triangleCount; ++triangleIt)
 			{
-				u32 idxA = firstVertex + mesh.indices[i * 3 + 0];
-				u32 idxB = firstVertex + mesh.indices[i * 3 + 2];
-				u32 idxC = firstVertex + mesh.indices[i * 3 + 1];
-
-				Vec3 a = m_vertices[idxA].position;
-				Vec3 b = m_vertices[idxB].position;
-				Vec3 c = m_vertices[idxC].position;
-
-				Vec3 normal = cross(b - a, c - b);
+				if (mesh.material_ids[triangleIt] != currentMaterialId || shape.segments.empty())
+				{
+					currentMaterialId = mesh.material_ids[triangleIt];
+					shape.segments.push_back(MeshSegment());
+					shape.segments.back().material    = max(0, currentMaterialId);
+					shape.segments.back().indexOffset = (u32)indices.size();
+					shape.segments.back().indexCount  = 0;
+				}
 
-				normal = normalize(normal);
+				indices.push_back(mesh.indices[triangleIt * 3 + 0]);
+				indices.push_back(mesh.indices[triangleIt * 3 + 2]);
+				indices.push_back(mesh.indices[triangleIt * 3 + 1]);
 
-				m_vertices[idxA].normal += normal;
-				m_vertices[idxB].normal += normal;
-				m_vertices[idxC].normal += normal;
+				shape.segments.back().indexCount += 3;
 			}
 
-			for (u32 i = firstVertex; i < (u32)m_vertices.size(); ++i)
-			{
-				m_vertices[i].normal = normalize(m_vertices[i].normal);
-			}
+			// Duplicates within a shape are welded here, in parallel
+			vertices.resize(
+			    weldVertices(vertices.data(), vertices.size(), sizeof(Vertex), indices.data(), indices.size()));
 		}
+	});
 
-		int currentMaterialId = -1;
+	// Merging shapes and welding again joins the vertices that OBJ files repeat for every shape
+	// or group that shares them
+	const u32 firstVertex       = (u32)m_vertices.size();
+	const u32 firstIndex        = (u32)m_indices.size();
+	size_t    sourceVertexCount = 0;
 
-		const u32 triangleCount = (u32)mesh.indices.size() / 3;
-		for (u64 triangleIt = 0; triangleIt < triangleCount; ++triangleIt)
-		{
-			if (mesh.material_ids[triangleIt] != currentMaterialId || m_segments.empty())
-			{
-				currentMaterialId = mesh.material_ids[triangleIt];
-				m_segments.push_back(MeshSegment());
-				m_segments.back().material    = max(0,currentMaterialId);
-				m_segments.back().indexOffset = (u32)m_indices.size();
-				m_segments.back().indexCount  = 0;
-			}
+	m_boundingBox.expandInit();
 
-			m_indices.push_back(mesh.indices[triangleIt * 3 + 0] + firstVertex);
-			m_indices.push_back(mesh.indices[triangleIt * 3 + 2] + firstVertex);
-			m_indices.push_back(mesh.indices[triangleIt * 3 + 1] + firstVertex);
+	for (const ObjShape& shape : objShapes)
+	{
+		const u32 shapeFirstVertex = (u32)m_vertices.size();
+		for (MeshSegment segment : shape.segments)
+		{
+			segment.indexOffset += (u32)m_indices.size();
+			m_segments.push_back(segment);
+		}
+		for (u32 index : shape.indices)
+		{
+			m_indices.push_back(index + shapeFirstVertex);
+		}
+		m_vertices.insert(m_vertices.end(), shape.vertices.begin(), shape.vertices.end());
 
-			m_segments.back().indexCount += 3;
+		if (!shape.vertices.empty())
+		{
+			m_boundingBox.expand(shape.bounds.m_min);
+			m_boundingBox.expand(shape.bounds.m_max);
 		}
+		sourceVertexCount += shape.sourceVertexCount;
+	}
+	objShapes.clear();
 
-		m_vertexCount = (u32)m_vertices.size();
-		m_indexCount  = (u32)m_indices.size();
+	const size_t weldedVertexCount = weldVertices(m_vertices.data() + firstVertex, m_vertices.size() - firstVertex,
+	    sizeof(Vertex), m_indices.data() + firstIndex, m_indices.size() - firstIndex);
+	for (size_t i = firstIndex; i < m_indices.size(); ++i)
+	{
+		m_indices[i] += firstVertex;
 	}
+	m_vertices.resize(firstVertex + weldedVertexCount);
+
+	RUSH_LOG("Welded %u vertices to %u (%.1f MB -> %.1f MB)", u32(sourceVertexCount), u32(weldedVertexCount),
+	    sourceVertexCount * sizeof(Vertex) / double(1 << 20), weldedVertexCount * sizeof(Vertex) / double(1 << 20));
+
+	m_vertexCount = (u32)m_vertices.size();
+	m_indexCount  = (u32)m_indices.size();
 
 	createGpuScene();
 
@@ -1432,78 +2168,33 @@ void ExamplePathTracer::createGpuScene()
 	GfxBufferDesc ibDesc(GfxBufferFlags::Storage, GfxFormat_R32_Uint, m_indexCount, ibStride);
 	m_indexBuffer = Gfx_CreateBuffer(ibDesc, m_indices.data());
 
-	if (!m_pendingTextures.empty())
+	if (!m_textureStreaming && !m_textures.empty())
 	{
-		const u32 textureCount = u32(m_pendingTextures.size());
-		RUSH_LOG("Loading %d textures", textureCount);
-
-		std::vector<std::thread> loadingThreads;
-
-		u32 threadCount = std::thread::hardware_concurrency();
-		for (u32 i = 0; i < threadCount; ++i)
-		{
-			loadingThreads.push_back(std::thread([this]() { this->loadingThreadFunction(); }));
-		}
-
-		m_loadingThreadShouldExit = true;
-		loadingThreadFunction();
-		for (auto& it : loadingThreads)
-		{
-			it.join();
-		}
-
-		RUSH_LOG("Uploading textures to GPU");
-
-		while (!m_loadedTextures.empty())
+		// Decoding started as each texture was enqueued. Upload them as they finish rather than
+		// after the last one, so upload overlaps decode and decoded data doesn't pile up. This
+		// thread decodes too between uploads; once only jobs already running on workers are left,
+		// it sleeps until they finish.
+		RUSH_LOG("Loading %d textures", u32(m_textures.size()));
+		JobSystem& jobs = JobSystem::getDefault();
+		for (;;)
 		{
-			TextureData* textureData = nullptr;
-
-			textureData = m_loadedTextures.back();
-			m_loadedTextures.pop_back();
-
-			if (textureData)
+			const bool decodeFinished = m_textureLoadCounter.done();
+			uploadLoadedTextures();
+			if (decodeFinished)
 			{
-				GfxTextureData mipData[16] = {};
-				for (u32 i = 0; i < textureData->desc.mips; ++i)
-				{
-					mipData[i].pixels = textureData->mips[i].data();
-					mipData[i].mip = i;
-				}
-
-				u32 descriptorIndex = textureData->descriptorIndex;
-				auto texture = Gfx_CreateTexture(textureData->desc, mipData, textureData->desc.mips);
-				if (!texture.valid())
-				{
-					RUSH_LOG_ERROR("Failed to create texture '%s' (format %u)",
-					    textureData->filename.c_str(), u32(textureData->desc.format));
-					continue;
-				}
-				m_textureDescriptors[descriptorIndex] = std::move(texture);
+				break;
+			}
+			if (!jobs.tryRunJob())
+			{
+				jobs.wait(m_textureLoadCounter);
 			}
 		}
 	}
 
-	std::vector<GfxTexture> textureDescriptors;
-	textureDescriptors.resize(MaxTextures, m_textureDescriptors[m_defaultWhiteTextureId].get());
-
-	for (size_t i = 0; i < m_textureDescriptors.size(); ++i)
-	{
-		if (m_textureDescriptors[i].get().valid())
-		{
-			textureDescriptors[i] = m_textureDescriptors[i].get();
-		}
-	}
-
-	if (m_materialDescriptorSet.valid())
-	{
-		Gfx_UpdateDescriptorSet(m_materialDescriptorSet,
-			nullptr, // constant buffers
-			nullptr, // samplers
-			textureDescriptors.data(),
-			nullptr, // storage images
-			nullptr  // storage buffers
-		);
-	}
+	// When streaming, textures that are still decoding keep the default white texture
+	// until onUpdate() picks them up
+	updateTextureStreaming();
+	updateTextureDescriptors();
 
 	if (!m_materials.empty())
 	{
@@ -1511,10 +2202,11 @@ void ExamplePathTracer::createGpuScene()
 		m_materialBuffer = Gfx_CreateBuffer(materialDesc, m_materials.data());
 	}
 
-	const u32 triangleCount = m_indexCount / 3;
+	const u32        triangleCount = m_indexCount / 3;
+	std::vector<u32> materialIndices;
 	if (triangleCount > 0)
 	{
-		std::vector<u32> materialIndices(triangleCount, 0);
+		materialIndices.assign(triangleCount, 0);
 		for (const auto& segment : m_segments)
 		{
 			const u32 start = segment.indexOffset / 3;
@@ -1530,19 +2222,59 @@ void ExamplePathTracer::createGpuScene()
 		m_materialIndexBuffer = Gfx_CreateBuffer(indexDesc, materialIndices.data());
 	}
 
+	// Loaders that don't track meshes produce a single mesh drawn once
+	if (m_meshes.empty())
+	{
+		SceneMesh mesh;
+		mesh.segmentCount = u32(m_segments.size());
+		mesh.indexCount   = m_indexCount;
+		m_meshes.push_back(mesh);
+		m_instances.assign(1, MeshInstance());
+	}
+
+	if (m_cpuPathTracer)
+	{
+		static_assert(sizeof(Vertex) == CpuPathTracer::VertexSize, "Vertex must match the CPU path tracer");
+		static_assert(sizeof(MaterialConstants) == CpuPathTracer::MaterialSize, "MaterialConstants must match the CPU path tracer");
+		static_assert(sizeof(SceneConstants) == CpuPathTracer::SceneConstantsSize, "SceneConstants must match the CPU path tracer");
+
+		std::vector<CpuPathTracer::Mesh> meshes;
+		meshes.reserve(m_meshes.size());
+		for (const SceneMesh& mesh : m_meshes)
+		{
+			meshes.push_back({mesh.indexOffset, mesh.indexCount});
+		}
+
+		std::vector<CpuPathTracer::Instance> instances;
+		instances.reserve(m_instances.size());
+		for (const MeshInstance& instance : m_instances)
+		{
+			instances.push_back({instance.transform * m_worldTransform, instance.mesh});
+		}
+
+		CpuPathTracer::SceneDesc sceneDesc;
+		sceneDesc.vertices        = m_vertices.data();
+		sceneDesc.vertexCount     = m_vertexCount;
+		sceneDesc.indices         = m_indices.data();
+		sceneDesc.indexCount      = m_indexCount;
+		sceneDesc.materials       = m_materials.data();
+		sceneDesc.materialCount   = u32(m_materials.size());
+		sceneDesc.materialIndices = materialIndices.empty() ? nullptr : materialIndices.data();
+		sceneDesc.meshes          = meshes.data();
+		sceneDesc.meshCount       = u32(meshes.size());
+		sceneDesc.instances       = instances.data();
+		sceneDesc.instanceCount   = u32(instances.size());
+		m_cpuPathTracer->setScene(sceneDesc);
+	}
+
 	const bool rtReady = m_rtPipeline.valid() && m_materialDescriptorSet.valid();
 	if (rtReady)
 	{
-		RUSH_LOG("Creating ray tracing data");
-
-		DynamicArray<GfxRayTracingGeometryDesc> geometries;
-#if RUSH_RENDER_API != RUSH_RENDER_API_MTL
-		geometries.reserve(m_segments.size());
-#else
-		geometries.reserve(1);
-#endif
+		RUSH_LOG("Creating ray tracing data for %u meshes and %u instances", u32(m_meshes.size()), u32(m_instances.size()));
 
 #if RUSH_RENDER_API != RUSH_RENDER_API_MTL
+		// SBT records follow m_segments. Each instance offsets the hit group index by the first segment
+		// of its mesh, so the record index of a geometry is its global segment index.
 		const GfxCapability& caps             = Gfx_GetCapability();
 		const u32            shaderHandleSize = caps.rtShaderHandleSize;
 		const u32 sbtRecordSize = alignCeiling(u32(shaderHandleSize + sizeof(MaterialConstants)), shaderHandleSize);
@@ -1551,38 +2283,11 @@ void ExamplePathTracer::createGpuScene()
 		sbtData.resize(m_segments.size() * sbtRecordSize);
 
 		const u8* hitGroupHandle = Gfx_GetRayTracingShaderHandle(m_rtPipeline, GfxRayTracingShaderType::HitGroup, 0);
-#endif
 
-#if RUSH_RENDER_API == RUSH_RENDER_API_MTL
-		{
-			GfxRayTracingGeometryDesc geometryDesc;
-			geometryDesc.indexBuffer       = m_indexBuffer.get();
-			geometryDesc.indexFormat       = ibDesc.format;
-			geometryDesc.indexCount        = m_indexCount;
-			geometryDesc.indexBufferOffset = 0;
-			geometryDesc.vertexBuffer      = m_vertexBuffer.get();
-			geometryDesc.vertexFormat      = GfxFormat::GfxFormat_RGB32_Float;
-			geometryDesc.vertexStride      = sizeof(Vertex);
-			geometryDesc.vertexCount       = m_vertexCount;
-			geometries.push_back(geometryDesc);
-		}
-#else
 		for (size_t i = 0; i < m_segments.size(); ++i)
 		{
 			const auto& segment = m_segments[i];
 
-			GfxRayTracingGeometryDesc geometryDesc;
-			geometryDesc.indexBuffer       = m_indexBuffer.get();
-			geometryDesc.indexFormat       = ibDesc.format;
-			geometryDesc.indexCount        = segment.indexCount;
-			geometryDesc.indexBufferOffset = segment.indexOffset * ibStride;
-			geometryDesc.vertexBuffer      = m_vertexBuffer.get();
-			geometryDesc.vertexFormat      = GfxFormat::GfxFormat_RGB32_Float;
-			geometryDesc.vertexStride      = sizeof(Vertex);
-			geometryDesc.vertexCount       = m_vertexCount;
-			geometries.push_back(geometryDesc);
-
-#if RUSH_RENDER_API != RUSH_RENDER_API_MTL
 			u8* sbtRecord          = &sbtData[i * sbtRecordSize];
 			u8* sbtRecordConstants = sbtRecord + shaderHandleSize;
 
@@ -1591,20 +2296,69 @@ void ExamplePathTracer::createGpuScene()
 
 			memcpy(sbtRecord, hitGroupHandle, sizeof(shaderHandleSize));
 			memcpy(sbtRecordConstants, &materialConstants, sizeof(materialConstants));
-#endif
 		}
-#endif
 
-#if RUSH_RENDER_API != RUSH_RENDER_API_MTL
 		m_sbtBuffer = Gfx_CreateBuffer(
 		    GfxBufferFlags::Storage | GfxBufferFlags::RayTracing, u32(sbtData.size() / sbtRecordSize), sbtRecordSize, sbtData.data());
+#else
+		// Primitive IDs are relative to the mesh, the shader adds the first index of the hit instance's mesh
+		std::vector<u32> instanceIndexOffsets;
+		instanceIndexOffsets.reserve(m_instances.size());
+		for (const MeshInstance& instance : m_instances)
+		{
+			instanceIndexOffsets.push_back(m_meshes[instance.mesh].indexOffset);
+		}
+
+		GfxBufferDesc instanceIndexOffsetDesc(
+		    GfxBufferFlags::Storage, GfxFormat_Unknown, u32(instanceIndexOffsets.size()), sizeof(u32));
+		m_instanceIndexOffsetBuffer = Gfx_CreateBuffer(instanceIndexOffsetDesc, instanceIndexOffsets.data());
+#endif
+
+		m_blases.clear();
+		m_blases.reserve(m_meshes.size());
+
+		for (const SceneMesh& mesh : m_meshes)
+		{
+			DynamicArray<GfxRayTracingGeometryDesc> geometries;
+
+#if RUSH_RENDER_API == RUSH_RENDER_API_MTL
+			{
+				GfxRayTracingGeometryDesc geometryDesc;
+				geometryDesc.indexBuffer       = m_indexBuffer.get();
+				geometryDesc.indexFormat       = ibDesc.format;
+				geometryDesc.indexCount        = mesh.indexCount;
+				geometryDesc.indexBufferOffset = mesh.indexOffset * ibStride;
+				geometryDesc.vertexBuffer      = m_vertexBuffer.get();
+				geometryDesc.vertexFormat      = GfxFormat::GfxFormat_RGB32_Float;
+				geometryDesc.vertexStride      = sizeof(Vertex);
+				geometryDesc.vertexCount       = m_vertexCount;
+				geometries.push_back(geometryDesc);
+			}
+#else
+			geometries.reserve(mesh.segmentCount);
+			for (u32 i = mesh.segmentOffset; i < mesh.segmentOffset + mesh.segmentCount; ++i)
+			{
+				const auto& segment = m_segments[i];
+
+				GfxRayTracingGeometryDesc geometryDesc;
+				geometryDesc.indexBuffer       = m_indexBuffer.get();
+				geometryDesc.indexFormat       = ibDesc.format;
+				geometryDesc.indexCount        = segment.indexCount;
+				geometryDesc.indexBufferOffset = segment.indexOffset * ibStride;
+				geometryDesc.vertexBuffer      = m_vertexBuffer.get();
+				geometryDesc.vertexFormat      = GfxFormat::GfxFormat_RGB32_Float;
+				geometryDesc.vertexStride      = sizeof(Vertex);
+				geometryDesc.vertexCount       = m_vertexCount;
+				geometries.push_back(geometryDesc);
+			}
 #endif
 
-		GfxAccelerationStructureDesc blasDesc;
-		blasDesc.type         = GfxAccelerationStructureType::BottomLevel;
-		blasDesc.geometryCount = u32(geometries.size());
-		blasDesc.geometries   = geometries.data();
-		m_blas                = Gfx_CreateAccelerationStructure(blasDesc);
+			GfxAccelerationStructureDesc blasDesc;
+			blasDesc.type          = GfxAccelerationStructureType::BottomLevel;
+			blasDesc.geometryCount = u32(geometries.size());
+			blasDesc.geometries    = geometries.data();
+			m_blases.push_back(Gfx_CreateAccelerationStructure(blasDesc));
+		}
 	}
 }
 
@@ -1701,158 +2455,446 @@ void ExamplePathTracer::loadConfig()
 	m_frameIndex = 0;
 }
 
-bool ExamplePathTracer::loadModel(const char* filename)
+// Binary scene cache: the converted vertices, indices, segments, meshes, instances and materials of a model, so
+// repeat launches read them back instead of parsing and baking the source again. Entries are
+// keyed by the content hash of the model file and record the other files the conversion read
+// (glTF buffers, OBJ material libraries) with their hashes. Material texture ids are stored
+// together with the files they came from and re-resolved through enqueueLoadTexture() on load.
+// Paths are kept relative to the model, so moved or copied scenes still hit the cache.
+static constexpr u32 kSceneCacheMagic   = 0x43535450; // 'PTSC'
+static constexpr u32 kSceneCacheVersion = 2;
+
+namespace
 {
-	RUSH_LOG("Loading model '%s'", filename);
+enum SceneCacheFlags : u32
+{
+	SceneCacheFlag_Normals    = 1 << 0,
+	SceneCacheFlag_Tangents   = 1 << 1,
+	SceneCacheFlag_Texcoords  = 1 << 2,
+	SceneCacheFlag_NormalMaps = 1 << 3,
+};
+
+struct SceneCacheHeader
+{
+	u32  magic;
+	u32  version;
+	u32  flags;
+	u32  vertexSize; // catches Vertex and MaterialConstants layout changes without a version bump
+	u32  materialSize;
+	u32  reserved;
+	Vec3 boundsMin;
+	Vec3 boundsMax;
+};
+
+// FileIn/FileOut take 32-bit sizes; large scenes go through in 1GB pieces
+constexpr u64 SceneCacheIoChunk = 1ull << 30;
+
+class SceneCacheWriter
+{
+public:
+	SceneCacheWriter(const char* filename) : m_stream(filename) {}
+
+	bool ok() const { return m_ok && m_stream.valid(); }
 
-	if (endsWith(filename, ".obj"))
+	void write(const void* data, u64 size)
 	{
-		return loadModelObj(filename);
+		const u8* bytes = static_cast<const u8*>(data);
+		while (ok() && size)
+		{
+			const u32 chunk = u32(min(size, SceneCacheIoChunk));
+			m_ok            = m_stream.write(bytes, chunk) == chunk;
+			bytes += chunk;
+			size -= chunk;
+		}
 	}
-	if (endsWith(filename, ".gltf"))
+
+	template <typename T> void writeT(const T& value) { write(&value, sizeof(T)); }
+
+	template <typename T> void writeVector(const std::vector<T>& data)
 	{
-		return loadModelGLTF(filename);
+		writeT(u32(data.size()));
+		write(data.data(), u64(data.size()) * sizeof(T));
 	}
-	else
+
+	void writeString(const std::string& str)
 	{
-		RUSH_LOG_ERROR("Unsupported model file extension.");
-		return false;
+		writeT(u32(str.size()));
+		write(str.data(), str.size());
 	}
-}
 
-// Discrete probability distribution sampling based on alias method
-// http://www.keithschwarz.com/darts-dice-coins
-template <typename T>
-struct DiscreteDistribution
+private:
+	FileOut m_stream;
+	bool    m_ok = true;
+};
+
+class SceneCacheReader
 {
-	typedef std::pair<T, size_t> Cell;
+public:
+	SceneCacheReader(const char* filename, u64 fileSize) : m_stream(filename), m_remaining(fileSize) {}
 
-	DiscreteDistribution(const T* weights, size_t count, T weightSum)
+	bool ok() const { return m_ok && m_stream.valid(); }
+
+	void read(void* data, u64 size)
 	{
-		std::vector<Cell> large;
-		std::vector<Cell> small;
-		for (size_t i = 0; i < count; ++i)
+		if (size > m_remaining)
 		{
-			T p = weights[i] * count / weightSum;
-			if (p < T(1)) small.push_back({ p, i });
-			else large.push_back({ p, i });
+			m_ok = false;
 		}
-
-		m_cells.resize(count, { T(0), 0 });
-
-		while (large.size() && small.size())
+		u8* bytes = static_cast<u8*>(data);
+		while (ok() && size)
 		{
-			auto l = small.back(); small.pop_back();
-			auto g = large.back(); large.pop_back();
-			m_cells[l.second].first = l.first;
-			m_cells[l.second].second = g.second;
-			g.first = (l.first + g.first) - T(1);
-			if (g.first < T(1))
-			{
-				small.push_back(g);
-			}
-			else
-			{
-				large.push_back(g);
-			}
+			const u32 chunk = u32(min(size, SceneCacheIoChunk));
+			m_ok            = m_stream.read(bytes, chunk) == chunk;
+			bytes += chunk;
+			size -= chunk;
+			m_remaining -= chunk;
 		}
+	}
+
+	template <typename T> void readT(T& value) { read(&value, sizeof(T)); }
 
-		while (large.size())
+	// Counts are checked against the bytes left, so a damaged entry can't request a huge allocation
+	template <typename T> void readVector(std::vector<T>& data)
+	{
+		u32 count = 0;
+		readT(count);
+		if (!ok() || u64(count) * sizeof(T) > m_remaining)
 		{
-			auto g = large.back(); large.pop_back();
-			m_cells[g.second].first = T(1);
+			m_ok = false;
+			return;
 		}
+		data.resize(count);
+		read(data.data(), u64(count) * sizeof(T));
+	}
 
-		while (small.size())
+	void readString(std::string& str)
+	{
+		u32 length = 0;
+		readT(length);
+		if (!ok() || length > m_remaining)
 		{
-			auto l = small.back(); small.pop_back();
-			m_cells[l.second].first = T(1);
+			m_ok = false;
+			return;
 		}
+		str.resize(length);
+		read(str.data(), length);
 	}
 
-	std::vector<Cell> m_cells;
+private:
+	FileIn m_stream;
+	u64    m_remaining;
+	bool   m_ok = true;
 };
 
-inline double latLongTexelArea(Vec2 pos, Vec2 imageSize)
+std::string getSceneCachePath(u64 modelHash)
 {
-	Vec2 uv0 = pos / imageSize;
-	Vec2 uv1 = (pos + Vec2(1.0f)) / imageSize;
+	const u64 key = computeContentHash(&kSceneCacheVersion, sizeof(kSceneCacheVersion), modelHash);
 
-	double theta0 = Pi * (uv0.x * 2.0 - 1.0);
-	double theta1 = Pi * (uv1.x * 2.0 - 1.0);
+	char name[64];
+	snprintf(name, sizeof(name), "PathTracer_scene_%016llx.bin", static_cast<unsigned long long>(key));
 
-	double phi0 = Pi * (uv0.y - 0.5);
-	double phi1 = Pi * (uv1.y - 0.5);
+	return std::string(Platform_GetExecutableDirectory()) + "/SceneCache/" + name;
+}
 
-	return abs(theta1 - theta0) * abs(sin(phi1) - sin(phi0));
+// Paths produced by the loaders all start with the model directory
+bool makeModelRelativePath(const std::string& path, const std::string& directory, std::string& out)
+{
+	if (path.compare(0, directory.size(), directory) != 0)
+	{
+		return false;
+	}
+	out = path.substr(directory.size());
+	return true;
+}
 }
 
-void ExamplePathTracer::loadEnvmap(const char* filename)
+bool ExamplePathTracer::loadSceneCache(const std::string& cachePath, const std::string& directory)
 {
-	struct EnvmapCell
+	std::error_code ec;
+	const u64       fileSize = std::filesystem::file_size(cachePath, ec);
+	if (ec)
+	{
+		return false;
+	}
+
+	SceneCacheReader reader(cachePath.c_str(), fileSize);
+
+	SceneCacheHeader header = {};
+	reader.readT(header);
+	if (!reader.ok() || header.magic != kSceneCacheMagic || header.version != kSceneCacheVersion ||
+	    header.vertexSize != sizeof(Vertex) || header.materialSize != sizeof(MaterialConstants))
+	{
+		return false;
+	}
+
+	u32 dependencyCount = 0;
+	reader.readT(dependencyCount);
+	for (u32 i = 0; i < dependencyCount && reader.ok(); ++i)
 	{
-		float p;
-		u32 i;
+		std::string path;
+		u64         expectedHash = 0;
+		reader.readString(path);
+		reader.readT(expectedHash);
+
+		u64 hash = 0;
+		if (reader.ok() && (!computeFileContentHash((directory + path).c_str(), hash) || hash != expectedHash))
+		{
+			RUSH_LOG("Scene cache entry is out of date, '%s' changed", (directory + path).c_str());
+			return false;
+		}
+	}
+
+	struct TextureRef
+	{
+		u32         descriptorIndex = 0;
+		GfxFormat   format          = GfxFormat_Unknown;
+		std::string path;
 	};
 
-	FileIn f(filename);
-	if (f.valid())
+	u32 textureCount = 0;
+	reader.readT(textureCount);
+	std::vector<TextureRef> textures(reader.ok() ? min<u32>(textureCount, MaxTextures) : 0);
+	for (TextureRef& texture : textures)
+	{
+		reader.readT(texture.descriptorIndex);
+		reader.readT(texture.format);
+		reader.readString(texture.path);
+	}
+
+	std::vector<MaterialConstants> materials;
+	std::vector<MeshSegment>       segments;
+	std::vector<SceneMesh>         meshes;
+	std::vector<MeshInstance>      instances;
+	std::vector<u32>               indices;
+	std::vector<Vertex>            vertices;
+	reader.readVector(materials);
+	reader.readVector(segments);
+	reader.readVector(meshes);
+	reader.readVector(instances);
+	reader.readVector(indices);
+	reader.readVector(vertices);
+
+	// Every range and index is used unchecked by the BLAS builds, the material table and the CPU
+	// BVH build, so a well-framed entry with bad contents must not get past this point
+	bool contentsValid = true;
+	for (const MeshInstance& instance : instances)
+	{
+		contentsValid &= instance.mesh < meshes.size();
+	}
+	for (const MeshSegment& segment : segments)
+	{
+		contentsValid &= u64(segment.indexOffset) + segment.indexCount <= indices.size();
+		contentsValid &= segment.material < materials.size();
+	}
+	for (const SceneMesh& mesh : meshes)
+	{
+		contentsValid &= u64(mesh.indexOffset) + mesh.indexCount <= indices.size();
+		contentsValid &= u64(mesh.segmentOffset) + mesh.segmentCount <= segments.size();
+	}
+	for (u32 index : indices)
+	{
+		contentsValid &= index < vertices.size();
+	}
+
+	if (!reader.ok() || textureCount != textures.size() || !contentsValid)
+	{
+		RUSH_LOG_ERROR("Scene cache entry '%s' is damaged", cachePath.c_str());
+		return false;
+	}
+
+	// Texture files are loaded as usual and may land in different descriptors this time
+	std::unordered_map<u32, u32> descriptorRemap;
+	for (const TextureRef& texture : textures)
+	{
+		std::string filename = directory + texture.path;
+		fixDirectorySeparatorsInplace(filename);
+		descriptorRemap[texture.descriptorIndex] = enqueueLoadTexture(filename, texture.format);
+	}
+	for (MaterialConstants& material : materials)
 	{
-		RUSH_LOG("Loading envmap '%s'", filename);
+		for (u32* id : {&material.albedoTextureId, &material.specularTextureId, &material.normalTextureId})
+		{
+			auto it = descriptorRemap.find(*id);
+			if (it != descriptorRemap.end())
+			{
+				*id = it->second;
+			}
+		}
+	}
 
-		int width, height, comp;
-		Vec4* img = (Vec4*)stbi_loadf(filename, &width, &height, &comp, 4);
+	m_materials      = std::move(materials);
+	m_segments       = std::move(segments);
+	m_meshes         = std::move(meshes);
+	m_instances      = std::move(instances);
+	m_indices        = std::move(indices);
+	m_vertices       = std::move(vertices);
+	m_vertexCount    = u32(m_vertices.size());
+	m_indexCount     = u32(m_indices.size());
+	m_boundingBox    = Box3(header.boundsMin, header.boundsMax);
+	m_haveNormals    = (header.flags & SceneCacheFlag_Normals) != 0;
+	m_haveTangents   = (header.flags & SceneCacheFlag_Tangents) != 0;
+	m_haveTexcoords  = (header.flags & SceneCacheFlag_Texcoords) != 0;
+	m_haveNormalMaps = (header.flags & SceneCacheFlag_NormalMaps) != 0;
 
-		const Vec2 imageSize = Vec2(float(width), float(height));
+	return true;
+}
 
-		std::vector<double> weights;
-		std::vector<double> areas;
+void ExamplePathTracer::saveSceneCache(const std::string& cachePath, const std::string& directory)
+{
+	std::vector<std::pair<std::string, u64>> dependencies;
+	for (const std::string& filename : m_modelDependencies)
+	{
+		std::pair<std::string, u64> dependency;
+		if (!makeModelRelativePath(filename, directory, dependency.first) ||
+		    !computeFileContentHash(filename.c_str(), dependency.second))
+		{
+			return;
+		}
+		dependencies.push_back(std::move(dependency));
+	}
 
-		const u64 pixelCount = u64(width) * height;
-		weights.reserve(pixelCount);
-		areas.reserve(pixelCount);
+	std::string directoryWithSeparators = directory;
+	fixDirectorySeparatorsInplace(directoryWithSeparators);
 
-		double weightSum = 0;
-		for (u64 i = 0; i < pixelCount; ++i)
+	std::vector<std::string> texturePaths;
+	for (const auto& texture : m_textures)
+	{
+		texturePaths.emplace_back();
+		if (!makeModelRelativePath(texture->filename, directoryWithSeparators, texturePaths.back()))
 		{
-			//img[i] = Vec4(1.0);
+			return;
+		}
+	}
 
-			u32 x = u32(i % width);
-			u32 y = u32(i / width);
-			Vec2 pixelPos = Vec2(float(x), float(y));
+	const std::filesystem::path path = cachePath;
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	SceneCacheHeader header = {};
+	header.magic            = kSceneCacheMagic;
+	header.version          = kSceneCacheVersion;
+	header.vertexSize       = sizeof(Vertex);
+	header.materialSize     = sizeof(MaterialConstants);
+	header.boundsMin        = m_boundingBox.m_min;
+	header.boundsMax        = m_boundingBox.m_max;
+	header.flags |= m_haveNormals ? SceneCacheFlag_Normals : 0;
+	header.flags |= m_haveTangents ? SceneCacheFlag_Tangents : 0;
+	header.flags |= m_haveTexcoords ? SceneCacheFlag_Texcoords : 0;
+	header.flags |= m_haveNormalMaps ? SceneCacheFlag_NormalMaps : 0;
+
+	const std::string tempPath = cachePath + ".tmp";
+	bool              written  = false;
+	{
+		SceneCacheWriter writer(tempPath.c_str());
 
-			double pixelIntensity = double(img[i].xyz().reduceMax());
-			double pixelArea = latLongTexelArea(pixelPos, imageSize);
-			double weight = pixelArea * pixelIntensity;
+		writer.writeT(header);
 
-			weights.push_back(weight);
-			areas.push_back(pixelArea);
-			weightSum += weight;
+		writer.writeT(u32(dependencies.size()));
+		for (const auto& dependency : dependencies)
+		{
+			writer.writeString(dependency.first);
+			writer.writeT(dependency.second);
 		}
 
-		for (u64 i = 0; i < pixelCount; ++i)
+		writer.writeT(u32(m_textures.size()));
+		for (size_t i = 0; i < m_textures.size(); ++i)
 		{
-			double pdf = (weights[i] / weightSum) / areas[i];
-			img[i].w = float(pdf);
+			writer.writeT(m_textures[i]->descriptorIndex);
+			writer.writeT(m_textures[i]->requestedFormat);
+			writer.writeString(texturePaths[i]);
 		}
 
-		DiscreteDistribution<double> distribution(weights.data(), weights.size(), weightSum);
+		writer.writeVector(m_materials);
+		writer.writeVector(m_segments);
+		writer.writeVector(m_meshes);
+		writer.writeVector(m_instances);
+		writer.writeVector(m_indices);
+		writer.writeVector(m_vertices);
+
+		written = writer.ok();
+	}
+
+	if (!written)
+	{
+		RUSH_LOG_ERROR("Failed to write scene cache entry '%s'", tempPath.c_str());
+		std::filesystem::remove(tempPath, ec);
+		return;
+	}
+
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+	}
+}
+
+bool ExamplePathTracer::loadModel(const char* filename)
+{
+	RUSH_LOG("Loading model '%s'", filename);
+
+	const bool isObj  = endsWith(filename, ".obj");
+	const bool isGltf = endsWith(filename, ".gltf");
+	if (!isObj && !isGltf)
+	{
+		RUSH_LOG_ERROR("Unsupported model file extension.");
+		return false;
+	}
 
-		std::vector<EnvmapCell> envmapDistributionBuffer;
-		envmapDistributionBuffer.reserve(pixelCount);
-		for (u64 i = 0; i < pixelCount; ++i)
+	const std::string directory = directoryFromFilename(filename);
+
+	std::string cachePath;
+	u64         modelHash = 0;
+	if (m_useSceneCache && computeFileContentHash(filename, modelHash))
+	{
+		Timer timer;
+		cachePath = getSceneCachePath(modelHash);
+		if (loadSceneCache(cachePath, directory))
 		{
-			EnvmapCell cell;
-			cell.p = float(distribution.m_cells[i].first);
-			cell.i = u32(distribution.m_cells[i].second);
-			envmapDistributionBuffer.push_back(cell);
+			RUSH_LOG("Loaded %u vertices and %u triangles from the scene cache in %.1f ms", m_vertexCount,
+			    m_indexCount / 3, timer.time() * 1000.0);
+			createGpuScene();
+			return true;
 		}
+	}
+
+	m_modelDependencies.clear();
+	const bool loaded = isObj ? loadModelObj(filename) : loadModelGLTF(filename);
+	if (loaded && !cachePath.empty())
+	{
+		saveSceneCache(cachePath, directory);
+	}
+
+	return loaded;
+}
+
+void ExamplePathTracer::loadEnvmap(const char* filename)
+{
+	// Matches EnvmapCell in Common.glsl
+	static_assert(sizeof(AliasTableCell) == 8, "Envmap distribution cells must be 8 bytes");
+
+	Timer      timer;
+	EnvmapData envmap;
+	if (loadEnvmapData(filename, m_envmapFormat, "PathTracer", envmap))
+	{
+		const u32 texelCount = u32(envmap.getTexelCount());
+
+		m_envmap = Gfx_CreateTexture(GfxTextureDesc::make2D(envmap.width, envmap.height, envmap.colorFormat), envmap.color);
+		m_envmapPdf = Gfx_CreateTexture(GfxTextureDesc::make2D(envmap.width, envmap.height, EnvmapData::PdfFormat), envmap.pdf);
+		m_envmapDistribution = Gfx_CreateBuffer(GfxBufferFlags::Storage, texelCount, sizeof(AliasTableCell), envmap.cells);
 
-		GfxTextureDesc desc = GfxTextureDesc::make2D(width, height, GfxFormat_RGBA32_Float);
-		m_envmap = Gfx_CreateTexture(desc, img);
-		m_envmapDistribution = Gfx_CreateBuffer(GfxBufferFlags::Storage, u32(pixelCount), sizeof(EnvmapCell), envmapDistributionBuffer.data());
+		if (m_cpuPathTracer)
+		{
+			// m_envmapFormat is RGBA32_Float in this mode, which loadEnvmapData() never narrows
+			RUSH_ASSERT(envmap.colorFormat == GfxFormat_RGBA32_Float);
+			m_cpuPathTracer->setEnvmap(envmap.width, envmap.height, static_cast<const float*>(envmap.color), envmap.pdf, envmap.cells);
+		}
 
-		free(img);
+		const size_t gpuBytes = envmap.getColorSize() + size_t(texelCount) * (sizeof(float) + sizeof(AliasTableCell));
+		RUSH_LOG("Loaded envmap '%s' (%ux%u, %s) %s in %.1f ms, %.1f MB on the GPU", filename, envmap.width, envmap.height,
+		    envmap.colorFormat == GfxFormat_RGBA16_Float ? "RGBA16F" : "RGBA32F",
+		    envmap.file.valid() ? "from cache" : "and built its distribution", timer.time() * 1000.0,
+		    double(gpuBytes) / (1024.0 * 1024.0));
 
 		m_settings.m_useEnvmap = true;
 	}
@@ -1862,7 +2904,15 @@ void ExamplePathTracer::loadEnvmap(const char* filename)
 		GfxTextureDesc desc = GfxTextureDesc::make2D(1, 1, GfxFormat_RGBA32_Float);
 		m_envmap = Gfx_CreateTexture(desc, &img);
 
-		EnvmapCell envmapCell = {};
-		m_envmapDistribution = Gfx_CreateBuffer(GfxBufferFlags::Storage, 1, sizeof(EnvmapCell), &envmapCell);
+		float pdf = 0.0f;
+		m_envmapPdf = Gfx_CreateTexture(GfxTextureDesc::make2D(1, 1, EnvmapData::PdfFormat), &pdf);
+
+		AliasTableCell envmapCell = {};
+		m_envmapDistribution = Gfx_CreateBuffer(GfxBufferFlags::Storage, 1, sizeof(AliasTableCell), &envmapCell);
+
+		if (m_cpuPathTracer)
+		{
+			m_cpuPathTracer->setEnvmap(1, 1, &img.x, &pdf, &envmapCell);
+		}
 	}
 }
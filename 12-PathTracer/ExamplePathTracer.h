@@ -8,7 +8,12 @@
 #include <Rush/UtilTimer.h>
 #include <Rush/Window.h>
 
+#include <Common/CompletionQueue.h>
+#include <Common/ContentHash.h>
 #include <Common/ExampleApp.h>
+#include <Common/GpuReadback.h>
+#include <Common/JobSystem.h>
+#include <Common/TextureCache.h>
 #include <Common/Utils.h>
 #include <Common/VirtualGamepad.h>
 
@@ -21,6 +26,8 @@
 
 #include "Common.glsl"
 
+class CpuPathTracer;
+
 class ExamplePathTracer : public ExampleApp
 {
 public:
@@ -37,7 +44,10 @@ private:
 	bool loadModel(const char* filename);
 	bool loadModelObj(const char* filename);
 	bool loadModelGLTF(const char* filename);
+	bool loadSceneCache(const std::string& cachePath, const std::string& directory);
+	void saveSceneCache(const std::string& cachePath, const std::string& directory);
 
+	// format may be a BCn format, in which case the image is encoded after mip generation
 	u32 enqueueLoadTexture(const std::string& filename, GfxFormat format);
 
 	Timer m_timer;
@@ -46,9 +56,10 @@ private:
 	{
 		MovingAverage<double, 60> gpuTotal;
 		MovingAverage<double, 60> cpuTotal;
+		MovingAverage<double, 60> cpuTrace;
 	} m_stats;
 
-	double m_totalGpuRenderTime = 0;
+	double m_totalGpuRenderTime = 0; // trace time on the CPU backend
 
 	Camera m_camera;
 	CameraManipulator* m_cameraMan;
@@ -73,6 +84,7 @@ private:
 	GfxOwn<GfxBuffer> m_materialBuffer;
 	GfxOwn<GfxBuffer> m_materialIndexBuffer;
 	GfxOwn<GfxBuffer> m_rtInstanceBuffer;
+	GfxOwn<GfxBuffer> m_instanceIndexOffsetBuffer; // Metal: first index of each instance's mesh
 	u32 m_indexCount = 0;
 	u32 m_vertexCount = 0;
 
@@ -112,6 +124,8 @@ private:
 
 	std::string m_statusString;
 	std::string m_modelFilename;
+	std::vector<std::string> m_modelDependencies; // other files the model loaders read
+	bool m_useSceneCache = true;
 	bool m_valid = false;
 
 	bool m_haveNormals = false;
@@ -159,28 +173,80 @@ private:
 
 	std::vector<MeshSegment> m_segments;
 
+	// Each unique mesh owns a contiguous run of segments and indices, and gets its own BLAS
+	struct SceneMesh
+	{
+		u32 segmentOffset = 0;
+		u32 segmentCount = 0;
+		u32 indexOffset = 0;
+		u32 indexCount = 0;
+	};
+
+	// Nodes that share a mesh become TLAS instances of the same BLAS
+	struct MeshInstance
+	{
+		Mat4 transform = Mat4::identity(); // mesh space to model space, before m_worldTransform
+		u32 mesh = 0;
+	};
+
+	std::vector<SceneMesh>    m_meshes;
+	std::vector<MeshInstance> m_instances;
+
 	WindowEventListener m_windowEvents;
 
 	float m_cameraScale = 1.0f;
 
 	struct TextureData
 	{
-		GfxTextureDesc     desc;
-		std::vector<u8>    mips[16];
+		GfxTextureDesc     desc;            // set on the main thread once the texture is loaded
+		StagedTexture      staged;
+		GfxFormat          requestedFormat; // as passed to enqueueLoadTexture(), kept in the scene cache
+		GfxFormat          loadFormat;      // requested format, or its source format when compression is off
 		u32                descriptorIndex;
 		std::string        filename;
+		u32                residentMip    = 0; // finest mip level currently on the GPU
+		u64                residentBytes  = 0;
+		u32                duplicateCount = 0; // other files with identical contents sharing this texture
+		u64                contentHash    = 0; // raw file hash, only computed when another file has the same size
+		bool               contentHashed  = false;
 	};
 
 	std::vector<GfxOwn<GfxTexture>> m_textureDescriptors;
 
-	std::unordered_map<std::string, TextureData*> m_textures;
-	std::vector<TextureData*>                     m_pendingTextures;
-	std::vector<TextureData*>                     m_loadedTextures;
+	std::vector<std::unique_ptr<TextureData>>          m_textures;
+	std::unordered_map<std::string, TextureData*>      m_texturesByName;
+	std::unordered_map<u64, std::vector<TextureData*>> m_texturesBySize; // file size combined with format
+	CompletionQueue<TextureData*>                      m_loadedTextures; // pushed by loader jobs
+	JobCounter                                         m_textureLoadCounter;
+	bool                                               m_useTextureCompression = true;
+
+	struct TextureUploadStats
+	{
+		u32    enqueueCount         = 0;
+		u32    uploadCount          = 0;
+		u32    overlappedCount      = 0; // textures first uploaded while others were still decoding
+		Timer  loadTimer;                  // reset at the first enqueue; m_timer restarts every frame
+		double uploadTime           = 0; // seconds spent in Gfx_CreateTexture
+		double overlappedUploadTime = 0;
+		bool   reported             = false;
+	} m_textureUploadStats;
+
+	// Streaming uploads a small tail of the mip chain as soon as a texture is decoded, then adds
+	// finer levels a few per frame while the resident total stays under the budget (0 = unlimited).
+	static constexpr u32    TextureStreamingTailSize      = 64;
+	static constexpr u64    TextureStreamingBytesPerFrame = 32ull << 20;
+	static constexpr double TextureStreamingResetInterval = 0.5; // seconds between accumulation restarts
+	bool                      m_textureStreaming     = true;
+	u64                       m_textureBudgetBytes   = 0;
+	u64                       m_textureResidentBytes = 0;
+	std::vector<TextureData*> m_streamingTextures;
+	bool                      m_textureResetPending  = false;
+	Timer                     m_textureResetTimer;        // never reset, unlike the per-frame m_timer
+	double                    m_lastTextureResetTime = 0; // on m_textureResetTimer
 
 	static constexpr u32     MaxTextures = PT_MAX_TEXTURES;
 	GfxOwn<GfxDescriptorSet> m_materialDescriptorSet;
 
-	bool m_loadingThreadShouldExit = false;
 	u32 m_frameIndex = 0;
 	bool m_showUI = true;
 	std::string m_startupError;
@@ -189,18 +255,46 @@ private:
 	std::mutex m_loadingMutex;
 
 	GfxOwn<GfxRayTracingPipeline>    m_rtPipeline;
-	GfxOwn<GfxAccelerationStructure> m_blas;
+	std::vector<GfxOwn<GfxAccelerationStructure>> m_blases; // one per SceneMesh
 	GfxOwn<GfxAccelerationStructure> m_tlas;
 	GfxOwn<GfxBuffer>                m_sbtBuffer;
 	GfxOwn<GfxTexture>               m_outputImage;
 	GfxOwn<GfxRenderPipeline>        m_blitTonemap;
 	GfxOwn<GfxTexture>               m_envmap;
+	GfxOwn<GfxTexture>               m_envmapPdf;
 	GfxOwn<GfxBuffer>                m_envmapDistribution;
-
-	// click-to-focus: shader writes the cursor pixel's depth here, read back same frame
-	GfxOwn<GfxBuffer> m_focusFeedbackBuffer;
-	Tuple2i           m_focusPickPixel = {};
-	bool              m_focusPickRequested = false;
+	GfxFormat                        m_envmapFormat = GfxFormat_RGBA16_Float; // --envmap-format rgba16f|rgba32f
+
+	// CPU backend, used when ray tracing is unavailable or with --cpu-tracer 1. It reads the same
+	// scene arrays and textures; its output is uploaded each frame and copied into m_outputImage.
+	std::unique_ptr<CpuPathTracer> m_cpuPathTracer;
+	GfxOwn<GfxComputeShader>       m_copyOutputShader;
+	GfxOwn<GfxComputePipeline>     m_copyOutputPipeline;
+	GfxOwn<GfxBuffer>              m_cpuOutputBuffer; // transient, one RGBA32F texel per output pixel
+
+	// click-to-focus: shader writes the cursor pixel's depth here, read back SlotCount frames later
+	GpuReadbackRing m_focusReadback;
+	Tuple2i         m_focusPickPixel = {};
+	bool            m_focusPickRequested = false;
+
+	// Adaptive sampling: the shader skips tiles whose sample count is PT_ADAPTIVE_TILE_CONVERGED and
+	// reports the largest pixel error of the others, read back SlotCount frames later on the GPU
+	struct AdaptiveTile
+	{
+		u32   sampleCount = 0;
+		u32   pixelCount  = 0;
+		float error       = -1.0f; // < 0 = not measured yet
+	};
+	std::vector<AdaptiveTile> m_adaptiveTiles;
+	std::vector<u32>          m_adaptiveTileSamples; // uploaded every frame
+	Tuple2i                   m_adaptiveGridSize     = {};
+	u64                       m_adaptiveEpoch        = 0; // bumped on reset, older read backs are dropped
+	u64                       m_adaptivePixelSamples = 0; // samples traced since the reset, summed over pixels
+	bool                      m_adaptiveActive       = false;
+	bool                      m_adaptiveConverged    = false;
+	float                     m_exitTargetError      = 0.0f; // --target-error: quit once converged, 0 = never
+	GfxOwn<GfxBuffer>         m_tileSampleBuffer;
+	GpuReadbackRing           m_tileErrorReadback;
 
 	struct Settings
 	{
@@ -223,6 +317,8 @@ private:
 		bool m_showFocusAssist = false;
 		float m_focusAssistFalloffPx = 4.0f;
 		float m_envmapRotationDegrees = 0.0;
+		bool m_adaptiveSampling = false;
+		float m_adaptiveTargetError = 0.02f; // relative standard error of the pixel mean
 
 		template <typename Ar> void describe(Ar& ar)
 		{
@@ -245,6 +341,8 @@ private:
 			ar.field("showFocusAssist", m_showFocusAssist);
 			ar.field("focusAssistFalloffPx", m_focusAssistFalloffPx);
 			ar.field("envmapRotationDegrees", m_envmapRotationDegrees);
+			ar.field("adaptiveSampling", m_adaptiveSampling);
+			ar.field("adaptiveTargetError", m_adaptiveTargetError);
 		}
 	};
 
@@ -262,9 +360,18 @@ private:
 		}
 	};
 
-	void loadingThreadFunction();
+	void loadTexture(TextureData* textureData);
+	bool uploadTextureMips(TextureData* textureData, u32 firstMip);
+	void releaseTextureSource(TextureData* textureData);
+	bool uploadLoadedTextures();   // returns true if any texture changed
+	bool updateTextureStreaming(); // returns true if any texture changed
+	void updateTextureDescriptors();
 	void createRayTracingScene(GfxContext* ctx);
 
+	bool   updateAdaptiveSampling(Tuple2i outputSize); // returns true if tiles may be skipped this frame
+	void   applyTileErrors(const float* errors);
+	double getSamplesPerPixel() const;
+
 	void createGpuScene();
 	std::string configFilePath() const;
 	void saveConfig();
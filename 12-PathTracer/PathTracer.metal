@@ -72,14 +72,18 @@ struct PathTracerSet0
 	constant SceneConstants* scene [[id(0)]];
 	sampler defaultSampler [[id(1)]];
 	texture2d<float, access::sample> envmapTexture [[id(2)]];
-	texture2d<float, access::read_write> outputImage [[id(3)]];
-	device uint* indexBuffer [[id(4)]];
-	device Vertex* vertexBuffer [[id(5)]];
-	device EnvmapCell* envmapDistribution [[id(6)]];
-	device MaterialConstants* materials [[id(7)]];
-	device uint* materialIndices [[id(8)]];
-	device float* focusFeedback [[id(9)]];
-	instance_acceleration_structure tlas [[id(10)]];
+	texture2d<float, access::sample> envmapPdfTexture [[id(3)]];
+	texture2d<float, access::read_write> outputImage [[id(4)]];
+	device uint* indexBuffer [[id(5)]];
+	device Vertex* vertexBuffer [[id(6)]];
+	device EnvmapCell* envmapDistribution [[id(7)]];
+	device MaterialConstants* materials [[id(8)]];
+	device uint* materialIndices [[id(9)]];
+	device float* focusFeedback [[id(10)]];
+	device uint* instanceIndexOffsets [[id(11)]]; // first index of each instance's mesh
+	device uint* tileSampleCount [[id(12)]];
+	device atomic_uint* tileError [[id(13)]];
+	instance_acceleration_structure tlas [[id(14)]];
 };
 
 struct PathTracerSet1
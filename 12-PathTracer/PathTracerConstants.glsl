@@ -12,6 +12,14 @@
 #define PT_FLAG_DEBUG_DISABLE_ACCUMULATION (1u << 5u)
 #define PT_FLAG_DEBUG_HIT_MASK             (1u << 6u)
 #define PT_FLAG_DEBUG_FOCAL_PLANE          (1u << 7u)
+#define PT_FLAG_ADAPTIVE_SAMPLING          (1u << 8u)
+
+// Adaptive sampling tracks square tiles of pixels. The host stops tracing a tile once the largest
+// error estimate of its pixels is below the target, but never before PT_ADAPTIVE_MIN_SAMPLES.
+#define PT_ADAPTIVE_TILE_SIZE       16u
+#define PT_ADAPTIVE_MIN_SAMPLES     16u
+#define PT_ADAPTIVE_TILE_CONVERGED  0xFFFFFFFFu // tile sample count of tiles that are skipped
+#define PT_ADAPTIVE_ERROR_BIAS      0.01f       // luminance below which error is judged in absolute terms
 
 #define PT_DEBUG_VIS_NONE              0u
 #define PT_DEBUG_VIS_ALBEDO           1u
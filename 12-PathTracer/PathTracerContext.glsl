@@ -2,8 +2,8 @@
 #define INCLUDED_PT_CONTEXT
 
 // Resource access for the shared fillPayload/loop is via the PT_* macros below, so one
-// body compiles for every backend. Metal is keyed on __METAL_VERSION__; each Vulkan entry
-// #defines its config token before including this:
+// body compiles for every backend. Metal is keyed on __METAL_VERSION__, the CPU backend on
+// __cplusplus; each Vulkan entry #defines its config token before including this:
 //   PT_CONFIG_SBT_RAYGEN  owns the SBT payload + render loop
 //   PT_CONFIG_SBT_HIT     closest-hit, only needs fillPayload (rmiss needs no token)
 
@@ -22,6 +22,8 @@ struct PtHit
 	uint  primId;
 	vec2  bary;        // (b1, b2); b0 = 1 - b1 - b2
 	bool  frontFacing;
+	mat3  objectToWorld; // instance transform for tangents
+	mat3  normalToWorld; // inverse transpose of objectToWorld
 };
 
 struct LightSample
@@ -60,11 +62,17 @@ struct PathTracerContext
 #define PT_VERTEX(ctx, i)           ((ctx).s0->vertexBuffer[(i)])
 #define PT_TEXTURE(ctx, id, uv)     ((ctx).s1->textures[(id)].sample((ctx).s0->defaultSampler, (uv)))
 #define PT_ENVMAP(ctx, uv)          ((ctx).s0->envmapTexture.sample((ctx).s0->defaultSampler, (uv)))
+#define PT_ENVMAP_PDF(ctx, uv)      ((ctx).s0->envmapPdfTexture.sample((ctx).s0->defaultSampler, (uv)).x)
 #define PT_ENVDIST(ctx, i)          ((ctx).s0->envmapDistribution[(i)])
 #define PT_ENVDIST_VALID(ctx)       ((ctx).s0->envmapDistribution != nullptr)
 #define PT_OUTPUT_READ(ctx, px)     ((ctx).s0->outputImage.read(uint2(px)).xyz)
 #define PT_OUTPUT_WRITE(ctx, px, v) ((ctx).s0->outputImage.write(float4((v), 1.0f), uint2(px)))
+#define PT_OUTPUT_READ4(ctx, px)     ((ctx).s0->outputImage.read(uint2(px)))
+#define PT_OUTPUT_WRITE4(ctx, px, v) ((ctx).s0->outputImage.write((v), uint2(px)))
 #define PT_FOCUS_WRITE(ctx, val)    ((ctx).s0->focusFeedback[0] = (val))
+#define PT_TILE_SAMPLES(ctx, tile)  ((ctx).s0->tileSampleCount[(tile)])
+#define PT_TILE_ERROR_MAX(ctx, tile, e) \
+	atomic_fetch_max_explicit(&(ctx).s0->tileError[(tile)], as_type<uint>(e), memory_order_relaxed)
 
 // Vertex members are packed; bridge to aligned vecs.
 #define PT_VTX_POS(v) float3((v).position)
@@ -75,6 +83,32 @@ struct PathTracerContext
 // Metal runs the whole path tracer inline in one kernel.
 #define PT_HAS_RENDER_LOOP
 
+#elif defined(__cplusplus) // CPU: CpuPathTracer.cpp declares PathTracerContext and its accessors.
+
+#define PT_SCENE(ctx, field)        ((ctx).constants->field)
+#define PT_INDEX(ctx, i)            ((ctx).index(i))
+#define PT_VERTEX(ctx, i)           ((ctx).vertex(i))
+#define PT_TEXTURE(ctx, id, uv)     ((ctx).sampleTexture((id), (uv)))
+#define PT_ENVMAP(ctx, uv)          ((ctx).sampleEnvmap(uv))
+#define PT_ENVMAP_PDF(ctx, uv)      ((ctx).sampleEnvmapPdf(uv))
+#define PT_ENVDIST(ctx, i)          ((ctx).envmapCell(i))
+#define PT_ENVDIST_VALID(ctx)       ((ctx).hasEnvmapDistribution())
+#define PT_OUTPUT_READ(ctx, px)     ((ctx).readOutput(px))
+#define PT_OUTPUT_WRITE(ctx, px, v) ((ctx).writeOutput((px), (v)))
+#define PT_OUTPUT_READ4(ctx, px)     ((ctx).readOutput4(px))
+#define PT_OUTPUT_WRITE4(ctx, px, v) ((ctx).writeOutput4((px), (v)))
+#define PT_FOCUS_WRITE(ctx, val)    ((ctx).writeFocus(val))
+#define PT_TILE_SAMPLES(ctx, tile)  ((ctx).tileSamples(tile))
+#define PT_TILE_ERROR_MAX(ctx, tile, e) ((ctx).maxTileError((tile), (e)))
+
+#define PT_VTX_POS(v) getPosition(v)
+#define PT_VTX_NRM(v) getNormal(v)
+#define PT_VTX_UV(v)  getTexcoord(v)
+#define PT_VTX_TAN(v) getTangent(v)
+
+// The CPU backend traces whole paths per pixel, like Metal.
+#define PT_HAS_RENDER_LOOP
+
 #else // GLSL / Vulkan: resources are module globals (Common.glsl), context carries nothing.
 
 struct PathTracerContext
@@ -87,11 +121,16 @@ struct PathTracerContext
 #define PT_VERTEX(ctx, i)           (vertexBuffer[(i)])
 #define PT_TEXTURE(ctx, id, uv)     (texture(sampler2D(textureDescriptors[(id)], defaultSampler), (uv)))
 #define PT_ENVMAP(ctx, uv)          (texture(sampler2D(envmapTexture, defaultSampler), (uv)))
+#define PT_ENVMAP_PDF(ctx, uv)      (texture(sampler2D(envmapPdfTexture, defaultSampler), (uv)).x)
 #define PT_ENVDIST(ctx, i)          (envmapDistributionBuffer[(i)])
 #define PT_ENVDIST_VALID(ctx)       (true)
 #define PT_OUTPUT_READ(ctx, px)     (imageLoad(outputImage, ivec2(px)).rgb)
 #define PT_OUTPUT_WRITE(ctx, px, v) imageStore(outputImage, ivec2(px), vec4((v), 1.0))
+#define PT_OUTPUT_READ4(ctx, px)     (imageLoad(outputImage, ivec2(px)))
+#define PT_OUTPUT_WRITE4(ctx, px, v) imageStore(outputImage, ivec2(px), (v))
 #define PT_FOCUS_WRITE(ctx, val)    focusFeedback[0] = (val)
+#define PT_TILE_SAMPLES(ctx, tile)  (tileSampleCount[(tile)])
+#define PT_TILE_ERROR_MAX(ctx, tile, e) atomicMax(tileError[(tile)], floatBitsToUint(e))
 
 // Vertex members are float[N] with accessors in Common.glsl.
 #define PT_VTX_POS(v) getPosition(v)
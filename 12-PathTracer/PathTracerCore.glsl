@@ -5,7 +5,8 @@
 // PathTracerContext/PtHit/PtPayload types.
 
 // Caller resolves material + index base (firstIndex + primId*3 for SBT geometry,
-// primId*3 for inline backends).
+// instance mesh first index + primId*3 for inline backends). Vertex data is in mesh
+// space and is brought to world space with the hit instance transform.
 SHADER_INLINE void fillPayload(PathTracerContext ctx, PtHit hit, uint indexBase,
 	MaterialConstants material, INOUT(PtPayload) pl)
 {
@@ -21,8 +22,8 @@ SHADER_INLINE void fillPayload(PathTracerContext ctx, PtHit hit, uint indexBase,
 	vec3 p1 = PT_VTX_POS(v1);
 	vec3 p2 = PT_VTX_POS(v2);
 
-	vec3 normal = normalize(PT_VTX_NRM(v0) * bary.x + PT_VTX_NRM(v1) * bary.y + PT_VTX_NRM(v2) * bary.z);
-	pl.geoNormal = normalize(cross(p1 - p0, p2 - p0));
+	vec3 normal = normalize(hit.normalToWorld * (PT_VTX_NRM(v0) * bary.x + PT_VTX_NRM(v1) * bary.y + PT_VTX_NRM(v2) * bary.z));
+	pl.geoNormal = normalize(hit.normalToWorld * cross(p1 - p0, p2 - p0));
 
 	vec2 uv = PT_VTX_UV(v0) * bary.x + PT_VTX_UV(v1) * bary.y + PT_VTX_UV(v2) * bary.z;
 	pl.texcoord = uv;
@@ -59,12 +60,13 @@ SHADER_INLINE void fillPayload(PathTracerContext ctx, PtHit hit, uint indexBase,
 	pl.bitangent = vec3(0.0f);
 
 	vec4 tangent = PT_VTX_TAN(v0) * bary.x + PT_VTX_TAN(v1) * bary.y + PT_VTX_TAN(v2) * bary.z;
-	float tangentLen = length(tangent.xyz);
+	vec3 tangentDir = hit.objectToWorld * tangent.xyz;
+	float tangentLen = length(tangentDir);
 	bool hasTangent = false;
 	bool hasBitangent = false;
 	if (tangentLen > 1e-5f)
 	{
-		vec3 tanU = tangent.xyz / tangentLen;
+		vec3 tanU = tangentDir / tangentLen;
 		vec3 tanV = cross(pl.shadingNormal, tanU) * tangent.w;
 		float bitangentLen = length(tanV);
 		if (bitangentLen > 1e-5f)
@@ -141,11 +143,11 @@ SHADER_INLINE vec3 worldToEnvmap(PathTracerContext ctx, vec3 dir)
 
 SHADER_INLINE LightSample sampleEnvmap(PathTracerContext ctx, vec3 envmapDir)
 {
-	vec4 s = PT_ENVMAP(ctx, cartesianToLatLongTexcoord(envmapDir));
+	vec2 uv = cartesianToLatLongTexcoord(envmapDir);
 	LightSample r;
 	r.w = envmapToWorld(ctx, envmapDir);
-	r.value = s.xyz;
-	r.pdfW = s.w;
+	r.value = PT_ENVMAP(ctx, uv).xyz;
+	r.pdfW = PT_ENVMAP_PDF(ctx, uv);
 	return r;
 }
 
@@ -186,7 +188,7 @@ SHADER_INLINE LightSample importanceSampleEnvmap(PathTracerContext ctx, INOUT(ui
 // Trace wrappers: closest hit (fills payload) and any hit (shadow). One pair per config.
 #ifdef __METAL_VERSION__
 
-SHADER_INLINE PtHit toPtHit(intersection_result<triangle_data, instancing> res)
+SHADER_INLINE PtHit toPtHit(intersection_result<triangle_data, instancing, world_space_data> res)
 {
 	PtHit hit;
 	hit.valid = res.type != intersection_type::none;
@@ -194,10 +196,14 @@ SHADER_INLINE PtHit toPtHit(intersection_result<triangle_data, instancing> res)
 	hit.primId = res.primitive_id;
 	hit.bary = res.triangle_barycentric_coord;
 	hit.frontFacing = res.triangle_front_facing;
+	float4x3 objectToWorld = res.object_to_world_transform;
+	float4x3 worldToObject = res.world_to_object_transform;
+	hit.objectToWorld = float3x3(objectToWorld[0], objectToWorld[1], objectToWorld[2]);
+	hit.normalToWorld = transpose(float3x3(worldToObject[0], worldToObject[1], worldToObject[2]));
 	return hit;
 }
 
-SHADER_INLINE MaterialConstants resolveMaterial(PathTracerContext ctx, uint primId)
+SHADER_INLINE MaterialConstants resolveMaterial(PathTracerContext ctx, uint triangleIndex)
 {
 	MaterialConstants material;
 	material.albedoFactor = float4(1.0f);
@@ -215,7 +221,7 @@ SHADER_INLINE MaterialConstants resolveMaterial(PathTracerContext ctx, uint prim
 	uint materialIndex = 0u;
 	if (ctx.s0->materialIndices)
 	{
-		materialIndex = ctx.s0->materialIndices[primId];
+		materialIndex = ctx.s0->materialIndices[triangleIndex];
 	}
 	if (ctx.s0->materials)
 	{
@@ -226,7 +232,7 @@ SHADER_INLINE MaterialConstants resolveMaterial(PathTracerContext ctx, uint prim
 
 SHADER_INLINE bool ptTraceFill(PathTracerContext ctx, PtRay r, INOUT(PtPayload) pl)
 {
-	intersector<triangle_data, instancing> it;
+	intersector<triangle_data, instancing, world_space_data> it;
 	it.assume_geometry_type(geometry_type::triangle);
 	it.set_triangle_cull_mode(triangle_cull_mode::none);
 
@@ -236,12 +242,20 @@ SHADER_INLINE bool ptTraceFill(PathTracerContext ctx, PtRay r, INOUT(PtPayload)
 	mr.min_distance = r.minT;
 	mr.max_distance = r.maxT;
 
-	PtHit hit = toPtHit(it.intersect(mr, ctx.s0->tlas));
+	intersection_result<triangle_data, instancing, world_space_data> res = it.intersect(mr, ctx.s0->tlas);
+	PtHit hit = toPtHit(res);
 	if (!hit.valid)
 	{
 		return false;
 	}
-	fillPayload(ctx, hit, hit.primId * 3u, resolveMaterial(ctx, hit.primId), pl);
+
+	// Primitive ids are relative to the mesh of the hit instance
+	uint indexBase = hit.primId * 3u;
+	if (ctx.s0->instanceIndexOffsets)
+	{
+		indexBase += ctx.s0->instanceIndexOffsets[res.instance_id];
+	}
+	fillPayload(ctx, hit, indexBase, resolveMaterial(ctx, indexBase / 3u), pl);
 	return true;
 }
 
@@ -260,6 +274,26 @@ SHADER_INLINE bool ptTraceShadow(PathTracerContext ctx, PtRay r)
 	return it.intersect(mr, ctx.s0->tlas).type != intersection_type::none;
 }
 
+#elif defined(__cplusplus)
+
+// The CPU context traces its own BVH and returns the index buffer position of the hit triangle
+SHADER_INLINE bool ptTraceFill(PathTracerContext ctx, PtRay r, INOUT(PtPayload) pl)
+{
+	PtHit hit;
+	uint triangle = 0u;
+	if (!ctx.traceClosest(r, hit, triangle))
+	{
+		return false;
+	}
+	fillPayload(ctx, hit, triangle * 3u, ctx.material(triangle), pl);
+	return true;
+}
+
+SHADER_INLINE bool ptTraceShadow(PathTracerContext ctx, PtRay r)
+{
+	return ctx.traceAny(r);
+}
+
 #elif defined(PT_CONFIG_SBT_RAYGEN)
 
 bool ptTraceFill(PathTracerContext ctx, PtRay r, INOUT(PtPayload) pl)
@@ -304,6 +338,27 @@ SHADER_INLINE void ptRenderPixel(PathTracerContext ctx, ivec2 pixelIndex)
 	uint randomSeed = hashFnv1(pixelRandomSeed + PT_SCENE(ctx, frameIndex));
 	vec2 pixelJitter = (randomFloat2(randomSeed) - 0.5f) / vec2(outputSize);
 
+	// With adaptive sampling every tile keeps its own sample count, and converged tiles are skipped
+	// apart from the focus pick pixel, which is traced for its depth but not accumulated.
+	bool adaptive = (PT_SCENE(ctx, flags) & PT_FLAG_ADAPTIVE_SAMPLING) != 0u;
+	uint tileCountX = (uint(outputSize.x) + PT_ADAPTIVE_TILE_SIZE - 1u) / PT_ADAPTIVE_TILE_SIZE;
+	uint tileIndex = (uint(pixelIndex.y) / PT_ADAPTIVE_TILE_SIZE) * tileCountX + uint(pixelIndex.x) / PT_ADAPTIVE_TILE_SIZE;
+	float frame = float(PT_SCENE(ctx, frameIndex));
+	bool tileConverged = false;
+	if (adaptive)
+	{
+		uint tileSamples = PT_TILE_SAMPLES(ctx, tileIndex);
+		tileConverged = tileSamples == PT_ADAPTIVE_TILE_CONVERGED;
+		frame = float(tileSamples);
+	}
+
+	ivec2 focusPick = PT_SCENE(ctx, focusPickPixel);
+	bool isFocusPick = focusPick.x >= 0 && pixelIndex.x == focusPick.x && pixelIndex.y == focusPick.y;
+	if (tileConverged && !isFocusPick)
+	{
+		return;
+	}
+
 	vec3 result = vec3(0.0f);
 	vec3 throughput = vec3(1.0f);
 
@@ -369,7 +424,6 @@ SHADER_INLINE void ptRenderPixel(PathTracerContext ctx, ivec2 pixelIndex)
 
 		if (!skipAccum)
 		{
-			float frame = float(PT_SCENE(ctx, frameIndex));
 			simpleColor = (PT_OUTPUT_READ(ctx, pixelIndex) * frame + simpleColor) / (frame + 1.0f);
 		}
 		PT_OUTPUT_WRITE(ctx, pixelIndex, simpleColor);
@@ -559,18 +613,34 @@ SHADER_INLINE void ptRenderPixel(PathTracerContext ctx, ivec2 pixelIndex)
 		result = mix(result, vec3(1.0f, 0.0f, 0.0f), focalOverlay);
 	}
 
-	ivec2 focusPick = PT_SCENE(ctx, focusPickPixel);
-	if (focusPick.x >= 0 && pixelIndex.x == focusPick.x && pixelIndex.y == focusPick.y)
+	if (isFocusPick)
 	{
 		PT_FOCUS_WRITE(ctx, primaryDepth);
 	}
+	if (tileConverged)
+	{
+		return;
+	}
 
-	float frame = float(PT_SCENE(ctx, frameIndex));
+	// Alpha accumulates squared luminance, so that mean and variance come from the same image
+	const vec3 lumaWeights = vec3(0.2126f, 0.7152f, 0.0722f);
+	float luma = dot(result, lumaWeights);
+	vec4 accum = vec4(result, luma * luma);
 	if (!skipAccum && frame > 0.0f)
 	{
-		result = mix(PT_OUTPUT_READ(ctx, pixelIndex), result, 1.0f / (frame + 1.0f));
+		accum = mix(PT_OUTPUT_READ4(ctx, pixelIndex), accum, 1.0f / (frame + 1.0f));
+	}
+	PT_OUTPUT_WRITE4(ctx, pixelIndex, accum);
+
+	if (adaptive)
+	{
+		// Standard error of the pixel mean relative to its luminance. Errors are never 0, which
+		// marks the tiles that weren't traced.
+		float mean = dot(accum.xyz, lumaWeights);
+		float variance = max(accum.w - mean * mean, 0.0f);
+		float error = sqrt(variance / max(frame, 1.0f)) / (mean + PT_ADAPTIVE_ERROR_BIAS);
+		PT_TILE_ERROR_MAX(ctx, tileIndex, max(error, 1e-20f));
 	}
-	PT_OUTPUT_WRITE(ctx, pixelIndex, result);
 }
 
 #endif // PT_HAS_RENDER_LOOP
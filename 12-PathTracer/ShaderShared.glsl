@@ -1,11 +1,15 @@
 #ifndef INCLUDED_SHADER_SHARED
 #define INCLUDED_SHADER_SHARED
 
-// Helpers shared between the GLSL (Vulkan) and Metal (MSL) path tracers.
+// Helpers shared between the GLSL (Vulkan), Metal (MSL) and C++ (CPU) path tracers.
 // A thin compatibility layer papers over the type-name, qualifier and inline
-// differences so the function bodies below compile unchanged on both backends.
+// differences so the function bodies below compile unchanged on all backends.
 
-#ifdef __METAL_VERSION__
+#if defined(__cplusplus) && !defined(__METAL_VERSION__)
+	// Types and intrinsics come from CpuShaderMath.h
+	#define SHADER_INLINE inline
+	#define INOUT(T) T&
+#elif defined(__METAL_VERSION__)
 	#define SHADER_INLINE static inline
 	#define INOUT(T) thread T&
 	#define vec2 float2
@@ -0,0 +1,611 @@
+#include "BlockCompression.h"
+#include "JobSystem.h"
+
+#include <Rush/MathCommon.h>
+#include <Rush/UtilLog.h>
+
+#include <math.h>
+#include <string.h>
+
+namespace Rush
+{
+
+namespace
+{
+	// Texels of one 4x4 block, row-major, channels as floats in 0..255
+	struct BlockTexels
+	{
+		float px[16][4];
+	};
+
+	// Writes fields LSB-first, as BC7 lays out its bitstream. Output must be zeroed.
+	struct BitWriter
+	{
+		u8* out;
+		u32 pos = 0;
+
+		void write(u32 value, u32 count)
+		{
+			for (u32 i = 0; i < count; ++i, ++pos)
+			{
+				if ((value >> i) & 1)
+				{
+					out[pos >> 3] |= u8(1 << (pos & 7));
+				}
+			}
+		}
+	};
+
+	void computeMean(const BlockTexels& block, u32 channels, float mean[4])
+	{
+		for (u32 c = 0; c < 4; ++c)
+		{
+			mean[c] = 0;
+		}
+		for (u32 i = 0; i < 16; ++i)
+		{
+			for (u32 c = 0; c < channels; ++c)
+			{
+				mean[c] += block.px[i][c];
+			}
+		}
+		for (u32 c = 0; c < channels; ++c)
+		{
+			mean[c] /= 16.0f;
+		}
+	}
+
+	// Principal axis of the block's colors via a few power iterations on the covariance matrix
+	void computePrincipalAxis(const BlockTexels& block, u32 channels, const float mean[4], float axis[4])
+	{
+		float cov[4][4] = {};
+		for (u32 i = 0; i < 16; ++i)
+		{
+			float d[4];
+			for (u32 c = 0; c < channels; ++c)
+			{
+				d[c] = block.px[i][c] - mean[c];
+			}
+			for (u32 a = 0; a < channels; ++a)
+			{
+				for (u32 b = 0; b < channels; ++b)
+				{
+					cov[a][b] += d[a] * d[b];
+				}
+			}
+		}
+
+		// Start from the largest-variance channel direction so the iteration cannot begin orthogonal to the answer
+		u32 startChannel = 0;
+		for (u32 c = 1; c < channels; ++c)
+		{
+			if (cov[c][c] > cov[startChannel][startChannel])
+			{
+				startChannel = c;
+			}
+		}
+
+		float v[4] = {};
+		for (u32 c = 0; c < channels; ++c)
+		{
+			v[c] = cov[startChannel][c];
+		}
+
+		for (u32 iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			float lengthSquared = 0;
+			for (u32 a = 0; a < channels; ++a)
+			{
+				for (u32 b = 0; b < channels; ++b)
+				{
+					next[a] += cov[a][b] * v[b];
+				}
+				lengthSquared += next[a] * next[a];
+			}
+
+			if (lengthSquared < 1e-12f)
+			{
+				break;
+			}
+
+			const float invLength = 1.0f / sqrtf(lengthSquared);
+			for (u32 c = 0; c < channels; ++c)
+			{
+				v[c] = next[c] * invLength;
+			}
+		}
+
+		float lengthSquared = 0;
+		for (u32 c = 0; c < channels; ++c)
+		{
+			lengthSquared += v[c] * v[c];
+		}
+
+		for (u32 c = 0; c < 4; ++c)
+		{
+			axis[c] = c < channels ? (lengthSquared > 1e-12f ? v[c] / sqrtf(lengthSquared) : 0.5f) : 0.0f;
+		}
+	}
+
+	// Endpoints spanning the block's projection onto its principal axis
+	void computeAxisEndpoints(const BlockTexels& block, u32 channels, float lo[4], float hi[4])
+	{
+		float mean[4], axis[4];
+		computeMean(block, channels, mean);
+		computePrincipalAxis(block, channels, mean, axis);
+
+		float minT = 0, maxT = 0;
+		for (u32 i = 0; i < 16; ++i)
+		{
+			float t = 0;
+			for (u32 c = 0; c < channels; ++c)
+			{
+				t += (block.px[i][c] - mean[c]) * axis[c];
+			}
+			minT = min(minT, t);
+			maxT = max(maxT, t);
+		}
+
+		for (u32 c = 0; c < 4; ++c)
+		{
+			lo[c] = clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			hi[c] = clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+		}
+	}
+
+	// Least-squares endpoints for fixed interpolation weights, where texel i = lerp(e0, e1, weights[i]).
+	// Returns false if the system is degenerate (all texels share one weight).
+	bool solveEndpoints(const BlockTexels& block, u32 channels, const float weights[16], float e0[4], float e1[4])
+	{
+		float aa = 0, bb = 0, ab = 0;
+		float ax[4] = {}, bx[4] = {};
+		for (u32 i = 0; i < 16; ++i)
+		{
+			const float b = weights[i];
+			const float a = 1.0f - b;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			for (u32 c = 0; c < channels; ++c)
+			{
+				ax[c] += a * block.px[i][c];
+				bx[c] += b * block.px[i][c];
+			}
+		}
+
+		const float det = aa * bb - ab * ab;
+		if (fabsf(det) < 1e-6f)
+		{
+			return false;
+		}
+
+		const float invDet = 1.0f / det;
+		for (u32 c = 0; c < channels; ++c)
+		{
+			e0[c] = clamp((ax[c] * bb - bx[c] * ab) * invDet, 0.0f, 255.0f);
+			e1[c] = clamp((bx[c] * aa - ax[c] * ab) * invDet, 0.0f, 255.0f);
+		}
+
+		return true;
+	}
+
+	// BC1 color block -----------------------------------------------------------------------
+
+	u16 packRGB565(const float c[3])
+	{
+		const u32 r = u32(clamp(c[0] * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f));
+		const u32 g = u32(clamp(c[1] * (63.0f / 255.0f) + 0.5f, 0.0f, 63.0f));
+		const u32 b = u32(clamp(c[2] * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f));
+		return u16((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRGB565(u16 v, float out[3])
+	{
+		const u32 r = (v >> 11) & 31;
+		const u32 g = (v >> 5) & 63;
+		const u32 b = v & 31;
+		out[0]      = float((r << 3) | (r >> 2));
+		out[1]      = float((g << 2) | (g >> 4));
+		out[2]      = float((b << 3) | (b >> 2));
+	}
+
+	struct ColorBlockResult
+	{
+		u16   color0 = 0;
+		u16   color1 = 0;
+		u32   indices = 0;
+		float error   = 1e30f;
+	};
+
+	// Four-color mode only (color0 > color1), which is also the only mode BC3 color blocks support
+	ColorBlockResult evaluateColorEndpoints(const BlockTexels& block, u16 color0, u16 color1)
+	{
+		ColorBlockResult result;
+
+		if (color0 < color1)
+		{
+			u16 temp = color0;
+			color0   = color1;
+			color1   = temp;
+		}
+
+		result.color0 = color0;
+		result.color1 = color1;
+		result.error  = 0;
+
+		float palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		const u32 paletteSize = color0 == color1 ? 1 : 4;
+		for (u32 c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+
+		for (u32 i = 0; i < 16; ++i)
+		{
+			u32   bestIndex = 0;
+			float bestError = 1e30f;
+			for (u32 p = 0; p < paletteSize; ++p)
+			{
+				float error = 0;
+				for (u32 c = 0; c < 3; ++c)
+				{
+					const float d = block.px[i][c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = p;
+				}
+			}
+			result.indices |= bestIndex << (2 * i);
+			result.error += bestError;
+		}
+
+		return result;
+	}
+
+	void encodeColorBlock(const BlockTexels& block, u8* output)
+	{
+		float lo[4], hi[4];
+		computeAxisEndpoints(block, 3, lo, hi);
+
+		ColorBlockResult best = evaluateColorEndpoints(block, packRGB565(hi), packRGB565(lo));
+
+		static const float indexWeights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+		for (u32 iteration = 0; iteration < 2 && best.error > 0; ++iteration)
+		{
+			float weights[16];
+			for (u32 i = 0; i < 16; ++i)
+			{
+				weights[i] = indexWeights[(best.indices >> (2 * i)) & 3];
+			}
+
+			float e0[4], e1[4];
+			if (!solveEndpoints(block, 3, weights, e0, e1))
+			{
+				break;
+			}
+
+			ColorBlockResult refined = evaluateColorEndpoints(block, packRGB565(e0), packRGB565(e1));
+			if (refined.error >= best.error)
+			{
+				break;
+			}
+			best = refined;
+		}
+
+		output[0] = u8(best.color0);
+		output[1] = u8(best.color0 >> 8);
+		output[2] = u8(best.color1);
+		output[3] = u8(best.color1 >> 8);
+		memcpy(output + 4, &best.indices, 4);
+	}
+
+	// BC4 single-channel block --------------------------------------------------------------
+
+	void encodeChannelBlock(const BlockTexels& block, u32 channel, u8* output)
+	{
+		float lo = 255.0f, hi = 0.0f;
+		for (u32 i = 0; i < 16; ++i)
+		{
+			lo = min(lo, block.px[i][channel]);
+			hi = max(hi, block.px[i][channel]);
+		}
+
+		const u32 a0 = u32(hi + 0.5f);
+		const u32 a1 = u32(lo + 0.5f);
+
+		output[0] = u8(a0);
+		output[1] = u8(a1);
+
+		// With a0 > a1, codes 0 and 1 are the endpoints and codes 2..7 step evenly from a0 to a1
+		static const u32 codeForStep[8] = {0, 2, 3, 4, 5, 6, 7, 1};
+
+		u64 indices = 0;
+		if (a0 > a1)
+		{
+			const float scale = 7.0f / float(a0 - a1);
+			for (u32 i = 0; i < 16; ++i)
+			{
+				const float t    = (float(a0) - block.px[i][channel]) * scale;
+				const u32   step = u32(clamp(t + 0.5f, 0.0f, 7.0f));
+				indices |= u64(codeForStep[step]) << (3 * i);
+			}
+		}
+
+		for (u32 i = 0; i < 6; ++i)
+		{
+			output[2 + i] = u8(indices >> (8 * i));
+		}
+	}
+
+	// BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with a unique p-bit each, 4-bit indices
+
+	const u32 g_bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+	struct Mode6Result
+	{
+		u32   endpoint[2][4] = {};
+		u32   pbit[2]        = {};
+		u8    indices[16]    = {};
+		float error          = 1e30f;
+	};
+
+	void evaluateMode6(const BlockTexels& block, const u32 endpoint[2][4], const u32 pbit[2], Mode6Result& result)
+	{
+		float e[2][4];
+		for (u32 j = 0; j < 2; ++j)
+		{
+			for (u32 c = 0; c < 4; ++c)
+			{
+				e[j][c] = float((endpoint[j][c] << 1) | pbit[j]);
+			}
+		}
+
+		float palette[16][4];
+		for (u32 p = 0; p < 16; ++p)
+		{
+			const u32 w = g_bc7Weights4[p];
+			for (u32 c = 0; c < 4; ++c)
+			{
+				palette[p][c] = float(((64 - w) * u32(e[0][c]) + w * u32(e[1][c]) + 32) >> 6);
+			}
+		}
+
+		float axis[4];
+		float axisLengthSquared = 0;
+		for (u32 c = 0; c < 4; ++c)
+		{
+			axis[c] = e[1][c] - e[0][c];
+			axisLengthSquared += axis[c] * axis[c];
+		}
+		const float invAxisLengthSquared = axisLengthSquared > 0 ? 1.0f / axisLengthSquared : 0.0f;
+
+		float totalError = 0;
+		u8    indices[16];
+		for (u32 i = 0; i < 16; ++i)
+		{
+			// Project onto the endpoint line for a first guess, then check its neighbours
+			float t = 0;
+			for (u32 c = 0; c < 4; ++c)
+			{
+				t += (block.px[i][c] - e[0][c]) * axis[c];
+			}
+			t = clamp(t * invAxisLengthSquared, 0.0f, 1.0f) * 15.0f;
+
+			const u32 guess = u32(t + 0.5f);
+			u32       first = guess > 0 ? guess - 1 : 0;
+			u32       last  = min<u32>(guess + 1, 15);
+
+			u32   bestIndex = guess;
+			float bestError = 1e30f;
+			for (u32 p = first; p <= last; ++p)
+			{
+				float error = 0;
+				for (u32 c = 0; c < 4; ++c)
+				{
+					const float d = block.px[i][c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = p;
+				}
+			}
+
+			indices[i] = u8(bestIndex);
+			totalError += bestError;
+
+			if (totalError >= result.error)
+			{
+				return;
+			}
+		}
+
+		result.error = totalError;
+		memcpy(result.endpoint, endpoint, sizeof(result.endpoint));
+		result.pbit[0] = pbit[0];
+		result.pbit[1] = pbit[1];
+		memcpy(result.indices, indices, sizeof(indices));
+	}
+
+	// Tries all four p-bit combinations for a pair of unquantized endpoints
+	void quantizeMode6(const BlockTexels& block, const float e0[4], const float e1[4], Mode6Result& result)
+	{
+		for (u32 p = 0; p < 4; ++p)
+		{
+			const u32 pbit[2] = {p & 1, p >> 1};
+			u32       endpoint[2][4];
+			for (u32 c = 0; c < 4; ++c)
+			{
+				endpoint[0][c] = u32(clamp((e0[c] - float(pbit[0])) * 0.5f + 0.5f, 0.0f, 127.0f));
+				endpoint[1][c] = u32(clamp((e1[c] - float(pbit[1])) * 0.5f + 0.5f, 0.0f, 127.0f));
+			}
+			evaluateMode6(block, endpoint, pbit, result);
+		}
+	}
+
+	void encodeBC7Block(const BlockTexels& block, u8* output)
+	{
+		float lo[4], hi[4];
+		computeAxisEndpoints(block, 4, lo, hi);
+
+		Mode6Result best;
+		quantizeMode6(block, lo, hi, best);
+
+		for (u32 iteration = 0; iteration < 2 && best.error > 0; ++iteration)
+		{
+			float weights[16];
+			for (u32 i = 0; i < 16; ++i)
+			{
+				weights[i] = float(g_bc7Weights4[best.indices[i]]) / 64.0f;
+			}
+
+			float e0[4], e1[4];
+			if (!solveEndpoints(block, 4, weights, e0, e1))
+			{
+				break;
+			}
+
+			const float previousError = best.error;
+			quantizeMode6(block, e0, e1, best);
+			if (best.error >= previousError)
+			{
+				break;
+			}
+		}
+
+		// The anchor (first) index is stored without its top bit, so it must be below 8
+		if (best.indices[0] & 8)
+		{
+			for (u32 c = 0; c < 4; ++c)
+			{
+				const u32 temp      = best.endpoint[0][c];
+				best.endpoint[0][c] = best.endpoint[1][c];
+				best.endpoint[1][c] = temp;
+			}
+			const u32 temp = best.pbit[0];
+			best.pbit[0]   = best.pbit[1];
+			best.pbit[1]   = temp;
+			for (u32 i = 0; i < 16; ++i)
+			{
+				best.indices[i] = u8(15 - best.indices[i]);
+			}
+		}
+
+		memset(output, 0, 16);
+		BitWriter bits = {output};
+		bits.write(1 << 6, 7); // mode 6
+		for (u32 c = 0; c < 4; ++c)
+		{
+			bits.write(best.endpoint[0][c], 7);
+			bits.write(best.endpoint[1][c], 7);
+		}
+		bits.write(best.pbit[0], 1);
+		bits.write(best.pbit[1], 1);
+		bits.write(best.indices[0], 3);
+		for (u32 i = 1; i < 16; ++i)
+		{
+			bits.write(best.indices[i], 4);
+		}
+	}
+
+	u32 getBlockSize(GfxFormat format)
+	{
+		switch (format)
+		{
+		case GfxFormat_BC1_Unorm:
+		case GfxFormat_BC1_Unorm_sRGB:
+		case GfxFormat_BC4_Unorm: return 8;
+		case GfxFormat_BC3_Unorm:
+		case GfxFormat_BC3_Unorm_sRGB:
+		case GfxFormat_BC5_Unorm:
+		case GfxFormat_BC7_Unorm:
+		case GfxFormat_BC7_Unorm_sRGB: return 16;
+		default: return 0;
+		}
+	}
+
+	void encodeBlock(GfxFormat format, const BlockTexels& block, u8* output)
+	{
+		switch (format)
+		{
+		case GfxFormat_BC1_Unorm:
+		case GfxFormat_BC1_Unorm_sRGB: encodeColorBlock(block, output); break;
+		case GfxFormat_BC3_Unorm:
+		case GfxFormat_BC3_Unorm_sRGB:
+			encodeChannelBlock(block, 3, output);
+			encodeColorBlock(block, output + 8);
+			break;
+		case GfxFormat_BC4_Unorm: encodeChannelBlock(block, 0, output); break;
+		case GfxFormat_BC5_Unorm:
+			encodeChannelBlock(block, 0, output);
+			encodeChannelBlock(block, 1, output + 8);
+			break;
+		case GfxFormat_BC7_Unorm:
+		case GfxFormat_BC7_Unorm_sRGB: encodeBC7Block(block, output); break;
+		default: RUSH_BREAK; break;
+		}
+	}
+}
+
+bool isBlockCompressedFormat(GfxFormat format) { return getBlockSize(format) != 0; }
+
+GfxFormat getBlockCompressionSourceFormat(GfxFormat format)
+{
+	switch (format)
+	{
+	case GfxFormat_BC1_Unorm_sRGB:
+	case GfxFormat_BC3_Unorm_sRGB:
+	case GfxFormat_BC7_Unorm_sRGB: return GfxFormat_RGBA8_sRGB;
+	default: return isBlockCompressedFormat(format) ? GfxFormat_RGBA8_Unorm : format;
+	}
+}
+
+size_t getCompressedLevelSize(GfxFormat format, u32 width, u32 height)
+{
+	return size_t(divUp<u32>(width, 4)) * divUp<u32>(height, 4) * getBlockSize(format);
+}
+
+void compressRGBA8(GfxFormat format, const u8* rgba, u32 width, u32 height, u8* output)
+{
+	const u32 blockSize    = getBlockSize(format);
+	const u32 blockColumns = divUp<u32>(width, 4);
+	const u32 blockRows    = divUp<u32>(height, 4);
+
+	RUSH_ASSERT(blockSize != 0);
+
+	// Roughly 256 blocks per job keeps scheduling overhead small on narrow mips
+	const u32 grainSize = divUp<u32>(256, blockColumns);
+
+	JobSystem::getDefault().parallelFor(blockRows, grainSize, [=](u32 beginRow, u32 endRow)
+	{
+		BlockTexels block;
+		for (u32 by = beginRow; by < endRow; ++by)
+		{
+			for (u32 bx = 0; bx < blockColumns; ++bx)
+			{
+				for (u32 i = 0; i < 16; ++i)
+				{
+					const u32 x = min(bx * 4 + (i & 3), width - 1);
+					const u32 y = min(by * 4 + (i >> 2), height - 1);
+					const u8* texel = &rgba[(size_t(y) * width + x) * 4];
+					for (u32 c = 0; c < 4; ++c)
+					{
+						block.px[i][c] = float(texel[c]);
+					}
+				}
+
+				encodeBlock(format, block, &output[(size_t(by) * blockColumns + bx) * blockSize]);
+			}
+		}
+	});
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Rush/GfxCommon.h>
+#include <Rush/Rush.h>
+
+#include <stddef.h>
+
+namespace Rush
+{
+
+// True for the BCn formats that compressRGBA8() can produce: BC1, BC3, BC4, BC5 and BC7.
+bool isBlockCompressedFormat(GfxFormat format);
+
+// RGBA8 format that a block-compressed format is encoded from (preserving sRGB-ness).
+// Returns the input unchanged for formats that are not block-compressed.
+GfxFormat getBlockCompressionSourceFormat(GfxFormat format);
+
+// Size of one level in bytes, with dimensions rounded up to whole 4x4 blocks.
+size_t getCompressedLevelSize(GfxFormat format, u32 width, u32 height);
+
+// Encodes a tightly packed RGBA8 image into 4x4 blocks; edge blocks replicate the last row and column.
+// BC1 encodes RGB, BC3 and BC7 encode RGBA, BC4 encodes R and BC5 encodes R and G.
+// Rows of blocks are spread over the default JobSystem.
+void compressRGBA8(GfxFormat format, const u8* rgba, u32 width, u32 height, u8* output);
+
+}
@@ -0,0 +1,596 @@
+#include "Bvh.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <float.h>
+
+namespace Rush
+{
+
+namespace
+{
+	constexpr u32 MaxBinCount = 32;
+
+	// Nodes with at least this many primitives are binned in parallel chunks
+	constexpr u32 ParallelBinningSize = 1 << 16;
+	constexpr u32 BinningChunkSize    = 1 << 14;
+
+	// Nodes with at least this many primitives build their right subtree as a separate job
+	constexpr u32 ParallelSubtreeSize = 1 << 12;
+
+	float getSurfaceArea(const Box3& box)
+	{
+		const Vec3 d = box.dimensions();
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// Primitive bounds are copied into references that are partitioned in place, so every pass over
+	// a node reads memory sequentially
+	struct BvhReference
+	{
+		Vec3 boundsMin;
+		u32  primitive;
+		Vec3 boundsMax;
+		u32  padding;
+
+		Vec3 center() const { return (boundsMin + boundsMax) * 0.5f; }
+	};
+
+	struct BvhBin
+	{
+		Box3 bounds;
+		u32  count;
+
+		void reset()
+		{
+			bounds.expandInit();
+			count = 0;
+		}
+
+		// Empty bins have inverted boxes, which must not be merged
+		void merge(const BvhBin& other)
+		{
+			if (other.count)
+			{
+				bounds.expand(other.bounds);
+				count += other.count;
+			}
+		}
+	};
+
+	struct BvhBinGrid
+	{
+		BvhBin bins[3][MaxBinCount];
+
+		void reset(u32 binCount)
+		{
+			for (auto& axisBins : bins)
+			{
+				for (u32 i = 0; i < binCount; ++i)
+				{
+					axisBins[i].reset();
+				}
+			}
+		}
+	};
+
+	struct BvhBuilder
+	{
+		BvhBuildSettings          settings;
+		std::vector<BvhReference> references;
+		std::vector<BvhNode>      nodes;
+		std::atomic<u32>          nodeCount = 0;
+		JobCounter                counter;
+
+		// Axes with a zero centroid extent have a zero scale and put everything into bin 0
+		u32 getBin(const Vec3& centroid, const Box3& centroidBounds, const Vec3& scale, int axis) const
+		{
+			const float position = (centroid[axis] - centroidBounds.m_min[axis]) * scale[axis];
+			return min(u32(position), settings.binCount - 1);
+		}
+
+		void binRange(u32 first, u32 end, const Box3& centroidBounds, const Vec3& scale, BvhBinGrid& grid) const
+		{
+			grid.reset(settings.binCount);
+			for (u32 i = first; i < end; ++i)
+			{
+				const BvhReference& reference = references[i];
+				const Vec3          centroid  = reference.center();
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					BvhBin& bin = grid.bins[axis][getBin(centroid, centroidBounds, scale, axis)];
+					bin.bounds.expand(reference.boundsMin);
+					bin.bounds.expand(reference.boundsMax);
+					bin.count++;
+				}
+			}
+		}
+
+		// Chunks are merged in order and boxes only take minima and maxima, so the bins are exact
+		void binRangeParallel(u32 first, u32 end, const Box3& centroidBounds, const Vec3& scale, BvhBinGrid& grid) const
+		{
+			const u32               chunkCount = divUp(end - first, BinningChunkSize);
+			std::vector<BvhBinGrid> chunkGrids(chunkCount);
+			JobSystem::getDefault().parallelFor(chunkCount, 1, [&](u32 begin, u32 chunkEnd)
+			{
+				for (u32 c = begin; c < chunkEnd; ++c)
+				{
+					const u32 chunkFirst = first + c * BinningChunkSize;
+					binRange(chunkFirst, min(chunkFirst + BinningChunkSize, end), centroidBounds, scale, chunkGrids[c]);
+				}
+			});
+
+			grid.reset(settings.binCount);
+			for (const BvhBinGrid& chunkGrid : chunkGrids)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					for (u32 i = 0; i < settings.binCount; ++i)
+					{
+						grid.bins[axis][i].merge(chunkGrid.bins[axis][i]);
+					}
+				}
+			}
+		}
+
+		void computeRangeBounds(u32 first, u32 end, Box3& rangeBounds, Box3& centroidBounds) const
+		{
+			rangeBounds.expandInit();
+			centroidBounds.expandInit();
+			for (u32 i = first; i < end; ++i)
+			{
+				rangeBounds.expand(references[i].boundsMin);
+				rangeBounds.expand(references[i].boundsMax);
+				centroidBounds.expand(references[i].center());
+			}
+		}
+
+		void buildNode(u32 nodeIndex, u32 first, u32 end, const Box3& nodeBounds, const Box3& centroidBounds, u32 depth)
+		{
+			BvhNode& node  = nodes[nodeIndex];
+			node.boundsMin = nodeBounds.m_min;
+			node.boundsMax = nodeBounds.m_max;
+			node.first     = first;
+			node.count     = end - first;
+
+			const u32 count = end - first;
+			if (count == 1 || depth == BvhMaxDepth)
+			{
+				return;
+			}
+
+			const Vec3 extent = centroidBounds.dimensions();
+			Vec3       scale;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				scale[axis] = extent[axis] > 0.0f ? float(settings.binCount) / extent[axis] : 0.0f;
+			}
+
+			u32  split = first;
+			Box3 childBounds[2];
+			Box3 childCentroids[2];
+
+			if (extent.x > 0.0f || extent.y > 0.0f || extent.z > 0.0f)
+			{
+				BvhBinGrid grid;
+				if (count >= ParallelBinningSize)
+				{
+					binRangeParallel(first, end, centroidBounds, scale, grid);
+				}
+				else
+				{
+					binRange(first, end, centroidBounds, scale, grid);
+				}
+
+				// Sweep the bins of each axis from the right to get the costs of all right halves,
+				// then from the left to evaluate each split plane
+				float bestCost  = FLT_MAX;
+				int   bestAxis  = -1;
+				u32   bestPlane = 0;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if (scale[axis] == 0.0f)
+					{
+						continue;
+					}
+
+					const BvhBin* bins = grid.bins[axis];
+
+					float  rightCost[MaxBinCount];
+					BvhBin right;
+					right.reset();
+					for (u32 i = settings.binCount - 1; i > 0; --i)
+					{
+						right.merge(bins[i]);
+						rightCost[i] = right.count ? getSurfaceArea(right.bounds) * float(right.count) : 0.0f;
+					}
+
+					BvhBin left;
+					left.reset();
+					for (u32 plane = 1; plane < settings.binCount; ++plane)
+					{
+						left.merge(bins[plane - 1]);
+						const float cost = (left.count ? getSurfaceArea(left.bounds) * float(left.count) : 0.0f) + rightCost[plane];
+						if (left.count && left.count < count && cost < bestCost)
+						{
+							bestCost  = cost;
+							bestAxis  = axis;
+							bestPlane = plane;
+						}
+					}
+				}
+
+				// Compare against the cost of intersecting every primitive in a leaf, both scaled by the node area
+				const float leafCost = getSurfaceArea(nodeBounds) * (float(count) - settings.traversalCost);
+				if (bestCost >= leafCost && count <= settings.maxLeafSize)
+				{
+					return;
+				}
+
+				// Partition with each reference classified once, gathering the child centroid bounds
+				childCentroids[0].expandInit();
+				childCentroids[1].expandInit();
+				u32 i = first;
+				u32 j = end;
+				while (i < j)
+				{
+					const Vec3 centroid = references[i].center();
+					if (getBin(centroid, centroidBounds, scale, bestAxis) < bestPlane)
+					{
+						childCentroids[0].expand(centroid);
+						++i;
+					}
+					else
+					{
+						childCentroids[1].expand(centroid);
+						std::swap(references[i], references[--j]);
+					}
+				}
+				split = i;
+
+				BvhBin halves[2];
+				halves[0].reset();
+				halves[1].reset();
+				for (u32 b = 0; b < settings.binCount; ++b)
+				{
+					halves[b < bestPlane ? 0 : 1].merge(grid.bins[bestAxis][b]);
+				}
+				RUSH_ASSERT(split - first == halves[0].count);
+
+				childBounds[0] = halves[0].bounds;
+				childBounds[1] = halves[1].bounds;
+			}
+			else
+			{
+				// All centroids coincide, so no plane separates them. Split the range in half to keep
+				// leaves small.
+				if (count <= settings.maxLeafSize)
+				{
+					return;
+				}
+
+				split = first + count / 2;
+				computeRangeBounds(first, split, childBounds[0], childCentroids[0]);
+				computeRangeBounds(split, end, childBounds[1], childCentroids[1]);
+			}
+
+			const u32 childIndex = nodeCount.fetch_add(2, std::memory_order_relaxed);
+			node.first = childIndex;
+			node.count = 0;
+
+			if (count >= ParallelSubtreeSize)
+			{
+				const Box3 rightBounds    = childBounds[1];
+				const Box3 rightCentroids = childCentroids[1];
+				JobSystem::getDefault().submit(
+				    [=, this]() { buildNode(childIndex + 1, split, end, rightBounds, rightCentroids, depth + 1); }, &counter);
+			}
+			else
+			{
+				buildNode(childIndex + 1, split, end, childBounds[1], childCentroids[1], depth + 1);
+			}
+
+			buildNode(childIndex, first, split, childBounds[0], childCentroids[0], depth + 1);
+		}
+	};
+
+	// Renumbers nodes depth first. Nodes are allocated in whatever order the jobs run, so this makes
+	// the layout deterministic and puts each left subtree right after its sibling pair.
+	void storeDepthFirst(const std::vector<BvhNode>& nodes, u32 nodeCount, std::vector<BvhNode>& out)
+	{
+		out.resize(nodeCount);
+		out[0] = nodes[0];
+
+		struct Pending
+		{
+			u32 source;
+			u32 destination;
+		};
+
+		std::vector<Pending> stack = {{0, 0}};
+		u32                  next  = 1;
+		while (!stack.empty())
+		{
+			const Pending pending = stack.back();
+			stack.pop_back();
+
+			BvhNode& node = out[pending.destination];
+			if (node.isLeaf())
+			{
+				continue;
+			}
+
+			const u32 source = nodes[pending.source].first;
+			out[next]        = nodes[source];
+			out[next + 1]    = nodes[source + 1];
+			node.first       = next;
+			stack.push_back({source + 1, next + 1});
+			stack.push_back({source, next});
+			next += 2;
+		}
+	}
+
+	Vec3 loadPosition(const float* positions, size_t positionStride, u32 index)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const u8*>(positions) + index * positionStride);
+		return Vec3(p[0], p[1], p[2]);
+	}
+
+	struct BvhRay
+	{
+		Vec3  origin;
+		Vec3  direction;
+		Vec3  invDirection;
+		float tMin;
+	};
+
+	// Returns the entry distance, or FLT_MAX when the box is missed before tMax
+	float intersectBox(const BvhNode& node, const BvhRay& ray, float tMax)
+	{
+		float tNear = ray.tMin;
+		float tFar  = tMax;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float t0 = (node.boundsMin[axis] - ray.origin[axis]) * ray.invDirection[axis];
+			float t1 = (node.boundsMax[axis] - ray.origin[axis]) * ray.invDirection[axis];
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+			}
+
+			// NaN from 0 * inf fails both comparisons and leaves the interval unchanged
+			tNear = t0 > tNear ? t0 : tNear;
+			tFar  = t1 < tFar ? t1 : tFar;
+		}
+		return tNear <= tFar ? tNear : FLT_MAX;
+	}
+
+	// Moller-Trumbore without culling; det > 0 when cross(p1 - p0, p2 - p0) points against the ray
+	bool intersectTriangle(const Vec3& p0, const Vec3& p1, const Vec3& p2, const BvhRay& ray, float tMax, BvhRayHit& hit)
+	{
+		const Vec3  e1  = p1 - p0;
+		const Vec3  e2  = p2 - p0;
+		const Vec3  pv  = cross(ray.direction, e2);
+		const float det = dot(e1, pv);
+		if (det == 0.0f)
+		{
+			return false;
+		}
+
+		const float invDet = 1.0f / det;
+		const Vec3  tv     = ray.origin - p0;
+		const float u      = dot(tv, pv) * invDet;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+
+		const Vec3  qv = cross(tv, e1);
+		const float v  = dot(ray.direction, qv) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+
+		const float t = dot(e2, qv) * invDet;
+		if (!(t >= ray.tMin && t < tMax))
+		{
+			return false;
+		}
+
+		hit.t           = t;
+		hit.u           = u;
+		hit.v           = v;
+		hit.frontFacing = det > 0.0f;
+		return true;
+	}
+
+	template <bool AnyHit>
+	bool traverseTriangleBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride,
+	    const Vec3& origin, const Vec3& direction, float tMin, float tMax, BvhRayHit& hit)
+	{
+		if (bvh.nodes.empty())
+		{
+			return false;
+		}
+
+		BvhRay ray;
+		ray.origin       = origin;
+		ray.direction    = direction;
+		ray.invDirection = Vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		ray.tMin         = tMin;
+
+		if (intersectBox(bvh.nodes[0], ray, tMax) == FLT_MAX)
+		{
+			return false;
+		}
+
+		bool  found    = false;
+		float closestT = tMax;
+
+		u32 stack[BvhMaxDepth + 1];
+		u32 stackSize      = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize != 0)
+		{
+			const BvhNode& node = bvh.nodes[stack[--stackSize]];
+
+			if (!node.isLeaf())
+			{
+				// Visit the nearer child first so that its hits cull the other one
+				const float tLeft    = intersectBox(bvh.nodes[node.first], ray, closestT);
+				const float tRight   = intersectBox(bvh.nodes[node.first + 1], ray, closestT);
+				const bool  hitLeft  = tLeft != FLT_MAX;
+				const bool  hitRight = tRight != FLT_MAX;
+				if (hitLeft && hitRight)
+				{
+					const bool leftFirst = tLeft <= tRight;
+					stack[stackSize++]   = leftFirst ? node.first + 1 : node.first;
+					stack[stackSize++]   = leftFirst ? node.first : node.first + 1;
+				}
+				else if (hitLeft || hitRight)
+				{
+					stack[stackSize++] = hitLeft ? node.first : node.first + 1;
+				}
+				continue;
+			}
+
+			for (u32 i = node.first; i < node.first + node.count; ++i)
+			{
+				const u32  triangle = bvh.primitives[i];
+				const u32* t        = indices + size_t(triangle) * 3;
+				const Vec3 p0       = loadPosition(positions, positionStride, t[0]);
+				const Vec3 p1       = loadPosition(positions, positionStride, t[1]);
+				const Vec3 p2       = loadPosition(positions, positionStride, t[2]);
+				if (intersectTriangle(p0, p1, p2, ray, closestT, hit))
+				{
+					if (AnyHit)
+					{
+						return true;
+					}
+					found         = true;
+					closestT      = hit.t;
+					hit.primitive = triangle;
+				}
+			}
+		}
+
+		return found;
+	}
+}
+
+void buildBvh(const Box3* bounds, u32 count, Bvh& out, const BvhBuildSettings& settings)
+{
+	out.nodes.clear();
+	out.primitives.resize(count);
+	if (count == 0)
+	{
+		return;
+	}
+
+	BvhBuilder builder;
+	builder.settings             = settings;
+	builder.settings.binCount    = min(max(settings.binCount, 2u), MaxBinCount);
+	builder.settings.maxLeafSize = max(settings.maxLeafSize, 1u);
+	builder.references.resize(count);
+
+	// A binary tree with at least one primitive per leaf has at most 2 * count - 1 nodes
+	builder.nodes.resize(size_t(count) * 2 - 1);
+	builder.nodeCount = 1;
+
+	const u32         chunkCount = divUp(count, BinningChunkSize);
+	std::vector<Box3> chunkBounds(chunkCount);
+	std::vector<Box3> chunkCentroids(chunkCount);
+	JobSystem::getDefault().parallelFor(chunkCount, 1, [&](u32 begin, u32 end)
+	{
+		for (u32 c = begin; c < end; ++c)
+		{
+			const u32 chunkFirst = c * BinningChunkSize;
+			for (u32 i = chunkFirst; i < min(count, chunkFirst + BinningChunkSize); ++i)
+			{
+				BvhReference& reference = builder.references[i];
+				reference.boundsMin     = bounds[i].m_min;
+				reference.boundsMax     = bounds[i].m_max;
+				reference.primitive     = i;
+				reference.padding       = 0;
+			}
+			builder.computeRangeBounds(chunkFirst, min(count, chunkFirst + BinningChunkSize), chunkBounds[c], chunkCentroids[c]);
+		}
+	});
+
+	Box3 rootBounds;
+	Box3 rootCentroids;
+	rootBounds.expandInit();
+	rootCentroids.expandInit();
+	for (u32 c = 0; c < chunkCount; ++c)
+	{
+		rootBounds.expand(chunkBounds[c]);
+		rootCentroids.expand(chunkCentroids[c]);
+	}
+
+	builder.buildNode(0, 0, count, rootBounds, rootCentroids, 0);
+	JobSystem::getDefault().wait(builder.counter);
+
+	for (u32 i = 0; i < count; ++i)
+	{
+		out.primitives[i] = builder.references[i].primitive;
+	}
+
+	storeDepthFirst(builder.nodes, builder.nodeCount.load(), out.nodes);
+}
+
+void buildTriangleBvh(const u32* indices, size_t indexCount, const float* positions, size_t positionStride, Bvh& out,
+    const BvhBuildSettings& settings)
+{
+	const u32         triangleCount = u32(indexCount / 3);
+	std::vector<Box3> bounds(triangleCount);
+	JobSystem::getDefault().parallelFor(triangleCount, 1 << 14, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			Box3& box = bounds[i];
+			box.expandInit();
+			for (u32 k = 0; k < 3; ++k)
+			{
+				box.expand(loadPosition(positions, positionStride, indices[size_t(i) * 3 + k]));
+			}
+		}
+	});
+
+	buildBvh(bounds.data(), triangleCount, out, settings);
+}
+
+float computeBvhSahCost(const Bvh& bvh, float traversalCost)
+{
+	if (bvh.nodes.empty())
+	{
+		return 0.0f;
+	}
+
+	double cost = 0;
+	for (const BvhNode& node : bvh.nodes)
+	{
+		const double area = getSurfaceArea(Box3(node.boundsMin, node.boundsMax));
+		cost += area * (node.isLeaf() ? double(node.count) : double(traversalCost));
+	}
+
+	const double rootArea = getSurfaceArea(Box3(bvh.nodes[0].boundsMin, bvh.nodes[0].boundsMax));
+	return rootArea > 0 ? float(cost / rootArea) : 0.0f;
+}
+
+bool intersectTriangleBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride,
+    const Vec3& origin, const Vec3& direction, float tMin, float tMax, BvhRayHit& hit)
+{
+	return traverseTriangleBvh<false>(bvh, indices, positions, positionStride, origin, direction, tMin, tMax, hit);
+}
+
+bool isTriangleBvhOccluded(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride,
+    const Vec3& origin, const Vec3& direction, float tMin, float tMax)
+{
+	BvhRayHit hit;
+	return traverseTriangleBvh<true>(bvh, indices, positions, positionStride, origin, direction, tMin, tMax, hit);
+}
+
+}
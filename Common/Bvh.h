@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+#include <Rush/Rush.h>
+
+#include <stddef.h>
+#include <vector>
+
+namespace Rush
+{
+
+// Builds stop splitting at this depth, so traversal can use a fixed-size stack of BvhMaxDepth + 1
+constexpr u32 BvhMaxDepth = 64;
+
+// 32 bytes. Inner nodes have count == 0 and their two children at first and first + 1, leaves
+// reference count primitives starting at first in Bvh::primitives.
+struct BvhNode
+{
+	Vec3 boundsMin;
+	u32  first = 0;
+	Vec3 boundsMax;
+	u32  count = 0;
+
+	bool isLeaf() const { return count != 0; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BVH nodes must be 32 bytes");
+
+// Nodes are stored depth first with nodes[0] as the root, and are empty when there are no primitives
+struct Bvh
+{
+	std::vector<BvhNode> nodes;
+	std::vector<u32>     primitives; // primitive indices in leaf order
+};
+
+struct BvhBuildSettings
+{
+	u32   maxLeafSize   = 8;    // larger ranges are always split
+	u32   binCount      = 16;   // SAH split candidates per axis are binCount - 1, at most 32 bins
+	float traversalCost = 1.0f; // cost of visiting a node relative to intersecting one primitive
+};
+
+// Builds over primitive bounding boxes with binned SAH splits (Wald, "On fast construction of
+// SAH-based bounding volume hierarchies"). Large nodes are binned and subtrees are built on the
+// default JobSystem; the result is the same for any number of threads.
+void buildBvh(const Box3* bounds, u32 count, Bvh& out, const BvhBuildSettings& settings = BvhBuildSettings());
+
+// Builds over an indexed triangle list, where primitive i is the triangle at indices[i * 3].
+// positions are float3 with a stride of positionStride bytes, so interleaved vertices work as is.
+void buildTriangleBvh(const u32* indices, size_t indexCount, const float* positions, size_t positionStride, Bvh& out,
+    const BvhBuildSettings& settings = BvhBuildSettings());
+
+// Expected cost of a random ray query relative to intersecting one primitive, per the SAH
+float computeBvhSahCost(const Bvh& bvh, float traversalCost = 1.0f);
+
+struct BvhRayHit
+{
+	float t         = 0.0f;
+	u32   primitive = ~0u;
+	float u         = 0.0f; // barycentric weight of the triangle's second vertex
+	float v         = 0.0f; // barycentric weight of the third vertex
+	bool  frontFacing = false; // cross(b - a, c - a) points against the ray
+};
+
+// Closest triangle hit by origin + t * direction with t in [tMin, tMax). Triangles are not culled
+// and the direction doesn't need to be normalized. indices and positions are the buildTriangleBvh()
+// inputs.
+bool intersectTriangleBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride,
+    const Vec3& origin, const Vec3& direction, float tMin, float tMax, BvhRayHit& hit);
+
+// Whether any triangle is hit with t in [tMin, tMax); stops at the first hit found
+bool isTriangleBvhOccluded(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride,
+    const Vec3& origin, const Vec3& direction, float tMin, float tMax);
+
+}
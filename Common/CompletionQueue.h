@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Rush/Rush.h>
+
+#include <atomic>
+#include <utility>
+
+namespace Rush
+{
+
+// Multi-producer, single-consumer queue for handing finished work from jobs back to the
+// main thread. push() is lock-free, so producers never block each other or the consumer;
+// the consumer detaches everything pushed so far with one atomic exchange and visits it
+// in push order.
+template <typename T> class CompletionQueue
+{
+	RUSH_DISALLOW_COPY_AND_ASSIGN(CompletionQueue);
+
+public:
+	CompletionQueue() = default;
+	~CompletionQueue()
+	{
+		consumeAll([](T&) {});
+	}
+
+	void push(T value)
+	{
+		Node* node = new Node{std::move(value), m_head.load(std::memory_order_relaxed)};
+		while (!m_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	// Calls fn(T&) for every item pushed before the call and returns how many there were.
+	// Only one thread may consume at a time.
+	template <typename Fn> u32 consumeAll(Fn&& fn)
+	{
+		Node* list = m_head.exchange(nullptr, std::memory_order_acquire);
+
+		// The list comes out newest first; reverse it to restore push order
+		Node* ordered = nullptr;
+		while (list)
+		{
+			Node* next = list->next;
+			list->next = ordered;
+			ordered    = list;
+			list       = next;
+		}
+
+		u32 count = 0;
+		while (ordered)
+		{
+			Node* next = ordered->next;
+			fn(ordered->value);
+			delete ordered;
+			ordered = next;
+			++count;
+		}
+
+		return count;
+	}
+
+	bool empty() const { return m_head.load(std::memory_order_acquire) == nullptr; }
+
+private:
+	struct Node
+	{
+		T     value;
+		Node* next;
+	};
+
+	std::atomic<Node*> m_head = nullptr;
+};
+
+}
@@ -0,0 +1,124 @@
+#include "ContentHash.h"
+#include "MappedFile.h"
+
+#include <string.h>
+
+namespace Rush
+{
+
+namespace
+{
+	constexpr u64 Prime1 = 0x9E3779B185EBCA87ull;
+	constexpr u64 Prime2 = 0xC2B2AE3D27D4EB4Full;
+	constexpr u64 Prime3 = 0x165667B19E3779F9ull;
+	constexpr u64 Prime4 = 0x85EBCA77C2B2AE63ull;
+	constexpr u64 Prime5 = 0x27D4EB2F165667C5ull;
+
+	inline u64 rotateLeft(u64 x, u32 r) { return (x << r) | (x >> (64 - r)); }
+
+	inline u64 read64(const u8* p)
+	{
+		u64 result;
+		memcpy(&result, p, sizeof(result));
+		return result;
+	}
+
+	inline u32 read32(const u8* p)
+	{
+		u32 result;
+		memcpy(&result, p, sizeof(result));
+		return result;
+	}
+
+	inline u64 round(u64 acc, u64 input)
+	{
+		acc += input * Prime2;
+		acc = rotateLeft(acc, 31);
+		return acc * Prime1;
+	}
+
+	inline u64 mergeRound(u64 acc, u64 value)
+	{
+		acc ^= round(0, value);
+		return acc * Prime1 + Prime4;
+	}
+}
+
+u64 computeContentHash(const void* data, size_t size, u64 seed)
+{
+	const u8*       p   = static_cast<const u8*>(data);
+	const u8* const end = p + size;
+
+	u64 hash;
+	if (size >= 32)
+	{
+		// Four independent lanes keep the multiplier pipelines busy
+		u64 v1 = seed + Prime1 + Prime2;
+		u64 v2 = seed + Prime2;
+		u64 v3 = seed;
+		u64 v4 = seed - Prime1;
+
+		const u8* const limit = end - 32;
+		do
+		{
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	}
+	else
+	{
+		hash = seed + Prime5;
+	}
+
+	hash += u64(size);
+
+	for (; p + 8 <= end; p += 8)
+	{
+		hash ^= round(0, read64(p));
+		hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+	}
+
+	if (p + 4 <= end)
+	{
+		hash ^= u64(read32(p)) * Prime1;
+		hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+		p += 4;
+	}
+
+	for (; p < end; ++p)
+	{
+		hash ^= u64(*p) * Prime5;
+		hash = rotateLeft(hash, 11) * Prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	hash *= Prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+bool computeFileContentHash(const char* filename, u64& outHash)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		return false;
+	}
+
+	outHash = computeContentHash(file.data(), file.size());
+	return true;
+}
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <Rush/Rush.h>
+
+#include <stddef.h>
+
+namespace Rush
+{
+
+// 64-bit XXH64 hash of a block of memory. Runs at several GB/s, so it is cheap enough to
+// fingerprint whole asset files; use it to detect identical content, not for security.
+u64 computeContentHash(const void* data, size_t size, u64 seed = 0);
+
+// Hashes the raw bytes of a file without decoding it. Returns false if the file can't be read.
+bool computeFileContentHash(const char* filename, u64& outHash);
+
+}
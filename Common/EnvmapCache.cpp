@@ -0,0 +1,338 @@
+#include "EnvmapCache.h"
+#include "ContentHash.h"
+#include "Half.h"
+#include "JobSystem.h"
+
+#include <Rush/Platform.h>
+#include <Rush/UtilFile.h>
+#include <Rush/UtilLog.h>
+
+#include <stb_image.h>
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+namespace Rush
+{
+
+namespace
+{
+	constexpr u32 EnvmapCacheMagic = 0x564E4552; // 'RENV'
+
+	// Bump whenever the layout or the distribution build changes, to invalidate stale entries
+	constexpr u32 EnvmapCacheVersion = 1;
+
+	constexpr u64 EnvmapCacheAlignment = 16;
+
+	// Largest finite half is 65504; anything from 65520 up rounds to infinity
+	constexpr float HalfOverflowThreshold = 65520.0f;
+
+	struct EnvmapCacheHeader
+	{
+		u32 magic;
+		u32 version;
+		u32 colorFormat;
+		u32 width;
+		u32 height;
+		u32 reserved;
+		u64 sourceHash;
+		u64 colorOffset;
+		u64 pdfOffset;
+		u64 cellOffset;
+	};
+
+	bool fitsHalfRange(const float* rgba, u32 width, u32 height)
+	{
+		std::atomic<bool> overflow = false;
+		JobSystem::getDefault().parallelFor(height, 16, [&](u32 begin, u32 end)
+		{
+			for (u32 y = begin; y < end && !overflow.load(std::memory_order_relaxed); ++y)
+			{
+				const float* row = rgba + size_t(y) * width * 4;
+				for (u32 i = 0; i < width * 4; i += 4)
+				{
+					if (max(max(row[i], row[i + 1]), row[i + 2]) >= HalfOverflowThreshold)
+					{
+						overflow = true;
+						break;
+					}
+				}
+			}
+		});
+		return !overflow;
+	}
+
+	bool writeAll(FileOut& stream, const void* data, u64 size)
+	{
+		// FileOut takes 32-bit sizes, and 16K float envmaps reach 2GB per plane
+		const u8* bytes = static_cast<const u8*>(data);
+		while (size)
+		{
+			const u32 chunk = u32(min<u64>(size, 1u << 30));
+			if (stream.write(bytes, chunk) != chunk)
+			{
+				return false;
+			}
+			bytes += chunk;
+			size -= chunk;
+		}
+		return true;
+	}
+}
+
+void EnvmapData::reset()
+{
+	width       = 0;
+	height      = 0;
+	colorFormat = GfxFormat_Unknown;
+	color       = nullptr;
+	pdf         = nullptr;
+	cells       = nullptr;
+	file.close();
+	colorStorage = std::vector<u8>();
+	pdfStorage   = std::vector<float>();
+	cellStorage  = std::vector<AliasTableCell>();
+}
+
+bool buildEnvmapData(const char* filename, GfxFormat colorFormat, EnvmapData& out)
+{
+	RUSH_ASSERT(colorFormat == GfxFormat_RGBA32_Float || colorFormat == GfxFormat_RGBA16_Float);
+
+	int    width = 0, height = 0, comp = 0;
+	float* rgba = stbi_loadf(filename, &width, &height, &comp, 4);
+	if (!rgba)
+	{
+		RUSH_LOG_ERROR("Failed to decode envmap '%s': %s", filename, stbi_failure_reason());
+		return false;
+	}
+
+	out.reset();
+	out.width  = u32(width);
+	out.height = u32(height);
+
+	// Writes the PDF into the alpha channel, from where it is moved to its own plane below
+	buildEnvmapDistribution(rgba, out.width, out.height, out.cellStorage);
+
+	if (colorFormat == GfxFormat_RGBA16_Float && !fitsHalfRange(rgba, out.width, out.height))
+	{
+		RUSH_LOG("Envmap '%s' exceeds the half float range, keeping RGBA32_Float", filename);
+		colorFormat = GfxFormat_RGBA32_Float;
+	}
+
+	out.colorFormat = colorFormat;
+	out.colorStorage.resize(out.getColorSize());
+	out.pdfStorage.resize(out.getTexelCount());
+
+	const u32 rowLength = out.width;
+	JobSystem::getDefault().parallelFor(out.height, 4, [&](u32 begin, u32 end)
+	{
+		for (u32 y = begin; y < end; ++y)
+		{
+			const size_t first = size_t(y) * rowLength;
+			const float* src   = rgba + first * 4;
+			float*       pdf   = out.pdfStorage.data() + first;
+
+			if (colorFormat == GfxFormat_RGBA16_Float)
+			{
+				u16* dst = reinterpret_cast<u16*>(out.colorStorage.data()) + first * 4;
+				for (u32 x = 0; x < rowLength; ++x)
+				{
+					dst[x * 4 + 0] = floatToHalf(src[x * 4 + 0]);
+					dst[x * 4 + 1] = floatToHalf(src[x * 4 + 1]);
+					dst[x * 4 + 2] = floatToHalf(src[x * 4 + 2]);
+					dst[x * 4 + 3] = 0x3C00; // 1.0
+					pdf[x]         = src[x * 4 + 3];
+				}
+			}
+			else
+			{
+				float* dst = reinterpret_cast<float*>(out.colorStorage.data()) + first * 4;
+				for (u32 x = 0; x < rowLength; ++x)
+				{
+					dst[x * 4 + 0] = src[x * 4 + 0];
+					dst[x * 4 + 1] = src[x * 4 + 1];
+					dst[x * 4 + 2] = src[x * 4 + 2];
+					dst[x * 4 + 3] = 1.0f;
+					pdf[x]         = src[x * 4 + 3];
+				}
+			}
+		}
+	});
+
+	stbi_image_free(rgba);
+
+	out.color = out.colorStorage.data();
+	out.pdf   = out.pdfStorage.data();
+	out.cells = out.cellStorage.data();
+
+	return true;
+}
+
+std::string getEnvmapCachePath(const char* tag, u64 sourceHash, GfxFormat colorFormat)
+{
+	const u32 params[] = {u32(colorFormat), EnvmapCacheVersion};
+	const u64 key      = computeContentHash(params, sizeof(params), sourceHash);
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s_envmap_%016llx.bin", tag, static_cast<unsigned long long>(key));
+
+	return std::string(Platform_GetExecutableDirectory()) + "/TextureCache/" + name;
+}
+
+bool loadCachedEnvmap(const std::string& cachePath, u64 sourceHash, EnvmapData& out)
+{
+	if (cachePath.empty())
+	{
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(cachePath.c_str()) || file.size() < sizeof(EnvmapCacheHeader))
+	{
+		return false;
+	}
+
+	EnvmapCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	const GfxFormat colorFormat = GfxFormat(header.colorFormat);
+	if (header.magic != EnvmapCacheMagic || header.version != EnvmapCacheVersion || header.sourceHash != sourceHash ||
+	    (colorFormat != GfxFormat_RGBA32_Float && colorFormat != GfxFormat_RGBA16_Float) || header.width == 0 ||
+	    header.height == 0)
+	{
+		return false;
+	}
+
+	out.reset();
+	out.width       = header.width;
+	out.height      = header.height;
+	out.colorFormat = colorFormat;
+
+	const u64 texelCount = out.getTexelCount();
+	if (header.colorOffset < sizeof(header) || header.colorOffset + out.getColorSize() > header.pdfOffset ||
+	    header.pdfOffset + texelCount * sizeof(float) > header.cellOffset ||
+	    header.cellOffset + texelCount * sizeof(AliasTableCell) > file.size())
+	{
+		RUSH_LOG_ERROR("Envmap cache entry '%s' is truncated", cachePath.c_str());
+		out.reset();
+		return false;
+	}
+
+	out.color = file.data() + header.colorOffset;
+	out.pdf   = reinterpret_cast<const float*>(file.data() + header.pdfOffset);
+	out.cells = reinterpret_cast<const AliasTableCell*>(file.data() + header.cellOffset);
+	out.file  = std::move(file);
+
+	return true;
+}
+
+bool saveCachedEnvmap(const std::string& cachePath, u64 sourceHash, const EnvmapData& envmap)
+{
+	if (cachePath.empty() || !envmap.valid())
+	{
+		return false;
+	}
+
+	const std::filesystem::path path = cachePath;
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	const u64 texelCount = envmap.getTexelCount();
+
+	EnvmapCacheHeader header = {};
+	header.magic             = EnvmapCacheMagic;
+	header.version           = EnvmapCacheVersion;
+	header.colorFormat       = u32(envmap.colorFormat);
+	header.width             = envmap.width;
+	header.height            = envmap.height;
+	header.sourceHash        = sourceHash;
+	header.colorOffset       = alignCeiling(u64(sizeof(header)), EnvmapCacheAlignment);
+	header.pdfOffset         = alignCeiling(header.colorOffset + envmap.getColorSize(), EnvmapCacheAlignment);
+	header.cellOffset        = alignCeiling(header.pdfOffset + texelCount * sizeof(float), EnvmapCacheAlignment);
+
+	struct Section
+	{
+		const void* data;
+		u64         offset;
+		u64         size;
+	};
+
+	const Section sections[] = {
+	    {envmap.color, header.colorOffset, envmap.getColorSize()},
+	    {envmap.pdf, header.pdfOffset, texelCount * sizeof(float)},
+	    {envmap.cells, header.cellOffset, texelCount * sizeof(AliasTableCell)},
+	};
+
+	char tempSuffix[32];
+	snprintf(tempSuffix, sizeof(tempSuffix), ".%016llx.tmp",
+	    static_cast<unsigned long long>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+	const std::string tempPath = cachePath + tempSuffix;
+
+	bool ok = false;
+	{
+		FileOut stream(tempPath.c_str());
+		if (!stream.valid())
+		{
+			RUSH_LOG_ERROR("Failed to open envmap cache entry '%s' for writing", tempPath.c_str());
+			return false;
+		}
+
+		static const u8 padding[EnvmapCacheAlignment] = {};
+
+		ok          = writeAll(stream, &header, sizeof(header));
+		u64 written = sizeof(header);
+		for (const Section& section : sections)
+		{
+			ok      = ok && writeAll(stream, padding, section.offset - written) && writeAll(stream, section.data, section.size);
+			written = section.offset + section.size;
+		}
+	}
+
+	if (!ok)
+	{
+		RUSH_LOG_ERROR("Failed to write envmap cache entry '%s'", tempPath.c_str());
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
+
+bool loadEnvmapData(const char* filename, GfxFormat colorFormat, const char* cacheTag, EnvmapData& out)
+{
+	u64 sourceHash = 0;
+	if (!computeFileContentHash(filename, sourceHash))
+	{
+		return false;
+	}
+
+	const std::string cachePath = getEnvmapCachePath(cacheTag, sourceHash, colorFormat);
+	if (loadCachedEnvmap(cachePath, sourceHash, out))
+	{
+		return true;
+	}
+
+	if (!buildEnvmapData(filename, colorFormat, out))
+	{
+		return false;
+	}
+
+	saveCachedEnvmap(cachePath, sourceHash, out);
+
+	return true;
+}
+
+}
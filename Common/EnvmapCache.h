@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Rush/GfxCommon.h>
+#include <Rush/Rush.h>
+
+#include "EnvmapSampling.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+
+namespace Rush
+{
+
+// Upload-ready lat-long envmap: a color plane, a separate R32F plane holding the solid-angle
+// PDF of sampling each texel, and the alias table over texels. The planes point either into a
+// mapped cache entry or into storage owned by this object.
+struct EnvmapData
+{
+	static constexpr GfxFormat PdfFormat = GfxFormat_R32_Float;
+
+	u32       width       = 0;
+	u32       height      = 0;
+	GfxFormat colorFormat = GfxFormat_Unknown; // RGBA32_Float or RGBA16_Float
+
+	const void*           color = nullptr;
+	const float*          pdf   = nullptr;
+	const AliasTableCell* cells = nullptr;
+
+	MappedFile                  file;
+	std::vector<u8>             colorStorage;
+	std::vector<float>          pdfStorage;
+	std::vector<AliasTableCell> cellStorage;
+
+	bool   valid() const { return color != nullptr; }
+	size_t getTexelCount() const { return size_t(width) * height; }
+	size_t getColorSize() const { return getTexelCount() * (colorFormat == GfxFormat_RGBA16_Float ? 8 : 16); }
+	void   reset();
+};
+
+// Decodes a Radiance HDR image and builds its sampling data. Color is stored as RGBA32_Float
+// or RGBA16_Float; half storage falls back to float when the image has values beyond the half
+// range, such as an unclipped sun.
+bool buildEnvmapData(const char* filename, GfxFormat colorFormat, EnvmapData& out);
+
+// Cache entry path for an envmap, under "TextureCache" next to the executable. The key is the
+// content hash of the source image, so renamed or copied files share one entry.
+std::string getEnvmapCachePath(const char* tag, u64 sourceHash, GfxFormat colorFormat);
+
+// Maps a cache entry written by saveCachedEnvmap(); out's planes then point into the mapping.
+bool loadCachedEnvmap(const std::string& cachePath, u64 sourceHash, EnvmapData& out);
+
+// Writes the planes to a new cache entry under a temporary name and renames it into place.
+bool saveCachedEnvmap(const std::string& cachePath, u64 sourceHash, const EnvmapData& envmap);
+
+// Loads an envmap through the cache: repeat runs map the stored planes and alias table instead
+// of decoding the image and rebuilding the distribution.
+bool loadEnvmapData(const char* filename, GfxFormat colorFormat, const char* cacheTag, EnvmapData& out);
+
+}
@@ -0,0 +1,419 @@
+#include "EnvmapSampling.h"
+#include "JobSystem.h"
+
+#include <Rush/MathCommon.h>
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ENVMAP_SSE 1
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define ENVMAP_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Rush
+{
+
+namespace
+{
+	// Prefix sums are accumulated in double and stored as a float offset from the start of
+	// their chunk, so each stored value is within half a float ulp of a value below ChunkSize
+	constexpr u32 ChunkSize = 1024;
+
+	// Rows are short enough that a float accumulator stays exact to well under 1e-4,
+	// so per-row sums are flushed to double every this many texels
+	constexpr u32 RowSumFlushInterval = 256;
+
+	// Writes max(r, g, b) * scale for each texel of a row to out and returns the sum of the outputs.
+	double computeRowWeights(const float* rgba, u32 width, float scale, float* out)
+	{
+		double sum = 0;
+		u32    x   = 0;
+
+#if ENVMAP_SSE
+		const __m128 vscale = _mm_set1_ps(scale);
+		while (x + 4 <= width)
+		{
+			const u32 end = min(width & ~3u, x + RowSumFlushInterval);
+			__m128    acc = _mm_setzero_ps();
+			for (; x < end; x += 4)
+			{
+				__m128 p0 = _mm_loadu_ps(rgba + x * 4);
+				__m128 p1 = _mm_loadu_ps(rgba + x * 4 + 4);
+				__m128 p2 = _mm_loadu_ps(rgba + x * 4 + 8);
+				__m128 p3 = _mm_loadu_ps(rgba + x * 4 + 12);
+				_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+				const __m128 w = _mm_mul_ps(_mm_max_ps(_mm_max_ps(p0, p1), p2), vscale);
+				_mm_storeu_ps(out + x, w);
+				acc = _mm_add_ps(acc, w);
+			}
+			alignas(16) float lanes[4];
+			_mm_store_ps(lanes, acc);
+			sum += double(lanes[0]) + double(lanes[1]) + double(lanes[2]) + double(lanes[3]);
+		}
+#elif ENVMAP_NEON
+		const float32x4_t vscale = vdupq_n_f32(scale);
+		while (x + 4 <= width)
+		{
+			const u32   end = min(width & ~3u, x + RowSumFlushInterval);
+			float32x4_t acc = vdupq_n_f32(0.0f);
+			for (; x < end; x += 4)
+			{
+				const float32x4x4_t p = vld4q_f32(rgba + x * 4);
+				const float32x4_t   w = vmulq_f32(vmaxq_f32(vmaxq_f32(p.val[0], p.val[1]), p.val[2]), vscale);
+				vst1q_f32(out + x, w);
+				acc = vaddq_f32(acc, w);
+			}
+			sum += double(vgetq_lane_f32(acc, 0)) + double(vgetq_lane_f32(acc, 1)) + double(vgetq_lane_f32(acc, 2)) +
+			       double(vgetq_lane_f32(acc, 3));
+		}
+#endif
+
+		for (; x < width; ++x)
+		{
+			const float* p = rgba + x * 4;
+			out[x]         = max(max(p[0], p[1]), p[2]) * scale;
+			sum += out[x];
+		}
+
+		return sum;
+	}
+
+	// Replaces the alpha channel of each texel in a row with max(r, g, b) * scale.
+	void writeRowPdf(float* rgba, u32 width, float scale)
+	{
+		u32 x = 0;
+
+#if ENVMAP_SSE
+		const __m128 vscale = _mm_set1_ps(scale);
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128 p0 = _mm_loadu_ps(rgba + x * 4);
+			__m128 p1 = _mm_loadu_ps(rgba + x * 4 + 4);
+			__m128 p2 = _mm_loadu_ps(rgba + x * 4 + 8);
+			__m128 p3 = _mm_loadu_ps(rgba + x * 4 + 12);
+			_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+			p3 = _mm_mul_ps(_mm_max_ps(_mm_max_ps(p0, p1), p2), vscale);
+			_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+			_mm_storeu_ps(rgba + x * 4, p0);
+			_mm_storeu_ps(rgba + x * 4 + 4, p1);
+			_mm_storeu_ps(rgba + x * 4 + 8, p2);
+			_mm_storeu_ps(rgba + x * 4 + 12, p3);
+		}
+#elif ENVMAP_NEON
+		const float32x4_t vscale = vdupq_n_f32(scale);
+		for (; x + 4 <= width; x += 4)
+		{
+			float32x4x4_t p = vld4q_f32(rgba + x * 4);
+			p.val[3]        = vmulq_f32(vmaxq_f32(vmaxq_f32(p.val[0], p.val[1]), p.val[2]), vscale);
+			vst4q_f32(rgba + x * 4, p);
+		}
+#endif
+
+		for (; x < width; ++x)
+		{
+			float* p = rgba + x * 4;
+			p[3]     = max(max(p[0], p[1]), p[2]) * scale;
+		}
+	}
+
+	void fillUniformAliasTable(u32 count, AliasTableCell* cells)
+	{
+		JobSystem::getDefault().parallelFor(count, 1 << 16, [=](u32 begin, u32 end)
+		{
+			for (u32 i = begin; i < end; ++i)
+			{
+				cells[i] = {1.0f, i};
+			}
+		});
+	}
+
+	struct AliasChunk
+	{
+		u32    lightCount  = 0;
+		u32    lightOffset = 0;
+		u32    heavyOffset = 0;
+		double deficitBase = 0; // sum of (1 - p) over lights in earlier chunks
+		double excessBase  = 0; // sum of (p - 1) over heavies in earlier chunks
+	};
+
+	struct AliasBuilder
+	{
+		const float*    weights;
+		u32             count;
+		double          scale; // weight to p, where p averages 1
+		AliasTableCell* cells;
+
+		std::vector<AliasChunk> chunks;
+		std::vector<u32>        lights;       // texels with p < 1, in texel order
+		std::vector<u32>        heavies;      // texels with p >= 1, in texel order
+		std::vector<float>      lightPrefix;  // exclusive sum of (1 - p) within the light's chunk
+		std::vector<float>      heavyPrefix;  // inclusive sum of (p - 1) within the heavy's chunk
+		double                  totalDeficit = 0;
+
+		double getP(u32 i) const { return double(weights[i]) * scale; }
+
+		// Deficit of all lights before light a. The sweep pairs light a with the current heavy b
+		// while light(a) < heavy(b); the heavy's remaining weight is 1 + heavy(b) - light(a).
+		double light(u32 a) const
+		{
+			return a < lights.size() ? chunks[lights[a] / ChunkSize].deficitBase + lightPrefix[a] : totalDeficit;
+		}
+
+		// Excess of all heavies up to and including heavy b
+		double heavy(u32 b) const { return chunks[heavies[b] / ChunkSize].excessBase + heavyPrefix[b]; }
+
+		// Number of lights among the first k events of the sweep (merge path search)
+		u32 findSplit(u32 k) const
+		{
+			const u32 heavyEvents = u32(heavies.size()) - 1;
+
+			u32 lo = k > heavyEvents ? k - heavyEvents : 0;
+			u32 hi = min(k, u32(lights.size()));
+			while (lo < hi)
+			{
+				const u32 mid = (lo + hi) / 2;
+				if (light(mid) < heavy(k - mid - 1))
+				{
+					lo = mid + 1;
+				}
+				else
+				{
+					hi = mid;
+				}
+			}
+			return lo;
+		}
+
+		// Runs sweep events [k0, k1). Each light event fills a light from the current heavy;
+		// each heavy event retires a heavy whose remaining weight dropped to 1 or less,
+		// filling it from the next heavy.
+		void sweep(u32 k0, u32 k1) const
+		{
+			const u32 lightCount = u32(lights.size());
+			const u32 lastHeavy  = u32(heavies.size()) - 1;
+
+			u32 a = findSplit(k0);
+			u32 b = k0 - a;
+			for (u32 k = k0; k < k1; ++k)
+			{
+				if (a < lightCount && (b == lastHeavy || light(a) < heavy(b)))
+				{
+					const u32 i = lights[a++];
+					cells[i]    = {float(getP(i)), heavies[b]};
+				}
+				else
+				{
+					const double remaining = 1.0 + heavy(b) - light(a);
+					cells[heavies[b]]      = {float(clamp(remaining, 0.0, 1.0)), heavies[b + 1]};
+					++b;
+				}
+			}
+		}
+	};
+}
+
+double getLatLongTexelSolidAngle(u32 y, u32 width, u32 height)
+{
+	const double pi   = 3.14159265358979323846;
+	const double phi0 = pi * (double(y) / double(height) - 0.5);
+	const double phi1 = pi * (double(y + 1) / double(height) - 0.5);
+	return (2.0 * pi / double(width)) * fabs(sin(phi1) - sin(phi0));
+}
+
+void buildAliasTable(const float* weights, u32 count, AliasTableCell* cells)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	AliasBuilder builder;
+	builder.weights = weights;
+	builder.count   = count;
+	builder.cells   = cells;
+	builder.chunks.resize(divUp(count, ChunkSize));
+
+	JobSystem& jobs = JobSystem::getDefault();
+
+	const u32 chunkCount = u32(builder.chunks.size());
+	const u32 chunkGrain = 64;
+
+	// The table is normalized by the exact sum of the weights it is given. Any mismatch between
+	// the sum of p and count would otherwise all be pushed onto the last heavy entry.
+	std::vector<double> chunkWeightSums(chunkCount);
+	jobs.parallelFor(chunkCount, chunkGrain, [&](u32 begin, u32 end)
+	{
+		for (u32 c = begin; c < end; ++c)
+		{
+			double sum = 0;
+			for (u32 i = c * ChunkSize; i < min(count, (c + 1) * ChunkSize); ++i)
+			{
+				sum += weights[i];
+			}
+			chunkWeightSums[c] = sum;
+		}
+	});
+
+	double weightSum = 0;
+	for (double chunkWeightSum : chunkWeightSums)
+	{
+		weightSum += chunkWeightSum;
+	}
+
+	if (!(weightSum > 0))
+	{
+		fillUniformAliasTable(count, cells);
+		return;
+	}
+
+	builder.scale = double(count) / weightSum;
+
+	// Classify texels and total each chunk's deficit and excess
+	jobs.parallelFor(chunkCount, chunkGrain, [&](u32 begin, u32 end)
+	{
+		for (u32 c = begin; c < end; ++c)
+		{
+			AliasChunk& chunk   = builder.chunks[c];
+			double      deficit = 0;
+			double      excess  = 0;
+			for (u32 i = c * ChunkSize; i < min(count, (c + 1) * ChunkSize); ++i)
+			{
+				const double p = builder.getP(i);
+				if (p < 1.0)
+				{
+					chunk.lightCount++;
+					deficit += 1.0 - p;
+				}
+				else
+				{
+					excess += p - 1.0;
+				}
+			}
+			chunk.deficitBase = deficit;
+			chunk.excessBase  = excess;
+		}
+	});
+
+	// Exclusive scan over chunks in double
+	u32    lightCount = 0;
+	u32    heavyCount = 0;
+	double deficitSum = 0;
+	double excessSum  = 0;
+	for (u32 c = 0; c < chunkCount; ++c)
+	{
+		AliasChunk& chunk = builder.chunks[c];
+		const u32   texelCount = min(count, (c + 1) * ChunkSize) - c * ChunkSize;
+
+		const double deficit = chunk.deficitBase;
+		const double excess  = chunk.excessBase;
+
+		chunk.lightOffset = lightCount;
+		chunk.heavyOffset = heavyCount;
+		chunk.deficitBase = deficitSum;
+		chunk.excessBase  = excessSum;
+
+		lightCount += chunk.lightCount;
+		heavyCount += texelCount - chunk.lightCount;
+		deficitSum += deficit;
+		excessSum += excess;
+	}
+	builder.totalDeficit = deficitSum;
+
+	if (heavyCount == 0)
+	{
+		// Only possible through rounding when all weights are equal
+		fillUniformAliasTable(count, cells);
+		return;
+	}
+
+	builder.lights.resize(lightCount);
+	builder.lightPrefix.resize(lightCount);
+	builder.heavies.resize(heavyCount);
+	builder.heavyPrefix.resize(heavyCount);
+
+	// Scatter texels into the light and heavy lists along with their in-chunk prefix sums
+	jobs.parallelFor(chunkCount, chunkGrain, [&](u32 begin, u32 end)
+	{
+		for (u32 c = begin; c < end; ++c)
+		{
+			const AliasChunk& chunk   = builder.chunks[c];
+			u32               light   = chunk.lightOffset;
+			u32               heavy   = chunk.heavyOffset;
+			double            deficit = 0;
+			double            excess  = 0;
+			for (u32 i = c * ChunkSize; i < min(count, (c + 1) * ChunkSize); ++i)
+			{
+				const double p = builder.getP(i);
+				if (p < 1.0)
+				{
+					builder.lights[light]      = i;
+					builder.lightPrefix[light] = float(deficit);
+					deficit += 1.0 - p;
+					++light;
+				}
+				else
+				{
+					excess += p - 1.0;
+					builder.heavies[heavy]     = i;
+					builder.heavyPrefix[heavy] = float(excess);
+					++heavy;
+				}
+			}
+		}
+	});
+
+	// Every light and every heavy but the last is retired by exactly one sweep event
+	const u32 eventCount = lightCount + heavyCount - 1;
+	const u32 eventGrain = max<u32>(1 << 16, divUp(eventCount, jobs.getWorkerCount() * 4));
+	jobs.parallelFor(eventCount, eventGrain, [&](u32 begin, u32 end) { builder.sweep(begin, end); });
+
+	const u32 lastHeavy = builder.heavies.back();
+	cells[lastHeavy]    = {1.0f, lastHeavy};
+}
+
+double buildEnvmapDistribution(float* rgba, u32 width, u32 height, std::vector<AliasTableCell>& cells)
+{
+	const u32 texelCount = width * height;
+
+	std::vector<float>  weights(texelCount);
+	std::vector<double> rowSums(height);
+
+	JobSystem& jobs = JobSystem::getDefault();
+
+	// Weight = intensity * solid angle; the solid angle is constant along a row
+	jobs.parallelFor(height, 4, [&](u32 begin, u32 end)
+	{
+		for (u32 y = begin; y < end; ++y)
+		{
+			const float area = float(getLatLongTexelSolidAngle(y, width, height));
+			rowSums[y] = computeRowWeights(rgba + size_t(y) * width * 4, width, area, weights.data() + size_t(y) * width);
+		}
+	});
+
+	double weightSum = 0;
+	for (double rowSum : rowSums)
+	{
+		weightSum += rowSum;
+	}
+
+	// pdf = (weight / weightSum) / area, and the area cancels out
+	const float pdfScale = weightSum > 0 ? float(1.0 / weightSum) : 0.0f;
+	jobs.parallelFor(height, 4, [&](u32 begin, u32 end)
+	{
+		for (u32 y = begin; y < end; ++y)
+		{
+			writeRowPdf(rgba + size_t(y) * width * 4, width, pdfScale);
+		}
+	});
+
+	cells.resize(texelCount);
+	buildAliasTable(weights.data(), texelCount, cells.data());
+
+	return weightSum;
+}
+
+}
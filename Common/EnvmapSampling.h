@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Rush/Rush.h>
+
+#include <stddef.h>
+#include <vector>
+
+namespace Rush
+{
+
+// One entry of a Vose alias table, laid out to match EnvmapCell in the path tracer shaders:
+// an entry picked uniformly returns its own index with probability p, otherwise alias.
+struct AliasTableCell
+{
+	float p;
+	u32   alias;
+};
+
+// Solid angle covered by each texel of row y in a width x height lat-long map.
+double getLatLongTexelSolidAngle(u32 y, u32 width, u32 height);
+
+// Builds an alias table over non-negative weights. Weights are classified in parallel and
+// the table is filled by a parallel sweep: the sequential Vose pairing is a merge of two
+// prefix sums, so it can be split anywhere. Prefix sums are accumulated in double and stored
+// as float offsets within 1K-entry chunks, which keeps them stable for hundreds of millions
+// of entries at 4 bytes each. All-zero weights give a uniform table.
+void buildAliasTable(const float* weights, u32 count, AliasTableCell* cells);
+
+// Importance-sampling data for an RGBA32F lat-long environment map. Texels are weighted by
+// max(r, g, b) times their solid angle; the solid-angle PDF of sampling each texel is written
+// to its alpha channel and cells receives the alias table (width * height entries).
+// Rows are processed with SIMD on the default JobSystem. Returns the weight total.
+double buildEnvmapDistribution(float* rgba, u32 width, u32 height, std::vector<AliasTableCell>& cells);
+
+}
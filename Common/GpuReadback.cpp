@@ -0,0 +1,55 @@
+#include "GpuReadback.h"
+
+#include <vector>
+
+namespace Rush
+{
+
+void GpuReadbackRing::create(u32 stride, u32 count, const char* debugName)
+{
+	GfxBufferDesc desc;
+	desc.flags       = GfxBufferFlags::Storage;
+	desc.hostVisible = true;
+	desc.stride      = stride;
+	desc.count       = count;
+	desc.debugName   = debugName;
+
+	const std::vector<u8> zeros(size_t(stride) * count);
+	for (GfxOwn<GfxBuffer>& buffer : m_buffers)
+	{
+		buffer = Gfx_CreateBuffer(desc, zeros.data());
+	}
+
+	m_schedule.reset();
+}
+
+void GpuReadbackRing::Schedule::reset()
+{
+	*this = Schedule();
+}
+
+bool GpuReadbackRing::Schedule::advance(u64& outUserData)
+{
+	m_current = (m_current + 1) % SlotCount;
+	if (!m_requested[m_current])
+	{
+		return false;
+	}
+
+	m_requested[m_current] = false;
+	m_pendingCount--;
+	outUserData = m_userData[m_current];
+	return true;
+}
+
+void GpuReadbackRing::Schedule::request(u64 userData)
+{
+	if (!m_requested[m_current])
+	{
+		m_requested[m_current] = true;
+		m_pendingCount++;
+	}
+	m_userData[m_current] = userData;
+}
+
+}
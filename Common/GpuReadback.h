@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Rush/GfxDevice.h>
+#include <Rush/Rush.h>
+
+namespace Rush
+{
+
+// Ring of host-visible storage buffers for reading small GPU results back without stalling. Shaders
+// write to the buffer of the current frame, and a requested result is read when its slot comes round
+// again, SlotCount frames later, instead of draining the pipeline with Gfx_Finish(). One ring serves
+// one kind of feedback, such as focus picks, stats counters or average luminance.
+class GpuReadbackRing
+{
+	RUSH_DISALLOW_COPY_AND_ASSIGN(GpuReadbackRing);
+
+public:
+	// Frames the backends record ahead of the GPU; Gfx_EndFrame() blocks on the oldest one beyond
+	// this. librush does not report it, so a backend that queues deeper must raise this value.
+	static constexpr u32 MaxFramesInFlight = 3;
+
+	// One slot per frame in flight plus the one being recorded, so that the frame which wrote a
+	// slot has completed by the time the slot is read
+	static constexpr u32 SlotCount = MaxFramesInFlight + 1;
+
+	// Slot bookkeeping without the buffers, so that the delay and wrap-around can be tested
+	// without a GPU
+	class Schedule
+	{
+	public:
+		void reset();
+
+		// Moves to the next slot. Returns true, with the userData of its request, if a result was
+		// requested there SlotCount frames ago.
+		bool advance(u64& outUserData);
+
+		void request(u64 userData);
+
+		u32 getCurrentSlot() const { return m_current; }
+		u32 getPendingCount() const { return m_pendingCount; }
+
+	private:
+		u64  m_userData[SlotCount]  = {};
+		bool m_requested[SlotCount] = {};
+		u32  m_current              = 0;
+		u32  m_pendingCount         = 0;
+	};
+
+	GpuReadbackRing() = default;
+
+	// Buffers start out zeroed
+	void create(u32 stride, u32 count, const char* debugName);
+	bool valid() const { return m_buffers[0].valid(); }
+
+	// Call once at the start of every frame, before recording work that writes getBuffer(). Moves to
+	// the next slot and, if a result was requested there, passes it to fn(void* data, size_t size,
+	// u64 userData) first. fn may also write the data, for example to reset counters that shaders
+	// accumulate into, before the slot is used again.
+	template <typename Fn> void beginFrame(Fn&& fn)
+	{
+		u64 userData = 0;
+		if (!m_schedule.advance(userData))
+		{
+			return;
+		}
+
+		GfxMappedBuffer mapped = Gfx_MapBuffer(m_buffers[m_schedule.getCurrentSlot()]);
+		if (mapped.data)
+		{
+			fn(static_cast<void*>(mapped.data), size_t(mapped.size), userData);
+		}
+		Gfx_UnmapBuffer(mapped);
+	}
+
+	// Buffer for shaders to write during this frame
+	GfxBuffer getBuffer() const { return m_buffers[m_schedule.getCurrentSlot()].get(); }
+
+	// Reads this frame's buffer back SlotCount frames from now; userData is passed back with it
+	void request(u64 userData = 0) { m_schedule.request(userData); }
+
+	// Requests that have not been passed back yet
+	u32 getPendingCount() const { return m_schedule.getPendingCount(); }
+
+private:
+	GfxOwn<GfxBuffer> m_buffers[SlotCount];
+	Schedule          m_schedule;
+};
+
+}
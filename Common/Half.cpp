@@ -0,0 +1,63 @@
+#include "Half.h"
+
+#include <string.h>
+
+namespace Rush
+{
+
+u16 floatToHalf(float value)
+{
+	u32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const u32 sign = (bits >> 16) & 0x8000;
+	bits &= 0x7FFFFFFF;
+
+	if (bits >= 0x47800000) // at least 65536, infinity or NaN
+	{
+		return u16(sign | (bits > 0x7F800000 ? 0x7E00 : 0x7C00));
+	}
+
+	if (bits < 0x38800000) // result is a half subnormal or zero; let the FPU round it
+	{
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		f += 0.5f;
+		memcpy(&bits, &f, sizeof(bits));
+		return u16(sign | (bits - 0x3F000000));
+	}
+
+	// Rebias the exponent from 127 to 15 and round the dropped 13 mantissa bits to even
+	const u32 odd = (bits >> 13) & 1;
+	bits += 0xC8000FFF + odd;
+	return u16(sign | (bits >> 13));
+}
+
+float halfToFloat(u16 value)
+{
+	const u32 sign     = u32(value & 0x8000) << 16;
+	const u32 exponent = (value >> 10) & 0x1F;
+	const u32 mantissa = value & 0x3FF;
+
+	u32 bits;
+	if (exponent == 0x1F) // infinity or NaN
+	{
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if (exponent == 0) // zero or subnormal, exactly mantissa * 2^-24
+	{
+		float f = float(mantissa) * (1.0f / 16777216.0f);
+		memcpy(&bits, &f, sizeof(bits));
+		bits |= sign;
+	}
+	else
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+}
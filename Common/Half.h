@@ -0,0 +1,14 @@
+#pragma once
+
+#include <Rush/Rush.h>
+
+namespace Rush
+{
+
+// Round-to-nearest-even float to half conversion; NaN stays NaN and overflow becomes infinity.
+u16 floatToHalf(float value);
+
+// Exact half to float conversion, including subnormals, infinity and NaN.
+float halfToFloat(u16 value);
+
+}
@@ -0,0 +1,218 @@
+#include "JobSystem.h"
+
+#include <Rush/UtilLog.h>
+
+namespace Rush
+{
+
+namespace
+{
+	// Identifies the pool and queue owned by the current thread, if it is a worker.
+	thread_local const JobSystem* t_workerOwner = nullptr;
+	thread_local u32              t_workerIndex = 0;
+}
+
+JobSystem::JobSystem(u32 threadCount)
+{
+	if (threadCount == 0)
+	{
+		const u32 hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	m_queues.reserve(threadCount);
+	for (u32 i = 0; i < threadCount; ++i)
+	{
+		m_queues.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	m_workers.reserve(threadCount);
+	for (u32 i = 0; i < threadCount; ++i)
+	{
+		m_workers.push_back(std::thread([this, i]() { workerFunction(i); }));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_exit = true;
+	}
+	m_workAvailable.notify_all();
+
+	for (auto& it : m_workers)
+	{
+		it.join();
+	}
+}
+
+JobSystem& JobSystem::getDefault()
+{
+	static JobSystem instance;
+	return instance;
+}
+
+u32 JobSystem::currentQueueIndex()
+{
+	if (t_workerOwner == this)
+	{
+		return t_workerIndex;
+	}
+
+	// External threads spread their jobs across worker queues
+	return m_submitCursor.fetch_add(1, std::memory_order_relaxed) % u32(m_queues.size());
+}
+
+void JobSystem::submit(Job job, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	WorkerQueue& queue = *m_queues[currentQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(Task{std::move(job), counter});
+	}
+
+	{
+		// Counted under the sleep mutex so a worker can't miss the wakeup between its check and wait
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queuedCount.fetch_add(1, std::memory_order_release);
+	}
+	m_workAvailable.notify_one();
+}
+
+bool JobSystem::popTask(u32 queueIndex, Task& out)
+{
+	WorkerQueue& queue = *m_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty())
+	{
+		return false;
+	}
+
+	out = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	m_queuedCount.fetch_sub(1, std::memory_order_acq_rel);
+	return true;
+}
+
+bool JobSystem::stealTask(u32 thiefIndex, Task& out)
+{
+	const u32 queueCount = u32(m_queues.size());
+	for (u32 i = 1; i < queueCount; ++i)
+	{
+		WorkerQueue& queue = *m_queues[(thiefIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			out = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			m_queuedCount.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::runTask(Task& task)
+{
+	task.fn();
+
+	if (task.counter && task.counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_workDone.notify_all();
+	}
+}
+
+bool JobSystem::tryRunTask(u32 queueIndex)
+{
+	if (m_queuedCount.load(std::memory_order_acquire) == 0)
+	{
+		return false;
+	}
+
+	Task task;
+	if (popTask(queueIndex, task) || stealTask(queueIndex, task))
+	{
+		runTask(task);
+		return true;
+	}
+
+	return false;
+}
+
+void JobSystem::workerFunction(u32 workerIndex)
+{
+	t_workerOwner = this;
+	t_workerIndex = workerIndex;
+
+	for (;;)
+	{
+		if (tryRunTask(workerIndex))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_workAvailable.wait(lock, [this]() { return m_exit || m_queuedCount.load(std::memory_order_acquire) != 0; });
+		if (m_exit && m_queuedCount.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+	}
+}
+
+bool JobSystem::tryRunJob()
+{
+	return tryRunTask(t_workerOwner == this ? t_workerIndex : 0);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	const u32 queueIndex = t_workerOwner == this ? t_workerIndex : 0;
+
+	while (!counter.done())
+	{
+		if (tryRunTask(queueIndex))
+		{
+			continue;
+		}
+
+		// Nothing left to help with: the remaining jobs are already running on workers
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_workDone.wait(lock, [&counter]() { return counter.done(); });
+	}
+}
+
+void JobSystem::parallelFor(u32 count, u32 grainSize, const std::function<void(u32 begin, u32 end)>& fn)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	grainSize = max<u32>(1, grainSize);
+
+	if (count <= grainSize)
+	{
+		fn(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (u32 begin = 0; begin < count; begin += grainSize)
+	{
+		const u32 end = min(begin + grainSize, count);
+		submit([&fn, begin, end]() { fn(begin, end); }, &counter);
+	}
+
+	wait(counter);
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Rush/Rush.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Rush
+{
+
+// Tracks completion of a group of jobs. Every submit() that references a counter
+// increments it; the counter drops back to zero once all jobs in the group have run.
+struct JobCounter
+{
+	std::atomic<u32> pending = 0;
+
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Pool of persistent worker threads. Each worker owns a deque: it pops its own
+// jobs LIFO and steals FIFO from the other workers when it runs dry. Idle workers
+// sleep on a condition variable and are woken by submit(), so there is no polling.
+class JobSystem
+{
+	RUSH_DISALLOW_COPY_AND_ASSIGN(JobSystem);
+
+public:
+	using Job = std::function<void()>;
+
+	// threadCount = 0 creates one worker per hardware thread, minus one for the caller.
+	explicit JobSystem(u32 threadCount = 0);
+	~JobSystem();
+
+	void submit(Job job, JobCounter* counter = nullptr);
+
+	// Blocks until counter reaches zero. The calling thread runs queued jobs while it waits.
+	void wait(JobCounter& counter);
+
+	// Runs one queued job on the calling thread, if there is one, and returns whether it did. Lets
+	// a thread that consumes results as jobs finish help with the work between results.
+	bool tryRunJob();
+
+	// Splits [0, count) into chunks of at most grainSize and runs fn(begin, end) on
+	// the pool. Returns once every chunk has completed.
+	void parallelFor(u32 count, u32 grainSize, const std::function<void(u32 begin, u32 end)>& fn);
+
+	u32 getWorkerCount() const { return u32(m_workers.size()); }
+
+	// Process-wide pool shared by the examples, created on first use.
+	static JobSystem& getDefault();
+
+private:
+	struct Task
+	{
+		Job         fn;
+		JobCounter* counter = nullptr;
+	};
+
+	struct WorkerQueue
+	{
+		std::mutex       mutex;
+		std::deque<Task> tasks;
+	};
+
+	void workerFunction(u32 workerIndex);
+	bool tryRunTask(u32 queueIndex);
+	bool popTask(u32 queueIndex, Task& out);
+	bool stealTask(u32 thiefIndex, Task& out);
+	void runTask(Task& task);
+	u32  currentQueueIndex();
+
+	std::vector<std::thread>                  m_workers;
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+	std::atomic<u32> m_queuedCount  = 0;
+	std::atomic<u32> m_submitCursor = 0;
+
+	std::mutex              m_sleepMutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_workDone;
+	bool                    m_exit = false;
+};
+
+}
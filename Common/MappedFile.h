@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Rush/Rush.h>
+
+#include <stddef.h>
+
+namespace Rush
+{
+
+// Read-only memory mapping of a whole file. Pages are faulted in on first access, so
+// large cached assets can be handed to the GPU upload path without an extra copy.
+class MappedFile
+{
+	RUSH_DISALLOW_COPY_AND_ASSIGN(MappedFile);
+
+public:
+	MappedFile() = default;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	bool open(const char* filename);
+	void close();
+
+	bool      valid() const { return m_data != nullptr; }
+	const u8* data() const { return m_data; }
+	size_t    size() const { return m_size; }
+
+private:
+	const u8* m_data = nullptr;
+	size_t    m_size = 0;
+#if defined(_WIN32)
+	void* m_file    = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
+
+}
@@ -0,0 +1,644 @@
+#include "MeshCompression.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <math.h>
+#include <string.h>
+
+namespace Rush
+{
+
+namespace
+{
+	// Chunks are the unit of parallel decode; large enough to amortize the frequency tables
+	constexpr u32 VertexChunkSize = 16384;
+	constexpr u32 IndexChunkSize  = 3 * 16384;
+
+	constexpr u32 ProbabilityBits  = 12;
+	constexpr u32 ProbabilityScale = 1u << ProbabilityBits;
+	constexpr u32 RansLowerBound   = 1u << 16;
+
+	enum EntropyMode : u8
+	{
+		EntropyMode_Raw,
+		EntropyMode_Constant,
+		EntropyMode_Rans,
+	};
+
+	struct ChunkedStreamHeader
+	{
+		u32 chunkCount;
+		u32 chunkElements;
+		u64 elementCount;
+	};
+
+	inline void write32(std::vector<u8>& out, u32 value)
+	{
+		const size_t offset = out.size();
+		out.resize(offset + sizeof(value));
+		memcpy(out.data() + offset, &value, sizeof(value));
+	}
+
+	inline u32 read32(const u8* p)
+	{
+		u32 result;
+		memcpy(&result, p, sizeof(result));
+		return result;
+	}
+
+	inline u16 zigzag16(u16 delta) { return u16((delta << 1) ^ u16(s16(delta) >> 15)); }
+	inline u16 unzigzag16(u16 value) { return u16((value >> 1) ^ u16(-(value & 1))); }
+	inline u32 zigzag32(u32 delta) { return (delta << 1) ^ u32(s32(delta) >> 31); }
+	inline u32 unzigzag32(u32 value) { return (value >> 1) ^ u32(-s32(value & 1)); }
+
+	inline float signNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+	// Scales symbol counts to frequencies summing to ProbabilityScale, keeping every present symbol
+	void normalizeFrequencies(const u32 counts[256], size_t total, u32 freqs[256])
+	{
+		u32 sum = 0;
+		for (u32 s = 0; s < 256; ++s)
+		{
+			freqs[s] = counts[s] ? max(1u, u32(u64(counts[s]) * ProbabilityScale / total)) : 0;
+			sum += freqs[s];
+		}
+
+		while (sum != ProbabilityScale)
+		{
+			u32 largest = 0;
+			for (u32 s = 1; s < 256; ++s)
+			{
+				largest = freqs[s] > freqs[largest] ? s : largest;
+			}
+
+			if (sum < ProbabilityScale)
+			{
+				freqs[largest] += ProbabilityScale - sum;
+				sum = ProbabilityScale;
+			}
+			else
+			{
+				const u32 excess = min(sum - ProbabilityScale, freqs[largest] - 1);
+				freqs[largest] -= excess;
+				sum -= excess;
+			}
+		}
+	}
+
+	// Four interleaved states let consecutive symbols decode independently
+	constexpr u32 RansStateCount = 4;
+
+	bool encodeRans(const u8* data, size_t size, const u32 freqs[256], std::vector<u8>& payload)
+	{
+		u32 starts[256];
+		for (u32 s = 0, start = 0; s < 256; ++s)
+		{
+			starts[s] = start;
+			start += freqs[s];
+		}
+
+		// rANS encodes back to front; bytes are produced in reverse and flipped at the end
+		payload.clear();
+		payload.reserve(size / 2 + 16);
+
+		u32 states[RansStateCount];
+		for (u32& state : states)
+		{
+			state = RansLowerBound;
+		}
+
+		for (size_t i = size; i-- > 0;)
+		{
+			u32&      state    = states[i % RansStateCount];
+			const u32 freq     = freqs[data[i]];
+			if (u64(state) >= u64(freq) << (32 - ProbabilityBits))
+			{
+				payload.push_back(u8(state));
+				payload.push_back(u8(state >> 8));
+				state >>= 16;
+			}
+			state = ((state / freq) << ProbabilityBits) + (state % freq) + starts[data[i]];
+
+			if (payload.size() >= size)
+			{
+				return false;
+			}
+		}
+
+		for (u32 k = RansStateCount; k-- > 0;)
+		{
+			for (u32 i = 0; i < 4; ++i)
+			{
+				payload.push_back(u8(states[k] >> (i * 8)));
+			}
+		}
+
+		std::reverse(payload.begin(), payload.end());
+		return true;
+	}
+
+	bool decodeRans(const u8* payload, size_t payloadSize, const u32 freqs[256], u8* out, size_t outSize)
+	{
+		// Each slot packs the symbol with its frequency and offset within the symbol's range.
+		// Blocks with a single symbol use constant mode, so frequencies fit in 12 bits.
+		u32 slots[ProbabilityScale];
+		for (u32 s = 0, start = 0; s < 256; ++s)
+		{
+			if (freqs[s] >= ProbabilityScale)
+			{
+				return false;
+			}
+			for (u32 i = 0; i < freqs[s]; ++i)
+			{
+				slots[start + i] = (freqs[s] << 20) | (i << 8) | s;
+			}
+			start += freqs[s];
+		}
+
+		if (payloadSize < RansStateCount * 4)
+		{
+			return false;
+		}
+
+		const u8* p   = payload;
+		const u8* end = payload + payloadSize;
+
+		u32 states[RansStateCount];
+		for (u32& state : states)
+		{
+			state = (u32(p[0]) << 24) | (u32(p[1]) << 16) | (u32(p[2]) << 8) | u32(p[3]);
+			p += 4;
+		}
+
+		bool overrun = false;
+		auto decode  = [&](u32& state) -> u8
+		{
+			const u32 slot = slots[state & (ProbabilityScale - 1)];
+			state          = (slot >> 20) * (state >> ProbabilityBits) + ((slot >> 8) & 0xFFF);
+			if (state < RansLowerBound)
+			{
+				if (end - p < 2)
+				{
+					overrun = true;
+					return 0;
+				}
+				state = (state << 16) | (u32(p[0]) << 8) | u32(p[1]);
+				p += 2;
+			}
+			return u8(slot);
+		};
+
+		// Branch-free refill while there are enough payload bytes for every state to take one word
+		auto decodeFast = [&](u32& state) -> u8
+		{
+			const u32  slot   = slots[state & (ProbabilityScale - 1)];
+			state             = (slot >> 20) * (state >> ProbabilityBits) + ((slot >> 8) & 0xFFF);
+			const u32  word   = (u32(p[0]) << 8) | u32(p[1]);
+			const bool refill = state < RansLowerBound;
+			state             = refill ? (state << 16) | word : state;
+			p += refill ? 2 : 0;
+			return u8(slot);
+		};
+
+		u32    s0 = states[0], s1 = states[1], s2 = states[2], s3 = states[3];
+		size_t i  = 0;
+		for (; i + RansStateCount <= outSize && end - p >= 2 * RansStateCount; i += RansStateCount)
+		{
+			out[i + 0] = decodeFast(s0);
+			out[i + 1] = decodeFast(s1);
+			out[i + 2] = decodeFast(s2);
+			out[i + 3] = decodeFast(s3);
+		}
+
+		u32* tail[] = {&s0, &s1, &s2, &s3};
+		for (; i < outSize && !overrun; ++i)
+		{
+			out[i] = decode(*tail[i % RansStateCount]);
+		}
+		if (overrun)
+		{
+			return false;
+		}
+
+		states[0] = s0;
+		states[1] = s1;
+		states[2] = s2;
+		states[3] = s3;
+
+		// The encoder starts from the lower bound, so anything else means corrupt input
+		for (u32 state : states)
+		{
+			if (state != RansLowerBound)
+			{
+				return false;
+			}
+		}
+		return p == end;
+	}
+
+	// Encodes elementCount elements in chunks of chunkElements; each chunk is independent
+	void writeChunked(size_t elementCount, u32 chunkElements,
+	    const std::function<void(size_t begin, size_t end, std::vector<u8>& out)>& encodeChunk, std::vector<u8>& out)
+	{
+		const u32 chunkCount = u32(divUp<u64>(elementCount, chunkElements));
+
+		std::vector<std::vector<u8>> chunks(chunkCount);
+		JobSystem::getDefault().parallelFor(chunkCount, 1, [&](u32 begin, u32 end)
+		{
+			for (u32 i = begin; i < end; ++i)
+			{
+				const size_t first = size_t(i) * chunkElements;
+				encodeChunk(first, min<size_t>(first + chunkElements, elementCount), chunks[i]);
+			}
+		});
+
+		ChunkedStreamHeader header = {chunkCount, chunkElements, elementCount};
+
+		const size_t headerOffset = out.size();
+		out.resize(headerOffset + sizeof(header));
+		memcpy(out.data() + headerOffset, &header, sizeof(header));
+
+		for (const std::vector<u8>& chunk : chunks)
+		{
+			write32(out, u32(chunk.size()));
+		}
+		for (const std::vector<u8>& chunk : chunks)
+		{
+			out.insert(out.end(), chunk.begin(), chunk.end());
+		}
+	}
+
+	bool readChunked(const u8* data, size_t size, size_t elementCount,
+	    const std::function<bool(const u8* chunk, size_t chunkSize, size_t begin, size_t end)>& decodeChunk)
+	{
+		ChunkedStreamHeader header;
+		if (size < sizeof(header))
+		{
+			return false;
+		}
+		memcpy(&header, data, sizeof(header));
+
+		if (header.elementCount != elementCount || header.chunkElements == 0 ||
+		    header.chunkCount != divUp<u64>(elementCount, header.chunkElements) ||
+		    (size - sizeof(header)) / sizeof(u32) < header.chunkCount)
+		{
+			return false;
+		}
+
+		const u8* sizes = data + sizeof(header);
+
+		std::vector<size_t> offsets(header.chunkCount + 1);
+		offsets[0] = sizeof(header) + size_t(header.chunkCount) * sizeof(u32);
+		for (u32 i = 0; i < header.chunkCount; ++i)
+		{
+			offsets[i + 1] = offsets[i] + read32(sizes + i * sizeof(u32));
+		}
+		if (offsets.back() > size)
+		{
+			return false;
+		}
+
+		std::atomic<bool> failed = false;
+		JobSystem::getDefault().parallelFor(header.chunkCount, 1, [&](u32 begin, u32 end)
+		{
+			for (u32 i = begin; i < end && !failed.load(std::memory_order_relaxed); ++i)
+			{
+				const size_t first = size_t(i) * header.chunkElements;
+				const size_t last  = min<size_t>(first + header.chunkElements, elementCount);
+				if (!decodeChunk(data + offsets[i], offsets[i + 1] - offsets[i], first, last))
+				{
+					failed = true;
+				}
+			}
+		});
+
+		return !failed;
+	}
+}
+
+void encodeOctahedral16(const Vec3& v, u16 out[2])
+{
+	const float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+	if (!(l1 > 0.0f))
+	{
+		out[0] = out[1] = 0;
+		return;
+	}
+
+	float x = v.x / l1;
+	float y = v.y / l1;
+	if (v.z < 0.0f)
+	{
+		const float fx = (1.0f - fabsf(y)) * signNotZero(x);
+		const float fy = (1.0f - fabsf(x)) * signNotZero(y);
+		x              = fx;
+		y              = fy;
+	}
+
+	out[0] = quantizeSnorm16(x);
+	out[1] = quantizeSnorm16(y);
+}
+
+Vec3 decodeOctahedral16(const u16 in[2])
+{
+	float       x = dequantizeSnorm16(in[0]);
+	float       y = dequantizeSnorm16(in[1]);
+	const float z = 1.0f - fabsf(x) - fabsf(y);
+	if (z < 0.0f)
+	{
+		const float fx = (1.0f - fabsf(y)) * signNotZero(x);
+		const float fy = (1.0f - fabsf(x)) * signNotZero(y);
+		x              = fx;
+		y              = fy;
+	}
+
+	return normalize(Vec3(x, y, z));
+}
+
+u16 quantizeUnorm16(float v, float lo, float hi)
+{
+	if (!(hi > lo))
+	{
+		return 0;
+	}
+	return u16(lroundf(saturate((v - lo) / (hi - lo)) * 65535.0f));
+}
+
+float dequantizeUnorm16(u16 q, float lo, float hi) { return lo + (hi - lo) * (float(q) / 65535.0f); }
+
+u16 quantizeSnorm16(float v) { return u16(s16(lroundf(clamp(v, -1.0f, 1.0f) * 32767.0f))); }
+
+float dequantizeSnorm16(u16 q) { return max(float(s16(q)) / 32767.0f, -1.0f); }
+
+void encodeEntropyBlock(const u8* data, size_t size, std::vector<u8>& out)
+{
+	write32(out, u32(size));
+
+	u32 counts[256] = {};
+	for (size_t i = 0; i < size; ++i)
+	{
+		counts[data[i]]++;
+	}
+
+	if (size && counts[data[0]] == size)
+	{
+		out.push_back(EntropyMode_Constant);
+		out.push_back(data[0]);
+		return;
+	}
+
+	if (size)
+	{
+		u32 freqs[256];
+		normalizeFrequencies(counts, size, freqs);
+
+		// Presence bitmap followed by 16-bit frequencies of the present symbols
+		u8              present[32] = {};
+		std::vector<u8> table;
+		std::vector<u8> payload;
+		for (u32 s = 0; s < 256; ++s)
+		{
+			if (freqs[s])
+			{
+				present[s / 8] |= u8(1 << (s % 8));
+				table.push_back(u8(freqs[s]));
+				table.push_back(u8(freqs[s] >> 8));
+			}
+		}
+
+		if (encodeRans(data, size, freqs, payload) &&
+		    sizeof(present) + table.size() + sizeof(u32) + payload.size() < size)
+		{
+			out.push_back(EntropyMode_Rans);
+			out.insert(out.end(), present, present + sizeof(present));
+			out.insert(out.end(), table.begin(), table.end());
+			write32(out, u32(payload.size()));
+			out.insert(out.end(), payload.begin(), payload.end());
+			return;
+		}
+	}
+
+	out.push_back(EntropyMode_Raw);
+	if (size)
+	{
+		out.insert(out.end(), data, data + size);
+	}
+}
+
+size_t decodeEntropyBlock(const u8* data, size_t size, u8* out, size_t outSize)
+{
+	if (size < 5 || read32(data) != outSize)
+	{
+		return 0;
+	}
+
+	const u8* p   = data + 5;
+	const u8* end = data + size;
+
+	switch (data[4])
+	{
+	case EntropyMode_Raw:
+		if (size_t(end - p) < outSize)
+		{
+			return 0;
+		}
+		if (outSize)
+		{
+			memcpy(out, p, outSize);
+		}
+		return 5 + outSize;
+
+	case EntropyMode_Constant:
+		if (p == end)
+		{
+			return 0;
+		}
+		if (outSize)
+		{
+			memset(out, *p, outSize);
+		}
+		return 6;
+
+	case EntropyMode_Rans:
+	{
+		if (size_t(end - p) < 32)
+		{
+			return 0;
+		}
+
+		const u8* present = p;
+		p += 32;
+
+		u32 freqs[256] = {};
+		u32 sum        = 0;
+		for (u32 s = 0; s < 256; ++s)
+		{
+			if (present[s / 8] & (1 << (s % 8)))
+			{
+				if (end - p < 2)
+				{
+					return 0;
+				}
+				freqs[s] = u32(p[0]) | (u32(p[1]) << 8);
+				sum += freqs[s];
+				p += 2;
+			}
+		}
+
+		if (sum != ProbabilityScale || end - p < 4)
+		{
+			return 0;
+		}
+
+		const u32 payloadSize = read32(p);
+		p += 4;
+		if (size_t(end - p) < payloadSize || !decodeRans(p, payloadSize, freqs, out, outSize))
+		{
+			return 0;
+		}
+
+		return size_t(p + payloadSize - data);
+	}
+
+	default: return 0;
+	}
+}
+
+void compressIndices(const u32* indices, size_t count, std::vector<u8>& out)
+{
+	writeChunked(count, IndexChunkSize, [&](size_t begin, size_t end, std::vector<u8>& chunk)
+	{
+		std::vector<u8> bytes;
+		bytes.reserve((end - begin) * 2);
+
+		u32 previous = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			u32 value = zigzag32(indices[i] - previous);
+			previous  = indices[i];
+			while (value >= 0x80)
+			{
+				bytes.push_back(u8(value | 0x80));
+				value >>= 7;
+			}
+			bytes.push_back(u8(value));
+		}
+
+		write32(chunk, u32(bytes.size()));
+		encodeEntropyBlock(bytes.data(), bytes.size(), chunk);
+	}, out);
+}
+
+bool decompressIndices(const u8* data, size_t size, u32* out, size_t count)
+{
+	return readChunked(data, size, count, [&](const u8* chunk, size_t chunkSize, size_t begin, size_t end)
+	{
+		if (chunkSize < 4)
+		{
+			return false;
+		}
+
+		// Each index takes at most five bytes
+		const u32 byteCount = read32(chunk);
+		if (byteCount > (end - begin) * 5)
+		{
+			return false;
+		}
+
+		std::vector<u8> bytes(byteCount);
+		if (!decodeEntropyBlock(chunk + 4, chunkSize - 4, bytes.data(), bytes.size()))
+		{
+			return false;
+		}
+
+		const u8* p        = bytes.data();
+		const u8* pEnd     = p + bytes.size();
+		u32       previous = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			u32 value = 0;
+			for (u32 shift = 0;; shift += 7)
+			{
+				if (p == pEnd || shift > 28)
+				{
+					return false;
+				}
+				const u8 byte = *p++;
+				value |= u32(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+				{
+					break;
+				}
+			}
+			previous = previous + unzigzag32(value);
+			out[i]   = previous;
+		}
+
+		return p == pEnd;
+	});
+}
+
+void compressVertexComponents(const u16* components, size_t vertexCount, u32 componentCount, std::vector<u8>& out)
+{
+	writeChunked(vertexCount, VertexChunkSize, [&](size_t begin, size_t end, std::vector<u8>& chunk)
+	{
+		const size_t    count = end - begin;
+		std::vector<u8> lo(count), hi(count);
+		for (u32 c = 0; c < componentCount; ++c)
+		{
+			u16 previous = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				const u16 value = components[(begin + i) * componentCount + c];
+				const u16 coded = zigzag16(u16(value - previous));
+				previous        = value;
+				lo[i]           = u8(coded);
+				hi[i]           = u8(coded >> 8);
+			}
+			encodeEntropyBlock(lo.data(), count, chunk);
+			encodeEntropyBlock(hi.data(), count, chunk);
+		}
+	}, out);
+}
+
+bool decompressVertexComponents(const u8* data, size_t size, u16* out, size_t vertexCount, u32 componentCount)
+{
+	return readChunked(data, size, vertexCount, [&](const u8* chunk, size_t chunkSize, size_t begin, size_t end)
+	{
+		const size_t    count = end - begin;
+		std::vector<u8> lo(count), hi(count);
+
+		const u8* p    = chunk;
+		const u8* pEnd = chunk + chunkSize;
+		for (u32 c = 0; c < componentCount; ++c)
+		{
+			size_t consumed = decodeEntropyBlock(p, size_t(pEnd - p), lo.data(), count);
+			if (!consumed)
+			{
+				return false;
+			}
+			p += consumed;
+
+			consumed = decodeEntropyBlock(p, size_t(pEnd - p), hi.data(), count);
+			if (!consumed)
+			{
+				return false;
+			}
+			p += consumed;
+
+			u16  previous = 0;
+			u16* dst      = out + begin * componentCount + c;
+			for (size_t i = 0; i < count; ++i)
+			{
+				previous += unzigzag16(u16(lo[i] | (hi[i] << 8)));
+				dst[i * componentCount] = previous;
+			}
+		}
+
+		return p == pEnd;
+	});
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Half.h"
+
+#include <Rush/MathTypes.h>
+#include <Rush/Rush.h>
+
+#include <stddef.h>
+#include <vector>
+
+namespace Rush
+{
+
+// Maps a unit vector onto the octahedron and stores the two coordinates as 16-bit snorm values.
+// Zero-length vectors encode as +Z.
+void encodeOctahedral16(const Vec3& v, u16 out[2]);
+Vec3 decodeOctahedral16(const u16 in[2]);
+
+// Clamps v to [-1, 1] and stores it as a 16-bit snorm value, and back.
+u16   quantizeSnorm16(float v);
+float dequantizeSnorm16(u16 q);
+
+// Quantizes v within [lo, hi] to a 16-bit unorm value, and back.
+u16   quantizeUnorm16(float v, float lo, float hi);
+float dequantizeUnorm16(u16 q, float lo, float hi);
+
+// Order-0 rANS coder over bytes. A block records its own decoded size, and falls back to raw
+// storage when that is smaller or to a single byte when all input bytes are equal.
+// decodeEntropyBlock() returns the number of input bytes consumed, or 0 if the block is malformed
+// or does not decode to exactly outSize bytes.
+void   encodeEntropyBlock(const u8* data, size_t size, std::vector<u8>& out);
+size_t decodeEntropyBlock(const u8* data, size_t size, u8* out, size_t outSize);
+
+// Index buffers are stored as zigzag-coded deltas between consecutive indices, written as
+// variable-length integers and entropy coded in independent chunks.
+void compressIndices(const u32* indices, size_t count, std::vector<u8>& out);
+bool decompressIndices(const u8* data, size_t size, u32* out, size_t count);
+
+// Vertices are given as componentCount interleaved 16-bit quantized components per vertex. Each
+// component is delta coded against the previous vertex, split into low and high byte planes and
+// entropy coded, in independent chunks.
+void compressVertexComponents(const u16* components, size_t vertexCount, u32 componentCount, std::vector<u8>& out);
+bool decompressVertexComponents(const u8* data, size_t size, u16* out, size_t vertexCount, u32 componentCount);
+
+// Chunks are encoded and decoded in parallel on the default JobSystem.
+
+}
@@ -0,0 +1,1121 @@
+#include "MeshOptimizer.h"
+
+#include <Rush/MathTypes.h>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+namespace Rush
+{
+
+namespace
+{
+	constexpr u32 ForsythCacheSize    = 32;
+	constexpr u32 ForsythMaxValence   = 64;
+	constexpr float CacheDecayPower   = 1.5f;
+	constexpr float LastTriangleScore = 0.75f;
+	constexpr float ValenceBoostScale = 2.0f;
+	constexpr float ValenceBoostPower = 0.5f;
+
+	// FIFO size used to place cluster boundaries, matching typical hardware
+	constexpr u32 OverdrawCacheSize = 16;
+
+	// Maps the vertices referenced by an index range to dense ids, so that per-vertex state
+	// scales with the vertex range a segment uses rather than with the whole vertex buffer
+	u32 compactIndices(const u32* indices, size_t indexCount, std::vector<u32>& localIndices)
+	{
+		localIndices.resize(indexCount);
+		if (indexCount == 0)
+		{
+			return 0;
+		}
+
+		const auto [lowest, highest] = std::minmax_element(indices, indices + indexCount);
+
+		// Small ranges spread over a large vertex buffer, such as clusters, are cheaper to sort
+		if (size_t(*highest - *lowest) > indexCount * 16)
+		{
+			std::vector<u32> sorted(indices, indices + indexCount);
+			std::sort(sorted.begin(), sorted.end());
+			sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+			for (size_t i = 0; i < indexCount; ++i)
+			{
+				localIndices[i] = u32(std::lower_bound(sorted.begin(), sorted.end(), indices[i]) - sorted.begin());
+			}
+			return u32(sorted.size());
+		}
+
+		constexpr u32    Unassigned = ~0u;
+		std::vector<u32> remap(size_t(*highest - *lowest) + 1, Unassigned);
+
+		u32 count = 0;
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			u32& local = remap[indices[i] - *lowest];
+			if (local == Unassigned)
+			{
+				local = count++;
+			}
+			localIndices[i] = local;
+		}
+
+		return count;
+	}
+
+	struct ForsythScoreTables
+	{
+		float cache[ForsythCacheSize];
+		float valence[ForsythMaxValence + 1];
+
+		ForsythScoreTables()
+		{
+			for (u32 i = 0; i < ForsythCacheSize; ++i)
+			{
+				// The vertices of the last triangle get a fixed score so that the next triangle
+				// does not simply reuse the same edge
+				cache[i] = i < 3 ? LastTriangleScore
+				                 : powf(1.0f - float(i - 3) / float(ForsythCacheSize - 3), CacheDecayPower);
+			}
+			for (u32 i = 0; i <= ForsythMaxValence; ++i)
+			{
+				// Prefer vertices with few remaining triangles, to finish them off
+				valence[i] = i ? ValenceBoostScale * powf(float(i), -ValenceBoostPower) : 0.0f;
+			}
+		}
+
+		float score(s32 cachePosition, u32 liveTriangles) const
+		{
+			if (liveTriangles == 0)
+			{
+				return -1.0f;
+			}
+			const float cacheScore = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+			return cacheScore + valence[min(liveTriangles, ForsythMaxValence)];
+		}
+	};
+
+	// Counts transformed vertices per triangle for a FIFO cache, starting from an empty cache
+	struct FifoCache
+	{
+		std::vector<u32> timestamps;
+		u32              time = 0;
+		u32              size = 0;
+
+		FifoCache(u32 vertexCount, u32 cacheSize) : timestamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+		u32 process(u32 v)
+		{
+			if (time - timestamps[v] > size)
+			{
+				timestamps[v] = time++;
+				return 1;
+			}
+			return 0;
+		}
+
+		void flush() { time += size + 1; }
+	};
+
+	u32 hashVertex(const u8* vertex, size_t vertexSize)
+	{
+		u32 hash = 0x811c9dc5;
+		for (size_t i = 0; i < vertexSize; i += 4)
+		{
+			u32 word;
+			memcpy(&word, vertex + i, 4);
+			hash ^= word;
+			hash *= 0x5bd1e995;
+			hash ^= hash >> 15;
+		}
+		return hash;
+	}
+
+	struct Cluster
+	{
+		size_t firstTriangle;
+		size_t triangleCount;
+		float  sortKey;
+	};
+
+	// Triangles with fewer new vertices than this are accepted from the input order when a cluster
+	// runs out of neighbours, so that meshes without shared vertices still fill their clusters
+	constexpr u32 ClusterFillTriangles = MaxClusterTriangles / 2;
+
+	void computeClusterBounds(const u32* indices, size_t indexCount, const float* positions, size_t positionStride,
+	    MeshCluster& cluster)
+	{
+		auto getPosition = [&](u32 index)
+		{
+			const float* p = reinterpret_cast<const float*>(reinterpret_cast<const u8*>(positions) + index * positionStride);
+			return Vec3(p[0], p[1], p[2]);
+		};
+
+		Box3 box;
+		box.expandInit();
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			box.expand(getPosition(indices[i]));
+		}
+
+		cluster.center = box.center();
+		cluster.radius = 0.0f;
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			cluster.radius = max(cluster.radius, (getPosition(indices[i]) - cluster.center).length());
+		}
+
+		std::vector<Vec3> normals;
+		normals.reserve(indexCount / 3);
+		Vec3 axis(0.0f);
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			const Vec3 a = getPosition(indices[i + 0]);
+			const Vec3 n = cross(getPosition(indices[i + 1]) - a, getPosition(indices[i + 2]) - a);
+			const float length = n.length();
+			if (length > 0.0f)
+			{
+				normals.push_back(n / length);
+				axis += normals.back();
+			}
+		}
+
+		cluster.coneAxis   = Vec3(0.0f);
+		cluster.coneCutoff = 1.0f;
+		if (axis.length() == 0.0f)
+		{
+			return;
+		}
+
+		axis = normalize(axis);
+
+		float minDot = 1.0f;
+		for (const Vec3& n : normals)
+		{
+			minDot = min(minDot, dot(n, axis));
+		}
+
+		// Normals spread over a hemisphere or more leave no view direction that sees only back faces
+		cluster.coneAxis = axis;
+		if (minDot > 0.0f)
+		{
+			cluster.coneCutoff = sqrtf(1.0f - minDot * minDot);
+		}
+	}
+
+	// Area-weighted sum of squared distances to the planes of the triangles around a vertex
+	struct Quadric
+	{
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+		double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+		double a22 = 0.0, a23 = 0.0;
+		double a33    = 0.0;
+		double weight = 0.0;
+
+		void addPlane(double x, double y, double z, double w, double area)
+		{
+			a00 += area * x * x;
+			a01 += area * x * y;
+			a02 += area * x * z;
+			a03 += area * x * w;
+			a11 += area * y * y;
+			a12 += area * y * z;
+			a13 += area * y * w;
+			a22 += area * z * z;
+			a23 += area * z * w;
+			a33 += area * w * w;
+			weight += area;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00;
+			a01 += q.a01;
+			a02 += q.a02;
+			a03 += q.a03;
+			a11 += q.a11;
+			a12 += q.a12;
+			a13 += q.a13;
+			a22 += q.a22;
+			a23 += q.a23;
+			a33 += q.a33;
+			weight += q.weight;
+		}
+
+		// Mean squared distance of p to the planes
+		double evaluate(const Quadric& q, const Vec3& p) const
+		{
+			const double x = p.x, y = p.y, z = p.z;
+			const double sum = (a00 + q.a00) * x * x + 2.0 * (a01 + q.a01) * x * y + 2.0 * (a02 + q.a02) * x * z +
+			                   2.0 * (a03 + q.a03) * x + (a11 + q.a11) * y * y + 2.0 * (a12 + q.a12) * y * z +
+			                   2.0 * (a13 + q.a13) * y + (a22 + q.a22) * z * z + 2.0 * (a23 + q.a23) * z + (a33 + q.a33);
+			const double totalWeight = weight + q.weight;
+			return totalWeight > 0.0 ? max(sum, 0.0) / totalWeight : 0.0;
+		}
+	};
+
+	// Cosine of the largest rotation a collapse may cause to a remaining triangle, which also rejects
+	// nearly collinear slivers whose normals are mostly rounding error
+	constexpr float MinNormalCosine = 0.25f;
+
+	struct EdgeCollapse
+	{
+		u32    from; // welded positions
+		u32    to;
+		double cost;
+	};
+}
+
+VertexCacheStats analyzeVertexCache(const u32* indices, size_t indexCount, u32 cacheSize)
+{
+	VertexCacheStats result;
+	if (indexCount < 3)
+	{
+		return result;
+	}
+
+	std::vector<u32> localIndices;
+	const u32        vertexCount = compactIndices(indices, indexCount, localIndices);
+
+	FifoCache cache(vertexCount, cacheSize);
+
+	size_t misses = 0;
+	for (u32 v : localIndices)
+	{
+		misses += cache.process(v);
+	}
+
+	result.acmr = float(double(misses) / double(indexCount / 3));
+	result.atvr = float(double(misses) / double(vertexCount));
+	return result;
+}
+
+void optimizeVertexCache(u32* indices, size_t indexCount)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	static const ForsythScoreTables tables;
+
+	std::vector<u32> localIndices;
+	const u32        vertexCount = compactIndices(indices, triangleCount * 3, localIndices);
+
+	// Triangles adjacent to each vertex; the first liveTriangles[v] entries are not yet emitted
+	std::vector<u32> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		liveTriangles[localIndices[i]]++;
+	}
+
+	std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+	for (u32 v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	std::vector<u32> adjacency(triangleCount * 3);
+	{
+		std::vector<u32> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			adjacency[cursor[localIndices[i]]++] = u32(i / 3);
+		}
+	}
+
+	std::vector<float> vertexScore(vertexCount);
+	for (u32 v = 0; v < vertexCount; ++v)
+	{
+		vertexScore[v] = tables.score(-1, liveTriangles[v]);
+	}
+
+	// Start from the highest scoring triangle
+	size_t bestTriangle = 0;
+	float  bestScore    = -1.0f;
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const u32*  tri   = &localIndices[t * 3];
+		const float score = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+		if (score > bestScore)
+		{
+			bestScore    = score;
+			bestTriangle = t;
+		}
+	}
+
+	std::vector<u8> emitted(triangleCount, 0);
+
+	std::vector<u32> output(triangleCount * 3);
+
+	u32 cache[ForsythCacheSize + 3];
+	u32 cacheCount = 0;
+
+	size_t scanCursor = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		const u32* tri = &localIndices[bestTriangle * 3];
+		memcpy(&output[emittedCount * 3], &indices[bestTriangle * 3], sizeof(u32) * 3);
+		emitted[bestTriangle] = 1;
+
+		// Retire the triangle from its vertices' live lists
+		for (u32 k = 0; k < 3; ++k)
+		{
+			const u32 v     = tri[k];
+			u32*      list  = &adjacency[adjacencyOffsets[v]];
+			u32&      count = liveTriangles[v];
+			for (u32 i = 0; i < count; ++i)
+			{
+				if (list[i] == bestTriangle)
+				{
+					std::swap(list[i], list[count - 1]);
+					--count;
+					break;
+				}
+			}
+		}
+
+		// Move the triangle's vertices to the front of the LRU cache
+		u32 newCache[ForsythCacheSize + 3];
+		u32 newCount = 0;
+		for (u32 k = 0; k < 3; ++k)
+		{
+			newCache[newCount++] = tri[k];
+		}
+		for (u32 i = 0; i < cacheCount; ++i)
+		{
+			const u32 v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+			{
+				newCache[newCount++] = v;
+			}
+		}
+
+		for (u32 i = 0; i < newCount; ++i)
+		{
+			const u32 v    = newCache[i];
+			vertexScore[v] = tables.score(i < ForsythCacheSize ? s32(i) : -1, liveTriangles[v]);
+		}
+
+		// Rescore triangles around the touched vertices and pick the best one among them
+		bestScore    = -1.0f;
+		bestTriangle = triangleCount;
+		for (u32 i = 0; i < newCount; ++i)
+		{
+			const u32  v    = newCache[i];
+			const u32* list = &adjacency[adjacencyOffsets[v]];
+			for (u32 j = 0; j < liveTriangles[v]; ++j)
+			{
+				const u32   t     = list[j];
+				const u32*  other = &localIndices[size_t(t) * 3];
+				const float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+				if (score > bestScore)
+				{
+					bestScore    = score;
+					bestTriangle = t;
+				}
+			}
+		}
+
+		cacheCount = min(newCount, ForsythCacheSize);
+		memcpy(cache, newCache, cacheCount * sizeof(u32));
+
+		if (bestTriangle == triangleCount)
+		{
+			// Dead end: continue with the next triangle that has not been emitted
+			while (scanCursor < triangleCount && emitted[scanCursor])
+			{
+				++scanCursor;
+			}
+			bestTriangle = scanCursor;
+		}
+	}
+
+	memcpy(indices, output.data(), triangleCount * 3 * sizeof(u32));
+}
+
+void optimizeOverdraw(u32* indices, size_t indexCount, const float* positions, size_t positionStride, float threshold)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	std::vector<u32> localIndices;
+	const u32        vertexCount = compactIndices(indices, triangleCount * 3, localIndices);
+
+	auto getPosition = [&](u32 index)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const u8*>(positions) + index * positionStride);
+		return Vec3(p[0], p[1], p[2]);
+	};
+
+	// Hard boundaries: triangles where the cache has nothing in common with what came before
+	std::vector<size_t> hardBoundaries;
+	{
+		FifoCache cache(vertexCount, OverdrawCacheSize);
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			const u32* tri    = &localIndices[t * 3];
+			const u32  misses = cache.process(tri[0]) + cache.process(tri[1]) + cache.process(tri[2]);
+			if (t == 0 || misses == 3)
+			{
+				hardBoundaries.push_back(t);
+			}
+		}
+		hardBoundaries.push_back(triangleCount);
+	}
+
+	// Soft boundaries: within each hard cluster, split wherever the ACMR so far, simulated from
+	// a cold cache, is within threshold of the ACMR of the whole hard cluster
+	std::vector<Cluster> clusters;
+	{
+		FifoCache cache(vertexCount, OverdrawCacheSize);
+		for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h)
+		{
+			const size_t begin = hardBoundaries[h];
+			const size_t end   = hardBoundaries[h + 1];
+
+			cache.flush();
+			size_t clusterMisses = 0;
+			for (size_t t = begin; t < end; ++t)
+			{
+				const u32* tri = &localIndices[t * 3];
+				clusterMisses += cache.process(tri[0]) + cache.process(tri[1]) + cache.process(tri[2]);
+			}
+			const float target = float(clusterMisses) / float(end - begin) * threshold;
+
+			cache.flush();
+			size_t start  = begin;
+			size_t misses = 0;
+			for (size_t t = begin; t < end; ++t)
+			{
+				const u32* tri = &localIndices[t * 3];
+				misses += cache.process(tri[0]) + cache.process(tri[1]) + cache.process(tri[2]);
+
+				if (t + 1 < end && float(misses) / float(t + 1 - start) <= target)
+				{
+					clusters.push_back({start, t + 1 - start, 0.0f});
+					start  = t + 1;
+					misses = 0;
+					cache.flush();
+				}
+			}
+			clusters.push_back({start, end - start, 0.0f});
+		}
+	}
+
+	// Sort key: how far the cluster faces away from the mesh center
+	Vec3              meshCentroid(0.0f);
+	double            meshArea = 0.0;
+	std::vector<Vec3> clusterCentroids(clusters.size());
+	std::vector<Vec3> clusterNormals(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		Vec3  centroid(0.0f);
+		Vec3  normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; ++t)
+		{
+			const Vec3 a = getPosition(indices[t * 3 + 0]);
+			const Vec3 b = getPosition(indices[t * 3 + 1]);
+			const Vec3 d = getPosition(indices[t * 3 + 2]);
+
+			const Vec3  n            = cross(b - a, d - a);
+			const float triangleArea = n.length();
+
+			centroid += (a + b + d) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		clusterCentroids[c] = area > 0.0f ? centroid / area : getPosition(indices[clusters[c].firstTriangle * 3]);
+		clusterNormals[c]   = normal.length() > 0.0f ? normalize(normal) : Vec3(0.0f);
+	}
+
+	if (meshArea > 0.0)
+	{
+		meshCentroid = meshCentroid / float(meshArea);
+	}
+
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		clusters[c].sortKey = dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(),
+	    [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<u32> output;
+	output.reserve(triangleCount * 3);
+	for (const Cluster& cluster : clusters)
+	{
+		output.insert(output.end(), indices + cluster.firstTriangle * 3,
+		    indices + (cluster.firstTriangle + cluster.triangleCount) * 3);
+	}
+
+	memcpy(indices, output.data(), output.size() * sizeof(u32));
+}
+
+void optimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, u32* indices, size_t indexCount)
+{
+	constexpr u32 Unassigned = ~0u;
+
+	std::vector<u32> remap(vertexCount, Unassigned);
+
+	u32 next = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		RUSH_ASSERT(indices[i] < vertexCount);
+		u32& target = remap[indices[i]];
+		if (target == Unassigned)
+		{
+			target = next++;
+		}
+		indices[i] = target;
+	}
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		if (remap[v] == Unassigned)
+		{
+			remap[v] = next++;
+		}
+	}
+
+	u8*             bytes = static_cast<u8*>(vertices);
+	std::vector<u8> original(bytes, bytes + vertexCount * vertexSize);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		memcpy(bytes + size_t(remap[v]) * vertexSize, original.data() + v * vertexSize, vertexSize);
+	}
+}
+
+size_t weldVertices(void* vertices, size_t vertexCount, size_t vertexSize, u32* indices, size_t indexCount)
+{
+	RUSH_ASSERT(vertexSize % 4 == 0);
+
+	// Open addressing table of unique vertices, at most half full
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2)
+	{
+		tableSize *= 2;
+	}
+
+	constexpr u32    Empty = ~0u;
+	std::vector<u32> table(tableSize, Empty);
+	std::vector<u32> remap(vertexCount);
+
+	u8*    bytes       = static_cast<u8*>(vertices);
+	size_t uniqueCount = 0;
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		const u8* vertex = bytes + v * vertexSize;
+		for (size_t slot = hashVertex(vertex, vertexSize) & (tableSize - 1);; slot = (slot + 1) & (tableSize - 1))
+		{
+			const u32 entry = table[slot];
+			if (entry == Empty)
+			{
+				// Unique vertices are compacted in place, behind the one being read
+				if (uniqueCount != v)
+				{
+					memcpy(bytes + uniqueCount * vertexSize, vertex, vertexSize);
+				}
+				table[slot] = u32(uniqueCount);
+				remap[v]    = u32(uniqueCount++);
+				break;
+			}
+			if (memcmp(bytes + size_t(entry) * vertexSize, vertex, vertexSize) == 0)
+			{
+				remap[v] = entry;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		indices[i] = remap[indices[i]];
+	}
+
+	return uniqueCount;
+}
+
+void buildMeshClusters(u32* indices, size_t indexCount, const float* positions, size_t positionStride,
+    u32 indexOffset, std::vector<MeshCluster>& clusters)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	std::vector<u32> localIndices;
+	const u32        vertexCount = compactIndices(indices, triangleCount * 3, localIndices);
+
+	std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		adjacencyOffsets[localIndices[i] + 1]++;
+	}
+	for (u32 v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+
+	std::vector<u32> adjacency(triangleCount * 3);
+	{
+		std::vector<u32> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			adjacency[cursor[localIndices[i]]++] = u32(i / 3);
+		}
+	}
+
+	std::vector<Vec3> centroids(triangleCount, Vec3(0.0f));
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		for (u32 k = 0; k < 3; ++k)
+		{
+			const float* p = reinterpret_cast<const float*>(
+			    reinterpret_cast<const u8*>(positions) + indices[t * 3 + k] * positionStride);
+			centroids[t] += Vec3(p[0], p[1], p[2]);
+		}
+		centroids[t] = centroids[t] / 3.0f;
+	}
+
+	constexpr u32    NoCluster = ~0u;
+	std::vector<u32> vertexCluster(vertexCount, NoCluster); // last cluster that used each vertex
+	std::vector<u32> triangleCluster(triangleCount, NoCluster); // last cluster that considered each triangle
+	std::vector<u8>  emitted(triangleCount, 0);
+	std::vector<u32> candidates;
+	std::vector<u32> output;
+	output.reserve(triangleCount * 3);
+
+	size_t scanCursor = 0;
+	for (u32 clusterId = 0; output.size() < triangleCount * 3; ++clusterId)
+	{
+		while (emitted[scanCursor])
+		{
+			++scanCursor;
+		}
+
+		const size_t clusterBegin     = output.size();
+		u32          clusterVertices  = 0;
+		u32          clusterTriangles = 0;
+		Vec3         centroidSum(0.0f);
+
+		candidates.clear();
+
+		auto countNewVertices = [&](size_t triangle)
+		{
+			const u32* tri = &localIndices[triangle * 3];
+			return u32(vertexCluster[tri[0]] != clusterId) + u32(vertexCluster[tri[1]] != clusterId) +
+			       u32(vertexCluster[tri[2]] != clusterId);
+		};
+
+		size_t next = scanCursor;
+		for (;;)
+		{
+			emitted[next] = 1;
+			output.insert(output.end(), indices + next * 3, indices + next * 3 + 3);
+			centroidSum += centroids[next];
+			++clusterTriangles;
+
+			for (u32 k = 0; k < 3; ++k)
+			{
+				const u32 v = localIndices[next * 3 + k];
+				if (vertexCluster[v] != clusterId)
+				{
+					vertexCluster[v] = clusterId;
+					++clusterVertices;
+					for (u32 i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i)
+					{
+						const u32 t = adjacency[i];
+						if (!emitted[t] && triangleCluster[t] != clusterId)
+						{
+							triangleCluster[t] = clusterId;
+							candidates.push_back(t);
+						}
+					}
+				}
+			}
+
+			if (clusterTriangles == MaxClusterTriangles)
+			{
+				break;
+			}
+
+			// Prefer triangles that add the fewest vertices, then the ones closest to the cluster
+			const Vec3 centroid = centroidSum / float(clusterTriangles);
+			size_t     best     = triangleCount;
+			u32        bestNew  = 4;
+			float      bestDist = 0.0f;
+			size_t     live     = 0;
+			for (u32 t : candidates)
+			{
+				if (emitted[t])
+				{
+					continue;
+				}
+				candidates[live++] = t;
+
+				const u32 newVertices = countNewVertices(t);
+				if (clusterVertices + newVertices > MaxClusterVertices || newVertices > bestNew)
+				{
+					continue;
+				}
+
+				const Vec3  delta = centroids[t] - centroid;
+				const float dist  = dot(delta, delta);
+				if (newVertices < bestNew || dist < bestDist)
+				{
+					best     = t;
+					bestNew  = newVertices;
+					bestDist = dist;
+				}
+			}
+			candidates.resize(live);
+
+			if (best == triangleCount && clusterTriangles < ClusterFillTriangles)
+			{
+				while (scanCursor < triangleCount && emitted[scanCursor])
+				{
+					++scanCursor;
+				}
+				if (scanCursor < triangleCount && clusterVertices + countNewVertices(scanCursor) <= MaxClusterVertices)
+				{
+					best = scanCursor;
+				}
+			}
+
+			if (best == triangleCount)
+			{
+				break;
+			}
+			next = best;
+		}
+
+		// Growing by distance wanders around the cluster, so restore cache locality within it
+		optimizeVertexCache(output.data() + clusterBegin, output.size() - clusterBegin);
+
+		MeshCluster cluster;
+		cluster.indexOffset = indexOffset + u32(clusterBegin);
+		cluster.indexCount  = u32(output.size() - clusterBegin);
+		computeClusterBounds(output.data() + clusterBegin, cluster.indexCount, positions, positionStride, cluster);
+		clusters.push_back(cluster);
+	}
+
+	memcpy(indices, output.data(), output.size() * sizeof(u32));
+}
+
+bool isMeshClusterVisible(const MeshCluster& cluster, const Vec4* planes, u32 planeCount, const Vec3& cameraPosition)
+{
+	for (u32 i = 0; i < planeCount; ++i)
+	{
+		const Vec4& plane = planes[i];
+		if (plane.x * cluster.center.x + plane.y * cluster.center.y + plane.z * cluster.center.z + plane.w <
+		    -cluster.radius)
+		{
+			return false;
+		}
+	}
+
+	// Every triangle faces away when the view direction to the sphere stays within the cone
+	const Vec3 view = cluster.center - cameraPosition;
+	return dot(view, cluster.coneAxis) < cluster.coneCutoff * view.length() + cluster.radius;
+}
+
+size_t simplifyMesh(u32* destination, const u32* indices, size_t indexCount, const float* positions,
+    size_t positionStride, size_t targetIndexCount, float targetError, float* resultError)
+{
+	if (resultError)
+	{
+		*resultError = 0.0f;
+	}
+
+	// Triangle corners as dense vertex ids, mapped back to the caller's indices at the end
+	std::vector<u32> corners;
+	const u32        vertexCount = compactIndices(indices, indexCount / 3 * 3, corners);
+
+	std::vector<u32> originalIds(vertexCount);
+	for (size_t i = 0; i < corners.size(); ++i)
+	{
+		originalIds[corners[i]] = indices[i];
+	}
+
+	std::vector<Vec3> points(vertexCount);
+	for (u32 v = 0; v < vertexCount; ++v)
+	{
+		const float* p =
+		    reinterpret_cast<const float*>(reinterpret_cast<const u8*>(positions) + originalIds[v] * positionStride);
+		points[v] = Vec3(p[0], p[1], p[2]);
+	}
+
+	// Weld vertices that share a position, so that normal and texcoord seams are not mistaken for borders
+	std::vector<u32> order(vertexCount);
+	for (u32 v = 0; v < vertexCount; ++v)
+	{
+		order[v] = v;
+	}
+	auto lessPosition = [&](u32 a, u32 b)
+	{
+		const Vec3& pa = points[a];
+		const Vec3& pb = points[b];
+		return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+	};
+	std::sort(order.begin(), order.end(), lessPosition);
+
+	std::vector<u32> welded(vertexCount);
+	std::vector<u32> weldedVertex; // any vertex at each welded position
+	std::vector<u32> vertexCounts; // vertices sharing each welded position
+	for (u32 i = 0; i < vertexCount; ++i)
+	{
+		if (i == 0 || lessPosition(order[i - 1], order[i]))
+		{
+			weldedVertex.push_back(order[i]);
+			vertexCounts.push_back(0);
+		}
+		welded[order[i]] = u32(weldedVertex.size() - 1);
+		vertexCounts.back()++;
+	}
+	const u32 positionCount = u32(weldedVertex.size());
+
+	// Applies the collapses of a pass and drops triangles with two corners at one position, which
+	// also removes triangles that were degenerate to begin with
+	std::vector<u32> vertexRemap(vertexCount);
+	for (u32 v = 0; v < vertexCount; ++v)
+	{
+		vertexRemap[v] = v;
+	}
+	auto removeCollapsedTriangles = [&]()
+	{
+		size_t writeIndex = 0;
+		for (size_t t = 0; t < corners.size(); t += 3)
+		{
+			const u32 a = vertexRemap[corners[t + 0]];
+			const u32 b = vertexRemap[corners[t + 1]];
+			const u32 c = vertexRemap[corners[t + 2]];
+			if (welded[a] != welded[b] && welded[b] != welded[c] && welded[c] != welded[a])
+			{
+				corners[writeIndex++] = a;
+				corners[writeIndex++] = b;
+				corners[writeIndex++] = c;
+			}
+		}
+		corners.resize(writeIndex);
+	};
+	removeCollapsedTriangles();
+
+	// Seams, open borders and non-manifold edges are locked in place
+	std::vector<u8> locked(positionCount, 0);
+	for (u32 p = 0; p < positionCount; ++p)
+	{
+		locked[p] = vertexCounts[p] > 1;
+	}
+
+	{
+		std::vector<u64> edges;
+		edges.reserve(corners.size());
+		for (size_t t = 0; t < corners.size(); t += 3)
+		{
+			for (u32 k = 0; k < 3; ++k)
+			{
+				const u32 a = welded[corners[t + k]];
+				const u32 b = welded[corners[t + (k + 1) % 3]];
+				if (a != b)
+				{
+					edges.push_back((u64(min(a, b)) << 32) | max(a, b));
+				}
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t runEnd = i + 1;
+			while (runEnd < edges.size() && edges[runEnd] == edges[i])
+			{
+				++runEnd;
+			}
+			if (runEnd - i != 2)
+			{
+				locked[u32(edges[i] >> 32)]        = 1;
+				locked[u32(edges[i] & 0xffffffff)] = 1;
+			}
+			i = runEnd;
+		}
+	}
+
+	std::vector<Quadric> quadrics(positionCount);
+	for (size_t t = 0; t < corners.size(); t += 3)
+	{
+		const u32  a      = welded[corners[t + 0]];
+		const u32  b      = welded[corners[t + 1]];
+		const u32  c      = welded[corners[t + 2]];
+		Vec3       normal = cross(points[weldedVertex[b]] - points[weldedVertex[a]],
+		          points[weldedVertex[c]] - points[weldedVertex[a]]);
+		const float length = normal.length();
+		if (length == 0.0f)
+		{
+			continue;
+		}
+		normal = normal / length;
+
+		const float distance = -dot(normal, points[weldedVertex[a]]);
+		for (u32 p : {a, b, c})
+		{
+			quadrics[p].addPlane(normal.x, normal.y, normal.z, distance, length * 0.5f);
+		}
+	}
+
+	// Collapses run in passes over independent sets of vertices, so each pass can use the
+	// adjacency and triangle shapes from its start
+	std::vector<u32>          touched(positionCount, 0);
+	std::vector<u32>          adjacencyOffsets(positionCount + 1);
+	std::vector<u32>          adjacency;
+	std::vector<EdgeCollapse> collapses;
+
+	const double maxCost     = double(targetError) * double(targetError);
+	double       reachedCost = 0.0;
+
+	for (u32 pass = 1; corners.size() > targetIndexCount; ++pass)
+	{
+		const size_t triangleCount = corners.size() / 3;
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (u32 v : corners)
+		{
+			adjacencyOffsets[welded[v] + 1]++;
+		}
+		for (u32 p = 0; p < positionCount; ++p)
+		{
+			adjacencyOffsets[p + 1] += adjacencyOffsets[p];
+		}
+		adjacency.resize(corners.size());
+		{
+			std::vector<u32> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < corners.size(); ++i)
+			{
+				adjacency[cursor[welded[corners[i]]]++] = u32(i / 3);
+			}
+		}
+
+		// Each interior edge is seen once in each direction, so only the increasing one is kept
+		collapses.clear();
+		for (size_t i = 0; i < corners.size(); ++i)
+		{
+			const u32 a = welded[corners[i]];
+			const u32 b = welded[corners[i - i % 3 + (i + 1) % 3]];
+			if (a >= b || (locked[a] && locked[b]))
+			{
+				continue;
+			}
+
+			const double costToB = locked[a] ? HUGE_VAL : quadrics[a].evaluate(quadrics[b], points[weldedVertex[b]]);
+			const double costToA = locked[b] ? HUGE_VAL : quadrics[a].evaluate(quadrics[b], points[weldedVertex[a]]);
+			collapses.push_back(costToB <= costToA ? EdgeCollapse{a, b, costToB} : EdgeCollapse{b, a, costToA});
+		}
+		std::sort(collapses.begin(), collapses.end(),
+		    [](const EdgeCollapse& x, const EdgeCollapse& y) { return x.cost < y.cost; });
+
+		for (u32 v = 0; v < vertexCount; ++v)
+		{
+			vertexRemap[v] = v;
+		}
+
+		size_t removedTriangles = 0;
+		for (const EdgeCollapse& collapse : collapses)
+		{
+			if (collapse.cost > maxCost || (triangleCount - removedTriangles) * 3 <= targetIndexCount)
+			{
+				break;
+			}
+			if (touched[collapse.from] == pass || touched[collapse.to] == pass)
+			{
+				continue;
+			}
+
+			// Reject collapses that flip or fold a remaining triangle, and find the vertex of the target
+			// position in this chart, which is the one on a triangle shared by both positions
+			const Vec3 target       = points[weldedVertex[collapse.to]];
+			u32        targetVertex = ~0u;
+			u32        collapsed    = 0;
+			bool       flips        = false;
+			for (u32 j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; ++j)
+			{
+				const u32* triangle = &corners[size_t(adjacency[j]) * 3];
+
+				Vec3 before[3];
+				Vec3 after[3];
+				bool shared = false;
+				for (u32 k = 0; k < 3; ++k)
+				{
+					const u32 p = welded[triangle[k]];
+					before[k]   = points[triangle[k]];
+					after[k]    = p == collapse.from ? target : before[k];
+					if (p == collapse.to)
+					{
+						shared       = true;
+						targetVertex = triangle[k];
+					}
+				}
+
+				if (shared)
+				{
+					++collapsed;
+					continue;
+				}
+
+				const Vec3 normalBefore = cross(before[1] - before[0], before[2] - before[0]);
+				const Vec3 normalAfter  = cross(after[1] - after[0], after[2] - after[0]);
+				flips = dot(normalBefore, normalAfter) <= MinNormalCosine * normalBefore.length() * normalAfter.length();
+			}
+
+			if (flips || targetVertex == ~0u)
+			{
+				continue;
+			}
+
+			for (u32 j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; ++j)
+			{
+				for (u32 k = 0; k < 3; ++k)
+				{
+					touched[welded[corners[size_t(adjacency[j]) * 3 + k]]] = pass;
+				}
+			}
+
+			vertexRemap[weldedVertex[collapse.from]] = targetVertex;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			removedTriangles += collapsed;
+			reachedCost = max(reachedCost, collapse.cost);
+		}
+
+		if (removedTriangles == 0)
+		{
+			break;
+		}
+
+		removeCollapsedTriangles();
+	}
+
+	for (size_t i = 0; i < corners.size(); ++i)
+	{
+		destination[i] = originalIds[corners[i]];
+	}
+
+	if (resultError)
+	{
+		*resultError = float(sqrt(reachedCost));
+	}
+
+	return corners.size();
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Rush/MathTypes.h>
+#include <Rush/Rush.h>
+
+#include <stddef.h>
+#include <vector>
+
+namespace Rush
+{
+
+// Post-transform vertex cache efficiency of a triangle list, simulated with a FIFO cache.
+// ACMR is transformed vertices per triangle (0.5 is ideal for large grids, 3 is worst) and
+// ATVR is transformed vertices per referenced vertex (1 is ideal).
+struct VertexCacheStats
+{
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+};
+
+VertexCacheStats analyzeVertexCache(const u32* indices, size_t indexCount, u32 cacheSize = 16);
+
+// Reorders triangles for post-transform vertex cache locality (Forsyth's linear-speed algorithm).
+// Indices may reference any range of vertices, so this can run on a sub-range of a shared buffer.
+void optimizeVertexCache(u32* indices, size_t indexCount);
+
+// Splits a cache-optimized triangle list into clusters at points where restarting does not cost
+// much cache efficiency (at most threshold times the ACMR), then draws outward-facing clusters
+// first so that they occlude the rest. positions are float3 with a stride of positionStride bytes.
+void optimizeOverdraw(u32* indices, size_t indexCount, const float* positions, size_t positionStride,
+    float threshold = 1.05f);
+
+// Reorders vertices in order of first use by the index buffer and remaps the indices to match.
+// Unreferenced vertices are moved to the end.
+void optimizeVertexFetch(void* vertices, size_t vertexCount, size_t vertexSize, u32* indices, size_t indexCount);
+
+// Merges bitwise identical vertices, keeping them in order of first occurrence, and remaps the
+// indices to match. vertexSize must be a multiple of 4. Returns the new vertex count, vertices past
+// it are left unspecified.
+size_t weldVertices(void* vertices, size_t vertexCount, size_t vertexSize, u32* indices, size_t indexCount);
+
+// Triangle clusters for culling. Each cluster is a contiguous range of the index buffer, so visible
+// clusters can be drawn with regular indexed draws and neighbours merged into one draw.
+constexpr u32 MaxClusterVertices  = 64;
+constexpr u32 MaxClusterTriangles = 124;
+
+struct MeshCluster
+{
+	Vec3  center; // bounding sphere
+	float radius;
+	Vec3  coneAxis;   // average facing direction of the triangles
+	float coneCutoff; // sine of the normal cone half angle, 1 when the cluster can not be backface culled
+	u32   indexOffset;
+	u32   indexCount;
+};
+
+// Reorders triangles into clusters grown across shared vertices, and appends them to clusters with
+// index offsets relative to indexOffset. Triangles face the side that cross(b - a, c - a) points to.
+void buildMeshClusters(u32* indices, size_t indexCount, const float* positions, size_t positionStride,
+    u32 indexOffset, std::vector<MeshCluster>& clusters);
+
+// Tests the bounding sphere against planes (inside where dot(plane.xyz, p) + plane.w >= 0, with
+// normalized plane.xyz), and the normal cone against the camera position.
+bool isMeshClusterVisible(const MeshCluster& cluster, const Vec4* planes, u32 planeCount, const Vec3& cameraPosition);
+
+// Simplifies a triangle list by collapsing edges into one of their endpoints in order of least quadric
+// error, until at most targetIndexCount indices remain or the next collapse would cost more than
+// targetError. Vertices never move, so the result indexes the original vertex buffer and levels of
+// detail need only their own indices. Vertices on open borders and on attribute seams (several
+// vertices at one position) are kept, so segments simplified separately do not crack apart.
+// Writes the indices to destination, which may be indices, and returns their count. resultError
+// receives the largest collapse error as an approximate distance from the original surface.
+size_t simplifyMesh(u32* destination, const u32* indices, size_t indexCount, const float* positions,
+    size_t positionStride, size_t targetIndexCount, float targetError, float* resultError = nullptr);
+
+}
@@ -0,0 +1,344 @@
+#include "MipGenerator.h"
+
+#include <Rush/MathCommon.h>
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MIPGEN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__clang__) || defined(__GNUC__)
+#define MIPGEN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MIPGEN_TARGET_AVX2
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define MIPGEN_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Rush
+{
+
+namespace
+{
+	// Each row kernel averages 2x2 blocks from two source rows into the first dstWidth
+	// pixels of dst and returns how many it wrote; the caller finishes the tail and the
+	// odd edges, where one destination texel covers three source rows or columns.
+	using DownsampleRowFunction = u32 (*)(const u8* row0, const u8* row1, u8* dst, u32 dstWidth);
+
+	struct SrgbTables
+	{
+		float toLinear[256];
+		u8    fromLinear[65536 + 3]; // indexed by linear value in 0.16 fixed point; padded for 32-bit gathers
+
+		SrgbTables()
+		{
+			for (u32 i = 0; i < 256; ++i)
+			{
+				const double c = i / 255.0;
+				toLinear[i]    = float(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+			}
+
+			for (u32 i = 0; i < 65536; ++i)
+			{
+				const double l = i / 65535.0;
+				const double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+				fromLinear[i]  = u8(min(255.0, c * 255.0 + 0.5));
+			}
+			fromLinear[65536] = fromLinear[65537] = fromLinear[65538] = 0;
+		}
+	};
+
+	const SrgbTables& getSrgbTables()
+	{
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	// Averages columnCount x rowCount source texels starting at column x0, each 1 to 3 wide. Color is
+	// averaged in linear light when srgbTables is set and lands in the 16-bit encode table; alpha and
+	// linear color are rounded integer averages.
+	inline void downsamplePixel(
+	    const SrgbTables* srgbTables, const u8* const* rows, u32 rowCount, u32 x0, u32 columnCount, u8* out)
+	{
+		const u32 texelCount = rowCount * columnCount;
+		for (u32 c = 0; c < 4; ++c)
+		{
+			if (srgbTables && c < 3)
+			{
+				float sum = 0.0f;
+				for (u32 y = 0; y < rowCount; ++y)
+				{
+					for (u32 x = 0; x < columnCount; ++x)
+					{
+						sum += srgbTables->toLinear[rows[y][(x0 + x) * 4 + c]];
+					}
+				}
+				out[c] = srgbTables->fromLinear[u32(sum * (65535.0f / float(texelCount)) + 0.5f)];
+			}
+			else
+			{
+				u32 sum = 0;
+				for (u32 y = 0; y < rowCount; ++y)
+				{
+					for (u32 x = 0; x < columnCount; ++x)
+					{
+						sum += rows[y][(x0 + x) * 4 + c];
+					}
+				}
+				out[c] = u8((sum + texelCount / 2) / texelCount);
+			}
+		}
+	}
+
+#if MIPGEN_X86
+
+	bool cpuSupportsAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx     = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	u32 downsampleRowSSE2(const u8* row0, const u8* row1, u8* dst, u32 dstWidth)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i bias = _mm_set1_epi16(2);
+
+		// 8 source pixels per row -> 4 output pixels
+		u32 x = 0;
+		for (; x + 4 <= dstWidth; x += 4)
+		{
+			const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+			const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+			const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+			const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+
+			// vertical sums widened to 16 bits: lo = [p0 p1], hi = [p2 p3]
+			const __m128i lo0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			const __m128i hi0 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			const __m128i lo1 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			const __m128i hi1 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+			// horizontal sums: even pixels + odd pixels
+			__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi64(lo0, hi0), _mm_unpackhi_epi64(lo0, hi0));
+			__m128i s1 = _mm_add_epi16(_mm_unpacklo_epi64(lo1, hi1), _mm_unpackhi_epi64(lo1, hi1));
+
+			s0 = _mm_srli_epi16(_mm_add_epi16(s0, bias), 2);
+			s1 = _mm_srli_epi16(_mm_add_epi16(s1, bias), 2);
+
+			_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(s0, s1));
+		}
+
+		return x;
+	}
+
+	MIPGEN_TARGET_AVX2 u32 downsampleRowAVX2(const u8* row0, const u8* row1, u8* dst, u32 dstWidth)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i bias = _mm256_set1_epi16(2);
+
+		// 16 source pixels per row -> 8 output pixels; same scheme as SSE2 within each 128-bit lane
+		u32 x = 0;
+		for (; x + 8 <= dstWidth; x += 8)
+		{
+			const __m256i a0 = _mm256_loadu_si256((const __m256i*)(row0 + x * 8));
+			const __m256i a1 = _mm256_loadu_si256((const __m256i*)(row0 + x * 8 + 32));
+			const __m256i b0 = _mm256_loadu_si256((const __m256i*)(row1 + x * 8));
+			const __m256i b1 = _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + 32));
+
+			const __m256i lo0 = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero));
+			const __m256i hi0 = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero));
+			const __m256i lo1 = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero));
+			const __m256i hi1 = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero));
+
+			__m256i s0 = _mm256_add_epi16(_mm256_unpacklo_epi64(lo0, hi0), _mm256_unpackhi_epi64(lo0, hi0));
+			__m256i s1 = _mm256_add_epi16(_mm256_unpacklo_epi64(lo1, hi1), _mm256_unpackhi_epi64(lo1, hi1));
+
+			s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, bias), 2);
+			s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, bias), 2);
+
+			// packus works per lane, giving [o0 o1 o4 o5 | o2 o3 o6 o7]; restore pixel order
+			const __m256i packed = _mm256_packus_epi16(s0, s1);
+			_mm256_storeu_si256((__m256i*)(dst + x * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+
+		return x;
+	}
+
+	// Two output texels per iteration with the channels of both in the 8 lanes. Source bytes are
+	// decoded by gathering from the sRGB table and the rounded linear sums are encoded by gathering
+	// from the 16-bit table; alpha stays an integer average like in downsamplePixel().
+	MIPGEN_TARGET_AVX2 u32 downsampleRowSrgbAVX2(const u8* row0, const u8* row1, u8* dst, u32 dstWidth)
+	{
+		const SrgbTables& t          = getSrgbTables();
+		const __m128i     evenOdd    = _mm_setr_epi8(0, 1, 2, 3, 8, 9, 10, 11, 4, 5, 6, 7, 12, 13, 14, 15);
+		const __m256i     alphaMask  = _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+		const __m256      colorScale = _mm256_set1_ps(0.25f * 65535.0f);
+		const __m256      half       = _mm256_set1_ps(0.5f);
+		const __m256i     byteMask   = _mm256_set1_epi32(0xFF);
+		const __m256i     alphaBias  = _mm256_set1_epi32(2);
+
+		u32 x = 0;
+		for (; x + 2 <= dstWidth; x += 2)
+		{
+			// [s0 s2 | s1 s3]: the low half holds the left texel of each 2x2 block, the high half the right
+			const __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row0 + x * 8)), evenOdd);
+			const __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(row1 + x * 8)), evenOdd);
+
+			const __m256i a0 = _mm256_cvtepu8_epi32(a);
+			const __m256i a1 = _mm256_cvtepu8_epi32(_mm_unpackhi_epi64(a, a));
+			const __m256i b0 = _mm256_cvtepu8_epi32(b);
+			const __m256i b1 = _mm256_cvtepu8_epi32(_mm_unpackhi_epi64(b, b));
+
+			// Same summation order as downsamplePixel()
+			__m256 sum = _mm256_i32gather_ps(t.toLinear, a0, 4);
+			sum        = _mm256_add_ps(sum, _mm256_i32gather_ps(t.toLinear, a1, 4));
+			sum        = _mm256_add_ps(sum, _mm256_i32gather_ps(t.toLinear, b0, 4));
+			sum        = _mm256_add_ps(sum, _mm256_i32gather_ps(t.toLinear, b1, 4));
+
+			const __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(sum, colorScale), half));
+			const __m256i color = _mm256_and_si256(_mm256_i32gather_epi32((const int*)t.fromLinear, index, 1), byteMask);
+
+			const __m256i alphaSum = _mm256_add_epi32(_mm256_add_epi32(a0, a1), _mm256_add_epi32(b0, b1));
+			const __m256i alpha    = _mm256_srli_epi32(_mm256_add_epi32(alphaSum, alphaBias), 2);
+
+			const __m256i result = _mm256_blendv_epi8(color, alpha, alphaMask);
+			const __m128i words  = _mm_packus_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+			_mm_storel_epi64((__m128i*)(dst + x * 4), _mm_packus_epi16(words, words));
+		}
+
+		return x;
+	}
+
+#elif MIPGEN_NEON
+
+	u32 downsampleRowNEON(const u8* row0, const u8* row1, u8* dst, u32 dstWidth)
+	{
+		// 16 source pixels per row -> 8 output pixels, channels deinterleaved by vld4
+		u32 x = 0;
+		for (; x + 8 <= dstWidth; x += 8)
+		{
+			const uint8x16x4_t a = vld4q_u8(row0 + x * 8);
+			const uint8x16x4_t b = vld4q_u8(row1 + x * 8);
+
+			uint8x8x4_t out;
+			for (int c = 0; c < 4; ++c)
+			{
+				const uint16x8_t sum = vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c]));
+				out.val[c]           = vrshrn_n_u16(sum, 2);
+			}
+
+			vst4_u8(dst + x * 4, out);
+		}
+
+		return x;
+	}
+
+#endif
+
+	DownsampleRowFunction selectLinearRowFunction()
+	{
+#if MIPGEN_X86
+		return cpuSupportsAvx2() ? downsampleRowAVX2 : downsampleRowSSE2;
+#elif MIPGEN_NEON
+		return downsampleRowNEON;
+#else
+		return nullptr;
+#endif
+	}
+
+	// Without gathers the table lookups dominate, so only AVX2 has an sRGB kernel
+	DownsampleRowFunction selectSrgbRowFunction()
+	{
+#if MIPGEN_X86
+		return cpuSupportsAvx2() ? downsampleRowSrgbAVX2 : nullptr;
+#else
+		return nullptr;
+#endif
+	}
+}
+
+u32 computeMipCount(u32 width, u32 height)
+{
+	u32 count = 1;
+	u32 size  = max(width, height);
+	while (size > 1)
+	{
+		size >>= 1;
+		++count;
+	}
+	return count;
+}
+
+void downsampleRGBA8(const u8* src, u32 srcWidth, u32 srcHeight, u8* dst, bool sRGB)
+{
+	static const DownsampleRowFunction linearRowFunction = selectLinearRowFunction();
+	static const DownsampleRowFunction srgbRowFunction   = selectSrgbRowFunction();
+
+	const DownsampleRowFunction rowFunction = sRGB ? srgbRowFunction : linearRowFunction;
+	const SrgbTables*           srgbTables  = sRGB ? &getSrgbTables() : nullptr;
+
+	const u32    dstWidth  = max<u32>(1, srcWidth / 2);
+	const u32    dstHeight = max<u32>(1, srcHeight / 2);
+	const size_t srcPitch  = size_t(srcWidth) * 4;
+	const size_t dstPitch  = size_t(dstWidth) * 4;
+
+	// With an odd source size the last row and column of texels fold in three source texels, so the
+	// row kernels only get the 2x2 blocks before them
+	const u32 lastColumnCount = srcWidth == 1 ? 1 : 2 + (srcWidth & 1);
+	const u32 vectorWidth     = srcWidth == 1 ? 0 : dstWidth - (srcWidth & 1);
+
+	for (u32 y = 0; y < dstHeight; ++y)
+	{
+		const u32 rowCount = srcHeight == 1 ? 1 : (y + 1 == dstHeight ? 2 + (srcHeight & 1) : 2);
+		const u8* rows[3];
+		for (u32 i = 0; i < rowCount; ++i)
+		{
+			rows[i] = src + size_t(y * 2 + i) * srcPitch;
+		}
+		u8* dstRow = dst + size_t(y) * dstPitch;
+
+		u32 x = rowFunction && rowCount == 2 && vectorWidth ? rowFunction(rows[0], rows[1], dstRow, vectorWidth) : 0;
+		for (; x < dstWidth; ++x)
+		{
+			const u32 columnCount = x + 1 == dstWidth ? lastColumnCount : 2;
+			downsamplePixel(srgbTables, rows, rowCount, x * 2, columnCount, dstRow + x * 4);
+		}
+	}
+}
+
+void generateMipLevelsRGBA8(u8* const* levels, u32 mipCount, u32 width, u32 height, bool sRGB)
+{
+	for (u32 i = 1; i < mipCount; ++i)
+	{
+		downsampleRGBA8(levels[i - 1], width, height, levels[i], sRGB);
+
+		width  = max<u32>(1, width / 2);
+		height = max<u32>(1, height / 2);
+	}
+}
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Rush/Rush.h>
+
+namespace Rush
+{
+
+// Number of levels in a full mip chain, down to and including 1x1.
+u32 computeMipCount(u32 width, u32 height);
+
+// 2x2 box downsample of a tightly packed RGBA8 image into max(1, width/2) x max(1, height/2).
+// With an odd width or height the last column or row averages three source texels, so no texel
+// is dropped. When sRGB is set, color channels are averaged in linear light and re-encoded; alpha
+// is always averaged linearly. Linear images use AVX2, SSE2 or NEON where available, sRGB images
+// use AVX2 gathers where available and lookup tables elsewhere.
+void downsampleRGBA8(const u8* src, u32 srcWidth, u32 srcHeight, u8* dst, bool sRGB);
+
+// Fills levels[1..mipCount) from the RGBA8 image in levels[0]. Each level must have room for
+// max(1, width >> i) x max(1, height >> i) texels; the caller owns the memory.
+void generateMipLevelsRGBA8(u8* const* levels, u32 mipCount, u32 width, u32 height, bool sRGB);
+
+}
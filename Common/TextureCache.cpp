@@ -0,0 +1,226 @@
+#include "TextureCache.h"
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+#include "Utils.h"
+
+#include <Rush/Platform.h>
+#include <Rush/UtilFile.h>
+#include <Rush/UtilHash.h>
+#include <Rush/UtilLog.h>
+
+#include <filesystem>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+namespace Rush
+{
+
+namespace
+{
+constexpr u32 TextureCacheMagic = 0x43585452; // 'RTXC'
+
+// Bump whenever the layout or the mip generation changes, to invalidate stale entries
+constexpr u32 TextureCacheVersion = 2;
+
+// Mip payloads are aligned so the mapped pointers are suitable for SIMD reads
+constexpr u64 TextureCacheAlignment = 16;
+
+struct TextureCacheHeader
+{
+	u32 magic;
+	u32 version;
+	u32 format;
+	u32 width;
+	u32 height;
+	u32 mipCount;
+	u64 mipOffset[StagedTexture::MaxMips];
+	u64 mipSize[StagedTexture::MaxMips];
+};
+
+// Size that the GPU upload reads for one level, or 0 for formats that staging never produces
+size_t getExpectedLevelSize(GfxFormat format, u32 width, u32 height, u32 mip)
+{
+	const u32 levelWidth  = max<u32>(1, width >> mip);
+	const u32 levelHeight = max<u32>(1, height >> mip);
+	if (isBlockCompressedFormat(format))
+	{
+		return getCompressedLevelSize(format, levelWidth, levelHeight);
+	}
+	if (format == GfxFormat_RGBA8_Unorm || format == GfxFormat_RGBA8_sRGB)
+	{
+		return size_t(levelWidth) * levelHeight * 4;
+	}
+	return 0;
+}
+}
+
+std::string getTextureCachePath(const char* tag, const std::string& sourceFilename, GfxFormat format)
+{
+	std::error_code ec;
+
+	const u64 fileSize = std::filesystem::file_size(sourceFilename, ec);
+	if (ec)
+	{
+		return std::string();
+	}
+
+	const auto writeTime = std::filesystem::last_write_time(sourceFilename, ec);
+	if (ec)
+	{
+		return std::string();
+	}
+
+	const std::filesystem::path canonical = std::filesystem::weakly_canonical(sourceFilename, ec);
+	std::string key = ec ? sourceFilename : canonical.generic_string();
+#if defined(_WIN32)
+	key = toLower(key);
+#endif
+
+	char suffix[128];
+	snprintf(suffix, sizeof(suffix), "|%llu|%lld|%u|%u", static_cast<unsigned long long>(fileSize),
+	    static_cast<long long>(writeTime.time_since_epoch().count()), u32(format), TextureCacheVersion);
+	key += suffix;
+
+	const u64 hash = hashStrFnv1a64(key.c_str());
+
+	char name[64];
+	snprintf(name, sizeof(name), "%s_texture_%016llx.bin", tag, static_cast<unsigned long long>(hash));
+
+	return std::string(Platform_GetExecutableDirectory()) + "/TextureCache/" + name;
+}
+
+bool loadCachedTexture(const std::string& cachePath, StagedTexture& out)
+{
+	if (cachePath.empty())
+	{
+		return false;
+	}
+
+	MappedFile file;
+	if (!file.open(cachePath.c_str()) || file.size() < sizeof(TextureCacheHeader))
+	{
+		return false;
+	}
+
+	TextureCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (header.magic != TextureCacheMagic || header.version != TextureCacheVersion || header.mipCount == 0 ||
+	    header.mipCount > StagedTexture::MaxMips)
+	{
+		return false;
+	}
+
+	for (u32 i = 0; i < header.mipCount; ++i)
+	{
+		if (header.mipOffset[i] > file.size() || header.mipSize[i] > file.size() - header.mipOffset[i])
+		{
+			RUSH_LOG_ERROR("Texture cache entry '%s' is truncated", cachePath.c_str());
+			return false;
+		}
+	}
+
+	// The upload reads the level sizes implied by the description, so they must match what is stored
+	const GfxFormat format = GfxFormat(header.format);
+
+	bool valid = header.width != 0 && header.height != 0 && header.mipCount <= computeMipCount(header.width, header.height);
+	for (u32 i = 0; valid && i < header.mipCount; ++i)
+	{
+		const size_t expectedSize = getExpectedLevelSize(format, header.width, header.height, i);
+		valid = expectedSize != 0 && header.mipSize[i] == expectedSize;
+	}
+
+	if (!valid)
+	{
+		RUSH_LOG_ERROR("Texture cache entry '%s' does not match its description", cachePath.c_str());
+		return false;
+	}
+
+	out.reset();
+	out.desc      = GfxTextureDesc::make2D(header.width, header.height, GfxFormat(header.format));
+	out.desc.mips = header.mipCount;
+	for (u32 i = 0; i < header.mipCount; ++i)
+	{
+		out.mips[i]     = file.data() + header.mipOffset[i];
+		out.mipSizes[i] = size_t(header.mipSize[i]);
+	}
+	out.file = std::move(file);
+
+	return true;
+}
+
+bool saveCachedTexture(const std::string& cachePath, const StagedTexture& texture)
+{
+	const GfxTextureDesc& desc = texture.desc;
+
+	if (cachePath.empty() || desc.mips == 0 || desc.mips > StagedTexture::MaxMips)
+	{
+		return false;
+	}
+
+	const std::filesystem::path path = cachePath;
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	TextureCacheHeader header = {};
+	header.magic              = TextureCacheMagic;
+	header.version            = TextureCacheVersion;
+	header.format             = u32(desc.format);
+	header.width              = desc.width;
+	header.height             = desc.height;
+	header.mipCount           = desc.mips;
+
+	u64 offset = alignCeiling(u64(sizeof(header)), TextureCacheAlignment);
+	for (u32 i = 0; i < desc.mips; ++i)
+	{
+		header.mipOffset[i] = offset;
+		header.mipSize[i]   = texture.mipSizes[i];
+		offset              = alignCeiling(offset + texture.mipSizes[i], TextureCacheAlignment);
+	}
+
+	// Unique temporary name, as several loader jobs may write entries concurrently
+	char tempSuffix[32];
+	snprintf(tempSuffix, sizeof(tempSuffix), ".%016llx.tmp",
+	    static_cast<unsigned long long>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+	const std::string tempPath = cachePath + tempSuffix;
+
+	u64 written = 0;
+	{
+		FileOut stream(tempPath.c_str());
+		if (!stream.valid())
+		{
+			RUSH_LOG_ERROR("Failed to open texture cache entry '%s' for writing", tempPath.c_str());
+			return false;
+		}
+
+		static const u8 padding[TextureCacheAlignment] = {};
+
+		written += stream.write(&header, sizeof(header));
+		for (u32 i = 0; i < desc.mips; ++i)
+		{
+			written += stream.write(padding, u32(header.mipOffset[i] - written));
+			written += stream.write(texture.mips[i], u32(texture.mipSizes[i]));
+		}
+	}
+
+	if (written != header.mipOffset[desc.mips - 1] + header.mipSize[desc.mips - 1])
+	{
+		RUSH_LOG_ERROR("Failed to write texture cache entry '%s'", tempPath.c_str());
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+
+	return true;
+}
+
+}
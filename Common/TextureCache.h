@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Rush/GfxCommon.h>
+#include <Rush/Rush.h>
+
+#include "TextureStaging.h"
+
+#include <string>
+
+namespace Rush
+{
+
+// Cache entry path for a source image, under "TextureCache" next to the executable.
+// The key covers the canonical source path, its size and modification time, and the target
+// format. The tag separates applications that filter the same source differently.
+// Returns an empty string if the source file does not exist.
+std::string getTextureCachePath(const char* tag, const std::string& sourceFilename, GfxFormat format);
+
+// Maps a cache entry written by saveCachedTexture(); out.mips then point into the mapping.
+// Fails on missing, truncated or out-of-date entries, in which case the caller should decode
+// the source image.
+bool loadCachedTexture(const std::string& cachePath, StagedTexture& out);
+
+// Writes the staged mip chain to a new cache entry. The file is written under a temporary
+// name and renamed into place, so concurrent readers never see a partial entry.
+bool saveCachedTexture(const std::string& cachePath, const StagedTexture& texture);
+
+}
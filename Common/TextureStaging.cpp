@@ -0,0 +1,265 @@
+#include "TextureStaging.h"
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+
+#include <Rush/MathCommon.h>
+
+#include <stb_image.h>
+
+#include <new>
+#include <utility>
+
+namespace Rush
+{
+
+namespace
+{
+	// Smallest class is one 4 KB page
+	constexpr u32 MinSizeClass = 12;
+
+	// Mip levels inside a staging block start on 16-byte boundaries for the SIMD kernels
+	constexpr size_t LevelAlignment = 16;
+
+	constexpr std::align_val_t BlockAlignment = std::align_val_t(64);
+
+	u32 getSizeClass(size_t size)
+	{
+		u32 sizeClass = MinSizeClass;
+		while ((size_t(1) << sizeClass) < size)
+		{
+			++sizeClass;
+		}
+		return sizeClass;
+	}
+}
+
+StagingBuffer::StagingBuffer(StagingBuffer&& other) noexcept { *this = std::move(other); }
+
+StagingBuffer& StagingBuffer::operator=(StagingBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		reset();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+		std::swap(m_capacity, other.m_capacity);
+		std::swap(m_allocator, other.m_allocator);
+		std::swap(m_freeFunction, other.m_freeFunction);
+	}
+	return *this;
+}
+
+StagingBuffer StagingBuffer::adopt(void* data, size_t size, FreeFunction freeFunction)
+{
+	StagingBuffer result;
+	result.m_data         = static_cast<u8*>(data);
+	result.m_size         = size;
+	result.m_capacity     = size;
+	result.m_freeFunction = freeFunction;
+	return result;
+}
+
+void StagingBuffer::reset()
+{
+	if (m_allocator)
+	{
+		m_allocator->release(m_data, m_capacity);
+	}
+	else if (m_data && m_freeFunction)
+	{
+		m_freeFunction(m_data);
+	}
+
+	m_data         = nullptr;
+	m_size         = 0;
+	m_capacity     = 0;
+	m_allocator    = nullptr;
+	m_freeFunction = nullptr;
+}
+
+StagingAllocator::StagingAllocator(size_t maxCachedBytes) : m_maxCachedBytes(maxCachedBytes) {}
+
+StagingAllocator::~StagingAllocator()
+{
+	RUSH_ASSERT(m_bytesInUse == 0);
+	trim();
+}
+
+StagingBuffer StagingAllocator::allocate(size_t size)
+{
+	StagingBuffer result;
+	if (size == 0)
+	{
+		return result;
+	}
+
+	const u32    sizeClass = getSizeClass(size);
+	const size_t capacity  = size_t(1) << sizeClass;
+
+	u8* data = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_freeBlocks[sizeClass].empty())
+		{
+			data = m_freeBlocks[sizeClass].back();
+			m_freeBlocks[sizeClass].pop_back();
+			m_cachedBytes -= capacity;
+		}
+		m_bytesInUse += capacity;
+		m_peakBytesInUse = max(m_peakBytesInUse, m_bytesInUse);
+	}
+
+	if (!data)
+	{
+		data = static_cast<u8*>(::operator new(capacity, BlockAlignment));
+	}
+
+	result.m_data      = data;
+	result.m_size      = size;
+	result.m_capacity  = capacity;
+	result.m_allocator = this;
+
+	return result;
+}
+
+void StagingAllocator::release(u8* data, size_t capacity)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bytesInUse -= capacity;
+		if (m_cachedBytes + capacity <= m_maxCachedBytes)
+		{
+			m_freeBlocks[getSizeClass(capacity)].push_back(data);
+			m_cachedBytes += capacity;
+			return;
+		}
+	}
+
+	::operator delete(data, BlockAlignment);
+}
+
+void StagingAllocator::trim()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (std::vector<u8*>& blocks : m_freeBlocks)
+	{
+		for (u8* data : blocks)
+		{
+			::operator delete(data, BlockAlignment);
+		}
+		blocks.clear();
+	}
+	m_cachedBytes = 0;
+}
+
+size_t StagingAllocator::getBytesInUse() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bytesInUse;
+}
+
+size_t StagingAllocator::getPeakBytesInUse() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_peakBytesInUse;
+}
+
+StagingAllocator& StagingAllocator::getDefault()
+{
+	static StagingAllocator allocator;
+	return allocator;
+}
+
+void StagedTexture::reset()
+{
+	desc = GfxTextureDesc();
+	for (u32 i = 0; i < MaxMips; ++i)
+	{
+		mips[i]     = nullptr;
+		mipSizes[i] = 0;
+	}
+	topLevel.reset();
+	mipTail.reset();
+	file.close();
+}
+
+bool stageTextureFromFile(const char* filename, GfxFormat format, bool sRGBFilter, StagedTexture& out)
+{
+	out.reset();
+
+	int w, h, comp;
+	u8* pixels = stbi_load(filename, &w, &h, &comp, 4);
+	if (!pixels)
+	{
+		return false;
+	}
+
+	const u32 width    = u32(w);
+	const u32 height   = u32(h);
+	const u32 mipCount = min(computeMipCount(width, height), StagedTexture::MaxMips);
+
+	// The decoder's buffer is used in place as mip 0, so the full-resolution image is never copied
+	out.topLevel = StagingBuffer::adopt(pixels, size_t(width) * height * 4, stbi_image_free);
+
+	// All smaller levels share one staging block
+	size_t offsets[StagedTexture::MaxMips] = {};
+	size_t sizes[StagedTexture::MaxMips]   = {};
+	size_t tailSize                        = 0;
+	for (u32 i = 0; i < mipCount; ++i)
+	{
+		sizes[i] = size_t(max<u32>(1, width >> i)) * max<u32>(1, height >> i) * 4;
+		if (i > 0)
+		{
+			offsets[i] = tailSize;
+			tailSize   = alignCeiling(tailSize + sizes[i], LevelAlignment);
+		}
+	}
+
+	out.mipTail = StagingAllocator::getDefault().allocate(tailSize);
+
+	u8* levels[StagedTexture::MaxMips] = {pixels};
+	for (u32 i = 1; i < mipCount; ++i)
+	{
+		levels[i] = out.mipTail.data() + offsets[i];
+	}
+
+	generateMipLevelsRGBA8(levels, mipCount, width, height, sRGBFilter);
+
+	// Block-compressed textures need whole blocks in the top level, so odd sizes stay uncompressed
+	const bool compress = isBlockCompressedFormat(format) && (width % 4) == 0 && (height % 4) == 0;
+	if (compress)
+	{
+		size_t compressedOffsets[StagedTexture::MaxMips] = {};
+		size_t compressedSize                            = 0;
+		for (u32 i = 0; i < mipCount; ++i)
+		{
+			compressedOffsets[i] = compressedSize;
+			sizes[i]             = getCompressedLevelSize(format, max<u32>(1, width >> i), max<u32>(1, height >> i));
+			compressedSize       = alignCeiling(compressedSize + sizes[i], LevelAlignment);
+		}
+
+		StagingBuffer compressed = StagingAllocator::getDefault().allocate(compressedSize);
+		for (u32 i = 0; i < mipCount; ++i)
+		{
+			u8* destination = compressed.data() + compressedOffsets[i];
+			compressRGBA8(format, levels[i], max<u32>(1, width >> i), max<u32>(1, height >> i), destination);
+			levels[i] = destination;
+		}
+
+		// The RGBA8 chain is no longer needed once the compressed one exists
+		out.topLevel.reset();
+		out.mipTail = std::move(compressed);
+	}
+
+	out.desc      = GfxTextureDesc::make2D(width, height, compress ? format : getBlockCompressionSourceFormat(format));
+	out.desc.mips = mipCount;
+	for (u32 i = 0; i < mipCount; ++i)
+	{
+		out.mips[i]     = levels[i];
+		out.mipSizes[i] = sizes[i];
+	}
+
+	return true;
+}
+
+}
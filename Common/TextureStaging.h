@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Rush/GfxCommon.h>
+#include <Rush/Rush.h>
+
+#include "MappedFile.h"
+
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+namespace Rush
+{
+
+class StagingAllocator;
+
+// CPU memory holding texture data between decode and upload. Owns either a block from a
+// StagingAllocator or memory adopted from another allocator (such as a decoder's output),
+// and gives it back as soon as reset() is called or the buffer is destroyed.
+class StagingBuffer
+{
+	RUSH_DISALLOW_COPY_AND_ASSIGN(StagingBuffer);
+
+public:
+	using FreeFunction = void (*)(void*);
+
+	StagingBuffer() = default;
+	StagingBuffer(StagingBuffer&& other) noexcept;
+	StagingBuffer& operator=(StagingBuffer&& other) noexcept;
+	~StagingBuffer() { reset(); }
+
+	static StagingBuffer adopt(void* data, size_t size, FreeFunction freeFunction);
+
+	void reset();
+
+	bool   valid() const { return m_data != nullptr; }
+	u8*    data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	friend class StagingAllocator;
+
+	u8*               m_data         = nullptr;
+	size_t            m_size         = 0;
+	size_t            m_capacity     = 0;
+	StagingAllocator* m_allocator    = nullptr;
+	FreeFunction      m_freeFunction = nullptr;
+};
+
+// Thread-safe pool of staging blocks in power-of-two size classes. Released blocks are kept
+// for reuse up to a small cap, so concurrent loader jobs recycle memory instead of
+// growing the heap for every texture.
+class StagingAllocator
+{
+	RUSH_DISALLOW_COPY_AND_ASSIGN(StagingAllocator);
+
+public:
+	StagingAllocator(size_t maxCachedBytes = 64u << 20);
+	~StagingAllocator();
+
+	StagingBuffer allocate(size_t size);
+
+	// Frees all cached blocks; blocks still in use are unaffected.
+	void trim();
+
+	size_t getBytesInUse() const;
+	size_t getPeakBytesInUse() const;
+
+	static StagingAllocator& getDefault();
+
+private:
+	friend class StagingBuffer;
+
+	void release(u8* data, size_t capacity);
+
+	static constexpr u32 SizeClassCount = 48;
+
+	mutable std::mutex m_mutex;
+	std::vector<u8*>   m_freeBlocks[SizeClassCount];
+	size_t             m_maxCachedBytes = 0;
+	size_t             m_cachedBytes    = 0;
+	size_t             m_bytesInUse     = 0;
+	size_t             m_peakBytesInUse = 0;
+};
+
+// A texture's mip chain on the CPU, ready for Gfx_CreateTexture. Level pointers refer to memory
+// owned by this object (staging buffers or a mapped texture cache entry) and stay valid until
+// reset() is called.
+struct StagedTexture
+{
+	static constexpr u32 MaxMips = 16;
+
+	GfxTextureDesc desc;
+	const u8*      mips[MaxMips]     = {};
+	size_t         mipSizes[MaxMips] = {};
+
+	StagingBuffer topLevel; // decoder output, used in place as mip 0
+	StagingBuffer mipTail;  // remaining levels, or the whole chain once block-compressed
+	MappedFile    file;
+
+	bool valid() const { return mips[0] != nullptr; }
+	void reset();
+};
+
+// Decodes an image with stb_image, generates its mip chain and, if format is a block-compressed
+// format and the image is a whole number of blocks, encodes it. Otherwise the chain stays RGBA8
+// in the matching sRGB or linear format. sRGBFilter selects gamma-correct mip filtering.
+bool stageTextureFromFile(const char* filename, GfxFormat format, bool sRGBFilter, StagedTexture& out);
+
+}
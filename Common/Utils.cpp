@@ -26,7 +26,7 @@ namespace
 
 		char* end = nullptr;
 		long parsed = std::strtol(value, &end, 10);
-		if (end == value || parsed <= 0)
+		if (end == value || parsed < 0)
 		{
 			return defaultValue;
 		}
@@ -34,6 +34,23 @@ namespace
 		return static_cast<u32>(parsed);
 	}
 
+	float parseFloat(const char* value, float defaultValue)
+	{
+		if (!value)
+		{
+			return defaultValue;
+		}
+
+		char* end = nullptr;
+		float parsed = std::strtof(value, &end);
+		if (end == value || !(parsed >= 0.0f))
+		{
+			return defaultValue;
+		}
+
+		return parsed;
+	}
+
 	std::string trimQuotes(std::string_view text)
 	{
 		if (text.size() >= 2 && ((text.front() == '"' && text.back() == '"') || (text.front() == '\'' && text.back() == '\'')))
@@ -214,6 +231,18 @@ bool getArgU32(int argc, char** argv, const char* longKey, const char* shortKey,
 	return true;
 }
 
+bool getArgFloat(int argc, char** argv, const char* longKey, const char* shortKey, float& out)
+{
+	const char* value = nullptr;
+	if (!findArgValue(argc, argv, longKey, shortKey, value))
+	{
+		return false;
+	}
+
+	out = parseFloat(value, out);
+	return true;
+}
+
 bool getPositionalArg(int argc, char** argv, int position, const char*& value)
 {
 	if (position < 0)
@@ -0,0 +1,690 @@
+#include "WideBvh.h"
+
+#include <Rush/MathCommon.h>
+
+#include <float.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define WIDEBVH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__clang__) || defined(__GNUC__)
+#define WIDEBVH_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define WIDEBVH_TARGET_AVX2
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define WIDEBVH_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Rush
+{
+
+namespace
+{
+	float getSurfaceArea(const BvhNode& node)
+	{
+		const Vec3 d = node.boundsMax - node.boundsMin;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	Vec3 loadPosition(const float* positions, size_t positionStride, u32 index)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const u8*>(positions) + index * positionStride);
+		return Vec3(p[0], p[1], p[2]);
+	}
+
+	template <u32 Width> struct BvhCollapser
+	{
+		const Bvh&      bvh;
+		const u32*      indices;
+		const float*    positions;
+		size_t          positionStride;
+		WideBvh<Width>& out;
+
+		void setLeaf(WideBvhNode<Width>& node, u32 slot, const BvhNode& leaf)
+		{
+			node.first[slot] = u32(out.triangles.size());
+			node.count[slot] = divUp(leaf.count, Width);
+
+			for (u32 i = 0; i < leaf.count; i += Width)
+			{
+				WideBvhTrianglePack<Width> pack = {};
+				for (u32 lane = 0; lane < Width; ++lane)
+				{
+					pack.primitive[lane] = ~0u;
+				}
+
+				for (u32 lane = 0; lane < min(Width, leaf.count - i); ++lane)
+				{
+					const u32  triangle = bvh.primitives[leaf.first + i + lane];
+					const u32* t        = indices + size_t(triangle) * 3;
+					const Vec3 p0       = loadPosition(positions, positionStride, t[0]);
+					const Vec3 e1       = loadPosition(positions, positionStride, t[1]) - p0;
+					const Vec3 e2       = loadPosition(positions, positionStride, t[2]) - p0;
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						pack.v0[axis][lane] = p0[axis];
+						pack.e1[axis][lane] = e1[axis];
+						pack.e2[axis][lane] = e2[axis];
+					}
+					pack.primitive[lane] = triangle;
+				}
+
+				out.triangles.push_back(pack);
+			}
+		}
+
+		// Opens the inner child with the largest surface area until the node is full, so that the
+		// children of a wide node are roughly the same size. Returns the index of the new node.
+		u32 collapseNode(u32 binaryIndex)
+		{
+			u32 children[Width];
+			u32 childCount = 0;
+
+			const BvhNode& binary = bvh.nodes[binaryIndex];
+			if (binary.isLeaf())
+			{
+				children[childCount++] = binaryIndex;
+			}
+			else
+			{
+				children[childCount++] = binary.first;
+				children[childCount++] = binary.first + 1;
+			}
+
+			while (childCount < Width)
+			{
+				u32   largest     = Width;
+				float largestArea = -1.0f;
+				for (u32 i = 0; i < childCount; ++i)
+				{
+					const BvhNode& child = bvh.nodes[children[i]];
+					if (!child.isLeaf() && getSurfaceArea(child) > largestArea)
+					{
+						largest     = i;
+						largestArea = getSurfaceArea(child);
+					}
+				}
+				if (largest == Width)
+				{
+					break;
+				}
+
+				const u32 opened       = bvh.nodes[children[largest]].first;
+				children[largest]      = opened;
+				children[childCount++] = opened + 1;
+			}
+
+			const u32 nodeIndex = u32(out.nodes.size());
+			out.nodes.emplace_back();
+
+			WideBvhNode<Width> node = {};
+			for (u32 slot = 0; slot < Width; ++slot)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					node.boundsMin[axis][slot] = FLT_MAX;
+					node.boundsMax[axis][slot] = -FLT_MAX;
+				}
+			}
+
+			for (u32 slot = 0; slot < childCount; ++slot)
+			{
+				const BvhNode& child = bvh.nodes[children[slot]];
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					node.boundsMin[axis][slot] = child.boundsMin[axis];
+					node.boundsMax[axis][slot] = child.boundsMax[axis];
+				}
+
+				if (child.isLeaf())
+				{
+					setLeaf(node, slot, child);
+				}
+				else
+				{
+					node.first[slot] = collapseNode(children[slot]);
+				}
+			}
+
+			out.nodes[nodeIndex] = node;
+			return nodeIndex;
+		}
+	};
+
+	template <u32 Width>
+	void collapseBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride, WideBvh<Width>& out)
+	{
+		out.nodes.clear();
+		out.triangles.clear();
+		if (bvh.nodes.empty())
+		{
+			return;
+		}
+
+		// Upper bounds, as every wide node holds at least two binary nodes unless it is a leaf root
+		out.nodes.reserve(bvh.nodes.size() / 2 + 1);
+		out.triangles.reserve(bvh.nodes.size() / 2 + 1);
+
+		BvhCollapser<Width> collapser = {bvh, indices, positions, positionStride, out};
+		collapser.collapseNode(0);
+	}
+
+	struct WideBvhRay
+	{
+		float origin[3];
+		float direction[3];
+		float invDirection[3];
+		bool  negative[3]; // the near plane of each axis is the maximum rather than the minimum
+		float tMin;
+	};
+
+	// Lane results of a triangle pack; det > 0 means front facing, like intersectTriangleBvh()
+	template <u32 Width> struct TriangleLanes
+	{
+		float t[Width];
+		float u[Width];
+		float v[Width];
+		float det[Width];
+	};
+
+	// Each kernel set writes the entry distances of all children and returns a bit mask of those whose
+	// boxes the ray enters before tMax, and intersects a triangle pack returning the mask of lanes hit
+	// in [tMin, tMax). Both follow the scalar routines in Bvh.cpp operation by operation, including
+	// ignoring NaN slab distances from rays in a box face plane.
+	template <u32 Width> struct ScalarKernels
+	{
+		static u32 intersectChildren(const WideBvhNode<Width>& node, const WideBvhRay& ray, float tMax, float* tNear)
+		{
+			u32 mask = 0;
+			for (u32 lane = 0; lane < Width; ++lane)
+			{
+				float tEnter = ray.tMin;
+				float tExit  = tMax;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					const float nearPlane = ray.negative[axis] ? node.boundsMax[axis][lane] : node.boundsMin[axis][lane];
+					const float farPlane  = ray.negative[axis] ? node.boundsMin[axis][lane] : node.boundsMax[axis][lane];
+					const float t0        = (nearPlane - ray.origin[axis]) * ray.invDirection[axis];
+					const float t1        = (farPlane - ray.origin[axis]) * ray.invDirection[axis];
+					tEnter                = t0 > tEnter ? t0 : tEnter;
+					tExit                 = t1 < tExit ? t1 : tExit;
+				}
+				tNear[lane] = tEnter;
+				mask |= tEnter <= tExit ? 1u << lane : 0u;
+			}
+			return mask;
+		}
+
+		static u32 intersectTriangles(
+		    const WideBvhTrianglePack<Width>& pack, const WideBvhRay& ray, float tMax, TriangleLanes<Width>& lanes)
+		{
+			const float* d    = ray.direction;
+			u32          mask = 0;
+			for (u32 lane = 0; lane < Width; ++lane)
+			{
+				const float e1[3] = {pack.e1[0][lane], pack.e1[1][lane], pack.e1[2][lane]};
+				const float e2[3] = {pack.e2[0][lane], pack.e2[1][lane], pack.e2[2][lane]};
+				const float tv[3] = {ray.origin[0] - pack.v0[0][lane], ray.origin[1] - pack.v0[1][lane],
+				    ray.origin[2] - pack.v0[2][lane]};
+
+				const float pv[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+				const float qv[3] = {tv[1] * e1[2] - tv[2] * e1[1], tv[2] * e1[0] - tv[0] * e1[2], tv[0] * e1[1] - tv[1] * e1[0]};
+
+				const float det    = e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2];
+				const float invDet = 1.0f / det;
+				const float u      = (tv[0] * pv[0] + tv[1] * pv[1] + tv[2] * pv[2]) * invDet;
+				const float v      = (d[0] * qv[0] + d[1] * qv[1] + d[2] * qv[2]) * invDet;
+				const float t      = (e2[0] * qv[0] + e2[1] * qv[1] + e2[2] * qv[2]) * invDet;
+
+				lanes.t[lane]   = t;
+				lanes.u[lane]   = u;
+				lanes.v[lane]   = v;
+				lanes.det[lane] = det;
+
+				const bool hit = det != 0.0f && u >= 0.0f && u <= 1.0f && v >= 0.0f && u + v <= 1.0f && t >= ray.tMin && t < tMax;
+				mask |= hit ? 1u << lane : 0u;
+			}
+			return mask;
+		}
+	};
+
+#if WIDEBVH_X86
+
+	bool cpuSupportsAvx2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx     = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	// _mm_max_ps and _mm_min_ps return their second operand when either is NaN, which keeps the
+	// running interval
+	struct Sse2Kernels
+	{
+		static u32 intersectChildren(const WideBvhNode<4>& node, const WideBvhRay& ray, float tMax, float* tNear)
+		{
+			__m128 tEnter = _mm_set1_ps(ray.tMin);
+			__m128 tExit  = _mm_set1_ps(tMax);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float* nearPlane = ray.negative[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+				const float* farPlane  = ray.negative[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+				const __m128 origin    = _mm_set1_ps(ray.origin[axis]);
+				const __m128 inv       = _mm_set1_ps(ray.invDirection[axis]);
+				const __m128 t0        = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearPlane), origin), inv);
+				const __m128 t1        = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farPlane), origin), inv);
+				tEnter                 = _mm_max_ps(t0, tEnter);
+				tExit                  = _mm_min_ps(t1, tExit);
+			}
+			_mm_storeu_ps(tNear, tEnter);
+			return u32(_mm_movemask_ps(_mm_cmple_ps(tEnter, tExit)));
+		}
+
+		static u32 intersectTriangles(const WideBvhTrianglePack<4>& pack, const WideBvhRay& ray, float tMax, TriangleLanes<4>& lanes)
+		{
+			const __m128 dx  = _mm_set1_ps(ray.direction[0]);
+			const __m128 dy  = _mm_set1_ps(ray.direction[1]);
+			const __m128 dz  = _mm_set1_ps(ray.direction[2]);
+			const __m128 e1x = _mm_load_ps(pack.e1[0]);
+			const __m128 e1y = _mm_load_ps(pack.e1[1]);
+			const __m128 e1z = _mm_load_ps(pack.e1[2]);
+			const __m128 e2x = _mm_load_ps(pack.e2[0]);
+			const __m128 e2y = _mm_load_ps(pack.e2[1]);
+			const __m128 e2z = _mm_load_ps(pack.e2[2]);
+			const __m128 tvx = _mm_sub_ps(_mm_set1_ps(ray.origin[0]), _mm_load_ps(pack.v0[0]));
+			const __m128 tvy = _mm_sub_ps(_mm_set1_ps(ray.origin[1]), _mm_load_ps(pack.v0[1]));
+			const __m128 tvz = _mm_sub_ps(_mm_set1_ps(ray.origin[2]), _mm_load_ps(pack.v0[2]));
+
+			const __m128 pvx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			const __m128 pvy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			const __m128 pvz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			const __m128 qvx = _mm_sub_ps(_mm_mul_ps(tvy, e1z), _mm_mul_ps(tvz, e1y));
+			const __m128 qvy = _mm_sub_ps(_mm_mul_ps(tvz, e1x), _mm_mul_ps(tvx, e1z));
+			const __m128 qvz = _mm_sub_ps(_mm_mul_ps(tvx, e1y), _mm_mul_ps(tvy, e1x));
+
+			const __m128 det    = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, pvx), _mm_mul_ps(e1y, pvy)), _mm_mul_ps(e1z, pvz));
+			const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+			const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tvx, pvx), _mm_mul_ps(tvy, pvy)), _mm_mul_ps(tvz, pvz)), invDet);
+			const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qvx), _mm_mul_ps(dy, qvy)), _mm_mul_ps(dz, qvz)), invDet);
+			const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qvx), _mm_mul_ps(e2y, qvy)), _mm_mul_ps(e2z, qvz)), invDet);
+
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one  = _mm_set1_ps(1.0f);
+			__m128       hit  = _mm_cmpneq_ps(det, zero);
+			hit               = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+			hit               = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+			hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, _mm_set1_ps(ray.tMin)), _mm_cmplt_ps(t, _mm_set1_ps(tMax))));
+
+			_mm_storeu_ps(lanes.t, t);
+			_mm_storeu_ps(lanes.u, u);
+			_mm_storeu_ps(lanes.v, v);
+			_mm_storeu_ps(lanes.det, det);
+			return u32(_mm_movemask_ps(hit));
+		}
+	};
+
+	using Bvh4Kernels = Sse2Kernels;
+
+	// Out of line, as AVX2 code can't be inlined into the baseline traversal loop
+	WIDEBVH_TARGET_AVX2 u32 intersectChildrenAVX2(const WideBvhNode<8>& node, const WideBvhRay& ray, float tMax, float* tNear)
+	{
+		__m256 tEnter = _mm256_set1_ps(ray.tMin);
+		__m256 tExit  = _mm256_set1_ps(tMax);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float* nearPlane = ray.negative[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+			const float* farPlane  = ray.negative[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+			const __m256 origin    = _mm256_set1_ps(ray.origin[axis]);
+			const __m256 inv       = _mm256_set1_ps(ray.invDirection[axis]);
+			const __m256 t0        = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearPlane), origin), inv);
+			const __m256 t1        = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farPlane), origin), inv);
+			tEnter                 = _mm256_max_ps(t0, tEnter);
+			tExit                  = _mm256_min_ps(t1, tExit);
+		}
+		_mm256_storeu_ps(tNear, tEnter);
+		return u32(_mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ)));
+	}
+
+	WIDEBVH_TARGET_AVX2 u32 intersectTrianglesAVX2(
+	    const WideBvhTrianglePack<8>& pack, const WideBvhRay& ray, float tMax, TriangleLanes<8>& lanes)
+	{
+		const __m256 dx  = _mm256_set1_ps(ray.direction[0]);
+		const __m256 dy  = _mm256_set1_ps(ray.direction[1]);
+		const __m256 dz  = _mm256_set1_ps(ray.direction[2]);
+		const __m256 e1x = _mm256_load_ps(pack.e1[0]);
+		const __m256 e1y = _mm256_load_ps(pack.e1[1]);
+		const __m256 e1z = _mm256_load_ps(pack.e1[2]);
+		const __m256 e2x = _mm256_load_ps(pack.e2[0]);
+		const __m256 e2y = _mm256_load_ps(pack.e2[1]);
+		const __m256 e2z = _mm256_load_ps(pack.e2[2]);
+		const __m256 tvx = _mm256_sub_ps(_mm256_set1_ps(ray.origin[0]), _mm256_load_ps(pack.v0[0]));
+		const __m256 tvy = _mm256_sub_ps(_mm256_set1_ps(ray.origin[1]), _mm256_load_ps(pack.v0[1]));
+		const __m256 tvz = _mm256_sub_ps(_mm256_set1_ps(ray.origin[2]), _mm256_load_ps(pack.v0[2]));
+
+		const __m256 pvx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+		const __m256 pvy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+		const __m256 pvz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+		const __m256 qvx = _mm256_sub_ps(_mm256_mul_ps(tvy, e1z), _mm256_mul_ps(tvz, e1y));
+		const __m256 qvy = _mm256_sub_ps(_mm256_mul_ps(tvz, e1x), _mm256_mul_ps(tvx, e1z));
+		const __m256 qvz = _mm256_sub_ps(_mm256_mul_ps(tvx, e1y), _mm256_mul_ps(tvy, e1x));
+
+		const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, pvx), _mm256_mul_ps(e1y, pvy)), _mm256_mul_ps(e1z, pvz));
+		const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+		const __m256 u      = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tvx, pvx), _mm256_mul_ps(tvy, pvy)), _mm256_mul_ps(tvz, pvz)), invDet);
+		const __m256 v = _mm256_mul_ps(
+		    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qvx), _mm256_mul_ps(dy, qvy)), _mm256_mul_ps(dz, qvz)), invDet);
+		const __m256 t = _mm256_mul_ps(
+		    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qvx), _mm256_mul_ps(e2y, qvy)), _mm256_mul_ps(e2z, qvz)), invDet);
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one  = _mm256_set1_ps(1.0f);
+		__m256       hit  = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+		hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+		hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+		hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(ray.tMin), _CMP_GE_OQ),
+		                             _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ)));
+
+		_mm256_storeu_ps(lanes.t, t);
+		_mm256_storeu_ps(lanes.u, u);
+		_mm256_storeu_ps(lanes.v, v);
+		_mm256_storeu_ps(lanes.det, det);
+		return u32(_mm256_movemask_ps(hit));
+	}
+
+#elif WIDEBVH_NEON
+
+	// vmaxnmq_f32 and vminnmq_f32 return the number when one operand is NaN, which keeps the running
+	// interval
+	struct NeonKernels
+	{
+		static u32 getLaneMask(uint32x4_t mask)
+		{
+			const uint32x4_t bits = {1, 2, 4, 8};
+			return vaddvq_u32(vandq_u32(mask, bits));
+		}
+
+		static u32 intersectChildren(const WideBvhNode<4>& node, const WideBvhRay& ray, float tMax, float* tNear)
+		{
+			float32x4_t tEnter = vdupq_n_f32(ray.tMin);
+			float32x4_t tExit  = vdupq_n_f32(tMax);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float*      nearPlane = ray.negative[axis] ? node.boundsMax[axis] : node.boundsMin[axis];
+				const float*      farPlane  = ray.negative[axis] ? node.boundsMin[axis] : node.boundsMax[axis];
+				const float32x4_t origin    = vdupq_n_f32(ray.origin[axis]);
+				const float32x4_t inv       = vdupq_n_f32(ray.invDirection[axis]);
+				const float32x4_t t0        = vmulq_f32(vsubq_f32(vld1q_f32(nearPlane), origin), inv);
+				const float32x4_t t1        = vmulq_f32(vsubq_f32(vld1q_f32(farPlane), origin), inv);
+				tEnter                      = vmaxnmq_f32(t0, tEnter);
+				tExit                       = vminnmq_f32(t1, tExit);
+			}
+			vst1q_f32(tNear, tEnter);
+			return getLaneMask(vcleq_f32(tEnter, tExit));
+		}
+
+		static u32 intersectTriangles(const WideBvhTrianglePack<4>& pack, const WideBvhRay& ray, float tMax, TriangleLanes<4>& lanes)
+		{
+			const float32x4_t dx  = vdupq_n_f32(ray.direction[0]);
+			const float32x4_t dy  = vdupq_n_f32(ray.direction[1]);
+			const float32x4_t dz  = vdupq_n_f32(ray.direction[2]);
+			const float32x4_t e1x = vld1q_f32(pack.e1[0]);
+			const float32x4_t e1y = vld1q_f32(pack.e1[1]);
+			const float32x4_t e1z = vld1q_f32(pack.e1[2]);
+			const float32x4_t e2x = vld1q_f32(pack.e2[0]);
+			const float32x4_t e2y = vld1q_f32(pack.e2[1]);
+			const float32x4_t e2z = vld1q_f32(pack.e2[2]);
+			const float32x4_t tvx = vsubq_f32(vdupq_n_f32(ray.origin[0]), vld1q_f32(pack.v0[0]));
+			const float32x4_t tvy = vsubq_f32(vdupq_n_f32(ray.origin[1]), vld1q_f32(pack.v0[1]));
+			const float32x4_t tvz = vsubq_f32(vdupq_n_f32(ray.origin[2]), vld1q_f32(pack.v0[2]));
+
+			// Separate multiplies and subtractions rather than fused ones, to round like the scalar code
+			const float32x4_t pvx = vsubq_f32(vmulq_f32(dy, e2z), vmulq_f32(dz, e2y));
+			const float32x4_t pvy = vsubq_f32(vmulq_f32(dz, e2x), vmulq_f32(dx, e2z));
+			const float32x4_t pvz = vsubq_f32(vmulq_f32(dx, e2y), vmulq_f32(dy, e2x));
+			const float32x4_t qvx = vsubq_f32(vmulq_f32(tvy, e1z), vmulq_f32(tvz, e1y));
+			const float32x4_t qvy = vsubq_f32(vmulq_f32(tvz, e1x), vmulq_f32(tvx, e1z));
+			const float32x4_t qvz = vsubq_f32(vmulq_f32(tvx, e1y), vmulq_f32(tvy, e1x));
+
+			const float32x4_t det    = vaddq_f32(vaddq_f32(vmulq_f32(e1x, pvx), vmulq_f32(e1y, pvy)), vmulq_f32(e1z, pvz));
+			const float32x4_t invDet = vdivq_f32(vdupq_n_f32(1.0f), det);
+			const float32x4_t u = vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(tvx, pvx), vmulq_f32(tvy, pvy)), vmulq_f32(tvz, pvz)), invDet);
+			const float32x4_t v = vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(dx, qvx), vmulq_f32(dy, qvy)), vmulq_f32(dz, qvz)), invDet);
+			const float32x4_t t = vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(e2x, qvx), vmulq_f32(e2y, qvy)), vmulq_f32(e2z, qvz)), invDet);
+
+			const float32x4_t zero = vdupq_n_f32(0.0f);
+			const float32x4_t one  = vdupq_n_f32(1.0f);
+			uint32x4_t        hit  = vmvnq_u32(vceqq_f32(det, zero));
+			hit                    = vandq_u32(hit, vandq_u32(vcgeq_f32(u, zero), vcleq_f32(u, one)));
+			hit                    = vandq_u32(hit, vandq_u32(vcgeq_f32(v, zero), vcleq_f32(vaddq_f32(u, v), one)));
+			hit = vandq_u32(hit, vandq_u32(vcgeq_f32(t, vdupq_n_f32(ray.tMin)), vcltq_f32(t, vdupq_n_f32(tMax))));
+
+			vst1q_f32(lanes.t, t);
+			vst1q_f32(lanes.u, u);
+			vst1q_f32(lanes.v, v);
+			vst1q_f32(lanes.det, det);
+			return getLaneMask(hit);
+		}
+	};
+
+	using Bvh4Kernels = NeonKernels;
+
+#else
+
+	using Bvh4Kernels = ScalarKernels<4>;
+
+#endif
+
+	// Bvh8 kernels are picked once at runtime, since AVX2 is not part of the x86-64 baseline
+	struct Bvh8Kernels
+	{
+		using IntersectChildrenFunction  = u32 (*)(const WideBvhNode<8>&, const WideBvhRay&, float, float*);
+		using IntersectTrianglesFunction = u32 (*)(const WideBvhTrianglePack<8>&, const WideBvhRay&, float, TriangleLanes<8>&);
+
+		struct Functions
+		{
+			IntersectChildrenFunction  intersectChildren  = ScalarKernels<8>::intersectChildren;
+			IntersectTrianglesFunction intersectTriangles = ScalarKernels<8>::intersectTriangles;
+
+			Functions()
+			{
+#if WIDEBVH_X86
+				if (cpuSupportsAvx2())
+				{
+					intersectChildren  = intersectChildrenAVX2;
+					intersectTriangles = intersectTrianglesAVX2;
+				}
+#endif
+			}
+		};
+
+		static const Functions functions;
+
+		static u32 intersectChildren(const WideBvhNode<8>& node, const WideBvhRay& ray, float tMax, float* tNear)
+		{
+			return functions.intersectChildren(node, ray, tMax, tNear);
+		}
+
+		static u32 intersectTriangles(const WideBvhTrianglePack<8>& pack, const WideBvhRay& ray, float tMax, TriangleLanes<8>& lanes)
+		{
+			return functions.intersectTriangles(pack, ray, tMax, lanes);
+		}
+	};
+
+	const Bvh8Kernels::Functions Bvh8Kernels::functions;
+
+	// Nodes are pushed with their entry distance, so that ones beyond a closer hit found in the
+	// meantime are skipped when popped
+	struct StackEntry
+	{
+		u32   first;
+		u32   count;
+		float tNear;
+	};
+
+	template <u32 Width, typename Kernels, bool AnyHit>
+	bool traverseWideBvh(const WideBvh<Width>& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax,
+	    BvhRayHit& hit)
+	{
+		if (bvh.nodes.empty())
+		{
+			return false;
+		}
+
+		WideBvhRay ray;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			ray.origin[axis]       = origin[axis];
+			ray.direction[axis]    = direction[axis];
+			ray.invDirection[axis] = 1.0f / direction[axis];
+			ray.negative[axis]     = ray.invDirection[axis] < 0.0f;
+		}
+		ray.tMin = tMin;
+
+		bool  found    = false;
+		float closestT = tMax;
+
+		// Every node pops one entry and pushes at most Width
+		StackEntry stack[BvhMaxDepth * (Width - 1) + Width];
+		u32        stackSize = 0;
+		stack[stackSize++]   = {0, 0, tMin};
+
+		while (stackSize != 0)
+		{
+			const StackEntry entry = stack[--stackSize];
+			if (entry.tNear > closestT)
+			{
+				continue;
+			}
+
+			if (entry.count == 0)
+			{
+				const WideBvhNode<Width>& node = bvh.nodes[entry.first];
+
+				float tNear[Width];
+				u32   mask = Kernels::intersectChildren(node, ray, closestT, tNear);
+
+				// Push the hit children farthest first, so that the nearest is visited next
+				StackEntry children[Width];
+				u32        childCount = 0;
+				while (mask)
+				{
+					const u32 slot = bitScanForward(mask);
+					mask &= mask - 1;
+
+					StackEntry child = {node.first[slot], node.count[slot], tNear[slot]};
+					u32        i     = childCount++;
+					for (; i > 0 && children[i - 1].tNear < child.tNear; --i)
+					{
+						children[i] = children[i - 1];
+					}
+					children[i] = child;
+				}
+
+				for (u32 i = 0; i < childCount; ++i)
+				{
+					stack[stackSize++] = children[i];
+				}
+				continue;
+			}
+
+			for (u32 i = entry.first; i < entry.first + entry.count; ++i)
+			{
+				const WideBvhTrianglePack<Width>& pack = bvh.triangles[i];
+
+				TriangleLanes<Width> lanes;
+				u32                  mask = Kernels::intersectTriangles(pack, ray, closestT, lanes);
+				if (mask && AnyHit)
+				{
+					return true;
+				}
+
+				while (mask)
+				{
+					const u32 lane = bitScanForward(mask);
+					mask &= mask - 1;
+
+					if (lanes.t[lane] < closestT)
+					{
+						found           = true;
+						closestT        = lanes.t[lane];
+						hit.t           = lanes.t[lane];
+						hit.u           = lanes.u[lane];
+						hit.v           = lanes.v[lane];
+						hit.frontFacing = lanes.det[lane] > 0.0f;
+						hit.primitive   = pack.primitive[lane];
+					}
+				}
+			}
+		}
+
+		return found;
+	}
+}
+
+u32 getPreferredWideBvhWidth()
+{
+#if WIDEBVH_X86
+	static const u32 width = cpuSupportsAvx2() ? 8 : 4;
+	return width;
+#else
+	return 4;
+#endif
+}
+
+void collapseBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride, Bvh4& out)
+{
+	collapseBvh<4>(bvh, indices, positions, positionStride, out);
+}
+
+void collapseBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride, Bvh8& out)
+{
+	collapseBvh<8>(bvh, indices, positions, positionStride, out);
+}
+
+bool intersectWideBvh(const Bvh4& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax, BvhRayHit& hit)
+{
+	return traverseWideBvh<4, Bvh4Kernels, false>(bvh, origin, direction, tMin, tMax, hit);
+}
+
+bool intersectWideBvh(const Bvh8& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax, BvhRayHit& hit)
+{
+	return traverseWideBvh<8, Bvh8Kernels, false>(bvh, origin, direction, tMin, tMax, hit);
+}
+
+bool isWideBvhOccluded(const Bvh4& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax)
+{
+	BvhRayHit hit;
+	return traverseWideBvh<4, Bvh4Kernels, true>(bvh, origin, direction, tMin, tMax, hit);
+}
+
+bool isWideBvhOccluded(const Bvh8& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax)
+{
+	BvhRayHit hit;
+	return traverseWideBvh<8, Bvh8Kernels, true>(bvh, origin, direction, tMin, tMax, hit);
+}
+
+}
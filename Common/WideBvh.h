@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Bvh.h"
+
+namespace Rush
+{
+
+// BVHs with 4 or 8 children per node, collapsed from a binary Bvh for SIMD traversal. A ray is tested
+// against all children of a node at once, and leaf triangles are stored in packs of the same width
+// that are intersected at once. The lanes come from the tree rather than from a group of rays, so
+// incoherent secondary rays keep them as busy as primary rays.
+
+// Children are stored as structure of arrays, so one register holds one coordinate of every child.
+// Leaf slots reference count triangle packs starting at first, inner slots have count == 0 and their
+// node at first, and unused slots have inverted bounds that no ray hits.
+template <u32 Width> struct alignas(32) WideBvhNode
+{
+	float boundsMin[3][Width];
+	float boundsMax[3][Width];
+	u32   first[Width];
+	u32   count[Width];
+};
+
+// The first vertex and both edges of Width triangles, as Moller-Trumbore uses them. Unused lanes have
+// zero edges, which no ray hits, and primitive ~0u.
+template <u32 Width> struct alignas(32) WideBvhTrianglePack
+{
+	float v0[3][Width];
+	float e1[3][Width];
+	float e2[3][Width];
+	u32   primitive[Width];
+};
+
+static_assert(sizeof(WideBvhNode<4>) == 128 && sizeof(WideBvhNode<8>) == 256, "Wide BVH nodes must be 32 bytes per child");
+
+// nodes[0] is the root; both arrays are empty when there are no triangles
+template <u32 Width> struct WideBvh
+{
+	std::vector<WideBvhNode<Width>>         nodes;
+	std::vector<WideBvhTrianglePack<Width>> triangles;
+};
+
+using Bvh4 = WideBvh<4>;
+using Bvh8 = WideBvh<8>;
+
+// 8 on CPUs with AVX2, which traverse 8 lanes at once, and 4 elsewhere
+u32 getPreferredWideBvhWidth();
+
+// Collapses a BVH built by buildTriangleBvh() from the same indices and positions. Building it with a
+// maxLeafSize of the target width fills the triangle packs best. Queries don't need the index and
+// position arrays afterwards.
+void collapseBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride, Bvh4& out);
+void collapseBvh(const Bvh& bvh, const u32* indices, const float* positions, size_t positionStride, Bvh8& out);
+
+// Same queries and results as intersectTriangleBvh() and isTriangleBvhOccluded(). Bvh4 uses SSE2 or
+// NEON and Bvh8 uses AVX2 when available, both fall back to scalar code.
+bool intersectWideBvh(
+    const Bvh4& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax, BvhRayHit& hit);
+bool intersectWideBvh(
+    const Bvh8& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax, BvhRayHit& hit);
+
+bool isWideBvhOccluded(const Bvh4& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax);
+bool isWideBvhOccluded(const Bvh8& bvh, const Vec3& origin, const Vec3& direction, float tMin, float tMax);
+
+}
@@ -0,0 +1,327 @@
+#include "TestFramework.h"
+
+#include <Common/BlockCompression.h>
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+namespace
+{
+// Reference decoders, written from the format specifications independently of the encoder
+
+void decodeColorBlock(const u8* block, u8 out[16][4])
+{
+	const u16 color0 = u16(block[0] | (block[1] << 8));
+	const u16 color1 = u16(block[2] | (block[3] << 8));
+
+	u32 palette[4][3];
+	const u16 colors[2] = {color0, color1};
+	for (u32 j = 0; j < 2; ++j)
+	{
+		const u32 r   = (colors[j] >> 11) & 31;
+		const u32 g   = (colors[j] >> 5) & 63;
+		const u32 b   = colors[j] & 31;
+		palette[j][0] = (r << 3) | (r >> 2);
+		palette[j][1] = (g << 2) | (g >> 4);
+		palette[j][2] = (b << 3) | (b >> 2);
+	}
+	for (u32 c = 0; c < 3; ++c)
+	{
+		if (color0 > color1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	u32 indices;
+	memcpy(&indices, block + 4, 4);
+	for (u32 i = 0; i < 16; ++i)
+	{
+		const u32 index = (indices >> (2 * i)) & 3;
+		for (u32 c = 0; c < 3; ++c)
+		{
+			out[i][c] = u8(palette[index][c]);
+		}
+		out[i][3] = 255;
+	}
+}
+
+void decodeChannelBlock(const u8* block, u8 out[16][4], u32 channel)
+{
+	const u32 a0 = block[0];
+	const u32 a1 = block[1];
+
+	u32 palette[8] = {a0, a1};
+	if (a0 > a1)
+	{
+		for (u32 i = 2; i < 8; ++i)
+		{
+			palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+		}
+	}
+	else
+	{
+		for (u32 i = 2; i < 6; ++i)
+		{
+			palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	u64 indices = 0;
+	for (u32 i = 0; i < 6; ++i)
+	{
+		indices |= u64(block[2 + i]) << (8 * i);
+	}
+	for (u32 i = 0; i < 16; ++i)
+	{
+		out[i][channel] = u8(palette[(indices >> (3 * i)) & 7]);
+	}
+}
+
+u32 readBits(const u8* block, u32& pos, u32 count)
+{
+	u32 value = 0;
+	for (u32 i = 0; i < count; ++i, ++pos)
+	{
+		value |= u32((block[pos >> 3] >> (pos & 7)) & 1) << i;
+	}
+	return value;
+}
+
+// Only mode 6 is decoded, which is the mode the encoder emits
+bool decodeBC7Block(const u8* block, u8 out[16][4])
+{
+	if ((block[0] & 0x7f) != 0x40)
+	{
+		return false;
+	}
+
+	u32 pos = 7;
+	u32 endpoint[2][4];
+	for (u32 c = 0; c < 4; ++c)
+	{
+		endpoint[0][c] = readBits(block, pos, 7);
+		endpoint[1][c] = readBits(block, pos, 7);
+	}
+	const u32 p0 = readBits(block, pos, 1);
+	const u32 p1 = readBits(block, pos, 1);
+
+	static const u32 weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+	for (u32 i = 0; i < 16; ++i)
+	{
+		const u32 index = readBits(block, pos, i == 0 ? 3 : 4);
+		for (u32 c = 0; c < 4; ++c)
+		{
+			const u32 e0 = (endpoint[0][c] << 1) | p0;
+			const u32 e1 = (endpoint[1][c] << 1) | p1;
+			out[i][c]    = u8(((64 - weights[index]) * e0 + weights[index] * e1 + 32) >> 6);
+		}
+	}
+
+	return true;
+}
+
+bool decodeImage(GfxFormat format, const u8* data, u32 width, u32 height, std::vector<u8>& out)
+{
+	const u32 blockColumns = (width + 3) / 4;
+	const u32 blockRows    = (height + 3) / 4;
+	const u32 blockSize    = u32(getCompressedLevelSize(format, 4, 4));
+
+	out.assign(size_t(width) * height * 4, 0);
+
+	for (u32 by = 0; by < blockRows; ++by)
+	{
+		for (u32 bx = 0; bx < blockColumns; ++bx)
+		{
+			const u8* block = data + (size_t(by) * blockColumns + bx) * blockSize;
+
+			u8 texels[16][4] = {};
+			switch (format)
+			{
+			case GfxFormat_BC1_Unorm: decodeColorBlock(block, texels); break;
+			case GfxFormat_BC3_Unorm:
+				decodeColorBlock(block + 8, texels);
+				decodeChannelBlock(block, texels, 3);
+				break;
+			case GfxFormat_BC4_Unorm: decodeChannelBlock(block, texels, 0); break;
+			case GfxFormat_BC5_Unorm:
+				decodeChannelBlock(block, texels, 0);
+				decodeChannelBlock(block + 8, texels, 1);
+				break;
+			case GfxFormat_BC7_Unorm:
+				if (!decodeBC7Block(block, texels))
+				{
+					return false;
+				}
+				break;
+			default: return false;
+			}
+
+			for (u32 i = 0; i < 16; ++i)
+			{
+				const u32 x = bx * 4 + (i & 3);
+				const u32 y = by * 4 + (i >> 2);
+				if (x < width && y < height)
+				{
+					memcpy(&out[(size_t(y) * width + x) * 4], texels[i], 4);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+double computePSNR(const std::vector<u8>& a, const std::vector<u8>& b, u32 channelMask)
+{
+	double sum   = 0;
+	size_t count = 0;
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (channelMask & (1 << (i & 3)))
+		{
+			const double d = double(a[i]) - double(b[i]);
+			sum += d * d;
+			++count;
+		}
+	}
+
+	const double mse = sum / double(max<size_t>(1, count));
+	return mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+// Albedo-like content: smooth color gradients, soft features and a little noise
+void makeAlbedoImage(std::vector<u8>& pixels, u32 width, u32 height)
+{
+	pixels.resize(size_t(width) * height * 4);
+	u32 state = 12345;
+	for (u32 y = 0; y < height; ++y)
+	{
+		for (u32 x = 0; x < width; ++x)
+		{
+			state = state * 1664525u + 1013904223u;
+			const float fx    = float(x) / float(width);
+			const float fy    = float(y) / float(height);
+			const float noise = float(state >> 28) - 7.5f;
+			u8*         p     = &pixels[(size_t(y) * width + x) * 4];
+			p[0] = u8(clamp(128.0f + 100.0f * sinf(fx * 9.0f) + noise, 0.0f, 255.0f));
+			p[1] = u8(clamp(96.0f + 80.0f * cosf(fy * 7.0f + fx * 3.0f) + noise, 0.0f, 255.0f));
+			p[2] = u8(clamp(64.0f + 60.0f * sinf((fx + fy) * 11.0f) + noise, 0.0f, 255.0f));
+			p[3] = u8(clamp(255.0f * fy, 0.0f, 255.0f));
+		}
+	}
+}
+
+// Tangent-space normal map of a bumpy surface, encoded as 0.5 + 0.5 * n
+void makeNormalImage(std::vector<u8>& pixels, u32 width, u32 height)
+{
+	pixels.resize(size_t(width) * height * 4);
+	for (u32 y = 0; y < height; ++y)
+	{
+		for (u32 x = 0; x < width; ++x)
+		{
+			const float nx  = 0.4f * sinf(float(x) * 0.15f);
+			const float ny  = 0.4f * cosf(float(y) * 0.11f);
+			const float nz  = sqrtf(max(0.0f, 1.0f - nx * nx - ny * ny));
+			u8*         p   = &pixels[(size_t(y) * width + x) * 4];
+			p[0]            = u8(127.5f + 127.5f * nx);
+			p[1]            = u8(127.5f + 127.5f * ny);
+			p[2]            = u8(127.5f + 127.5f * nz);
+			p[3]            = 255;
+		}
+	}
+}
+}
+
+class BlockCompressionTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		struct Case
+		{
+			GfxFormat   format;
+			u32         channelMask;
+			bool        normalMap;
+			double      minPSNR;
+			const char* name;
+		};
+
+		// Thresholds sit a few dB below what the encoder achieves, to catch regressions
+		// without tying the test to exact encoder decisions.
+		const Case cases[] = {
+		    {GfxFormat_BC1_Unorm, 0x7, false, 32.0, "BC1"},
+		    {GfxFormat_BC3_Unorm, 0xF, false, 33.0, "BC3"},
+		    {GfxFormat_BC4_Unorm, 0x1, false, 45.0, "BC4"},
+		    {GfxFormat_BC5_Unorm, 0x3, true, 50.0, "BC5"},
+		    {GfxFormat_BC7_Unorm, 0xF, false, 34.0, "BC7"},
+		};
+
+		// Odd size exercises partial edge blocks
+		const u32 width  = 130;
+		const u32 height = 66;
+
+		std::vector<u8> albedo, normals, decoded;
+		makeAlbedoImage(albedo, width, height);
+		makeNormalImage(normals, width, height);
+
+		for (const Case& c : cases)
+		{
+			const std::vector<u8>& source = c.normalMap ? normals : albedo;
+
+			std::vector<u8> compressed(getCompressedLevelSize(c.format, width, height));
+			compressRGBA8(c.format, source.data(), width, height, compressed.data());
+
+			if (!decodeImage(c.format, compressed.data(), width, height, decoded))
+			{
+				return TestResult::fail("%s output could not be decoded", c.name);
+			}
+
+			const double psnr = computePSNR(source, decoded, c.channelMask);
+			if (psnr < c.minPSNR)
+			{
+				return TestResult::fail("%s PSNR %.2f dB is below %.2f dB", c.name, psnr, c.minPSNR);
+			}
+		}
+
+		// Flat blocks must come back within one level per channel (mode 6 shares a p-bit across channels)
+		std::vector<u8> flat(16 * 4);
+		for (u32 i = 0; i < 16; ++i)
+		{
+			flat[i * 4 + 0] = 200;
+			flat[i * 4 + 1] = 100;
+			flat[i * 4 + 2] = 50;
+			flat[i * 4 + 3] = 255;
+		}
+		u8 block[16];
+		compressRGBA8(GfxFormat_BC7_Unorm, flat.data(), 4, 4, block);
+		if (!decodeImage(GfxFormat_BC7_Unorm, block, 4, 4, decoded) || computePSNR(flat, decoded, 0xF) < 48.0)
+		{
+			return TestResult::fail("BC7 did not reproduce a flat block");
+		}
+
+		// Levels below 4x4 still take a whole block
+		if (getCompressedLevelSize(GfxFormat_BC5_Unorm, 8, 8) != 4 * 16 || getCompressedLevelSize(GfxFormat_BC5_Unorm, 4, 4) != 16
+		    || getCompressedLevelSize(GfxFormat_BC5_Unorm, 2, 2) != 16 || getCompressedLevelSize(GfxFormat_BC1_Unorm, 1, 1) != 8)
+		{
+			return TestResult::fail("Compressed mip levels have unexpected sizes");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(BlockCompressionTest, "util",
+	"Encodes BC1/BC3/BC4/BC5/BC7 on the CPU and checks PSNR against the RGBA8 source.");
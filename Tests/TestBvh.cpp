@@ -0,0 +1,766 @@
+#include "TestFramework.h"
+
+#include <Common/Bvh.h>
+#include <Common/WideBvh.h>
+
+#include <Rush/MathTypes.h>
+#include <Rush/UtilLog.h>
+#include <Rush/UtilTimer.h>
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+namespace
+{
+// Same layout as the path tracer's vertices, so the builder is tested with a strided position stream
+struct TestVertex
+{
+	Vec3 position;
+	Vec3 normal;
+	Vec2 texcoord;
+	Vec4 tangent;
+};
+
+static_assert(sizeof(TestVertex) == 48, "TestVertex must match the path tracer vertex layout");
+
+struct TestMesh
+{
+	std::vector<TestVertex> vertices;
+	std::vector<u32>        indices;
+
+	const float* positions() const { return &vertices[0].position.x; }
+	u32          triangleCount() const { return u32(indices.size() / 3); }
+};
+
+float nextRandom(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return float(state >> 8) / float(1 << 24);
+}
+
+void addTriangle(TestMesh& mesh, const Vec3& a, const Vec3& b, const Vec3& c)
+{
+	for (const Vec3& p : {a, b, c})
+	{
+		TestVertex v = {};
+		v.position   = p;
+		mesh.indices.push_back(u32(mesh.vertices.size()));
+		mesh.vertices.push_back(v);
+	}
+}
+
+// Small triangles scattered through a unit cube, plus a few long thin ones across it
+void makeTriangleSoup(u32 count, TestMesh& mesh)
+{
+	u32 state = 1234;
+	for (u32 i = 0; i < count; ++i)
+	{
+		const Vec3  center(nextRandom(state), nextRandom(state), nextRandom(state));
+		const float size = (i % 64 == 0) ? 1.0f : 0.02f;
+		auto        offset = [&]()
+		{ return Vec3(nextRandom(state) - 0.5f, nextRandom(state) - 0.5f, nextRandom(state) - 0.5f) * size; };
+		addTriangle(mesh, center + offset(), center + offset(), center + offset());
+	}
+}
+
+// Indexed UV sphere, as the loaders produce
+void makeSphere(u32 rings, u32 sectors, TestMesh& mesh)
+{
+	const u32 base = u32(mesh.vertices.size());
+	for (u32 r = 0; r <= rings; ++r)
+	{
+		const float theta  = Pi * float(r) / float(rings);
+		const float radius = (r == 0 || r == rings) ? 0.0f : sinf(theta);
+		for (u32 s = 0; s <= sectors; ++s)
+		{
+			const float phi = 2.0f * Pi * float(s) / float(sectors);
+			TestVertex  v   = {};
+			v.position      = Vec3(radius * cosf(phi), cosf(theta), radius * sinf(phi));
+			mesh.vertices.push_back(v);
+		}
+	}
+
+	for (u32 r = 0; r < rings; ++r)
+	{
+		for (u32 s = 0; s < sectors; ++s)
+		{
+			const u32 i = base + r * (sectors + 1) + s;
+			for (u32 index : {i, i + sectors + 1, i + 1, i + 1, i + sectors + 1, i + sectors + 2})
+			{
+				mesh.indices.push_back(index);
+			}
+		}
+	}
+}
+
+void buildMeshBvh(const TestMesh& mesh, Bvh& bvh, const BvhBuildSettings& settings = BvhBuildSettings())
+{
+	buildTriangleBvh(mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(TestVertex), bvh, settings);
+}
+
+bool contains(const BvhNode& outer, const Vec3& boundsMin, const Vec3& boundsMax)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (boundsMin[axis] < outer.boundsMin[axis] || boundsMax[axis] > outer.boundsMax[axis])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Checks that every triangle is referenced once, that children lie within their parents and leaves
+// bound their triangles, and that the depth limit holds
+TestResult validateBvh(const Bvh& bvh, const TestMesh& mesh, u32 maxLeafSize)
+{
+	const u32 triangleCount = mesh.triangleCount();
+	if (bvh.primitives.size() != triangleCount)
+	{
+		return TestResult::fail("BVH has %u primitives instead of %u", u32(bvh.primitives.size()), triangleCount);
+	}
+	if (bvh.nodes.size() > size_t(triangleCount) * 2)
+	{
+		return TestResult::fail("BVH has %u nodes for %u triangles", u32(bvh.nodes.size()), triangleCount);
+	}
+
+	std::vector<u32> references(triangleCount, 0);
+
+	struct Pending
+	{
+		u32 node;
+		u32 depth;
+	};
+	std::vector<Pending> stack = {{0, 0}};
+	while (!stack.empty())
+	{
+		const Pending  pending = stack.back();
+		const BvhNode& node    = bvh.nodes[pending.node];
+		stack.pop_back();
+
+		if (pending.depth > BvhMaxDepth)
+		{
+			return TestResult::fail("Node %u is deeper than %u", pending.node, BvhMaxDepth);
+		}
+
+		if (!node.isLeaf())
+		{
+			if (node.first + 1 >= bvh.nodes.size() || node.first <= pending.node)
+			{
+				return TestResult::fail("Node %u has invalid children at %u", pending.node, node.first);
+			}
+			for (u32 child = node.first; child < node.first + 2; ++child)
+			{
+				if (!contains(node, bvh.nodes[child].boundsMin, bvh.nodes[child].boundsMax))
+				{
+					return TestResult::fail("Node %u is not contained in its parent %u", child, pending.node);
+				}
+				stack.push_back({child, pending.depth + 1});
+			}
+			continue;
+		}
+
+		if (node.count > maxLeafSize && pending.depth < BvhMaxDepth)
+		{
+			// Ranges are split until they fit, even when no plane separates their triangles
+			return TestResult::fail("Leaf %u has %u triangles, more than %u", pending.node, node.count, maxLeafSize);
+		}
+
+		for (u32 i = node.first; i < node.first + node.count; ++i)
+		{
+			const u32 triangle = bvh.primitives[i];
+			if (triangle >= triangleCount)
+			{
+				return TestResult::fail("Leaf %u references triangle %u of %u", pending.node, triangle, triangleCount);
+			}
+			references[triangle]++;
+
+			for (u32 k = 0; k < 3; ++k)
+			{
+				const Vec3& p = mesh.vertices[mesh.indices[triangle * 3 + k]].position;
+				if (!contains(node, p, p))
+				{
+					return TestResult::fail("Leaf %u does not bound triangle %u", pending.node, triangle);
+				}
+			}
+		}
+	}
+
+	for (u32 i = 0; i < triangleCount; ++i)
+	{
+		if (references[i] != 1)
+		{
+			return TestResult::fail("Triangle %u is referenced %u times", i, references[i]);
+		}
+	}
+
+	return TestResult::pass();
+}
+
+// Closest hit by testing every triangle, with the same intersection routine as the BVH
+bool intersectBruteForce(const TestMesh& mesh, const Vec3& origin, const Vec3& direction, float tMax, BvhRayHit& hit)
+{
+	Bvh single;
+	single.nodes.resize(1);
+	single.primitives = {0};
+
+	bool found = false;
+	for (u32 i = 0; i < mesh.triangleCount(); ++i)
+	{
+		Box3 bounds;
+		bounds.expandInit();
+		for (u32 k = 0; k < 3; ++k)
+		{
+			bounds.expand(mesh.vertices[mesh.indices[i * 3 + k]].position);
+		}
+		single.nodes[0].boundsMin = bounds.m_min;
+		single.nodes[0].boundsMax = bounds.m_max;
+		single.nodes[0].count     = 1;
+
+		BvhRayHit triangleHit;
+		if (intersectTriangleBvh(single, &mesh.indices[i * 3], mesh.positions(), sizeof(TestVertex), origin, direction,
+		        0.0f, tMax, triangleHit))
+		{
+			found         = true;
+			tMax          = triangleHit.t;
+			hit           = triangleHit;
+			hit.primitive = i;
+		}
+	}
+	return found;
+}
+
+// Checks that every triangle is in exactly one pack lane and that node links stay in range
+template <u32 Width> TestResult validateWideBvh(const WideBvh<Width>& bvh, u32 triangleCount)
+{
+	std::vector<u32> references(triangleCount, 0);
+	for (const WideBvhTrianglePack<Width>& pack : bvh.triangles)
+	{
+		for (u32 lane = 0; lane < Width; ++lane)
+		{
+			if (pack.primitive[lane] == ~0u)
+			{
+				continue;
+			}
+			if (pack.primitive[lane] >= triangleCount)
+			{
+				return TestResult::fail("BVH%u references triangle %u of %u", Width, pack.primitive[lane], triangleCount);
+			}
+			references[pack.primitive[lane]]++;
+		}
+	}
+
+	for (u32 i = 0; i < triangleCount; ++i)
+	{
+		if (references[i] != 1)
+		{
+			return TestResult::fail("Triangle %u is in %u BVH%u packs", i, references[i], Width);
+		}
+	}
+
+	for (u32 nodeIndex = 0; nodeIndex < bvh.nodes.size(); ++nodeIndex)
+	{
+		const WideBvhNode<Width>& node = bvh.nodes[nodeIndex];
+		for (u32 slot = 0; slot < Width; ++slot)
+		{
+			if (node.boundsMin[0][slot] > node.boundsMax[0][slot])
+			{
+				continue;
+			}
+			const bool valid = node.count[slot] == 0
+			                       ? node.first[slot] > nodeIndex && node.first[slot] < bvh.nodes.size()
+			                       : node.first[slot] + node.count[slot] <= bvh.triangles.size();
+			if (!valid)
+			{
+				return TestResult::fail("BVH%u node %u slot %u links outside the tree", Width, nodeIndex, slot);
+			}
+		}
+	}
+
+	return TestResult::pass();
+}
+
+// Wide traversal must find the same hits as the binary BVH it was collapsed from
+template <u32 Width> TestResult compareWideBvh(const WideBvh<Width>& wide, const Bvh& bvh, const TestMesh& mesh)
+{
+	u32 state = 7;
+	for (u32 i = 0; i < 2000; ++i)
+	{
+		const Vec3 origin    = Vec3(nextRandom(state), nextRandom(state), nextRandom(state)) * 4.0f - Vec3(2.0f);
+		const Vec3 target    = Vec3(nextRandom(state), nextRandom(state), nextRandom(state)) - Vec3(0.5f);
+		const Vec3 direction = (target - origin) * (0.5f + nextRandom(state));
+		const float tMax     = (i % 4 == 0) ? 0.5f : FLT_MAX;
+
+		BvhRayHit  expected;
+		const bool expectedHit = intersectTriangleBvh(
+		    bvh, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), origin, direction, 0.0f, tMax, expected);
+
+		BvhRayHit  hit;
+		const bool found = intersectWideBvh(wide, origin, direction, 0.0f, tMax, hit);
+		if (found != expectedHit)
+		{
+			return TestResult::fail("Ray %u: BVH%u %s, binary BVH %s", i, Width, found ? "hit" : "missed", expectedHit ? "hit" : "missed");
+		}
+
+		if (isWideBvhOccluded(wide, origin, direction, 0.0f, tMax) != expectedHit)
+		{
+			return TestResult::fail("Ray %u: BVH%u occlusion query disagrees", i, Width);
+		}
+
+		if (found && (fabsf(hit.t - expected.t) > 1e-5f * expected.t || hit.frontFacing != expected.frontFacing))
+		{
+			return TestResult::fail("Ray %u: BVH%u hit triangle %u at %f, binary BVH triangle %u at %f", i, Width,
+			    hit.primitive, hit.t, expected.primitive, expected.t);
+		}
+	}
+
+	return TestResult::pass();
+}
+
+template <u32 Width> TestResult testWideBvh(const TestMesh& mesh)
+{
+	BvhBuildSettings settings;
+	settings.maxLeafSize = Width;
+
+	Bvh bvh;
+	buildMeshBvh(mesh, bvh, settings);
+
+	WideBvh<Width> wide;
+	collapseBvh(bvh, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), wide);
+
+	TestResult result = validateWideBvh(wide, mesh.triangleCount());
+	if (!result.passed)
+	{
+		return result;
+	}
+
+	return compareWideBvh(wide, bvh, mesh);
+}
+}
+
+class BvhBuildTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		Bvh empty;
+		buildBvh(nullptr, 0, empty);
+		if (!empty.nodes.empty() || !empty.primitives.empty())
+		{
+			return TestResult::fail("Empty input produced %u nodes", u32(empty.nodes.size()));
+		}
+
+		// Large enough to exercise parallel binning and subtree jobs
+		TestMesh soup;
+		makeTriangleSoup(200000, soup);
+
+		BvhBuildSettings settings;
+		settings.maxLeafSize = 4;
+
+		Bvh bvh;
+		buildMeshBvh(soup, bvh, settings);
+		TestResult result = validateBvh(bvh, soup, settings.maxLeafSize);
+		if (!result.passed)
+		{
+			return result;
+		}
+
+		// Nodes are renumbered depth first, so the result doesn't depend on job scheduling
+		Bvh again;
+		buildMeshBvh(soup, again, settings);
+		if (again.nodes.size() != bvh.nodes.size() || again.primitives != bvh.primitives
+		    || memcmp(again.nodes.data(), bvh.nodes.data(), bvh.nodes.size() * sizeof(BvhNode)) != 0)
+		{
+			return TestResult::fail("Two builds of the same input differ");
+		}
+
+		// Triangles whose bounds all share one center can't be separated by any plane
+		TestMesh stack;
+		for (u32 i = 0; i < 100; ++i)
+		{
+			const float size = 1.0f + float(i);
+			addTriangle(stack, Vec3(-size, -size, 0.0f), Vec3(size, -size, 0.0f), Vec3(0.0f, size, 0.0f));
+		}
+		Bvh stackBvh;
+		buildMeshBvh(stack, stackBvh, settings);
+		result = validateBvh(stackBvh, stack, settings.maxLeafSize);
+		if (!result.passed)
+		{
+			return result;
+		}
+
+		// SAH should clearly beat a tree that ignores the distribution, approximated here by
+		// the cost of a single leaf over everything
+		TestMesh sphere;
+		makeSphere(64, 128, sphere);
+		Bvh sphereBvh;
+		buildMeshBvh(sphere, sphereBvh);
+		result = validateBvh(sphereBvh, sphere, BvhBuildSettings().maxLeafSize);
+		if (!result.passed)
+		{
+			return result;
+		}
+
+		const float sahCost = computeBvhSahCost(sphereBvh);
+		if (!(sahCost > 0.0f && sahCost < 0.01f * float(sphere.triangleCount())))
+		{
+			return TestResult::fail("SAH cost %f is too high for %u triangles", sahCost, sphere.triangleCount());
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(BvhBuildTest, "util",
+	"Builds BVHs over a triangle soup, coincident triangles and a sphere, checking bounds, references and determinism.");
+
+class BvhRayTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		TestMesh mesh;
+		makeTriangleSoup(4000, mesh);
+		makeSphere(16, 32, mesh);
+
+		Bvh bvh;
+		buildMeshBvh(mesh, bvh);
+
+		u32 state    = 99;
+		u32 hitCount = 0;
+		for (u32 i = 0; i < 2000; ++i)
+		{
+			const Vec3 origin    = Vec3(nextRandom(state), nextRandom(state), nextRandom(state)) * 4.0f - Vec3(2.0f);
+			const Vec3 target    = Vec3(nextRandom(state), nextRandom(state), nextRandom(state)) - Vec3(0.5f);
+			const Vec3 direction = (target - origin) * (0.5f + nextRandom(state)); // not normalized
+			const float tMax     = (i % 4 == 0) ? 0.5f : FLT_MAX;
+
+			BvhRayHit  expected;
+			const bool expectedHit = intersectBruteForce(mesh, origin, direction, tMax, expected);
+
+			BvhRayHit  hit;
+			const bool found = intersectTriangleBvh(
+			    bvh, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), origin, direction, 0.0f, tMax, hit);
+			if (found != expectedHit)
+			{
+				return TestResult::fail("Ray %u: BVH %s, brute force %s", i, found ? "hit" : "missed", expectedHit ? "hit" : "missed");
+			}
+
+			const bool occluded = isTriangleBvhOccluded(
+			    bvh, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), origin, direction, 0.0f, tMax);
+			if (occluded != expectedHit)
+			{
+				return TestResult::fail("Ray %u: occlusion query returned %d", i, int(occluded));
+			}
+
+			if (!found)
+			{
+				continue;
+			}
+
+			hitCount++;
+			if (hit.t != expected.t || hit.frontFacing != expected.frontFacing)
+			{
+				return TestResult::fail("Ray %u: BVH hit triangle %u at %f, brute force triangle %u at %f", i, hit.primitive,
+				    hit.t, expected.primitive, expected.t);
+			}
+		}
+
+		if (hitCount < 500)
+		{
+			return TestResult::fail("Only %u of 2000 rays hit anything", hitCount);
+		}
+
+		// Rays from the center of the sphere see its inside, which faces away from them
+		TestMesh sphere;
+		makeSphere(16, 32, sphere);
+		Bvh sphereBvh;
+		buildMeshBvh(sphere, sphereBvh);
+
+		BvhRayHit hit;
+		if (!intersectTriangleBvh(sphereBvh, sphere.indices.data(), sphere.positions(), sizeof(TestVertex), Vec3(0.0f),
+		        Vec3(0.3f, 0.2f, 1.0f), 0.0f, FLT_MAX, hit))
+		{
+			return TestResult::fail("Ray from the sphere center missed");
+		}
+		const bool outsideFacing = hit.frontFacing;
+		if (!intersectTriangleBvh(sphereBvh, sphere.indices.data(), sphere.positions(), sizeof(TestVertex),
+		        Vec3(0.0f, 0.0f, -3.0f), Vec3(0.01f, 0.02f, 1.0f), 0.0f, FLT_MAX, hit))
+		{
+			return TestResult::fail("Ray from outside the sphere missed");
+		}
+		if (outsideFacing == hit.frontFacing)
+		{
+			return TestResult::fail("Inside and outside hits report the same facing");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(BvhRayTest, "util",
+	"Compares closest-hit and occlusion queries against brute force, including ray extents and triangle facing.");
+
+class WideBvhTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		Bvh  empty;
+		Bvh8 emptyWide;
+		collapseBvh(empty, nullptr, nullptr, sizeof(TestVertex), emptyWide);
+		BvhRayHit hit;
+		if (!emptyWide.nodes.empty() || intersectWideBvh(emptyWide, Vec3(0.0f), Vec3(0.0f, 0.0f, 1.0f), 0.0f, FLT_MAX, hit))
+		{
+			return TestResult::fail("Empty BVH8 is not empty");
+		}
+
+		// A binary root that is a leaf becomes the only slot of the wide root
+		TestMesh triangle;
+		addTriangle(triangle, Vec3(-1.0f, -1.0f, 1.0f), Vec3(1.0f, -1.0f, 1.0f), Vec3(0.0f, 1.0f, 1.0f));
+		TestResult result = testWideBvh<4>(triangle);
+		if (!result.passed)
+		{
+			return result;
+		}
+
+		TestMesh mesh;
+		makeTriangleSoup(4000, mesh);
+		makeSphere(16, 32, mesh);
+
+		result = testWideBvh<4>(mesh);
+		if (!result.passed)
+		{
+			return result;
+		}
+
+		return testWideBvh<8>(mesh);
+	}
+};
+
+RUSH_REGISTER_TEST(WideBvhTest, "util",
+	"Collapses binary BVHs to BVH4 and BVH8 and compares their SIMD ray queries with the binary BVH.");
+
+class BvhBenchmark final : public BenchmarkTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		TestMesh sphere;
+		makeSphere(1000, 1000, sphere);
+
+		TestMesh soup;
+		makeTriangleSoup(2000000, soup);
+
+		const struct
+		{
+			const char*     name;
+			const TestMesh* mesh;
+		} inputs[] = {{"sphere", &sphere}, {"triangle soup", &soup}};
+
+		for (const auto& input : inputs)
+		{
+			const TestMesh& mesh = *input.mesh;
+
+			// Best of a few runs, as the first touches the input for the first time
+			double bestTime = DBL_MAX;
+			Bvh    bvh;
+			for (u32 run = 0; run < 3; ++run)
+			{
+				Timer timer;
+				buildMeshBvh(mesh, bvh);
+				bestTime = min(bestTime, timer.time());
+			}
+
+			const TestResult result = validateBvh(bvh, mesh, BvhBuildSettings().maxLeafSize);
+			if (!result.passed)
+			{
+				return result;
+			}
+
+			RUSH_LOG("[Bench] BVH %s, %u triangles: %.1f ms, %.1f Mtris/s, %u nodes, SAH cost %.1f", input.name,
+			    mesh.triangleCount(), bestTime * 1000.0, double(mesh.triangleCount()) / bestTime * 1e-6,
+			    u32(bvh.nodes.size()), computeBvhSahCost(bvh));
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(BvhBenchmark, "benchmark",
+	"Times binned-SAH BVH builds of a two million triangle sphere and triangle soup, reporting Mtris/s.");
+
+class BvhRayBenchmark final : public BenchmarkTestCase
+{
+public:
+	struct BenchRay
+	{
+		Vec3  origin;
+		Vec3  direction;
+		float tMin;
+		float tMax;
+	};
+
+	// Best of a few single-threaded runs over all rays, in Mrays/s
+	template <typename Query> static double measure(const std::vector<BenchRay>& rays, u32& hitCount, Query query)
+	{
+		double bestTime = DBL_MAX;
+		for (u32 run = 0; run < 3; ++run)
+		{
+			hitCount = 0;
+			Timer timer;
+			for (const BenchRay& ray : rays)
+			{
+				hitCount += query(ray) ? 1 : 0;
+			}
+			bestTime = min(bestTime, timer.time());
+		}
+		return double(rays.size()) / bestTime * 1e-6;
+	}
+
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		TestMesh sphere;
+		makeSphere(256, 512, sphere);
+
+		TestMesh soup;
+		makeTriangleSoup(250000, soup);
+
+		const struct
+		{
+			const char*     name;
+			const TestMesh* mesh;
+			Vec3            center;
+		} scenes[] = {{"sphere", &sphere, Vec3(0.0f)}, {"triangle soup", &soup, Vec3(0.5f)}};
+
+		for (const auto& scene : scenes)
+		{
+			const TestMesh& mesh = *scene.mesh;
+
+			Bvh bvh;
+			buildMeshBvh(mesh, bvh);
+
+			BvhBuildSettings settings4;
+			settings4.maxLeafSize = 4;
+			Bvh bvhFor4;
+			buildMeshBvh(mesh, bvhFor4, settings4);
+			Bvh4 bvh4;
+			collapseBvh(bvhFor4, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), bvh4);
+
+			BvhBuildSettings settings8;
+			settings8.maxLeafSize = 8;
+			Bvh bvhFor8;
+			buildMeshBvh(mesh, bvhFor8, settings8);
+			Bvh8 bvh8;
+			collapseBvh(bvhFor8, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), bvh8);
+
+			// Primary rays through a 512x512 grid in front of the mesh
+			const u32             gridSize = 512;
+			const Vec3            eye      = scene.center + Vec3(0.0f, 0.0f, -2.5f);
+			std::vector<BenchRay> primary;
+			for (u32 y = 0; y < gridSize; ++y)
+			{
+				for (u32 x = 0; x < gridSize; ++x)
+				{
+					const Vec3 target = scene.center + Vec3(float(x) / float(gridSize) - 0.5f, float(y) / float(gridSize) - 0.5f, 0.0f) * 1.6f;
+					primary.push_back({eye, target - eye, 0.0f, FLT_MAX});
+				}
+			}
+
+			// Diffuse bounces and shadow rays towards a point light leave from the primary hits,
+			// slightly above the surface
+			const Vec3            light = scene.center + Vec3(2.0f, 3.0f, -2.0f);
+			std::vector<BenchRay> diffuse;
+			std::vector<BenchRay> shadow;
+			u32                   state = 5;
+			for (const BenchRay& ray : primary)
+			{
+				BvhRayHit hit;
+				if (!intersectTriangleBvh(bvh, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), ray.origin,
+				        ray.direction, ray.tMin, ray.tMax, hit))
+				{
+					continue;
+				}
+
+				const u32* t      = &mesh.indices[hit.primitive * 3];
+				const Vec3 p0     = mesh.vertices[t[0]].position;
+				Vec3       normal = normalize(cross(mesh.vertices[t[1]].position - p0, mesh.vertices[t[2]].position - p0));
+				if (dot(normal, ray.direction) > 0.0f)
+				{
+					normal = -normal;
+				}
+
+				const Vec3 position = ray.origin + ray.direction * hit.t + normal * 1e-4f;
+				const Vec3 bounce   = Vec3(nextRandom(state), nextRandom(state), nextRandom(state)) * 2.0f - Vec3(1.0f);
+				diffuse.push_back({position, normalize(bounce) + normal, 0.0f, FLT_MAX});
+				shadow.push_back({position, light - position, 0.0f, 1.0f});
+			}
+
+			const struct
+			{
+				const char*                  name;
+				const std::vector<BenchRay>* rays;
+				bool                         occlusion;
+			} rayTypes[] = {{"primary", &primary, false}, {"diffuse", &diffuse, false}, {"shadow", &shadow, true}};
+
+			for (const auto& rayType : rayTypes)
+			{
+				const bool occlusion = rayType.occlusion;
+
+				u32          binaryHits = 0;
+				const double binary     = measure(*rayType.rays, binaryHits, [&](const BenchRay& ray)
+				{
+					if (occlusion)
+					{
+						return isTriangleBvhOccluded(bvh, mesh.indices.data(), mesh.positions(), sizeof(TestVertex),
+						    ray.origin, ray.direction, ray.tMin, ray.tMax);
+					}
+					BvhRayHit hit;
+					return intersectTriangleBvh(bvh, mesh.indices.data(), mesh.positions(), sizeof(TestVertex), ray.origin,
+					    ray.direction, ray.tMin, ray.tMax, hit);
+				});
+
+				u32          hits4 = 0;
+				const double wide4 = measure(*rayType.rays, hits4, [&](const BenchRay& ray)
+				{
+					if (occlusion)
+					{
+						return isWideBvhOccluded(bvh4, ray.origin, ray.direction, ray.tMin, ray.tMax);
+					}
+					BvhRayHit hit;
+					return intersectWideBvh(bvh4, ray.origin, ray.direction, ray.tMin, ray.tMax, hit);
+				});
+
+				u32          hits8 = 0;
+				const double wide8 = measure(*rayType.rays, hits8, [&](const BenchRay& ray)
+				{
+					if (occlusion)
+					{
+						return isWideBvhOccluded(bvh8, ray.origin, ray.direction, ray.tMin, ray.tMax);
+					}
+					BvhRayHit hit;
+					return intersectWideBvh(bvh8, ray.origin, ray.direction, ray.tMin, ray.tMax, hit);
+				});
+
+				if (hits4 != binaryHits || hits8 != binaryHits)
+				{
+					return TestResult::fail("%s %s rays: %u binary BVH hits, %u BVH4 hits, %u BVH8 hits", scene.name,
+					    rayType.name, binaryHits, hits4, hits8);
+				}
+
+				RUSH_LOG("[Bench] BVH rays, %s, %u %s rays: binary %.2f, BVH4 %.2f, BVH8 %.2f Mrays/s", scene.name,
+				    u32(rayType.rays->size()), rayType.name, binary, wide4, wide8);
+			}
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(BvhRayBenchmark, "benchmark",
+	"Times primary, diffuse and shadow rays on a sphere and a triangle soup with binary, BVH4 and BVH8 traversal, reporting Mrays/s per thread.");
@@ -0,0 +1,71 @@
+#include "TestFramework.h"
+
+#include <Common/CompletionQueue.h>
+#include <Common/JobSystem.h>
+
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+class CompletionQueueTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		JobSystem jobs(4);
+
+		// Producers push while the consumer drains, as loader jobs and the main thread do.
+		const u32 producerCount = 8;
+		const u32 itemsPerProducer = 5000;
+
+		CompletionQueue<u32> queue;
+		JobCounter           counter;
+		for (u32 p = 0; p < producerCount; ++p)
+		{
+			jobs.submit([&queue, p]()
+			{
+				for (u32 i = 0; i < itemsPerProducer; ++i)
+				{
+					queue.push(p * itemsPerProducer + i);
+				}
+			}, &counter);
+		}
+
+		std::vector<u32> nextItem(producerCount, 0);
+		u32              consumed = 0;
+		bool             ordered  = true;
+
+		auto consume = [&](u32 item)
+		{
+			const u32 producer = item / itemsPerProducer;
+			ordered            = ordered && item % itemsPerProducer == nextItem[producer];
+			nextItem[producer] = item % itemsPerProducer + 1;
+			++consumed;
+		};
+
+		for (;;)
+		{
+			const bool finished = counter.done();
+			queue.consumeAll(consume);
+			if (finished)
+			{
+				break;
+			}
+		}
+
+		if (!ordered)
+		{
+			return TestResult::fail("Items from one producer were consumed out of push order");
+		}
+		if (consumed != producerCount * itemsPerProducer || !queue.empty())
+		{
+			return TestResult::fail("Consumed %u items, expected %u", consumed, producerCount * itemsPerProducer);
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(CompletionQueueTest, "util",
+	"Drains a multi-producer completion queue while jobs push to it, checking every item arrives once and in order.");
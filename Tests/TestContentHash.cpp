@@ -0,0 +1,87 @@
+#include "TestFramework.h"
+
+#include <Common/ContentHash.h>
+
+#include <filesystem>
+#include <stdio.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+class ContentHashTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		// Reference XXH64 values
+		if (computeContentHash("", 0) != 0xEF46DB3751D8E999ull || computeContentHash("abc", 3) != 0x44BC2CF5AD770999ull)
+		{
+			return TestResult::fail("Hash does not match XXH64 reference values");
+		}
+
+		// Every tail length and a one-bit change must give a different hash
+		std::vector<u8> data(1000);
+		for (size_t i = 0; i < data.size(); ++i)
+		{
+			data[i] = u8(i * 31 + 7);
+		}
+		const u64 hash = computeContentHash(data.data(), data.size());
+		for (size_t size = 990; size < data.size(); ++size)
+		{
+			if (computeContentHash(data.data(), size) == hash)
+			{
+				return TestResult::fail("Prefix of %zu bytes has the same hash as the whole buffer", size);
+			}
+		}
+		data[500] ^= 1;
+		if (computeContentHash(data.data(), data.size()) == hash)
+		{
+			return TestResult::fail("Flipping one bit did not change the hash");
+		}
+		data[500] ^= 1;
+
+		// Files are hashed by content, regardless of their name
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "RushContentHashTest";
+		const std::string filenameA = (directory / "a.bin").string();
+		const std::string filenameB = (directory / "copy of a.bin").string();
+
+		std::error_code ec;
+		std::filesystem::remove_all(directory, ec);
+		std::filesystem::create_directories(directory, ec);
+		for (const std::string& filename : {filenameA, filenameB})
+		{
+			FILE* f = fopen(filename.c_str(), "wb");
+			if (!f)
+			{
+				return TestResult::fail("Failed to create '%s'", filename.c_str());
+			}
+			fwrite(data.data(), 1, data.size(), f);
+			fclose(f);
+		}
+
+		const std::string missingFilename = (directory / "missing.bin").string();
+
+		u64        fileHashA     = 0;
+		u64        fileHashB     = 0;
+		u64        missingHash   = 0;
+		const bool hashedA       = computeFileContentHash(filenameA.c_str(), fileHashA);
+		const bool hashedB       = computeFileContentHash(filenameB.c_str(), fileHashB);
+		const bool hashedMissing = computeFileContentHash(missingFilename.c_str(), missingHash);
+		std::filesystem::remove_all(directory, ec);
+
+		if (!hashedA || !hashedB || fileHashA != hash || fileHashB != hash)
+		{
+			return TestResult::fail("Identical files did not hash to the in-memory content hash");
+		}
+		if (hashedMissing)
+		{
+			return TestResult::fail("Hashing a missing file succeeded");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(ContentHashTest, "util",
+	"Checks the content hash against XXH64 reference values and hashes identical files equally.");
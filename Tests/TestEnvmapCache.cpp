@@ -0,0 +1,157 @@
+#include "TestFramework.h"
+
+#include <Common/EnvmapCache.h>
+#include <Common/Half.h>
+
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include <filesystem>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+namespace
+{
+bool writeEnvmap(const std::string& path, u32 width, u32 height, float peak)
+{
+	std::vector<float> rgb(size_t(width) * height * 3);
+	for (u32 i = 0; i < width * height; ++i)
+	{
+		rgb[i * 3 + 0] = 0.01f + float(i % 7) * 0.3f;
+		rgb[i * 3 + 1] = 0.5f + float(i % 3);
+		rgb[i * 3 + 2] = float(i % 5) * 0.001f;
+	}
+	rgb[(width + 3) * 3] = peak;
+	return stbi_write_hdr(path.c_str(), int(width), int(height), 3, rgb.data()) != 0;
+}
+}
+
+class EnvmapCacheTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "RushEnvmapCacheTest";
+		const std::string imagePath  = (directory / "envmap.hdr").string();
+		const std::string brightPath = (directory / "bright.hdr").string();
+		const std::string cachePath  = (directory / "entry.bin").string();
+
+		std::error_code ec;
+		std::filesystem::remove_all(directory, ec);
+		std::filesystem::create_directories(directory, ec);
+
+		const u32 width  = 37;
+		const u32 height = 18;
+		if (!writeEnvmap(imagePath, width, height, 900.0f) || !writeEnvmap(brightPath, width, height, 200000.0f))
+		{
+			return TestResult::fail("Failed to write test envmaps");
+		}
+
+		TestResult result = check(imagePath, brightPath, cachePath, width, height);
+		std::filesystem::remove_all(directory, ec);
+		return result;
+	}
+
+private:
+	TestResult check(const std::string& imagePath, const std::string& brightPath, const std::string& cachePath,
+	    u32 width, u32 height)
+	{
+		int    w = 0, h = 0, comp = 0;
+		float* reference = stbi_loadf(imagePath.c_str(), &w, &h, &comp, 4);
+		if (!reference)
+		{
+			return TestResult::fail("Failed to decode '%s'", imagePath.c_str());
+		}
+		std::vector<float> rgba(reference, reference + size_t(w) * h * 4);
+		stbi_image_free(reference);
+
+		std::vector<AliasTableCell> cells;
+		buildEnvmapDistribution(rgba.data(), width, height, cells);
+
+		// Half storage keeps color to half precision and the PDF exact in its own plane
+		EnvmapData built;
+		if (!buildEnvmapData(imagePath.c_str(), GfxFormat_RGBA16_Float, built))
+		{
+			return TestResult::fail("Failed to build envmap data");
+		}
+		if (built.width != width || built.height != height || built.colorFormat != GfxFormat_RGBA16_Float)
+		{
+			return TestResult::fail("Built envmap has unexpected size or format");
+		}
+
+		const u16* color = static_cast<const u16*>(built.color);
+		for (size_t i = 0; i < built.getTexelCount(); ++i)
+		{
+			for (u32 c = 0; c < 3; ++c)
+			{
+				const float expected = rgba[i * 4 + c];
+				if (fabsf(halfToFloat(color[i * 4 + c]) - expected) > expected * (1.0f / 2048.0f) + 1e-7f)
+				{
+					return TestResult::fail("Half color of texel %u is %f, expected %f", u32(i),
+					    halfToFloat(color[i * 4 + c]), expected);
+				}
+			}
+			if (built.pdf[i] != rgba[i * 4 + 3])
+			{
+				return TestResult::fail("PDF plane differs from the distribution at texel %u", u32(i));
+			}
+		}
+		if (memcmp(built.cells, cells.data(), cells.size() * sizeof(AliasTableCell)) != 0)
+		{
+			return TestResult::fail("Alias table differs from the distribution");
+		}
+
+		// Values past the half range keep float storage rather than turning into infinity
+		EnvmapData bright;
+		if (!buildEnvmapData(brightPath.c_str(), GfxFormat_RGBA16_Float, bright) ||
+		    bright.colorFormat != GfxFormat_RGBA32_Float)
+		{
+			return TestResult::fail("Envmap beyond the half range was not stored as float");
+		}
+
+		// Cache entries map back bit for bit and are rejected for a different source
+		const u64 sourceHash = 0x1234567890ABCDEFull;
+		if (!saveCachedEnvmap(cachePath, sourceHash, built))
+		{
+			return TestResult::fail("Failed to write cache entry '%s'", cachePath.c_str());
+		}
+
+		EnvmapData cached;
+		if (loadCachedEnvmap(cachePath, sourceHash + 1, cached))
+		{
+			return TestResult::fail("Cache entry was accepted for a different source hash");
+		}
+		if (!loadCachedEnvmap(cachePath, sourceHash, cached) || !cached.file.valid())
+		{
+			return TestResult::fail("Failed to map cache entry '%s'", cachePath.c_str());
+		}
+		if (cached.width != width || cached.height != height || cached.colorFormat != GfxFormat_RGBA16_Float ||
+		    memcmp(cached.color, built.color, built.getColorSize()) != 0 ||
+		    memcmp(cached.pdf, built.pdf, built.getTexelCount() * sizeof(float)) != 0 ||
+		    memcmp(cached.cells, built.cells, built.getTexelCount() * sizeof(AliasTableCell)) != 0)
+		{
+			return TestResult::fail("Cached envmap does not match the built one");
+		}
+		if ((reinterpret_cast<uintptr_t>(cached.color) & 15) != 0 || (reinterpret_cast<uintptr_t>(cached.pdf) & 15) != 0 ||
+		    (reinterpret_cast<uintptr_t>(cached.cells) & 15) != 0)
+		{
+			return TestResult::fail("Cached envmap planes are not aligned");
+		}
+
+		cached.reset();
+		std::filesystem::resize_file(cachePath, std::filesystem::file_size(cachePath) - 8);
+		if (loadCachedEnvmap(cachePath, sourceHash, cached))
+		{
+			return TestResult::fail("Truncated cache entry was accepted");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(EnvmapCacheTest, "util",
+	"Builds half and float envmap planes with a separate PDF plane and round-trips them through the cache.");
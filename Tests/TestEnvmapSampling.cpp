@@ -0,0 +1,235 @@
+#include "TestFramework.h"
+
+#include <Common/EnvmapSampling.h>
+
+#include <Rush/UtilLog.h>
+#include <Rush/UtilTimer.h>
+
+#include <math.h>
+#include <utility>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+namespace
+{
+// HDR-like content: dim sky gradient, noise and a very bright sun a few texels across
+void makeEnvmap(std::vector<float>& rgba, u32 width, u32 height)
+{
+	rgba.resize(size_t(width) * height * 4);
+	u32 state = 4321;
+	for (u32 y = 0; y < height; ++y)
+	{
+		for (u32 x = 0; x < width; ++x)
+		{
+			state = state * 1664525u + 1013904223u;
+			const float noise = float(state >> 8) / float(1 << 24);
+			const float dx    = float(x) - float(width) * 0.3f;
+			const float dy    = float(y) - float(height) * 0.25f;
+			const bool  sun   = dx * dx + dy * dy < 9.0f;
+			float*      p     = &rgba[(size_t(y) * width + x) * 4];
+			p[0]              = sun ? 50000.0f : 0.2f + noise;
+			p[1]              = sun ? 48000.0f : 0.3f + 0.5f * float(y) / float(height);
+			p[2]              = sun ? 45000.0f : 0.5f * noise;
+			p[3]              = 1.0f;
+		}
+	}
+}
+
+// Probability of each entry implied by an alias table, times the entry count
+std::vector<double> aliasTableProbabilities(const std::vector<AliasTableCell>& cells)
+{
+	std::vector<double> result(cells.size(), 0.0);
+	for (size_t i = 0; i < cells.size(); ++i)
+	{
+		result[i] += cells[i].p;
+		result[cells[i].alias] += 1.0 - cells[i].p;
+	}
+	return result;
+}
+
+// The path tracer's previous single-threaded builder, kept as the benchmark baseline
+void buildEnvmapDistributionReference(float* rgba, u32 width, u32 height, std::vector<AliasTableCell>& cells)
+{
+	const size_t count = size_t(width) * height;
+
+	std::vector<double> weights, areas;
+	weights.reserve(count);
+	areas.reserve(count);
+
+	double weightSum = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float* p      = rgba + i * 4;
+		const double area   = getLatLongTexelSolidAngle(u32(i / width), width, height);
+		const double weight = area * double(max(max(p[0], p[1]), p[2]));
+		weights.push_back(weight);
+		areas.push_back(area);
+		weightSum += weight;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		rgba[i * 4 + 3] = float((weights[i] / weightSum) / areas[i]);
+	}
+
+	using Cell = std::pair<double, size_t>;
+	std::vector<Cell> large, small, table(count, {0.0, 0});
+	for (size_t i = 0; i < count; ++i)
+	{
+		const double p = weights[i] * double(count) / weightSum;
+		(p < 1.0 ? small : large).push_back({p, i});
+	}
+	while (!large.empty() && !small.empty())
+	{
+		Cell l = small.back();
+		Cell g = large.back();
+		small.pop_back();
+		large.pop_back();
+		table[l.second] = {l.first, g.second};
+		g.first         = (l.first + g.first) - 1.0;
+		(g.first < 1.0 ? small : large).push_back(g);
+	}
+	for (const Cell& c : large)
+	{
+		table[c.second].first = 1.0;
+	}
+	for (const Cell& c : small)
+	{
+		table[c.second].first = 1.0;
+	}
+
+	cells.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		cells[i] = {float(table[i].first), u32(table[i].second)};
+	}
+}
+}
+
+class EnvmapSamplingTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		// Odd width exercises the scalar tail of the SIMD row kernels
+		const u32 width  = 1027;
+		const u32 height = 512;
+
+		std::vector<float> rgba;
+		makeEnvmap(rgba, width, height);
+		const std::vector<float> source = rgba;
+
+		std::vector<AliasTableCell> cells;
+		const double weightSum = buildEnvmapDistribution(rgba.data(), width, height, cells);
+
+		// The alias table must reproduce each texel's share of the total weight, and the alpha
+		// channel must hold the matching solid-angle PDF
+		const std::vector<double> probabilities = aliasTableProbabilities(cells);
+
+		double maxTableError = 0;
+		double maxPdfError   = 0;
+		double pdfIntegral   = 0;
+		for (u32 y = 0; y < height; ++y)
+		{
+			const double area = getLatLongTexelSolidAngle(y, width, height);
+			for (u32 x = 0; x < width; ++x)
+			{
+				const size_t i         = size_t(y) * width + x;
+				const float* p         = &source[i * 4];
+				const double intensity = double(max(max(p[0], p[1]), p[2]));
+				const double expected  = intensity * area / weightSum;
+				const double pdf       = intensity / weightSum;
+
+				maxTableError = max(maxTableError, fabs(probabilities[i] / double(cells.size()) - expected) / expected);
+				maxPdfError   = max(maxPdfError, fabs(double(rgba[i * 4 + 3]) - pdf) / pdf);
+				pdfIntegral += double(rgba[i * 4 + 3]) * area;
+			}
+		}
+
+		if (maxTableError > 1e-3)
+		{
+			return TestResult::fail("Alias table probability is off by %.2e relative", maxTableError);
+		}
+		if (maxPdfError > 1e-5)
+		{
+			return TestResult::fail("Envmap PDF is off by %.2e relative", maxPdfError);
+		}
+		if (fabs(pdfIntegral - 1.0) > 1e-4)
+		{
+			return TestResult::fail("Envmap PDF integrates to %f over the sphere", pdfIntegral);
+		}
+
+		// Degenerate inputs: all-zero weights sample uniformly, and a single hot entry takes everything
+		std::vector<float> weights(5000, 0.0f);
+		cells.resize(weights.size());
+		buildAliasTable(weights.data(), u32(weights.size()), cells.data());
+		for (u32 i = 0; i < cells.size(); ++i)
+		{
+			if (cells[i].p != 1.0f || cells[i].alias != i)
+			{
+				return TestResult::fail("Zero weights did not produce a uniform alias table");
+			}
+		}
+
+		weights[1234] = 7.0f;
+		buildAliasTable(weights.data(), u32(weights.size()), cells.data());
+		const std::vector<double> hot = aliasTableProbabilities(cells);
+		if (fabs(hot[1234] - double(weights.size())) > 1e-2)
+		{
+			return TestResult::fail("Single non-zero weight is picked with probability %f", hot[1234] / double(weights.size()));
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(EnvmapSamplingTest, "util",
+	"Checks the parallel envmap alias table and PDF against the exact per-texel probabilities.");
+
+class EnvmapSamplingBenchmark final : public BenchmarkTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		const u32 sizes[] = {4096, 8192, 16384};
+		for (u32 width : sizes)
+		{
+			const u32 height = width / 2;
+
+			std::vector<float>          rgba;
+			std::vector<AliasTableCell> cells;
+			makeEnvmap(rgba, width, height);
+
+			// The double-precision baseline needs around 56 bytes per texel, too much at 16K
+			double referenceTime = 0;
+			if (width <= 8192)
+			{
+				Timer timer;
+				buildEnvmapDistributionReference(rgba.data(), width, height, cells);
+				referenceTime = timer.time();
+				cells         = std::vector<AliasTableCell>();
+			}
+
+			Timer timer;
+			buildEnvmapDistribution(rgba.data(), width, height, cells);
+			const double time = timer.time();
+
+			if (referenceTime > 0)
+			{
+				RUSH_LOG("[Bench] Envmap distribution %ux%u: reference %.1f ms, parallel %.1f ms (%.1fx)", width, height,
+				    referenceTime * 1000.0, time * 1000.0, referenceTime / time);
+			}
+			else
+			{
+				RUSH_LOG("[Bench] Envmap distribution %ux%u: parallel %.1f ms", width, height, time * 1000.0);
+			}
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(EnvmapSamplingBenchmark, "benchmark",
+	"Times envmap importance-sampling builds for 4K, 8K and 16K lat-long maps.");
@@ -471,6 +471,10 @@ void TestRunner::configureFromArgs(int argc, char** argv)
 		{
 			m_forceNoGraphics = true;
 		}
+		else if (std::strcmp(arg, "--bench") == 0)
+		{
+			m_runBenchmarks = true;
+		}
 		else if (std::strcmp(arg, "--help") == 0 || std::strcmp(arg, "-h") == 0)
 		{
 			RUSH_LOG("Usage:");
@@ -480,6 +484,7 @@ void TestRunner::configureFromArgs(int argc, char** argv)
 			RUSH_LOG("  --category, -c CAT   Run tests by category pattern (supports *)");
 			RUSH_LOG("  --no-gfx             Skip tests that require graphics");
 			RUSH_LOG("  --cpu-only           Alias for --no-gfx");
+			RUSH_LOG("  --bench              Include benchmark tests");
 			m_exitRequested = true;
 			m_state = State::Done;
 			m_exitCode = 0;
@@ -498,6 +503,11 @@ void TestRunner::configureFromArgs(int argc, char** argv)
 			continue;
 		}
 
+		if (entry.config.benchmark && !m_runBenchmarks)
+		{
+			continue;
+		}
+
 		if (shouldRunTest(entry))
 		{
 			m_selectedTests.push_back(entry);
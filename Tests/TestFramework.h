@@ -37,6 +37,7 @@ struct TestConfig
 {
 	bool captureScreenshot = false;
 	bool requiresGraphics = false;
+	bool benchmark = false; // only selected when the runner is given --bench
 };
 
 // Result returned by a test validation step.
@@ -113,6 +114,14 @@ public:
 	static constexpr TestConfig kConfig = {/*captureScreenshot*/ false, /*requiresGraphics*/ false};
 };
 
+// CPU-only timing test. Excluded from default runs; validate() should report its
+// measurements through the log and fail only on incorrect results.
+class BenchmarkTestCase : public TestCase
+{
+public:
+	static constexpr TestConfig kConfig = {/*captureScreenshot*/ false, /*requiresGraphics*/ false, /*benchmark*/ true};
+};
+
 // Validate that a screenshot image is present and has non-zero dimensions.
 // Returns a passing result on success, or a descriptive failure.
 TestResult validateScreenshot(const TestImage* image);
@@ -254,6 +263,7 @@ private:
 	DynamicArray<String>      m_testPatterns;
 	DynamicArray<String>      m_categoryPatterns;
 	bool                      m_forceNoGraphics = false;
+	bool                      m_runBenchmarks = false;
 	TimePoint                 m_runStart;
 	TimePoint                 m_testStart;
 	int                       m_exitCode = 0;
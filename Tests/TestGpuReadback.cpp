@@ -0,0 +1,80 @@
+#include "TestFramework.h"
+
+#include <Common/GpuReadback.h>
+
+using namespace Test;
+using namespace Rush;
+
+class GpuReadbackScheduleTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		constexpr u32 SlotCount = GpuReadbackRing::SlotCount;
+		static_assert(SlotCount > GpuReadbackRing::MaxFramesInFlight, "A slot would be read while its frame is in flight");
+
+		GpuReadbackRing::Schedule schedule;
+		schedule.reset();
+
+		// A request made in some frame comes back exactly SlotCount frames later, in the same slot,
+		// over enough frames for the ring to wrap around several times
+		const u32 frameCount = SlotCount * 5 + 1;
+		for (u32 requestFrame = 0; requestFrame < frameCount; ++requestFrame)
+		{
+			u64 userData = 0;
+			schedule.advance(userData);
+
+			const u32 requestSlot = schedule.getCurrentSlot();
+			schedule.request(1000 + requestFrame);
+
+			for (u32 delay = 1; delay <= SlotCount; ++delay)
+			{
+				const bool delivered = schedule.advance(userData);
+				if (delivered != (delay == SlotCount))
+				{
+					return TestResult::fail("Request from frame %u %s after %u frames", requestFrame,
+					    delivered ? "came back" : "did not come back", delay);
+				}
+			}
+
+			if (schedule.getCurrentSlot() != requestSlot || userData != 1000 + requestFrame)
+			{
+				return TestResult::fail("Request from frame %u came back in slot %u with user data %llu",
+				    requestFrame, schedule.getCurrentSlot(), (unsigned long long)userData);
+			}
+
+			if (schedule.getPendingCount() != 0)
+			{
+				return TestResult::fail("%u requests still pending", schedule.getPendingCount());
+			}
+		}
+
+		// Requests in consecutive frames are all in flight at once and come back in order; a second
+		// request in the same frame only replaces the user data
+		schedule.reset();
+		for (u32 frame = 0; frame < SlotCount * 3; ++frame)
+		{
+			u64        userData  = 0;
+			const bool delivered = schedule.advance(userData);
+			if (frame >= SlotCount && (!delivered || userData != frame - SlotCount + 1))
+			{
+				return TestResult::fail("Frame %u did not read back the request from frame %u", frame, frame - SlotCount);
+			}
+
+			schedule.request(frame);
+			schedule.request(frame + 1);
+
+			const u32 expectedPending = frame < SlotCount ? frame + 1 : SlotCount;
+			if (schedule.getPendingCount() != expectedPending)
+			{
+				return TestResult::fail("Frame %u has %u pending requests, expected %u", frame,
+				    schedule.getPendingCount(), expectedPending);
+			}
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(GpuReadbackScheduleTest, "util",
+	"Checks that readback ring requests come back SlotCount frames later across wrap-around.");
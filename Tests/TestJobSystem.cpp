@@ -0,0 +1,112 @@
+#include "TestFramework.h"
+
+#include <Common/JobSystem.h>
+
+#include <atomic>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+class JobSystemTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		JobSystem jobs(4);
+
+		// Plain submission: every job must run exactly once before wait() returns.
+		const u32 jobCount = 2000;
+		std::vector<std::atomic<u32>> runCounts(jobCount);
+		JobCounter counter;
+		for (u32 i = 0; i < jobCount; ++i)
+		{
+			jobs.submit([&runCounts, i]() { runCounts[i].fetch_add(1); }, &counter);
+		}
+		jobs.wait(counter);
+
+		if (!counter.done())
+		{
+			return TestResult::fail("JobCounter not done after wait()");
+		}
+
+		for (u32 i = 0; i < jobCount; ++i)
+		{
+			if (runCounts[i].load() != 1)
+			{
+				return TestResult::fail("Job %u ran %u times", i, runCounts[i].load());
+			}
+		}
+
+		// Nested submission: jobs that wait on their own children must not deadlock.
+		std::atomic<u32> leafCount = 0;
+		JobCounter outer;
+		for (u32 i = 0; i < 64; ++i)
+		{
+			jobs.submit([&jobs, &leafCount]()
+			{
+				JobCounter inner;
+				for (u32 j = 0; j < 16; ++j)
+				{
+					jobs.submit([&leafCount]() { leafCount.fetch_add(1); }, &inner);
+				}
+				jobs.wait(inner);
+			}, &outer);
+		}
+		jobs.wait(outer);
+
+		if (leafCount.load() != 64 * 16)
+		{
+			return TestResult::fail("Nested jobs ran %u leaves, expected %u", leafCount.load(), 64 * 16);
+		}
+
+		// parallelFor must cover every index exactly once, including a partial last chunk.
+		const u32 rangeCount = 100003;
+		std::vector<u8> visited(rangeCount, 0);
+		jobs.parallelFor(rangeCount, 1000, [&visited](u32 begin, u32 end)
+		{
+			for (u32 i = begin; i < end; ++i)
+			{
+				visited[i]++;
+			}
+		});
+
+		for (u32 i = 0; i < rangeCount; ++i)
+		{
+			if (visited[i] != 1)
+			{
+				return TestResult::fail("parallelFor visited index %u %u times", i, u32(visited[i]));
+			}
+		}
+
+		// A consumer that helps with tryRunJob() between results must see every job finish.
+		std::atomic<u32> helpedCount = 0;
+		u32 ranOnCaller = 0;
+		JobCounter helped;
+		for (u32 i = 0; i < 256; ++i)
+		{
+			jobs.submit([&helpedCount]() { helpedCount.fetch_add(1); }, &helped);
+		}
+		while (!helped.done())
+		{
+			if (jobs.tryRunJob())
+			{
+				++ranOnCaller;
+			}
+			else
+			{
+				jobs.wait(helped);
+			}
+		}
+
+		if (helpedCount.load() != 256 || ranOnCaller > 256 || jobs.tryRunJob())
+		{
+			return TestResult::fail("Helped jobs ran %u times, %u on the caller", helpedCount.load(), ranOnCaller);
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(JobSystemTest, "util",
+	"Runs flat, nested and parallelFor workloads through the shared job system.");
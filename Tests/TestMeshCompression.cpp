@@ -0,0 +1,418 @@
+#include "TestFramework.h"
+
+#include <Common/JobSystem.h>
+#include <Common/MeshCompression.h>
+
+#include <Rush/UtilFile.h>
+#include <Rush/UtilLog.h>
+#include <Rush/UtilTimer.h>
+
+#include <filesystem>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+namespace
+{
+// Same layout as the model viewer's ModelVertex
+struct FullVertex
+{
+	Vec3 position;
+	Vec3 normal;
+	Vec3 tangent;
+	Vec3 bitangent;
+	Vec2 texcoord;
+};
+
+constexpr u32 QuantizedComponentCount = 11;
+
+u32 nextRandom(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// Wavy height field grid, with triangles in row order like a typical scan or terrain export
+void makeGridMesh(u32 size, std::vector<FullVertex>& vertices, std::vector<u32>& indices)
+{
+	vertices.resize(size_t(size) * size);
+	for (u32 y = 0; y < size; ++y)
+	{
+		for (u32 x = 0; x < size; ++x)
+		{
+			const float u  = float(x) / float(size - 1);
+			const float v  = float(y) / float(size - 1);
+			const float dx = cosf(u * 20.0f) * 0.5f;
+			const float dz = -sinf(v * 13.0f) * 0.5f;
+
+			FullVertex& vertex = vertices[size_t(y) * size + x];
+			vertex.position    = Vec3(u * 100.0f, sinf(u * 20.0f) * 0.025f * 20.0f + cosf(v * 13.0f) * 0.5f, v * 100.0f);
+			vertex.normal      = normalize(Vec3(-dx, 1.0f, -dz));
+			vertex.tangent     = normalize(Vec3(1.0f, dx, 0.0f));
+			vertex.bitangent   = cross(vertex.normal, vertex.tangent);
+			vertex.texcoord    = Vec2(u * 4.0f, v * 4.0f);
+		}
+	}
+
+	indices.clear();
+	indices.reserve(size_t(size - 1) * (size - 1) * 6);
+	for (u32 y = 0; y + 1 < size; ++y)
+	{
+		for (u32 x = 0; x + 1 < size; ++x)
+		{
+			const u32 i = y * size + x;
+			const u32 quad[] = {i, i + size, i + 1, i + 1, i + size, i + size + 1};
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+}
+
+struct QuantizationBounds
+{
+	Box3 position;
+	Vec2 texcoordMin;
+	Vec2 texcoordMax;
+};
+
+void quantizeVertices(const std::vector<FullVertex>& vertices, QuantizationBounds& bounds, std::vector<u16>& out)
+{
+	bounds.position.expandInit();
+	bounds.texcoordMin = Vec2(vertices[0].texcoord);
+	bounds.texcoordMax = Vec2(vertices[0].texcoord);
+	for (const FullVertex& v : vertices)
+	{
+		bounds.position.expand(v.position);
+		bounds.texcoordMin = Vec2(min(bounds.texcoordMin.x, v.texcoord.x), min(bounds.texcoordMin.y, v.texcoord.y));
+		bounds.texcoordMax = Vec2(max(bounds.texcoordMax.x, v.texcoord.x), max(bounds.texcoordMax.y, v.texcoord.y));
+	}
+
+	out.resize(vertices.size() * QuantizedComponentCount);
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		const FullVertex& v = vertices[i];
+		u16*              q = &out[i * QuantizedComponentCount];
+		for (int c = 0; c < 3; ++c)
+		{
+			q[c] = quantizeUnorm16(v.position[c], bounds.position.m_min[c], bounds.position.m_max[c]);
+		}
+		encodeOctahedral16(v.normal, q + 3);
+		encodeOctahedral16(v.tangent, q + 5);
+		encodeOctahedral16(v.bitangent, q + 7);
+		q[9]  = quantizeUnorm16(v.texcoord.x, bounds.texcoordMin.x, bounds.texcoordMax.x);
+		q[10] = quantizeUnorm16(v.texcoord.y, bounds.texcoordMin.y, bounds.texcoordMax.y);
+	}
+}
+
+void dequantizeVertices(const u16* components, size_t count, const QuantizationBounds& bounds, FullVertex* out)
+{
+	JobSystem::getDefault().parallelFor(u32(count), 16384, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const u16*  q = components + size_t(i) * QuantizedComponentCount;
+			FullVertex& v = out[i];
+			for (int c = 0; c < 3; ++c)
+			{
+				v.position[c] = dequantizeUnorm16(q[c], bounds.position.m_min[c], bounds.position.m_max[c]);
+			}
+			v.normal     = decodeOctahedral16(q + 3);
+			v.tangent    = decodeOctahedral16(q + 5);
+			v.bitangent  = decodeOctahedral16(q + 7);
+			v.texcoord.x = dequantizeUnorm16(q[9], bounds.texcoordMin.x, bounds.texcoordMax.x);
+			v.texcoord.y = dequantizeUnorm16(q[10], bounds.texcoordMin.y, bounds.texcoordMax.y);
+		}
+	});
+}
+
+bool writeFile(const std::string& path, const void* data, size_t size)
+{
+	FileOut stream(path.c_str());
+	return stream.valid() && stream.write(data, u32(size)) == size;
+}
+
+bool readFile(const std::string& path, std::vector<u8>& out)
+{
+	FileIn stream(path.c_str());
+	if (!stream.valid())
+	{
+		return false;
+	}
+	out.resize(stream.length());
+	return stream.read(out.data(), u32(out.size())) == out.size();
+}
+}
+
+class MeshCompressionTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		u32 state = 1234;
+
+		// Entropy blocks: skewed, constant, empty and incompressible input
+		{
+			std::vector<u8> skewed(100000);
+			for (u8& b : skewed)
+			{
+				const u32 r = nextRandom(state);
+				b           = (r & 0xF) ? u8(r >> 20 & 3) : u8(r >> 12);
+			}
+			std::vector<u8> constant(5000, 0x5A);
+			std::vector<u8> random(5000);
+			for (u8& b : random)
+			{
+				b = u8(nextRandom(state));
+			}
+
+			const std::vector<u8>* inputs[] = {&skewed, &constant, &random};
+			for (const std::vector<u8>* input : inputs)
+			{
+				std::vector<u8> encoded;
+				encodeEntropyBlock(input->data(), input->size(), encoded);
+
+				std::vector<u8> decoded(input->size());
+				if (decodeEntropyBlock(encoded.data(), encoded.size(), decoded.data(), decoded.size()) != encoded.size() ||
+				    decoded != *input)
+				{
+					return TestResult::fail("Entropy block of %u bytes did not round-trip", u32(input->size()));
+				}
+				if (encoded.size() > input->size() + 5)
+				{
+					return TestResult::fail("Entropy block grew from %u to %u bytes", u32(input->size()), u32(encoded.size()));
+				}
+				if (decodeEntropyBlock(encoded.data(), encoded.size() - 1, decoded.data(), decoded.size()) != 0)
+				{
+					return TestResult::fail("Truncated entropy block was accepted");
+				}
+			}
+
+			std::vector<u8> encoded;
+			encodeEntropyBlock(skewed.data(), skewed.size(), encoded);
+			if (encoded.size() * 2 > skewed.size())
+			{
+				return TestResult::fail("Skewed input only compressed to %u of %u bytes", u32(encoded.size()), u32(skewed.size()));
+			}
+
+			encoded.clear();
+			encodeEntropyBlock(nullptr, 0, encoded);
+			if (decodeEntropyBlock(encoded.data(), encoded.size(), nullptr, 0) != encoded.size())
+			{
+				return TestResult::fail("Empty entropy block did not round-trip");
+			}
+		}
+
+		// Indices across several chunks, including extreme jumps
+		{
+			std::vector<FullVertex> vertices;
+			std::vector<u32>        indices;
+			makeGridMesh(200, vertices, indices);
+			indices[10] = 0xFFFFFFFF;
+			indices[11] = 0;
+
+			std::vector<u8> encoded;
+			compressIndices(indices.data(), indices.size(), encoded);
+
+			std::vector<u32> decoded(indices.size());
+			if (!decompressIndices(encoded.data(), encoded.size(), decoded.data(), decoded.size()) || decoded != indices)
+			{
+				return TestResult::fail("Indices did not round-trip");
+			}
+			if (decompressIndices(encoded.data(), encoded.size() - 1, decoded.data(), decoded.size()) ||
+			    decompressIndices(encoded.data(), encoded.size(), decoded.data(), decoded.size() - 1))
+			{
+				return TestResult::fail("Truncated or mismatched index stream was accepted");
+			}
+		}
+
+		// Quantized vertex components are lossless; quantization error stays within bounds
+		{
+			std::vector<FullVertex> vertices;
+			std::vector<u32>        indices;
+			makeGridMesh(300, vertices, indices);
+
+			QuantizationBounds bounds;
+			std::vector<u16>   components;
+			quantizeVertices(vertices, bounds, components);
+
+			std::vector<u8> encoded;
+			compressVertexComponents(components.data(), vertices.size(), QuantizedComponentCount, encoded);
+
+			std::vector<u16> decoded(components.size());
+			if (!decompressVertexComponents(
+			        encoded.data(), encoded.size(), decoded.data(), vertices.size(), QuantizedComponentCount) ||
+			    decoded != components)
+			{
+				return TestResult::fail("Vertex components did not round-trip");
+			}
+			if (decompressVertexComponents(
+			        encoded.data(), encoded.size() - 1, decoded.data(), vertices.size(), QuantizedComponentCount))
+			{
+				return TestResult::fail("Truncated vertex stream was accepted");
+			}
+
+			std::vector<FullVertex> restored(vertices.size());
+			dequantizeVertices(decoded.data(), vertices.size(), bounds, restored.data());
+
+			const Vec3 positionStep = bounds.position.dimensions() / 65535.0f;
+			for (size_t i = 0; i < vertices.size(); ++i)
+			{
+				const Vec3 error = restored[i].position - vertices[i].position;
+				for (int c = 0; c < 3; ++c)
+				{
+					if (fabsf(error[c]) > positionStep[c] * 0.5f + 1e-5f)
+					{
+						return TestResult::fail("Position error %f exceeds half a quantization step", fabsf(error[c]));
+					}
+				}
+				const float normalError = (restored[i].normal - vertices[i].normal).length();
+				if (normalError > 1e-4f)
+				{
+					return TestResult::fail("Octahedral normal is off by %f", normalError);
+				}
+			}
+		}
+
+		// Octahedral encoding over the whole sphere, including the folded lower hemisphere
+		for (u32 i = 0; i < 10000; ++i)
+		{
+			const float z   = float(nextRandom(state)) / float(1 << 23) - 1.0f;
+			const float phi = float(nextRandom(state)) / float(1 << 24) * 2.0f * Pi;
+			const float r   = sqrtf(max(0.0f, 1.0f - z * z));
+			const Vec3  n(r * cosf(phi), r * sinf(phi), z);
+
+			u16 q[2];
+			encodeOctahedral16(n, q);
+			if ((decodeOctahedral16(q) - n).length() > 1e-4f)
+			{
+				return TestResult::fail("Octahedral encoding of (%f, %f, %f) is too lossy", n.x, n.y, n.z);
+			}
+		}
+
+		// Half conversion rounds to nearest even and saturates to infinity
+		{
+			const struct
+			{
+				float value;
+				u16   half;
+			} cases[] = {
+				{0.0f, 0x0000},
+				{-0.0f, 0x8000},
+				{1.0f, 0x3C00},
+				{-2.5f, 0xC100},
+				{1.0f + 1.0f / 4096.0f, 0x3C00}, // halfway between 1 and the next half, rounds to even
+				{65504.0f, 0x7BFF},
+				{65520.0f, 0x7C00},
+				{5.9604645e-8f, 0x0001}, // smallest subnormal
+			};
+			for (const auto& c : cases)
+			{
+				if (floatToHalf(c.value) != c.half)
+				{
+					return TestResult::fail("Half of %g is 0x%04x, expected 0x%04x", c.value, floatToHalf(c.value), c.half);
+				}
+			}
+
+			// Every finite half value survives the trip through float
+			for (u32 h = 0; h < 0x10000; ++h)
+			{
+				if ((h & 0x7C00) != 0x7C00 && floatToHalf(halfToFloat(u16(h))) != h)
+				{
+					return TestResult::fail("Half 0x%04x does not round-trip through float", h);
+				}
+			}
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MeshCompressionTest, "util",
+	"Round-trips entropy blocks, delta-coded indices and quantized vertex streams, and checks quantization error.");
+
+class MeshCompressionBenchmark final : public BenchmarkTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "RushMeshCompressionBenchmark";
+		const std::string           rawPath   = (directory / "raw.bin").string();
+		const std::string           packPath  = (directory / "compressed.bin").string();
+
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+
+		std::vector<FullVertex> vertices;
+		std::vector<u32>        indices;
+		makeGridMesh(1024, vertices, indices);
+
+		// Raw version 1 payload: full float vertices followed by 32-bit indices
+		const size_t    vertexBytes = vertices.size() * sizeof(FullVertex);
+		const size_t    indexBytes  = indices.size() * sizeof(u32);
+		std::vector<u8> raw(vertexBytes + indexBytes);
+		memcpy(raw.data(), vertices.data(), vertexBytes);
+		memcpy(raw.data() + vertexBytes, indices.data(), indexBytes);
+
+		Timer encodeTimer;
+
+		QuantizationBounds bounds;
+		std::vector<u16>   components;
+		quantizeVertices(vertices, bounds, components);
+
+		std::vector<u8> packed;
+		compressVertexComponents(components.data(), vertices.size(), QuantizedComponentCount, packed);
+		const size_t packedVertexBytes = packed.size();
+		compressIndices(indices.data(), indices.size(), packed);
+
+		const double encodeTime = encodeTimer.time();
+
+		if (!writeFile(rawPath, raw.data(), raw.size()) || !writeFile(packPath, packed.data(), packed.size()))
+		{
+			std::filesystem::remove_all(directory, ec);
+			return TestResult::fail("Failed to write benchmark files");
+		}
+
+		// Load times include reading the file, so they depend on the page cache being warm
+		std::vector<u8> loaded;
+		Timer           rawTimer;
+		bool            ok      = readFile(rawPath, loaded);
+		const double    rawTime = rawTimer.time();
+
+		std::vector<FullVertex> restored(vertices.size());
+		std::vector<u32>        restoredIndices(indices.size());
+		std::vector<u16>        decoded(components.size());
+
+		Timer packTimer;
+		ok = ok && readFile(packPath, loaded);
+		ok = ok && decompressVertexComponents(
+		               loaded.data(), packedVertexBytes, decoded.data(), vertices.size(), QuantizedComponentCount);
+		ok = ok && decompressIndices(loaded.data() + packedVertexBytes, loaded.size() - packedVertexBytes,
+		               restoredIndices.data(), restoredIndices.size());
+		if (ok)
+		{
+			dequantizeVertices(decoded.data(), vertices.size(), bounds, restored.data());
+		}
+		const double packTime = packTimer.time();
+
+		std::filesystem::remove_all(directory, ec);
+
+		if (!ok || restoredIndices != indices)
+		{
+			return TestResult::fail("Compressed mesh failed to load");
+		}
+
+		RUSH_LOG("[Bench] Mesh %u vertices, %u indices on %u workers", u32(vertices.size()), u32(indices.size()),
+		    JobSystem::getDefault().getWorkerCount());
+		RUSH_LOG("[Bench]   raw:        %.1f MB, load %.1f ms", raw.size() / 1e6, rawTime * 1000.0);
+		RUSH_LOG("[Bench]   compressed: %.1f MB (vertices %.1f MB, indices %.1f MB), load and decode %.1f ms, encode %.1f ms",
+		    packed.size() / 1e6, packedVertexBytes / 1e6, (packed.size() - packedVertexBytes) / 1e6, packTime * 1000.0,
+		    encodeTime * 1000.0);
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MeshCompressionBenchmark, "benchmark",
+	"Compares size and load time of a raw float mesh against the quantized, entropy-coded encoding.");
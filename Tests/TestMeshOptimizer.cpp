@@ -0,0 +1,480 @@
+#include "TestFramework.h"
+
+#include <Common/MeshOptimizer.h>
+
+#include <Rush/MathTypes.h>
+#include <Rush/UtilLog.h>
+#include <Rush/UtilTimer.h>
+
+#include <algorithm>
+#include <array>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+namespace
+{
+struct TestVertex
+{
+	Vec3 position;
+	u32  id;
+};
+
+// UV sphere with triangles in random order, as OBJ exports of scanned data often arrive
+void makeShuffledSphere(u32 rings, u32 sectors, std::vector<TestVertex>& vertices, std::vector<u32>& indices)
+{
+	vertices.clear();
+	for (u32 r = 0; r <= rings; ++r)
+	{
+		// Pole rings are collapsed exactly, as sin(Pi) is not quite zero in floating point
+		const float theta  = Pi * float(r) / float(rings);
+		const float radius = (r == 0 || r == rings) ? 0.0f : sinf(theta);
+		for (u32 s = 0; s <= sectors; ++s)
+		{
+			const float phi = 2.0f * Pi * float(s) / float(sectors);
+			vertices.push_back({Vec3(radius * cosf(phi), cosf(theta), radius * sinf(phi)), u32(vertices.size())});
+		}
+	}
+
+	std::vector<std::array<u32, 3>> triangles;
+	for (u32 r = 0; r < rings; ++r)
+	{
+		for (u32 s = 0; s < sectors; ++s)
+		{
+			const u32 i = r * (sectors + 1) + s;
+			triangles.push_back({i, i + sectors + 1, i + 1});
+			triangles.push_back({i + 1, i + sectors + 1, i + sectors + 2});
+		}
+	}
+
+	u32 state = 777;
+	for (size_t i = triangles.size() - 1; i > 0; --i)
+	{
+		state = state * 1664525u + 1013904223u;
+		std::swap(triangles[i], triangles[(state >> 8) % (i + 1)]);
+	}
+
+	indices.clear();
+	for (const auto& t : triangles)
+	{
+		indices.insert(indices.end(), t.begin(), t.end());
+	}
+}
+
+// Triangles as sorted vertex id triples, to compare meshes regardless of triangle and vertex order
+std::vector<std::array<u32, 3>> getTriangleSet(const std::vector<TestVertex>& vertices, const u32* indices, size_t count)
+{
+	std::vector<std::array<u32, 3>> result;
+	for (size_t i = 0; i < count; i += 3)
+	{
+		// Rotate so the smallest id comes first, which keeps the winding
+		std::array<u32, 3> t = {vertices[indices[i]].id, vertices[indices[i + 1]].id, vertices[indices[i + 2]].id};
+		std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+		result.push_back(t);
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+}
+
+class MeshOptimizerTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		std::vector<TestVertex> vertices;
+		std::vector<u32>        indices;
+		makeShuffledSphere(100, 200, vertices, indices);
+
+		const auto             reference = getTriangleSet(vertices, indices.data(), indices.size());
+		const VertexCacheStats shuffled  = analyzeVertexCache(indices.data(), indices.size());
+
+		// A sub-range that does not start at vertex zero, as with model segments
+		std::vector<u32> range(indices.begin() + 3000, indices.begin() + 9000);
+		optimizeVertexCache(range.data(), range.size());
+		if (getTriangleSet(vertices, range.data(), range.size()) !=
+		    getTriangleSet(vertices, indices.data() + 3000, range.size()))
+		{
+			return TestResult::fail("Vertex cache optimization changed the triangles of a sub-range");
+		}
+
+		optimizeVertexCache(indices.data(), indices.size());
+		const VertexCacheStats cacheOptimized = analyzeVertexCache(indices.data(), indices.size());
+
+		if (getTriangleSet(vertices, indices.data(), indices.size()) != reference)
+		{
+			return TestResult::fail("Vertex cache optimization changed the triangles");
+		}
+		if (shuffled.acmr < 2.5f || cacheOptimized.acmr > 0.8f || cacheOptimized.atvr > 1.6f)
+		{
+			return TestResult::fail("Vertex cache optimization took ACMR from %.3f to %.3f, ATVR %.3f", shuffled.acmr,
+			    cacheOptimized.acmr, cacheOptimized.atvr);
+		}
+
+		optimizeOverdraw(indices.data(), indices.size(), &vertices[0].position.x, sizeof(TestVertex));
+		const VertexCacheStats overdrawOptimized = analyzeVertexCache(indices.data(), indices.size());
+
+		if (getTriangleSet(vertices, indices.data(), indices.size()) != reference)
+		{
+			return TestResult::fail("Overdraw optimization changed the triangles");
+		}
+		if (overdrawOptimized.acmr > cacheOptimized.acmr * 1.1f)
+		{
+			return TestResult::fail("Overdraw optimization raised ACMR from %.3f to %.3f", cacheOptimized.acmr,
+			    overdrawOptimized.acmr);
+		}
+
+		optimizeVertexFetch(vertices.data(), vertices.size(), sizeof(TestVertex), indices.data(), indices.size());
+
+		if (getTriangleSet(vertices, indices.data(), indices.size()) != reference)
+		{
+			return TestResult::fail("Vertex fetch optimization changed the triangles");
+		}
+
+		// Vertices must now be referenced in increasing order of first use
+		u32 nextVertex = 0;
+		for (u32 index : indices)
+		{
+			if (index > nextVertex)
+			{
+				return TestResult::fail("Vertex %u is first used before vertex %u", index, nextVertex);
+			}
+			nextVertex = max(nextVertex, index + 1);
+		}
+
+		const VertexCacheStats fetchOptimized = analyzeVertexCache(indices.data(), indices.size());
+		if (fetchOptimized.acmr != overdrawOptimized.acmr)
+		{
+			return TestResult::fail("Vertex fetch optimization changed the cache behavior");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MeshOptimizerTest, "util",
+	"Reorders a shuffled sphere for the vertex cache, overdraw and vertex fetch, keeping the same triangles.");
+
+class MeshWeldTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		std::vector<TestVertex> sphere;
+		std::vector<u32>        sphereIndices;
+		makeShuffledSphere(20, 40, sphere, sphereIndices);
+
+		// Every triangle gets its own three vertices, and the mesh is appended twice, as with
+		// unindexed OBJ exports that repeat a shape
+		std::vector<TestVertex> vertices;
+		std::vector<u32>        indices;
+		for (u32 copy = 0; copy < 2; ++copy)
+		{
+			for (u32 index : sphereIndices)
+			{
+				indices.push_back(u32(vertices.size()));
+				vertices.push_back(sphere[index]);
+			}
+		}
+
+		const std::vector<TestVertex> original        = vertices;
+		const std::vector<u32>        originalIndices = indices;
+
+		const size_t count =
+		    weldVertices(vertices.data(), vertices.size(), sizeof(TestVertex), indices.data(), indices.size());
+		if (count != sphere.size())
+		{
+			return TestResult::fail(
+			    "Welded %u vertices to %u, expected %u", u32(original.size()), u32(count), u32(sphere.size()));
+		}
+
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			if (indices[i] >= count ||
+			    memcmp(&vertices[indices[i]], &original[originalIndices[i]], sizeof(TestVertex)) != 0)
+			{
+				return TestResult::fail("Index %u refers to a different vertex after welding", u32(i));
+			}
+		}
+
+		// Unique vertices keep the order in which they were first used
+		for (size_t i = 1; i < count; ++i)
+		{
+			const auto firstUse = std::find(indices.begin(), indices.end(), u32(i));
+			if (firstUse < std::find(indices.begin(), indices.end(), u32(i - 1)))
+			{
+				return TestResult::fail("Welded vertex %u is first used before vertex %u", u32(i), u32(i - 1));
+			}
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MeshWeldTest, "util",
+	"Welds a sphere with unshared and repeated vertices back to its unique vertices.");
+
+class MeshClusterTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		std::vector<TestVertex> vertices;
+		std::vector<u32>        indices;
+		makeShuffledSphere(100, 200, vertices, indices);
+		optimizeVertexCache(indices.data(), indices.size());
+
+		const auto reference = getTriangleSet(vertices, indices.data(), indices.size());
+
+		// Clusters of the second half only, as for a segment that starts past the first index
+		const size_t             half = indices.size() / 6 * 3;
+		std::vector<MeshCluster> clusters;
+		buildMeshClusters(indices.data() + half, indices.size() - half, &vertices[0].position.x, sizeof(TestVertex),
+		    u32(half), clusters);
+
+		if (getTriangleSet(vertices, indices.data(), indices.size()) != reference)
+		{
+			return TestResult::fail("Cluster building changed the triangles");
+		}
+
+		u32 nextIndex = u32(half);
+		for (const MeshCluster& cluster : clusters)
+		{
+			if (cluster.indexOffset != nextIndex || cluster.indexCount == 0 || cluster.indexCount % 3 != 0 ||
+			    cluster.indexCount > MaxClusterTriangles * 3)
+			{
+				return TestResult::fail("Cluster at index %u has an invalid range", cluster.indexOffset);
+			}
+			nextIndex += cluster.indexCount;
+
+			std::vector<u32> clusterVertices(indices.begin() + cluster.indexOffset,
+			    indices.begin() + cluster.indexOffset + cluster.indexCount);
+			std::sort(clusterVertices.begin(), clusterVertices.end());
+			clusterVertices.erase(std::unique(clusterVertices.begin(), clusterVertices.end()), clusterVertices.end());
+			if (clusterVertices.size() > MaxClusterVertices)
+			{
+				return TestResult::fail("Cluster at index %u has %u vertices", cluster.indexOffset, u32(clusterVertices.size()));
+			}
+			for (u32 v : clusterVertices)
+			{
+				if ((vertices[v].position - cluster.center).length() > cluster.radius * 1.0001f)
+				{
+					return TestResult::fail("Vertex %u is outside the bounding sphere of its cluster", v);
+				}
+			}
+		}
+		if (nextIndex != indices.size())
+		{
+			return TestResult::fail("Clusters cover %u of %u indices", nextIndex - u32(half), u32(indices.size() - half));
+		}
+
+		// Clusters should be nearly full on a closed mesh
+		const float averageTriangles = float(indices.size() - half) / 3.0f / float(clusters.size());
+		if (averageTriangles < MaxClusterTriangles * 0.75f)
+		{
+			return TestResult::fail("Clusters only average %.1f triangles", averageTriangles);
+		}
+
+		// Culling must be conservative: a culled cluster has every triangle outside the plane or facing away
+		const Vec3 camera(0.0f, 0.0f, 3.0f);
+		const Vec4 plane(0.0f, 0.0f, 1.0f, 0.0f); // keeps z >= 0
+		u32        culled = 0;
+		for (const MeshCluster& cluster : clusters)
+		{
+			if (isMeshClusterVisible(cluster, &plane, 1, camera))
+			{
+				continue;
+			}
+			++culled;
+
+			for (u32 i = cluster.indexOffset; i < cluster.indexOffset + cluster.indexCount; i += 3)
+			{
+				const Vec3 a = vertices[indices[i + 0]].position;
+				const Vec3 b = vertices[indices[i + 1]].position;
+				const Vec3 c = vertices[indices[i + 2]].position;
+				const bool outside = max(max(a.z, b.z), c.z) < 0.0f;
+				const bool facingAway = dot(a - camera, cross(b - a, c - a)) >= 0.0f;
+				if (!outside && !facingAway)
+				{
+					return TestResult::fail("Cluster at index %u was culled with a visible triangle", cluster.indexOffset);
+				}
+			}
+		}
+
+		// The plane removes the back half of the sphere, and the normal cones much of the front
+		if (culled < clusters.size() * 6 / 10)
+		{
+			return TestResult::fail("Only %u of %u clusters were culled", culled, u32(clusters.size()));
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MeshClusterTest, "util",
+	"Builds clusters over part of a sphere and checks their ranges, limits, bounds and conservative culling.");
+
+class MeshSimplifyTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		std::vector<TestVertex> vertices;
+		std::vector<u32>        indices;
+		makeShuffledSphere(100, 200, vertices, indices);
+
+		// A closed surface with a texcoord seam, reduced to a quarter of its triangles
+		std::vector<u32> lod(indices.size());
+		float            error = 0.0f;
+		lod.resize(simplifyMesh(lod.data(), indices.data(), indices.size(), &vertices[0].position.x, sizeof(TestVertex),
+		    indices.size() / 4, 1.0f, &error));
+
+		if (lod.size() > indices.size() / 4 || lod.size() < indices.size() / 5)
+		{
+			return TestResult::fail("Sphere was simplified to %u of %u triangles", u32(lod.size() / 3), u32(indices.size() / 3));
+		}
+		if (error <= 0.0f || error > 0.01f)
+		{
+			return TestResult::fail("Sphere simplification reported an error of %f", error);
+		}
+
+		std::vector<u8> used(vertices.size(), 0);
+		for (size_t i = 0; i < lod.size(); i += 3)
+		{
+			const Vec3 a = vertices[lod[i + 0]].position;
+			const Vec3 b = vertices[lod[i + 1]].position;
+			const Vec3 c = vertices[lod[i + 2]].position;
+			// The sphere is wound inward, and collapses may leave slivers but must not flip triangles
+			const Vec3 n = cross(b - a, c - a);
+			if (n.length() == 0.0f || dot(n, a + b + c) > 0.5f * n.length() * (a + b + c).length())
+			{
+				return TestResult::fail("Simplified sphere triangle %u is flipped or degenerate", u32(i / 3));
+			}
+			if (1.0f - ((a + b + c) / 3.0f).length() > 0.01f)
+			{
+				return TestResult::fail("Simplified sphere triangle %u is too far from the surface", u32(i / 3));
+			}
+			used[lod[i]] = used[lod[i + 1]] = used[lod[i + 2]] = 1;
+		}
+		for (u32 r = 1; r < 100; ++r)
+		{
+			if (!used[r * 201] || !used[r * 201 + 200])
+			{
+				return TestResult::fail("Seam vertex on ring %u was collapsed", r);
+			}
+		}
+
+		// A flat grid collapses to its border, which stays in place and keeps the area covered
+		const u32               size = 32;
+		std::vector<TestVertex> grid;
+		std::vector<u32>        gridIndices;
+		for (u32 y = 0; y <= size; ++y)
+		{
+			for (u32 x = 0; x <= size; ++x)
+			{
+				grid.push_back({Vec3(float(x), float(y), 0.0f), u32(grid.size())});
+			}
+		}
+		for (u32 y = 0; y < size; ++y)
+		{
+			for (u32 x = 0; x < size; ++x)
+			{
+				const u32 i = y * (size + 1) + x;
+				gridIndices.insert(gridIndices.end(), {i, i + 1, i + size + 2, i, i + size + 2, i + size + 1});
+			}
+		}
+
+		lod.resize(gridIndices.size());
+		lod.resize(simplifyMesh(lod.data(), gridIndices.data(), gridIndices.size(), &grid[0].position.x,
+		    sizeof(TestVertex), 0, 1e-4f, &error));
+
+		if (lod.size() >= gridIndices.size() / 4)
+		{
+			return TestResult::fail("Grid was only simplified to %u of %u triangles", u32(lod.size() / 3),
+			    u32(gridIndices.size() / 3));
+		}
+
+		used.assign(grid.size(), 0);
+		float area = 0.0f;
+		for (size_t i = 0; i < lod.size(); i += 3)
+		{
+			const Vec3 a = grid[lod[i + 0]].position;
+			const Vec3 n = cross(grid[lod[i + 1]].position - a, grid[lod[i + 2]].position - a);
+			if (n.z <= 0.0f)
+			{
+				return TestResult::fail("Simplified grid triangle %u is flipped or degenerate", u32(i / 3));
+			}
+			area += n.z * 0.5f;
+			used[lod[i]] = used[lod[i + 1]] = used[lod[i + 2]] = 1;
+		}
+		for (u32 i = 0; i <= size; ++i)
+		{
+			if (!used[i] || !used[size * (size + 1) + i] || !used[i * (size + 1)] || !used[i * (size + 1) + size])
+			{
+				return TestResult::fail("Grid border vertex %u was collapsed", i);
+			}
+		}
+		if (fabsf(area - float(size * size)) > 0.01f)
+		{
+			return TestResult::fail("Simplified grid covers an area of %f instead of %u", area, size * size);
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MeshSimplifyTest, "util",
+	"Simplifies a sphere and a flat grid, checking triangle count, error, orientation and locked seams and borders.");
+
+class MeshOptimizerBenchmark final : public BenchmarkTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		std::vector<TestVertex> vertices;
+		std::vector<u32>        indices;
+		makeShuffledSphere(1000, 1000, vertices, indices);
+
+		const VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size());
+
+		Timer cacheTimer;
+		optimizeVertexCache(indices.data(), indices.size());
+		const double           cacheTime = cacheTimer.time();
+		const VertexCacheStats cache     = analyzeVertexCache(indices.data(), indices.size());
+
+		Timer overdrawTimer;
+		optimizeOverdraw(indices.data(), indices.size(), &vertices[0].position.x, sizeof(TestVertex));
+		const double           overdrawTime = overdrawTimer.time();
+		const VertexCacheStats overdraw     = analyzeVertexCache(indices.data(), indices.size());
+
+		Timer                    clusterTimer;
+		std::vector<MeshCluster> clusters;
+		buildMeshClusters(indices.data(), indices.size(), &vertices[0].position.x, sizeof(TestVertex), 0, clusters);
+		const double           clusterTime = clusterTimer.time();
+		const VertexCacheStats clustered   = analyzeVertexCache(indices.data(), indices.size());
+
+		Timer            simplifyTimer;
+		std::vector<u32> lod(indices.size());
+		float            lodError = 0.0f;
+		lod.resize(simplifyMesh(lod.data(), indices.data(), indices.size(), &vertices[0].position.x, sizeof(TestVertex),
+		    indices.size() / 2, 1.0f, &lodError));
+		const double simplifyTime = simplifyTimer.time();
+
+		RUSH_LOG("[Bench] Mesh optimizer, %u triangles", u32(indices.size() / 3));
+		RUSH_LOG("[Bench]   shuffled: ACMR %.3f, ATVR %.3f", before.acmr, before.atvr);
+		RUSH_LOG("[Bench]   vertex cache: ACMR %.3f, ATVR %.3f in %.1f ms", cache.acmr, cache.atvr, cacheTime * 1000.0);
+		RUSH_LOG("[Bench]   overdraw: ACMR %.3f, ATVR %.3f in %.1f ms", overdraw.acmr, overdraw.atvr, overdrawTime * 1000.0);
+		RUSH_LOG("[Bench]   clusters: %u averaging %.1f triangles, ACMR %.3f, ATVR %.3f in %.1f ms", u32(clusters.size()),
+		    float(indices.size() / 3) / float(clusters.size()), clustered.acmr, clustered.atvr, clusterTime * 1000.0);
+		RUSH_LOG("[Bench]   simplify: %u triangles with error %f in %.1f ms", u32(lod.size() / 3), lodError,
+		    simplifyTime * 1000.0);
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MeshOptimizerBenchmark, "benchmark",
+	"Times vertex cache, overdraw and cluster optimization and simplification of a two million triangle mesh.");
@@ -0,0 +1,212 @@
+#include "TestFramework.h"
+
+#include <Common/MipGenerator.h>
+
+#include <Rush/UtilLog.h>
+#include <Rush/UtilTimer.h>
+
+#include <stb_image_resize.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+namespace
+{
+void fillTestImage(std::vector<u8>& pixels, u32 width, u32 height, u32 seed)
+{
+	// Smooth gradients plus per-pixel noise, roughly like a tiling albedo map
+	pixels.resize(size_t(width) * height * 4);
+	u32 state = seed;
+	for (u32 y = 0; y < height; ++y)
+	{
+		for (u32 x = 0; x < width; ++x)
+		{
+			state = state * 1664525u + 1013904223u;
+			u8* p = &pixels[(size_t(y) * width + x) * 4];
+			p[0]  = u8((x * 255) / max<u32>(1, width - 1) ^ (state >> 28));
+			p[1]  = u8((y * 255) / max<u32>(1, height - 1) ^ (state >> 24 & 0xF));
+			p[2]  = u8(state >> 16);
+			p[3]  = u8(255 - (state >> 26));
+		}
+	}
+}
+
+// Sizes levels 1.. of a full chain after the RGBA8 image in mips[0] and fills them, as texture
+// staging does in its own memory. Returns the level count.
+u32 generateMipChain(std::vector<u8>* mips, u32 width, u32 height, bool sRGB)
+{
+	const u32 mipCount = computeMipCount(width, height);
+
+	u8* levels[16] = {mips[0].data()};
+	for (u32 i = 1; i < mipCount; ++i)
+	{
+		mips[i].resize(size_t(max<u32>(1, width >> i)) * max<u32>(1, height >> i) * 4);
+		levels[i] = mips[i].data();
+	}
+
+	generateMipLevelsRGBA8(levels, mipCount, width, height, sRGB);
+	return mipCount;
+}
+
+double srgbToLinear(double c)
+{
+	return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+double linearToSrgb(double l)
+{
+	return l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+}
+}
+
+class MipGeneratorTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		// Odd and tiny sizes exercise the SIMD body, the scalar tail and edge clamping.
+		const u32 sizes[] = {1, 2, 3, 5, 16, 17, 33, 70};
+		std::vector<u8> src, dst;
+		for (u32 width : sizes)
+		{
+			for (u32 height : sizes)
+			{
+				for (u32 sRGB = 0; sRGB < 2; ++sRGB)
+				{
+					fillTestImage(src, width, height, width * 131 + height);
+
+					const u32 dstWidth  = max<u32>(1, width / 2);
+					const u32 dstHeight = max<u32>(1, height / 2);
+					dst.assign(size_t(dstWidth) * dstHeight * 4, 0);
+					downsampleRGBA8(src.data(), width, height, dst.data(), sRGB != 0);
+
+					for (u32 y = 0; y < dstHeight; ++y)
+					{
+						for (u32 x = 0; x < dstWidth; ++x)
+						{
+							// Odd sizes fold the last source row and column into the last texel
+							const u32 columns = width == 1 ? 1 : (x + 1 == dstWidth ? 2 + (width & 1) : 2);
+							const u32 rows    = height == 1 ? 1 : (y + 1 == dstHeight ? 2 + (height & 1) : 2);
+							const u32 count   = columns * rows;
+							for (u32 c = 0; c < 4; ++c)
+							{
+								u32    sum       = 0;
+								double linearSum = 0.0;
+								for (u32 j = 0; j < rows; ++j)
+								{
+									for (u32 i = 0; i < columns; ++i)
+									{
+										const u8 v = src[(size_t(y * 2 + j) * width + x * 2 + i) * 4 + c];
+										sum += v;
+										linearSum += srgbToLinear(v / 255.0);
+									}
+								}
+
+								int expected = int((sum + count / 2) / count);
+								int tolerance = 0;
+								if (sRGB && c < 3)
+								{
+									expected  = int(linearToSrgb(linearSum / count) * 255.0 + 0.5);
+									tolerance = 1;
+								}
+
+								const int actual = dst[(size_t(y) * dstWidth + x) * 4 + c];
+								if (std::abs(actual - expected) > tolerance)
+								{
+									return TestResult::fail("%ux%u %s: pixel (%u, %u) channel %u is %d, expected %d",
+									    width, height, sRGB ? "sRGB" : "linear", x, y, c, actual, expected);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		// The last column and row of an odd-sized image must reach the next level
+		{
+			std::vector<u8> edge(5 * 5 * 4, 0);
+			for (u32 i = 0; i < 5; ++i)
+			{
+				memset(&edge[(i * 5 + 4) * 4], 255, 4);
+				memset(&edge[(4 * 5 + i) * 4], 255, 4);
+			}
+			u8 edgeDst[2 * 2 * 4];
+			downsampleRGBA8(edge.data(), 5, 5, edgeDst, false);
+			if (edgeDst[0] != 0 || edgeDst[(1 * 2 + 1) * 4] != 142 || edgeDst[1 * 4] != 85 || edgeDst[2 * 4] != 85)
+			{
+				return TestResult::fail("5x5 edge texels were not folded into the 2x2 level");
+			}
+		}
+
+		// Non-square textures must still reach 1x1.
+		std::vector<u8> mips[16];
+		fillTestImage(mips[0], 64, 4, 7);
+		const u32 mipCount = generateMipChain(mips, 64, 4, true);
+		if (mipCount != 7 || mips[mipCount - 1].size() != 4)
+		{
+			return TestResult::fail("64x4 chain has %u levels, expected 7 ending at 1x1", mipCount);
+		}
+
+		if (computeMipCount(4096, 4096) != 13 || computeMipCount(1, 1) != 1 || computeMipCount(8192, 3) != 14)
+		{
+			return TestResult::fail("computeMipCount returned an unexpected level count");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MipGeneratorTest, "util",
+	"Checks SIMD RGBA8 mip downsampling against a scalar reference, linear and sRGB, including odd sizes.");
+
+class MipGeneratorBenchmark final : public BenchmarkTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		const u32 sizes[] = {4096, 8192};
+		for (u32 size : sizes)
+		{
+			std::vector<u8> mips[16];
+			fillTestImage(mips[0], size, size, size);
+
+			// Baseline: the loaders' previous approach, one stbir_resize_uint8 per level
+			Timer timer;
+			u32 width = size, height = size;
+			for (u32 i = 1; width > 1 || height > 1; ++i)
+			{
+				const u32 nextWidth  = max<u32>(1, width / 2);
+				const u32 nextHeight = max<u32>(1, height / 2);
+				mips[i].resize(size_t(nextWidth) * nextHeight * 4);
+				stbir_resize_uint8(mips[i - 1].data(), width, height, width * 4,
+				    mips[i].data(), nextWidth, nextHeight, nextWidth * 4, 4);
+				width  = nextWidth;
+				height = nextHeight;
+			}
+			const double stbTime = timer.time();
+
+			timer.reset();
+			generateMipChain(mips, size, size, false);
+			const double linearTime = timer.time();
+
+			timer.reset();
+			generateMipChain(mips, size, size, true);
+			const double srgbTime = timer.time();
+
+			RUSH_LOG("[Bench] Mip chain %ux%u: stb %.1f ms, box linear %.1f ms (%.1fx), box sRGB %.1f ms (%.1fx)",
+			    size, size, stbTime * 1000.0, linearTime * 1000.0, stbTime / linearTime, srgbTime * 1000.0,
+			    stbTime / srgbTime);
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(MipGeneratorBenchmark, "benchmark",
+	"Times full RGBA8 mip chains for 4K and 8K images against per-level stb resizing.");
@@ -0,0 +1,109 @@
+#include "TestFramework.h"
+
+#include <Common/TextureCache.h>
+
+#include <filesystem>
+#include <string.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+class TextureCacheTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "RushTextureCacheTest";
+		const std::string cachePath = (directory / "entry.bin").string();
+
+		std::error_code ec;
+		std::filesystem::remove_all(directory, ec);
+
+		StagedTexture cached;
+		if (loadCachedTexture(cachePath, cached))
+		{
+			return TestResult::fail("Loading a missing cache entry succeeded");
+		}
+
+		// Odd level sizes make sure each level is realigned
+		std::vector<u8> mips[3];
+		mips[0].resize(5 * 3 * 4);
+		mips[1].resize(2 * 1 * 4);
+		mips[2].resize(1 * 1 * 4);
+
+		StagedTexture source;
+		source.desc      = GfxTextureDesc::make2D(5, 3, GfxFormat_RGBA8_sRGB);
+		source.desc.mips = 3;
+		for (u32 i = 0; i < 3; ++i)
+		{
+			for (size_t j = 0; j < mips[i].size(); ++j)
+			{
+				mips[i][j] = u8(i * 97 + j);
+			}
+			source.mips[i]     = mips[i].data();
+			source.mipSizes[i] = mips[i].size();
+		}
+
+		if (!saveCachedTexture(cachePath, source))
+		{
+			return TestResult::fail("Failed to write cache entry '%s'", cachePath.c_str());
+		}
+
+		if (!loadCachedTexture(cachePath, cached))
+		{
+			return TestResult::fail("Failed to map cache entry '%s'", cachePath.c_str());
+		}
+
+		if (cached.desc.width != 5 || cached.desc.height != 3 || cached.desc.mips != 3 ||
+		    cached.desc.format != GfxFormat_RGBA8_sRGB)
+		{
+			return TestResult::fail("Cache entry description does not match what was written");
+		}
+
+		for (u32 i = 0; i < 3; ++i)
+		{
+			if ((reinterpret_cast<uintptr_t>(cached.mips[i]) & 15) != 0)
+			{
+				return TestResult::fail("Mip %u is not 16 byte aligned", i);
+			}
+			if (cached.mipSizes[i] != mips[i].size() || memcmp(cached.mips[i], mips[i].data(), mips[i].size()) != 0)
+			{
+				return TestResult::fail("Mip %u contents do not match", i);
+			}
+		}
+
+		// Levels shorter than the description implies would make the upload read past the mapping
+		cached.reset();
+		const std::string mismatchedPath = (directory / "mismatched.bin").string();
+		source.mipSizes[1] = 4;
+		if (!saveCachedTexture(mismatchedPath, source))
+		{
+			return TestResult::fail("Failed to write cache entry '%s'", mismatchedPath.c_str());
+		}
+		if (loadCachedTexture(mismatchedPath, cached))
+		{
+			cached.reset();
+			std::filesystem::remove_all(directory, ec);
+			return TestResult::fail("Cache entry with a level smaller than its description was accepted");
+		}
+
+		// Truncated entries must be rejected rather than read out of bounds
+		cached.reset();
+		std::filesystem::resize_file(cachePath, std::filesystem::file_size(cachePath) - 1, ec);
+		const bool loadedTruncated = loadCachedTexture(cachePath, cached);
+
+		cached.reset();
+		std::filesystem::remove_all(directory, ec);
+
+		if (loadedTruncated)
+		{
+			return TestResult::fail("Truncated cache entry was accepted");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(TextureCacheTest, "util",
+	"Writes a mip chain to the texture cache and maps it back, rejecting truncated or mismatched entries.");
@@ -0,0 +1,100 @@
+#include "TestFramework.h"
+
+#include <Common/TextureStaging.h>
+
+#include <stb_image_write.h>
+
+#include <filesystem>
+#include <string.h>
+#include <vector>
+
+using namespace Test;
+using namespace Rush;
+
+class TextureStagingTest final : public CpuTestCase
+{
+public:
+	TestResult validate(GfxContext*, const TestImage*) override
+	{
+		// Released blocks are recycled for requests in the same size class
+		{
+			StagingAllocator allocator;
+
+			StagingBuffer a = allocator.allocate(5000);
+			if (!a.valid() || a.size() != 5000 || (reinterpret_cast<uintptr_t>(a.data()) & 63) != 0)
+			{
+				return TestResult::fail("Staging block has unexpected size or alignment");
+			}
+
+			const u8* first = a.data();
+			a.reset();
+
+			StagingBuffer b = allocator.allocate(6000);
+			if (b.data() != first)
+			{
+				return TestResult::fail("Released staging block was not reused");
+			}
+			if (allocator.getBytesInUse() != 8192)
+			{
+				return TestResult::fail("Unexpected staging bytes in use: %llu", (unsigned long long)allocator.getBytesInUse());
+			}
+		}
+
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "RushTextureStagingTest";
+		const std::string imagePath = (directory / "image.png").string();
+
+		std::error_code ec;
+		std::filesystem::remove_all(directory, ec);
+		std::filesystem::create_directories(directory, ec);
+
+		const u32       width  = 8;
+		const u32       height = 4;
+		std::vector<u8> pixels(width * height * 4);
+		for (size_t i = 0; i < pixels.size(); ++i)
+		{
+			pixels[i] = u8(i * 7);
+		}
+		if (!stbi_write_png(imagePath.c_str(), width, height, 4, pixels.data(), width * 4))
+		{
+			return TestResult::fail("Failed to write '%s'", imagePath.c_str());
+		}
+
+		// Uncompressed staging keeps the decoded image in place as mip 0
+		StagedTexture staged;
+		const bool    loaded = stageTextureFromFile(imagePath.c_str(), GfxFormat_RGBA8_Unorm, false, staged);
+		std::filesystem::remove_all(directory, ec);
+
+		if (!loaded)
+		{
+			return TestResult::fail("Failed to stage '%s'", imagePath.c_str());
+		}
+		if (staged.desc.width != width || staged.desc.height != height || staged.desc.mips != 4 ||
+		    staged.desc.format != GfxFormat_RGBA8_Unorm)
+		{
+			return TestResult::fail("Staged texture description is wrong");
+		}
+		if (staged.mips[0] != staged.topLevel.data() || memcmp(staged.mips[0], pixels.data(), pixels.size()) != 0)
+		{
+			return TestResult::fail("Mip 0 is not the decoded image");
+		}
+		for (u32 i = 1; i < staged.desc.mips; ++i)
+		{
+			const size_t expectedSize = size_t(max<u32>(1, width >> i)) * max<u32>(1, height >> i) * 4;
+			if (staged.mipSizes[i] != expectedSize || (reinterpret_cast<uintptr_t>(staged.mips[i]) & 15) != 0)
+			{
+				return TestResult::fail("Mip %u has unexpected size or alignment", i);
+			}
+		}
+
+		staged.reset();
+		if (staged.valid() || staged.topLevel.valid() || staged.mipTail.valid())
+		{
+			return TestResult::fail("Staged texture still holds memory after reset");
+		}
+
+		return TestResult::pass();
+	}
+};
+
+RUSH_REGISTER_TEST(TextureStagingTest, "util",
+	"Recycles staging blocks and stages a decoded image as mip 0 of its chain without copying it.");